@@ -1,7 +1,9 @@
-import { HttpClient } from '@angular/common/http';
+import { HttpClient, HttpResponse } from '@angular/common/http';
 import { Injectable } from '@angular/core';
 import { environment } from '../environments/environment';
 import { BehaviorSubject } from 'rxjs/internal/BehaviorSubject';
+import { Observable, of, timer } from 'rxjs';
+import { first, map, switchMap } from 'rxjs/operators';
 
 
 export interface Update {
@@ -32,6 +34,15 @@ export interface Status {
   screenEquipped: boolean;
 }
 
+export interface Command {
+  id: number;
+  type: string;
+  source: string;
+  state: string;
+  waitMs: number;
+  runMs: number;
+}
+
 @Injectable({
   providedIn: 'root'
 })
@@ -82,7 +93,7 @@ export class ApiService {
       winderEnabled: powerStateToNum
     }
 
-    return this.http.post(baseURL, powerBody, { observe:'response' });
+    return this.awaitCommand(this.http.post<Command>(baseURL, powerBody, { observe:'response' }));
   }
 
   updateTimerState(timerState: number) {
@@ -92,12 +103,31 @@ export class ApiService {
       + "timer?"
       + "timerEnabled=" + timerState;
 
-    return this.http.post(constructedURL, null, { observe: 'response' });
+    return this.awaitCommand(this.http.post<Command>(constructedURL, null, { observe: 'response' }));
   }
 
   updateState(update: Update) {
     const baseURL = ApiService.constructURL() + 'update';
-    return this.http.post(baseURL, update, { observe: 'response' });
+    return this.awaitCommand(this.http.post<Command>(baseURL, update, { observe: 'response' }));
+  }
+
+  // The winder answers 202 with the command's ID & applies it shortly after;
+  // emits the response once the command is done
+  awaitCommand(request: Observable<HttpResponse<Command>>) {
+    return request.pipe(
+      switchMap((response) => {
+        if (response.status != 202 || !response.body) {
+          return of(response);
+        }
+
+        const commandURL = ApiService.constructURL() + 'commands/' + response.body.id;
+        return timer(0, 100).pipe(
+          switchMap(() => this.http.get<Command>(commandURL)),
+          first((command) => command.state == 'done'),
+          map(() => response)
+        );
+      })
+    );
   }
 
   resetDevice() {
@@ -219,7 +219,7 @@ export class SettingsComponent implements OnInit, AfterViewChecked {
     }
 
     this.apiService.updateState(body).subscribe((response) => {
-      if (response.status == 204) {
+      if (response.ok) {
         this.getData();
       }
 
@@ -291,7 +291,7 @@ export class SettingsComponent implements OnInit, AfterViewChecked {
     this.upload.isTimerEnabledNum = timerStateToNum;
     this.apiService.updateTimerState(this.upload.isTimerEnabledNum).subscribe(
       (response) => {
-        if (response.status == 204) {
+        if (response.ok) {
           this.mapTimerEnabledState(this.upload.isTimerEnabledNum)
         }
       });
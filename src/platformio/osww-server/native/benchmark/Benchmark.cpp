@@ -0,0 +1,266 @@
+/*
+ * Micro-benchmarks for the API's request/response path, run on the host.
+ *
+ * Each case runs the firmware's own code for one request many times and reports
+ * time and heap allocations per request (operator new is counted by the native
+ * heap shim). The JSON schema cases must not allocate at all; a case that does,
+ * or that accepts/rejects the wrong body, fails the run.
+ *
+ * Responses are also serialized as MessagePack & CBOR, and with ?fields=, to
+ * compare body sizes as well as times.
+ *
+ * Winding patterns are compiled as uploaded, and a whole session's ETA is
+ * measured, against walking its segments one by one.
+ *
+ * Usage:
+ *   benchmark [--iterations 100000]
+ */
+
+#include <Arduino.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "NativeHal.h"
+#include "../../src/utils/ApiSchema.h"
+#include "../../src/utils/SettingsStore.h"
+#include "../../src/utils/PatternEngine.h"
+
+// What the web UI sends to /api/update
+static const char *updateBody = "{\"action\":\"START\",\"rotationDirection\":\"BOTH\",\"tpd\":330,\"hour\":\"08\",\"minutes\":\"10\",\"timerEnabled\":1,\"screenSleep\":false}";
+
+// What POST /api/patterns/{slot} gets for alternating sets
+static const char *patternBody = "{\"name\":\"Sets\",\"source\":\"repeat 3 { turn 20; pause 1m }\\nreverse; pause 5m\"}";
+// A DC motor at 8 s per turn, as main.cpp has it
+static const PATTERN_TIMING patternTiming = {8, false, 0};
+
+static volatile size_t sink;
+// Size of the last body a case serialized, 0 for cases that don't
+static size_t bodyBytes;
+
+struct BenchmarkCase
+{
+    const char *name;
+    bool (*run)();
+    bool mustNotAllocate;
+};
+
+static bool parseUpdate()
+{
+    JsonMessage json(updateSchema);
+    bool ok = json.parse(updateBody, strlen(updateBody));
+    sink = sink + json.getInt(UPDATE_TPD);
+    return ok && json.getInt(UPDATE_TPD) == 330 && strcmp(json.getText(UPDATE_HOUR), "08") == 0;
+}
+
+static bool parsePower()
+{
+    static const char *body = "{\"winderEnabled\":1}";
+    JsonMessage json(powerSchema);
+    return json.parse(body, strlen(body)) && strcmp(json.getText(POWER_WINDER_ENABLED), "1") == 0;
+}
+
+static bool rejectUpdate()
+{
+    // Minutes only come in steps of 10
+    static const char *body = "{\"action\":\"START\",\"rotationDirection\":\"BOTH\",\"tpd\":330,\"hour\":\"08\",\"minutes\":\"15\",\"timerEnabled\":1,\"screenSleep\":false}";
+    JsonMessage json(updateSchema);
+    return !json.parse(body, strlen(body)) && strstr(json.getError(), "minutes");
+}
+
+static bool serializeStatusAs(const JSON_FORMAT &format)
+{
+    JsonMessage json(statusSchema);
+    json.set(STATUS_STATUS, "Winding");
+    json.set(STATUS_ROTATIONS_PER_DAY, "330");
+    json.set(STATUS_DIRECTION, "BOTH");
+    json.set(STATUS_HOUR, "08");
+    json.set(STATUS_MINUTES, "10");
+    json.set(STATUS_SECONDS_PER_REVOLUTION, 8);
+    json.set(STATUS_START_EPOCH, 1792310638UL);
+    json.set(STATUS_CURRENT_EPOCH, 1792311638UL);
+    json.set(STATUS_FINISH_EPOCH, 1792313638UL);
+    json.set(STATUS_WINDER_ENABLED, "1");
+    json.set(STATUS_TIMER_ENABLED, "1");
+    json.set(STATUS_DB, -55);
+    json.set(STATUS_SCREEN_SLEEP, false);
+    json.set(STATUS_SCREEN_EQUIPPED, true);
+    json.set(STATUS_BOOT_TO_MOTOR_START_MS, -1L);
+    json.set(STATUS_AVERAGE_POWER_MW, 500);
+
+    char body[512];
+    size_t length = json.serialize(body, sizeof(body), format);
+    sink = sink + length;
+    bodyBytes = length;
+    return length > 0;
+}
+
+static bool serializeStatus()
+{
+    return serializeStatusAs(jsonFormat);
+}
+
+static bool serializeStatusMsgPack()
+{
+    return serializeStatusAs({JSON_ENCODING_MSGPACK, JSON_ALL_FIELDS});
+}
+
+static bool serializeStatusCbor()
+{
+    return serializeStatusAs({JSON_ENCODING_CBOR, JSON_ALL_FIELDS});
+}
+
+// What a dashboard polling many winders needs
+static bool serializeStatusFields()
+{
+    JSON_FORMAT format = jsonFormat;
+    return JsonMessage::selectFields(statusSchema, "status,currentTimeEpoch,estimatedRoutineFinishEpoch", format.fields) &&
+           serializeStatusAs(format);
+}
+
+static bool roundTripSettings()
+{
+    JsonMessage out(legacySettingsSchema);
+    out.set(LEGACY_SETTINGS_STATUS, "Stopped");
+    out.set(LEGACY_SETTINGS_TPD, "330");
+    out.set(LEGACY_SETTINGS_HOUR, "08");
+    out.set(LEGACY_SETTINGS_MINUTES, "10");
+    out.set(LEGACY_SETTINGS_TIMER_STATE, "1");
+    out.set(LEGACY_SETTINGS_DIRECTION, "CCW");
+
+    char contents[256];
+    size_t length = out.serialize(contents, sizeof(contents));
+
+    JsonMessage in(legacySettingsSchema);
+    return length > 0 && in.parse(contents, length) && strcmp(in.getText(LEGACY_SETTINGS_DIRECTION), "CCW") == 0;
+}
+
+// What loading the settings costs besides the NVS read, against parsing the old file above
+static bool roundTripSettingsBlob()
+{
+    WINDER_SETTINGS out = {330, 1, 8, 10, true, false};
+    SETTINGS_BLOB blob;
+    SettingsStore::encode(out, blob);
+
+    WINDER_SETTINGS in;
+    return SettingsStore::decode(blob, sizeof(blob), in) && in.direction == 1 && in.minutes == 10;
+}
+
+static bool compilePattern()
+{
+    JsonMessage json(patternUploadSchema);
+    WINDING_PATTERN pattern = {};
+    char error[PATTERN_ERROR_SIZE];
+    bool ok = json.parse(patternBody, strlen(patternBody)) &&
+              PatternCompiler::compile(json.getText(PATTERN_UPLOAD_SOURCE), pattern, error, sizeof(error));
+    sink = sink + pattern.length;
+    return ok && pattern.length == 15;
+}
+
+static PatternEngine &sessionEngine()
+{
+    static PatternEngine engine;
+    static bool loaded = false;
+    if (!loaded)
+    {
+        WINDING_PATTERN pattern = {};
+        char error[PATTERN_ERROR_SIZE];
+        PatternCompiler::compile("repeat 3 { turn 20; pause 1m }\nreverse; pause 5m", pattern, error, sizeof(error));
+        engine.load(pattern, patternTiming);
+        loaded = true;
+    }
+    return engine;
+}
+
+// The ETA of a 960 TPD session, as begin() works it out
+static bool measurePatternSession()
+{
+    unsigned long seconds = sessionEngine().measure(960);
+    sink = sink + seconds;
+    // 16 passes of 60 turns in 960 s, without the pauses after the last turn
+    return seconds == 16 * 960 - 60 - 300;
+}
+
+// The same ETA the long way, one segment at a time
+static bool walkPatternSession()
+{
+    PatternEngine &engine = sessionEngine();
+    PATTERN_SEGMENT segment;
+    unsigned long seconds = 0;
+    engine.begin(960);
+    while (engine.next(segment))
+    {
+        seconds += segment.seconds;
+    }
+    sink = sink + seconds;
+    return seconds == engine.measure(960);
+}
+
+static const BenchmarkCase cases[] = {
+    {"parse /api/update", parseUpdate, true},
+    {"parse /api/power", parsePower, true},
+    {"reject /api/update", rejectUpdate, true},
+    {"serialize /api/status", serializeStatus, true},
+    {"serialize status msgpack", serializeStatusMsgPack, true},
+    {"serialize status cbor", serializeStatusCbor, true},
+    {"serialize status 3 fields", serializeStatusFields, true},
+    {"legacy settings round trip", roundTripSettings, true},
+    {"settings blob round trip", roundTripSettingsBlob, true},
+    {"compile pattern upload", compilePattern, true},
+    {"pattern session ETA", measurePatternSession, true},
+    {"pattern session walked", walkPatternSession, true},
+};
+
+int main(int argc, char **argv)
+{
+    long iterations = 100000;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+        {
+            iterations = atol(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--iterations N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (iterations < 1)
+    {
+        iterations = 1;
+    }
+
+    printf("%-26s %10s %12s %12s %10s  %s\n", "case", "ns/op", "allocs/op", "peak_bytes", "body_bytes", "result");
+
+    int failures = 0;
+    for (const BenchmarkCase &benchmark : cases)
+    {
+        bool correct = true;
+        uint32_t allocationsBefore = nativeHeapAllocations();
+        nativeResetHeapPeak();
+        uint32_t inUseBefore = nativeHeapInUse();
+        bodyBytes = 0;
+
+        auto started = std::chrono::steady_clock::now();
+        for (long i = 0; i < iterations; i++)
+        {
+            correct = benchmark.run() && correct;
+        }
+        double elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+
+        double allocations = (double)(nativeHeapAllocations() - allocationsBefore) / iterations;
+        uint32_t peakBytes = nativeHeapPeak() - inUseBefore;
+        bool failed = !correct || (benchmark.mustNotAllocate && allocations > 0);
+        failures += failed;
+
+        char bytes[24];
+        snprintf(bytes, sizeof(bytes), bodyBytes ? "%zu" : "-", bodyBytes);
+        printf("%-26s %10.0f %12.2f %12u %10s  %s\n", benchmark.name, elapsedNs / iterations, allocations, peakBytes, bytes,
+               !correct ? "FAIL (wrong result)" : failed ? "FAIL (allocates)" : "ok");
+    }
+
+    return failures == 0 ? 0 : 1;
+}
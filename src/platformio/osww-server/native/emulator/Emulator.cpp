@@ -0,0 +1,468 @@
+/*
+ * Runs Winderoo's firmware on Linux: the real setup() & loop(), serving the real
+ * HTTP API and web UI on localhost.
+ *
+ * Motor & LED are emulated GPIO, the OLED is a framebuffer, LittleFS & NVS are
+ * directories under the state directory & the history partition is a file in it.
+ * ESP.restart() and deep sleep re-exec the emulator with RTC memory carried over;
+ * deep sleep fast-forwards the clocks instead of waiting.
+ *
+ * Several emulators can run side by side, each with its own --port & --state.
+ * The MAC address follows the port, so each one is a separate winder on the
+ * network, e.g. for a group of winders (GROUP_ENABLED) on loopback.
+ *
+ * The current sensor (CURRENT_SENSE_ENABLED) reads a synthetic motor: running
+ * current with ripple & noise, and a spike whenever it starts or reverses.
+ * --jam-after makes the cushion jam for good once the motor has run that long.
+ *
+ * The heap's high-water mark is kept in heap.json in the state directory, for
+ * the footprint budgets (scripts/footprint.py). It carries over reboots.
+ *
+ * What a browse would find is kept in mdns.json in the state directory: the
+ * advertised services with their TXT records, and how many announcements it
+ * took (each TXT update is one), with the time of the last.
+ *
+ * Usage:
+ *   emulator [--port 8080] [--state .pio/native-emulator] [--data data] [--oled] [--quiet] [--jam-after SECONDS]
+ */
+
+#include <Arduino.h>
+#include <Adafruit_SSD1306.h>
+#include <ESPAsyncWebServer.h>
+#include <ESPmDNS.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <esp_adc_cal.h>
+#include <esp_partition.h>
+#include <esp_sleep.h>
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "NativeHal.h"
+#include "../../src/utils/BoardProfile.h"
+#include "../../src/utils/CurrentSensor.h"
+
+#define REBOOT_STATE_ENV "WINDEROO_NATIVE_REBOOT"
+#define REBOOT_STATE_MAGIC 0x52424F54 // "RBOT"
+#define HEAP_REPORT_INTERVAL_MS 1000
+
+// Must match CURRENT_SENSE_SHUNT_MILLIOHMS in main.cpp
+#define SHUNT_MILLIOHMS 1000
+
+// The synthetic motor
+#define MOTOR_RUNNING_MILLIAMPS 120.0
+#define MOTOR_RIPPLE_HZ 45.0
+#define MOTOR_INRUSH_MILLIAMPS 450.0
+#define MOTOR_INRUSH_DECAY_MS 40.0
+#define MOTOR_STALL_MILLIAMPS 650.0
+#define MOTOR_NOISE_MILLIAMPS 10.0
+
+// The firmware
+void setup();
+void loop();
+#if OLED_ENABLED
+extern Adafruit_SSD1306 display;
+#endif
+
+// Bounds of RTC_DATA_ATTR storage, provided by the linker
+extern char __start_native_rtc_data[] __attribute__((weak));
+extern char __stop_native_rtc_data[] __attribute__((weak));
+
+struct RebootState
+{
+    uint32_t magic;
+    uint8_t deepSleep;
+    uint8_t wakeupCause;
+    uint64_t worldEpochMicros;
+    uint64_t rtcEpochMicros;
+    uint32_t rtcMemorySize;
+};
+
+struct EmulatorOptions
+{
+    uint16_t port = 8080;
+    std::string stateDirectory = ".pio/native-emulator";
+    std::string dataDirectory = "data";
+    bool showOled = false;
+    bool quiet = false;
+    long jamAfterSeconds = 0;
+};
+
+// Motor run time after which the synthetic cushion jams, 0 for never
+static unsigned long long jamAfterMicros = 0;
+
+// Highest heap use written to heap.json, by this process or the one before a reboot
+static uint32_t reportedHeapPeak = 0;
+
+static size_t rtcMemorySize()
+{
+    if (!__start_native_rtc_data || !__stop_native_rtc_data)
+    {
+        return 0;
+    }
+    return __stop_native_rtc_data - __start_native_rtc_data;
+}
+
+/**
+ * First run only: fills the emulated LittleFS with the files `pio run -t uploadfs` would flash
+ */
+static void seedFilesystem(const std::string &root, const std::string &data)
+{
+    namespace fs = std::filesystem;
+
+    if (fs::exists(root))
+    {
+        return;
+    }
+
+    fs::create_directories(root);
+    if (!fs::exists(data))
+    {
+        fprintf(stderr, "[NATIVE] - No %s directory, LittleFS starts empty\n", data.c_str());
+        return;
+    }
+
+    fs::copy(data, root, fs::copy_options::recursive);
+    printf("[NATIVE] - Seeded LittleFS from %s\n", data.c_str());
+}
+
+static std::string rebootStatePath(const EmulatorOptions &options)
+{
+    return options.stateDirectory + "/reboot.bin";
+}
+
+/**
+ * Saves RTC memory & the clocks as they'll be after the reboot, then replaces
+ * this process with a fresh copy - the closest the host gets to a reset.
+ */
+[[noreturn]] static void reboot(const NativeRestart &restart, const EmulatorOptions &options, char **argv)
+{
+    nativeReboot(restart);
+
+    RebootState state = {};
+    state.magic = REBOOT_STATE_MAGIC;
+    state.deepSleep = restart.deepSleep;
+    state.wakeupCause = restart.deepSleep ? esp_sleep_get_wakeup_cause() : ESP_SLEEP_WAKEUP_UNDEFINED;
+    state.worldEpochMicros = nativeWorldEpochMicros();
+    state.rtcEpochMicros = nativeRtcEpochMicros();
+    state.rtcMemorySize = rtcMemorySize();
+
+    std::string path = rebootStatePath(options);
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file)
+    {
+        fwrite(&state, sizeof(state), 1, file);
+        fwrite(__start_native_rtc_data, 1, state.rtcMemorySize, file);
+        fclose(file);
+        setenv(REBOOT_STATE_ENV, path.c_str(), 1);
+    }
+
+    if (restart.deepSleep)
+    {
+        printf("[NATIVE] - Fast-forwarding %llu s of deep sleep\n", restart.sleepMicros / 1000000ULL);
+    }
+    printf("[NATIVE] - Rebooting\n");
+    fflush(stdout);
+
+    // Exec the resolved path, so the process keeps its name
+    char executable[4096];
+    ssize_t length = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+    if (length > 0)
+    {
+        executable[length] = '\0';
+        execv(executable, argv);
+    }
+    perror("[NATIVE] - execv");
+    exit(1);
+}
+
+static std::string heapReportPath(const EmulatorOptions &options)
+{
+    return options.stateDirectory + "/heap.json";
+}
+
+/**
+ * Picks up the high-water mark from before a reboot; a fresh start begins a new one
+ */
+static void loadHeapReport(const EmulatorOptions &options)
+{
+    if (!getenv(REBOOT_STATE_ENV))
+    {
+        return;
+    }
+    FILE *file = fopen(heapReportPath(options).c_str(), "r");
+    if (file)
+    {
+        unsigned peak = 0;
+        if (fscanf(file, "{\"peak\": %u", &peak) == 1)
+        {
+            reportedHeapPeak = peak;
+        }
+        fclose(file);
+    }
+}
+
+/**
+ * Rewrites heap.json when the heap grew past what it says, at most once per interval
+ */
+static void writeHeapReport(const EmulatorOptions &options)
+{
+    static unsigned long writtenMs = 0;
+    uint32_t peak = nativeHeapPeak();
+    if (peak <= reportedHeapPeak || (writtenMs != 0 && millis() - writtenMs < HEAP_REPORT_INTERVAL_MS))
+    {
+        return;
+    }
+
+    // Written aside & renamed, a reader never sees half a file
+    std::string path = heapReportPath(options);
+    std::string temporary = path + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "w");
+    if (!file)
+    {
+        return;
+    }
+    fprintf(file, "{\"peak\": %u, \"inUse\": %u, \"allocations\": %u}\n", (unsigned)peak, (unsigned)nativeHeapInUse(), (unsigned)nativeHeapAllocations());
+    fclose(file);
+    rename(temporary.c_str(), path.c_str());
+
+    reportedHeapPeak = peak;
+    writtenMs = millis();
+}
+
+/**
+ * JSON string contents, for the few values that come from the user
+ */
+static std::string jsonEscape(const String &value)
+{
+    std::string escaped;
+    for (const char *c = value.c_str(); *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += *c;
+    }
+    return escaped;
+}
+
+/**
+ * Rewrites mdns.json after each TXT update, as the responder would announce it
+ */
+static void writeMdnsReport(const EmulatorOptions &options)
+{
+    static unsigned long writtenUpdates = 0;
+    if (MDNS.getTxtUpdates() == writtenUpdates)
+    {
+        return;
+    }
+
+    std::string path = options.stateDirectory + "/mdns.json";
+    std::string temporary = path + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "w");
+    if (!file)
+    {
+        return;
+    }
+    fprintf(file, "{\"hostname\": \"%s\", \"announcements\": %lu, \"announcedMs\": %lu, \"services\": [", jsonEscape(MDNS.getHostname()).c_str(), MDNS.getTxtUpdates(), MDNS.getTxtUpdatedMs());
+    const char *serviceSeparator = "";
+    for (const MDNSResponder::Service &service : MDNS.getServices())
+    {
+        fprintf(file, "%s{\"service\": \"%s\", \"proto\": \"%s\", \"port\": %u, \"txt\": {", serviceSeparator, service.service.c_str(), service.proto.c_str(), (unsigned)service.port);
+        const char *txtSeparator = "";
+        for (const auto &entry : service.txt)
+        {
+            fprintf(file, "%s\"%s\": \"%s\"", txtSeparator, jsonEscape(entry.first).c_str(), jsonEscape(entry.second).c_str());
+            txtSeparator = ", ";
+        }
+        fprintf(file, "}}");
+        serviceSeparator = ", ";
+    }
+    fprintf(file, "]}\n");
+    fclose(file);
+    rename(temporary.c_str(), path.c_str());
+
+    writtenUpdates = MDNS.getTxtUpdates();
+}
+
+static void restoreAfterReboot()
+{
+    const char *path = getenv(REBOOT_STATE_ENV);
+    if (!path)
+    {
+        return;
+    }
+
+    FILE *file = fopen(path, "rb");
+    unsetenv(REBOOT_STATE_ENV);
+    if (!file)
+    {
+        return;
+    }
+
+    RebootState state;
+    if (fread(&state, sizeof(state), 1, file) == 1 && state.magic == REBOOT_STATE_MAGIC && state.rtcMemorySize == rtcMemorySize())
+    {
+        if (fread(__start_native_rtc_data, 1, state.rtcMemorySize, file) != state.rtcMemorySize)
+        {
+            memset(__start_native_rtc_data, 0, state.rtcMemorySize);
+        }
+        nativeSetWorldEpoch((unsigned long)(state.worldEpochMicros / 1000000ULL));
+        nativeSetRtcEpochMicros(state.rtcEpochMicros);
+        nativeSetWakeupCause((esp_sleep_wakeup_cause_t)state.wakeupCause);
+    }
+    fclose(file);
+    remove(path);
+}
+
+/**
+ * Shunt reading for the current sensor, follows the H-bridge inputs. Called
+ * from the sensor's task only, in sample order.
+ */
+static uint16_t motorCurrentSample(uint8_t channel, unsigned long long atMicros)
+{
+    (void)channel;
+    static int drive = 0;
+    static unsigned long long changedMicros = 0;
+    static unsigned long long lastMicros = 0;
+    static unsigned long long runMicros = 0;
+    static uint32_t noise = 1;
+
+    int next = nativeGetPinValue(board.motorPinA) - nativeGetPinValue(board.motorPinB);
+    if (next != drive)
+    {
+        drive = next;
+        changedMicros = atMicros;
+    }
+    if (drive != 0 && atMicros > lastMicros)
+    {
+        runMicros += atMicros - lastMicros;
+    }
+    lastMicros = atMicros;
+    if (drive == 0)
+    {
+        return 0;
+    }
+
+    noise = noise * 1664525 + 1013904223;
+    double milliamps;
+    if (jamAfterMicros > 0 && runMicros >= jamAfterMicros)
+    {
+        milliamps = MOTOR_STALL_MILLIAMPS;
+    }
+    else
+    {
+        double seconds = atMicros / 1000000.0;
+        double sinceMs = (atMicros - changedMicros) / 1000.0;
+        milliamps = MOTOR_RUNNING_MILLIAMPS * (1 + 0.15 * sin(2 * M_PI * MOTOR_RIPPLE_HZ * seconds)) +
+                    MOTOR_INRUSH_MILLIAMPS * exp(-sinceMs / MOTOR_INRUSH_DECAY_MS);
+    }
+    milliamps += MOTOR_NOISE_MILLIAMPS * ((noise >> 16) / 32768.0 - 1);
+
+    double millivolts = std::max(0.0, milliamps) * SHUNT_MILLIOHMS / 1000;
+    return nativeAdcRawFromMillivolts(CURRENT_SENSE_ATTENUATION, (uint32_t)millivolts);
+}
+
+static bool parseOptions(int argc, char **argv, EmulatorOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--port") && hasValue)
+        {
+            options.port = (uint16_t)atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--state") && hasValue)
+        {
+            options.stateDirectory = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--data") && hasValue)
+        {
+            options.dataDirectory = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--oled"))
+        {
+            options.showOled = true;
+        }
+        else if (!strcmp(argv[i], "--quiet"))
+        {
+            options.quiet = true;
+        }
+        else if (!strcmp(argv[i], "--jam-after") && hasValue)
+        {
+            options.jamAfterSeconds = atol(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--port N] [--state DIR] [--data DIR] [--oled] [--quiet] [--jam-after SECONDS]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    EmulatorOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        return 2;
+    }
+
+    // Keep the log readable when piped to a file
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    std::string filesystemRoot = options.stateDirectory + "/littlefs";
+    std::string nvsRoot = options.stateDirectory + "/nvs";
+    std::filesystem::create_directories(nvsRoot);
+    seedFilesystem(filesystemRoot, options.dataDirectory);
+
+    LittleFS.setRoot(filesystemRoot.c_str());
+    nativeSetNvsRoot(nvsRoot.c_str());
+    nativeSetPartitionRoot(options.stateDirectory.c_str());
+    nativeSetWebServerPort(options.port);
+    uint8_t mac[6] = {0x02, 0x57, 0x44, 0x4E, (uint8_t)(options.port >> 8), (uint8_t)options.port};
+    WiFi.setMacAddress(mac);
+    nativeSetSerialEnabled(!options.quiet);
+    jamAfterMicros = options.jamAfterSeconds * 1000000ULL;
+    nativeSetAdcSource(motorCurrentSample);
+    loadHeapReport(options);
+    restoreAfterReboot();
+
+    try
+    {
+        setup();
+
+#if OLED_ENABLED
+        unsigned long shownFrame = display.getFrameCount();
+#endif
+        for (;;)
+        {
+            loop();
+            writeHeapReport(options);
+            writeMdnsReport(options);
+
+#if OLED_ENABLED
+            if (options.showOled && display.getFrameCount() != shownFrame)
+            {
+                shownFrame = display.getFrameCount();
+                printf("%s\n", display.isOn() ? display.renderAscii().c_str() : "[OLED off]");
+            }
+#endif
+        }
+    }
+    catch (const NativeRestart &restart)
+    {
+        reboot(restart, options, argv);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef Adafruit_GFX_H
+#define Adafruit_GFX_H
+
+#include <Arduino.h>
+
+/**
+ * Drawing primitives over a 1-bit framebuffer. Text is not rasterised;
+ * each print() is remembered with its cursor position instead.
+ */
+class Adafruit_GFX : public Print
+{
+protected:
+    int16_t _width;
+    int16_t _height;
+    int16_t _cursorX = 0;
+    int16_t _cursorY = 0;
+    uint8_t _textSize = 1;
+    uint16_t _textColor = 1;
+    uint8_t _rotation = 0;
+    String _pendingText;
+    int16_t _pendingX = 0;
+    int16_t _pendingY = 0;
+
+    void flushText();
+    virtual void onText(int16_t x, int16_t y, const String &text) { (void)x; (void)y; (void)text; }
+
+public:
+    Adafruit_GFX(int16_t width, int16_t height) : _width(width), _height(height) {}
+
+    virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+
+    void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color);
+    void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) { drawLine(x, y, x + w - 1, y, color); }
+    void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) { drawLine(x, y, x, y + h - 1, color); }
+    void drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+    void fillScreen(uint16_t color) { fillRect(0, 0, _width, _height, color); }
+    void drawTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color);
+
+    void setCursor(int16_t x, int16_t y);
+    void setTextSize(uint8_t size) { _textSize = size ? size : 1; }
+    void setTextColor(uint16_t color) { _textColor = color; }
+    void setTextColor(uint16_t color, uint16_t background) { (void)background; _textColor = color; }
+    void setTextWrap(bool wrap) { (void)wrap; }
+    void setRotation(uint8_t rotation) { _rotation = rotation & 3; }
+    uint8_t getRotation() const { return _rotation; }
+    int16_t getCursorX() const { return _cursorX; }
+    int16_t getCursorY() const { return _cursorY; }
+
+    void getTextBounds(const char *string, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h);
+    void getTextBounds(const String &string, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h)
+    {
+        getTextBounds(string.c_str(), x, y, x1, y1, w, h);
+    }
+
+    size_t write(uint8_t value) override;
+    using Print::write;
+
+    int16_t width() const { return _width; }
+    int16_t height() const { return _height; }
+};
+
+#endif
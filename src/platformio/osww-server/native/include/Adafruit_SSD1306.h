@@ -0,0 +1,56 @@
+#ifndef Adafruit_SSD1306_H
+#define Adafruit_SSD1306_H
+
+#include <vector>
+
+#include <Adafruit_GFX.h>
+#include <Wire.h>
+
+#define SSD1306_BLACK 0
+#define SSD1306_WHITE 1
+#define SSD1306_INVERSE 2
+#define BLACK SSD1306_BLACK
+#define WHITE SSD1306_WHITE
+#define INVERSE SSD1306_INVERSE
+
+#define SSD1306_EXTERNALVCC 0x01
+#define SSD1306_SWITCHCAPVCC 0x02
+#define SSD1306_DISPLAYOFF 0xAE
+#define SSD1306_DISPLAYON 0xAF
+
+/**
+ * Emulated 128x64 OLED. display() copies the draw buffer to what's "on the glass".
+ */
+class Adafruit_SSD1306 : public Adafruit_GFX
+{
+private:
+    std::vector<uint8_t> _buffer;
+    std::vector<uint8_t> _shown;
+    std::vector<String> _textLines;
+    std::vector<String> _shownTextLines;
+    bool _on = true;
+    bool _inverted = false;
+    unsigned long _frames = 0;
+
+protected:
+    void onText(int16_t x, int16_t y, const String &text) override;
+
+public:
+    Adafruit_SSD1306(uint8_t width, uint8_t height, TwoWire *wire = &Wire, int8_t resetPin = -1, uint32_t clkDuring = 400000UL, uint32_t clkAfter = 100000UL);
+
+    bool begin(uint8_t switchvcc = SSD1306_SWITCHCAPVCC, uint8_t i2caddr = 0, bool reset = true, bool periphBegin = true);
+    void display();
+    void clearDisplay();
+    void invertDisplay(bool invert) { _inverted = invert; }
+    void dim(bool dim) { (void)dim; }
+    void ssd1306_command(uint8_t command);
+    void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+    bool getPixel(int16_t x, int16_t y);
+    uint8_t *getBuffer() { return _buffer.data(); }
+
+    bool isOn() const { return _on; }
+    unsigned long getFrameCount() const { return _frames; }
+    String renderAscii() const;
+};
+
+#endif
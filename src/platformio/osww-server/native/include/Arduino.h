@@ -0,0 +1,69 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+/*
+ * Host (native) stand-in for the Arduino-ESP32 core.
+ *
+ * Just enough of the core for Winderoo's firmware to build & run on Linux.
+ * GPIO, LEDC & the clock are emulated; see NativeHal.h to drive them.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "WString.h"
+#include "Print.h"
+#include "HardwareSerial.h"
+#include "Esp.h"
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+
+#define NATIVE_BUILD 1
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define INPUT_PULLDOWN 0x09
+
+#define LED_BUILTIN 2
+
+#define bit(b) (1UL << (b))
+#define BIT(nr) (1UL << (nr))
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// As in the core's Arduino.h
+using std::max;
+using std::min;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+int8_t digitalPinToAnalogChannel(uint8_t pin);
+
+double ledcSetup(uint8_t channel, double frequency, uint8_t resolution);
+void ledcAttachPin(uint8_t pin, uint8_t channel);
+void ledcWrite(uint8_t channel, uint32_t duty);
+
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
+
+long random(long max);
+long random(long min, long max);
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef ArduinoHA_H
+#define ArduinoHA_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+/*
+ * Enough of dawidchyrzynski's home-assistant-integration for the firmware
+ * to build on the host. The native build has no broker, so nothing is sent.
+ */
+
+class HAMqtt;
+
+class HADevice
+{
+public:
+    void setUniqueId(const byte *uniqueId, uint16_t length) { (void)uniqueId; (void)length; }
+    void setName(const char *name) { (void)name; }
+    void setManufacturer(const char *manufacturer) { (void)manufacturer; }
+    void setModel(const char *model) { (void)model; }
+    void setSoftwareVersion(const char *version) { (void)version; }
+    void enableSharedAvailability() {}
+    void setAvailability(bool online) { (void)online; }
+};
+
+class HANumeric
+{
+private:
+    int32_t _value = 0;
+
+public:
+    HANumeric() {}
+    HANumeric(int32_t value) : _value(value) {}
+    bool isSet() const { return true; }
+    int32_t toInt32() const { return _value; }
+    uint8_t toStr(char *buffer) const { return (uint8_t)sprintf(buffer, "%d", (int)_value); }
+};
+
+class HABaseDeviceType
+{
+protected:
+    const char *_uniqueId;
+    const char *_name = nullptr;
+    const char *_icon = nullptr;
+
+public:
+    HABaseDeviceType(const char *uniqueId) : _uniqueId(uniqueId) {}
+    virtual ~HABaseDeviceType() {}
+    const char *uniqueId() const { return _uniqueId; }
+    void setName(const char *name) { _name = name; }
+    void setIcon(const char *icon) { _icon = icon; }
+
+protected:
+    // Builds the discovery payload; publishConfig() sends nothing if it didn't
+    virtual void buildSerializer() {}
+    void publishConfig() { buildSerializer(); }
+};
+
+class HASwitch : public HABaseDeviceType
+{
+private:
+    bool _currentState = false;
+    void (*_commandCallback)(bool state, HASwitch *sender) = nullptr;
+
+public:
+    HASwitch(const char *uniqueId) : HABaseDeviceType(uniqueId) {}
+    bool setState(bool state, bool force = false) { (void)force; _currentState = state; return true; }
+    void setCurrentState(bool state) { _currentState = state; }
+    bool getCurrentState() const { return _currentState; }
+    void onCommand(void (*callback)(bool state, HASwitch *sender)) { _commandCallback = callback; }
+};
+
+class HANumber : public HABaseDeviceType
+{
+private:
+    HANumeric _currentState;
+    void (*_commandCallback)(HANumeric number, HANumber *sender) = nullptr;
+
+public:
+    HANumber(const char *uniqueId) : HABaseDeviceType(uniqueId) {}
+    void setMin(float min) { (void)min; }
+    void setMax(float max) { (void)max; }
+    void setStep(float step) { (void)step; }
+    void setOptimistic(bool optimistic) { (void)optimistic; }
+    bool setState(const HANumeric &state, bool force = false) { (void)force; _currentState = state; return true; }
+    bool setState(int32_t state, bool force = false) { return setState(HANumeric(state), force); }
+    void setCurrentState(const HANumeric &state) { _currentState = state; }
+    void setCurrentState(int32_t state) { _currentState = HANumeric(state); }
+    const HANumeric &getCurrentState() const { return _currentState; }
+    void onCommand(void (*callback)(HANumeric number, HANumber *sender)) { _commandCallback = callback; }
+};
+
+class HASelect : public HABaseDeviceType
+{
+private:
+    int8_t _currentState = -1;
+    void (*_commandCallback)(int8_t index, HASelect *sender) = nullptr;
+
+public:
+    HASelect(const char *uniqueId) : HABaseDeviceType(uniqueId) {}
+    void setOptions(const char *options) { (void)options; }
+    bool setState(int8_t state, bool force = false) { (void)force; _currentState = state; return true; }
+    void setCurrentState(int8_t state) { _currentState = state; }
+    int8_t getCurrentState() const { return _currentState; }
+    void onCommand(void (*callback)(int8_t index, HASelect *sender)) { _commandCallback = callback; }
+};
+
+class HAButton : public HABaseDeviceType
+{
+private:
+    void (*_commandCallback)(HAButton *sender) = nullptr;
+
+public:
+    HAButton(const char *uniqueId) : HABaseDeviceType(uniqueId) {}
+    void onCommand(void (*callback)(HAButton *sender)) { _commandCallback = callback; }
+};
+
+class HASensor : public HABaseDeviceType
+{
+public:
+    HASensor(const char *uniqueId) : HABaseDeviceType(uniqueId) {}
+    bool setValue(const char *value, bool force = false) { (void)value; (void)force; return true; }
+};
+
+class HAMqtt
+{
+private:
+    void (*_connectedCallback)() = nullptr;
+    void (*_disconnectedCallback)() = nullptr;
+    void (*_messageCallback)(const char *topic, const uint8_t *payload, uint16_t length) = nullptr;
+
+public:
+    HAMqtt(Client &client, HADevice &device) { (void)client; (void)device; }
+    bool begin(const char *serverIp, const char *username = nullptr, const char *password = nullptr)
+    {
+        (void)serverIp;
+        (void)username;
+        (void)password;
+        return true;
+    }
+    void loop() {}
+    bool isConnected() const { return false; }
+    void onConnected(void (*callback)()) { _connectedCallback = callback; }
+    void onDisconnected(void (*callback)()) { _disconnectedCallback = callback; }
+    void onMessage(void (*callback)(const char *topic, const uint8_t *payload, uint16_t length)) { _messageCallback = callback; }
+    bool publish(const char *topic, const char *payload, bool retained = false)
+    {
+        (void)topic;
+        (void)payload;
+        (void)retained;
+        return false;
+    }
+    bool subscribe(const char *topic)
+    {
+        (void)topic;
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef Client_H
+#define Client_H
+
+#include <WiFiClient.h>
+
+#endif
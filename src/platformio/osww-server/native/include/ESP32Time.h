@@ -0,0 +1,39 @@
+#ifndef ESP32Time_H
+#define ESP32Time_H
+
+#include <ctime>
+
+#include <Arduino.h>
+
+/**
+ * fbiego's ESP32Time over the emulated RTC (see nativeRtcEpochMicros())
+ */
+class ESP32Time
+{
+private:
+    long _offset;
+
+public:
+    ESP32Time(unsigned long offset = 0) : _offset(offset) {}
+
+    void setTime(unsigned long epoch = 1609459200, int ms = 0);
+    void setTime(int sc, int mn, int hr, int dy, int mt, int yr, int ms = 0);
+    void offset(long offset) { _offset = offset; }
+
+    unsigned long getEpoch();
+    unsigned long getLocalEpoch();
+    unsigned long getMillis();
+    unsigned long getMicros();
+    int getSecond();
+    int getMinute();
+    int getHour(bool mode = false);
+    int getDay();
+    int getMonth();
+    int getYear();
+    String getTime(String format);
+    String getTime();
+    String getDateTime(bool mode = false);
+    struct tm getTimeStruct();
+};
+
+#endif
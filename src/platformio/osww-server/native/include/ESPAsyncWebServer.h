@@ -0,0 +1,433 @@
+#ifndef ESPAsyncWebServer_H
+#define ESPAsyncWebServer_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <Arduino.h>
+#include <FS.h>
+
+/*
+ * ESPAsyncWebServer over blocking POSIX sockets.
+ *
+ * Each connection is read on its own thread, but handlers run one at a time
+ * under a single lock - the same guarantee the async_tcp task gives on the ESP32.
+ */
+
+typedef enum
+{
+    HTTP_GET = 0b00000001,
+    HTTP_POST = 0b00000010,
+    HTTP_DELETE = 0b00000100,
+    HTTP_PUT = 0b00001000,
+    HTTP_PATCH = 0b00010000,
+    HTTP_HEAD = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+
+typedef uint8_t WebRequestMethodComposite;
+
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+// contentLength() of a response that streams until either side closes, e.g. server-sent events
+#define NATIVE_STREAMING_RESPONSE -2
+
+class AsyncWebServer;
+class AsyncWebServerRequest;
+class AsyncWebServerResponse;
+
+class AsyncWebHeader
+{
+private:
+    String _name;
+    String _value;
+
+public:
+    AsyncWebHeader(const String &name, const String &value) : _name(name), _value(value) {}
+    const String &name() const { return _name; }
+    const String &value() const { return _value; }
+};
+
+class AsyncWebParameter
+{
+private:
+    String _name;
+    String _value;
+    bool _isPost;
+    bool _isFile;
+
+public:
+    AsyncWebParameter(const String &name, const String &value, bool form = false, bool file = false)
+        : _name(name), _value(value), _isPost(form), _isFile(file) {}
+    const String &name() const { return _name; }
+    const String &value() const { return _value; }
+    size_t size() const { return _value.length(); }
+    bool isPost() const { return _isPost; }
+    bool isFile() const { return _isFile; }
+};
+
+typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)> ArBodyHandlerFunction;
+typedef std::function<size_t(uint8_t *buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+typedef std::function<void(void)> ArDisconnectHandler;
+
+class AsyncWebServerResponse
+{
+protected:
+    int _code;
+    String _contentType;
+    std::vector<std::pair<String, String>> _headers;
+
+public:
+    AsyncWebServerResponse(int code, const String &contentType) : _code(code), _contentType(contentType) {}
+    virtual ~AsyncWebServerResponse() {}
+
+    void setCode(int code) { _code = code; }
+    void setContentType(const String &contentType) { _contentType = contentType; }
+    void addHeader(const String &name, const String &value) { _headers.push_back(std::make_pair(name, value)); }
+
+    int code() const { return _code; }
+    const String &contentType() const { return _contentType; }
+    const std::vector<std::pair<String, String>> &headers() const { return _headers; }
+
+    // Length of the body, -1 when it is produced in chunks, NATIVE_STREAMING_RESPONSE when it never ends
+    virtual long contentLength() { return 0; }
+    // Copies up to maxLen body bytes starting at index; 0 ends the body
+    virtual size_t fill(uint8_t *buffer, size_t maxLen, size_t index)
+    {
+        (void)buffer;
+        (void)maxLen;
+        (void)index;
+        return 0;
+    }
+};
+
+class AsyncBasicResponse : public AsyncWebServerResponse
+{
+private:
+    String _content;
+
+public:
+    AsyncBasicResponse(int code, const String &contentType = String(), const String &content = String())
+        : AsyncWebServerResponse(code, contentType), _content(content) {}
+    long contentLength() override { return _content.length(); }
+    size_t fill(uint8_t *buffer, size_t maxLen, size_t index) override;
+};
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print
+{
+private:
+    std::string _content;
+
+public:
+    AsyncResponseStream(const String &contentType, size_t bufferSize)
+        : AsyncWebServerResponse(200, contentType)
+    {
+        _content.reserve(bufferSize);
+    }
+    size_t write(uint8_t value) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    long contentLength() override { return _content.length(); }
+    size_t fill(uint8_t *buffer, size_t maxLen, size_t index) override;
+};
+
+class AsyncChunkedResponse : public AsyncWebServerResponse
+{
+private:
+    AwsResponseFiller _filler;
+
+public:
+    AsyncChunkedResponse(const String &contentType, AwsResponseFiller filler)
+        : AsyncWebServerResponse(200, contentType), _filler(filler) {}
+    long contentLength() override { return -1; }
+    size_t fill(uint8_t *buffer, size_t maxLen, size_t index) override { return _filler(buffer, maxLen, index); }
+};
+
+class AsyncFileResponse : public AsyncWebServerResponse
+{
+private:
+    File _file;
+
+public:
+    AsyncFileResponse(File file, const String &contentType) : AsyncWebServerResponse(200, contentType), _file(file) {}
+    long contentLength() override { return _file.size(); }
+    size_t fill(uint8_t *buffer, size_t maxLen, size_t index) override;
+};
+
+class AsyncWebServerRequest
+{
+    friend class AsyncWebServer;
+
+private:
+    AsyncWebServer *_server;
+    WebRequestMethodComposite _method = HTTP_GET;
+    String _url;
+    String _host;
+    String _contentType;
+    size_t _contentLength = 0;
+    std::vector<AsyncWebHeader> _headers;
+    std::vector<AsyncWebParameter> _params;
+    AsyncWebServerResponse *_response = nullptr;
+    ArDisconnectHandler _onDisconnect;
+
+public:
+    void *_tempObject = nullptr;
+
+    AsyncWebServerRequest(AsyncWebServer *server) : _server(server) {}
+    ~AsyncWebServerRequest();
+
+    WebRequestMethodComposite method() const { return _method; }
+    const char *methodToString() const;
+    const String &url() const { return _url; }
+    const String &host() const { return _host; }
+    const String &contentType() const { return _contentType; }
+    size_t contentLength() const { return _contentLength; }
+
+    size_t headers() const { return _headers.size(); }
+    bool hasHeader(const String &name) const;
+    AsyncWebHeader *getHeader(const String &name);
+    AsyncWebHeader *getHeader(size_t index) { return index < _headers.size() ? &_headers[index] : nullptr; }
+    const String &header(const char *name);
+
+    size_t params() const { return _params.size(); }
+    bool hasParam(const String &name, bool post = false, bool file = false) const;
+    AsyncWebParameter *getParam(size_t index) { return index < _params.size() ? &_params[index] : nullptr; }
+    AsyncWebParameter *getParam(const String &name, bool post = false, bool file = false);
+    bool hasArg(const char *name) const { return hasParam(name) || hasParam(name, true); }
+    const String &arg(const String &name);
+
+    void onDisconnect(ArDisconnectHandler handler) { _onDisconnect = handler; }
+
+    void send(AsyncWebServerResponse *response);
+    void send(int code, const String &contentType = String(), const String &content = String());
+    void send(FS &fs, const String &path, const String &contentType = String(), bool download = false);
+
+    AsyncWebServerResponse *beginResponse(int code, const String &contentType = String(), const String &content = String());
+    AsyncWebServerResponse *beginResponse(FS &fs, const String &path, const String &contentType = String(), bool download = false);
+    AsyncResponseStream *beginResponseStream(const String &contentType, size_t bufferSize = 1460);
+    AsyncWebServerResponse *beginChunkedResponse(const String &contentType, AwsResponseFiller callback);
+
+    // Native only
+    AsyncWebServerResponse *takeResponse();
+    bool hasResponse() const { return _response != nullptr; }
+};
+
+class AsyncWebHandler
+{
+public:
+    virtual ~AsyncWebHandler() {}
+    virtual bool canHandle(AsyncWebServerRequest *request) { (void)request; return false; }
+    virtual void handleRequest(AsyncWebServerRequest *request) { (void)request; }
+    virtual void handleUpload(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)
+    {
+        (void)request;
+        (void)filename;
+        (void)index;
+        (void)data;
+        (void)len;
+        (void)final;
+    }
+    virtual void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+    {
+        (void)request;
+        (void)data;
+        (void)len;
+        (void)index;
+        (void)total;
+    }
+    virtual bool isRequestHandlerTrivial() { return true; }
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler
+{
+private:
+    String _uri;
+    WebRequestMethodComposite _method = HTTP_ANY;
+    ArRequestHandlerFunction _onRequest;
+    ArUploadHandlerFunction _onUpload;
+    ArBodyHandlerFunction _onBody;
+
+public:
+    void setUri(const String &uri) { _uri = uri; }
+    void setMethod(WebRequestMethodComposite method) { _method = method; }
+    void onRequest(ArRequestHandlerFunction fn) { _onRequest = fn; }
+    void onUpload(ArUploadHandlerFunction fn) { _onUpload = fn; }
+    void onBody(ArBodyHandlerFunction fn) { _onBody = fn; }
+
+    bool canHandle(AsyncWebServerRequest *request) override;
+    void handleRequest(AsyncWebServerRequest *request) override;
+    void handleUpload(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final) override;
+    void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) override;
+    bool isRequestHandlerTrivial() override { return !_onBody && !_onUpload; }
+};
+
+class AsyncStaticWebHandler : public AsyncWebHandler
+{
+private:
+    String _uri;
+    FS &_fs;
+    String _path;
+    String _defaultFile = "index.htm";
+    String _cacheControl;
+
+    bool resolve(AsyncWebServerRequest *request, String &path, bool &gzipped);
+
+public:
+    AsyncStaticWebHandler(const String &uri, FS &fs, const String &path, const char *cacheControl);
+
+    AsyncStaticWebHandler &setCacheControl(const char *cacheControl)
+    {
+        _cacheControl = cacheControl;
+        return *this;
+    }
+    AsyncStaticWebHandler &setDefaultFile(const char *filename)
+    {
+        _defaultFile = filename;
+        return *this;
+    }
+    AsyncStaticWebHandler &setLastModified(const char *lastModified)
+    {
+        (void)lastModified;
+        return *this;
+    }
+
+    bool canHandle(AsyncWebServerRequest *request) override;
+    void handleRequest(AsyncWebServerRequest *request) override;
+};
+
+class AsyncWebServer
+{
+private:
+    uint16_t _port;
+    int _listener = -1;
+    bool _running = false;
+    std::thread _acceptThread;
+    std::vector<AsyncWebHandler *> _handlers;
+    AsyncCallbackWebHandler _catchAllHandler;
+
+    void acceptLoop();
+    void serveConnection(int client);
+
+public:
+    AsyncWebServer(uint16_t port);
+    ~AsyncWebServer();
+
+    void begin();
+    void end();
+    void reset();
+
+    AsyncWebHandler &addHandler(AsyncWebHandler *handler);
+    bool removeHandler(AsyncWebHandler *handler);
+
+    AsyncCallbackWebHandler &on(const char *uri, ArRequestHandlerFunction onRequest);
+    AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest);
+    AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload);
+    AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody);
+    AsyncStaticWebHandler &serveStatic(const char *uri, FS &fs, const char *path, const char *cacheControl = nullptr);
+
+    void onNotFound(ArRequestHandlerFunction fn) { _catchAllHandler.onRequest(fn); }
+    void onFileUpload(ArUploadHandlerFunction fn) { _catchAllHandler.onUpload(fn); }
+    void onRequestBody(ArBodyHandlerFunction fn) { _catchAllHandler.onBody(fn); }
+
+    // Native only: the emulator picks the port at runtime
+    void setPort(uint16_t port) { _port = port; }
+    uint16_t getPort() const { return _port; }
+};
+
+class AsyncEventSource;
+
+/**
+ * One open /events connection. Messages queue up until the connection's thread sends them.
+ */
+class AsyncEventSourceClient
+{
+private:
+    AsyncEventSource *_source;
+    std::string _queue;
+    uint32_t _lastId;
+    bool _connected = true;
+
+public:
+    AsyncEventSourceClient(AsyncEventSource *source, uint32_t lastId) : _source(source), _lastId(lastId) {}
+
+    void send(const char *message, const char *event = nullptr, uint32_t id = 0, uint32_t reconnect = 0);
+    void close() { _connected = false; }
+    bool connected() const { return _connected; }
+    uint32_t lastId() const { return _lastId; }
+
+    // Native only
+    AsyncEventSource *source() const { return _source; }
+    size_t take(uint8_t *buffer, size_t maxLen);
+};
+
+class AsyncEventSourceResponse : public AsyncWebServerResponse
+{
+private:
+    AsyncEventSourceClient *_client;
+
+public:
+    AsyncEventSourceResponse(AsyncEventSourceClient *client);
+    ~AsyncEventSourceResponse();
+    long contentLength() override { return NATIVE_STREAMING_RESPONSE; }
+    size_t fill(uint8_t *buffer, size_t maxLen, size_t index) override;
+};
+
+typedef std::function<void(AsyncEventSourceClient *client)> ArEventHandlerFunction;
+
+class AsyncEventSource : public AsyncWebHandler
+{
+    friend class AsyncEventSourceResponse;
+
+private:
+    String _url;
+    std::vector<AsyncEventSourceClient *> _clients;
+    ArEventHandlerFunction _connectcb;
+
+public:
+    AsyncEventSource(const String &url) : _url(url) {}
+    ~AsyncEventSource();
+
+    const char *url() const { return _url.c_str(); }
+    void close();
+    void onConnect(ArEventHandlerFunction cb) { _connectcb = cb; }
+    void send(const char *message, const char *event = nullptr, uint32_t id = 0, uint32_t reconnect = 0);
+    size_t count() const;
+
+    bool canHandle(AsyncWebServerRequest *request) override;
+    void handleRequest(AsyncWebServerRequest *request) override;
+};
+
+class DefaultHeaders
+{
+private:
+    std::vector<std::pair<String, String>> _headers;
+
+public:
+    static DefaultHeaders &Instance()
+    {
+        static DefaultHeaders instance;
+        return instance;
+    }
+    void addHeader(const String &name, const String &value) { _headers.push_back(std::make_pair(name, value)); }
+    const std::vector<std::pair<String, String>> &headers() const { return _headers; }
+};
+
+/**
+ * The lock every handler runs under. Exposed so the emulator can make its
+ * own calls into the firmware from the same "task".
+ */
+std::recursive_mutex &nativeAsyncTcpLock();
+
+/**
+ * Overrides the port every AsyncWebServer listens on, so several emulators can share a host
+ */
+void nativeSetWebServerPort(uint16_t port);
+
+#endif
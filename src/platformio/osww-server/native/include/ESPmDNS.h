@@ -0,0 +1,53 @@
+#ifndef ESPmDNS_H
+#define ESPmDNS_H
+
+#include <map>
+#include <vector>
+
+#include <Arduino.h>
+#include <mdns.h>
+
+/**
+ * Records what the firmware advertises instead of answering on the network
+ */
+class MDNSResponder
+{
+public:
+    struct Service
+    {
+        String service;
+        String proto;
+        uint16_t port;
+        std::map<String, String> txt;
+    };
+
+private:
+    String _hostname;
+    std::vector<Service> _services;
+    unsigned long _txtUpdates = 0;
+    unsigned long _txtUpdatedMs = 0;
+
+    Service *findService(const char *service, const char *proto);
+
+public:
+    bool begin(const char *hostname);
+    void end();
+    bool addService(const char *service, const char *proto, uint16_t port);
+    bool addServiceTxt(const char *service, const char *proto, const char *key, const char *value);
+    bool addServiceTxt(const String &service, const String &proto, const String &key, const String &value)
+    {
+        return addServiceTxt(service.c_str(), proto.c_str(), key.c_str(), value.c_str());
+    }
+    // What mdns_service_txt_set() does: replaces the whole record, one announcement
+    bool setServiceTxt(const char *service, const char *proto, const mdns_txt_item_t *txt, uint8_t count);
+
+    const String &getHostname() const { return _hostname; }
+    const std::vector<Service> &getServices() const { return _services; }
+    // Each one an announcement on a real network
+    unsigned long getTxtUpdates() const { return _txtUpdates; }
+    unsigned long getTxtUpdatedMs() const { return _txtUpdatedMs; }
+};
+
+extern MDNSResponder MDNS;
+
+#endif
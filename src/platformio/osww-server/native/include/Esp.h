@@ -0,0 +1,23 @@
+#ifndef Esp_H
+#define Esp_H
+
+#include <cstdint>
+
+class EspClass
+{
+public:
+    void restart();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getHeapSize();
+    uint32_t getMaxAllocHeap();
+    uint32_t getCpuFreqMHz() { return 240; }
+    const char *getSdkVersion() { return "native"; }
+    uint32_t getSketchSize() { return 0; }
+    uint32_t getFreeSketchSpace() { return 0; }
+    uint64_t getEfuseMac() { return 0x0000A1B2C3D4E5F6ULL; }
+};
+
+extern EspClass ESP;
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef FS_H
+#define FS_H
+
+#include <cstdio>
+#include <memory>
+
+#include <Arduino.h>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs
+{
+
+class FileImpl;
+
+/**
+ * A file under the emulated filesystem's root directory on the host
+ */
+class File : public Stream
+{
+private:
+    std::shared_ptr<FileImpl> _impl;
+
+public:
+    File() {}
+    File(std::shared_ptr<FileImpl> impl) : _impl(impl) {}
+
+    size_t write(uint8_t value) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    void flush() override;
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t read(uint8_t *buffer, size_t size);
+
+    bool seek(uint32_t position);
+    size_t position() const;
+    size_t size() const;
+    void close();
+    operator bool() const;
+    const char *path() const;
+    const char *name() const;
+    bool isDirectory() const;
+    File openNextFile(const char *mode = FILE_READ);
+};
+
+class FS
+{
+protected:
+    String _root;
+
+public:
+    explicit FS(const char *root = "") : _root(root) {}
+
+    void setRoot(const String &root) { _root = root; }
+    const String &getRoot() const { return _root; }
+    String hostPath(const String &path) const;
+
+    File open(const char *path, const char *mode = FILE_READ, bool create = false);
+    File open(const String &path, const char *mode = FILE_READ, bool create = false) { return open(path.c_str(), mode, create); }
+    bool exists(const char *path);
+    bool exists(const String &path) { return exists(path.c_str()); }
+    bool remove(const char *path);
+    bool remove(const String &path) { return remove(path.c_str()); }
+    bool rename(const char *pathFrom, const char *pathTo);
+    bool rename(const String &pathFrom, const String &pathTo) { return rename(pathFrom.c_str(), pathTo.c_str()); }
+    bool mkdir(const char *path);
+    bool mkdir(const String &path) { return mkdir(path.c_str()); }
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+
+#endif
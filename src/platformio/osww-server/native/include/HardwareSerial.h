@@ -0,0 +1,33 @@
+#ifndef HardwareSerial_H
+#define HardwareSerial_H
+
+#include "Print.h"
+
+/**
+ * Serial console for the host build. Output goes to stdout, input is never available.
+ */
+class HardwareSerial : public Stream
+{
+private:
+    bool _enabled = true;
+
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+    void setEnabled(bool enabled) { _enabled = enabled; }
+
+    size_t write(uint8_t value) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    void flush() override;
+
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+
+    operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
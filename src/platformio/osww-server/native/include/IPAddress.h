@@ -0,0 +1,40 @@
+#ifndef IPAddress_H
+#define IPAddress_H
+
+#include <cstdint>
+
+#include "WString.h"
+
+class IPAddress
+{
+private:
+    uint8_t _octets[4];
+
+public:
+    IPAddress() : _octets{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _octets{a, b, c, d} {}
+    IPAddress(uint32_t address)
+    {
+        // Network byte order in memory, like lwIP
+        _octets[0] = address & 0xFF;
+        _octets[1] = (address >> 8) & 0xFF;
+        _octets[2] = (address >> 16) & 0xFF;
+        _octets[3] = (address >> 24) & 0xFF;
+    }
+
+    operator uint32_t() const
+    {
+        return (uint32_t)_octets[0] | ((uint32_t)_octets[1] << 8) | ((uint32_t)_octets[2] << 16) | ((uint32_t)_octets[3] << 24);
+    }
+
+    uint8_t operator[](int index) const { return _octets[index]; }
+    uint8_t &operator[](int index) { return _octets[index]; }
+    bool operator==(const IPAddress &other) const { return (uint32_t)*this == (uint32_t)other; }
+    bool operator!=(const IPAddress &other) const { return !(*this == other); }
+
+    bool fromString(const char *address);
+    bool fromString(const String &address) { return fromString(address.c_str()); }
+    String toString() const;
+};
+
+#endif
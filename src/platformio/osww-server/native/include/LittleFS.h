@@ -0,0 +1,29 @@
+#ifndef LittleFS_H
+#define LittleFS_H
+
+#include "FS.h"
+
+namespace fs
+{
+
+/**
+ * LittleFS on the host is a plain directory, see FS::setRoot()
+ */
+class LittleFSFS : public FS
+{
+private:
+    bool _mounted = false;
+
+public:
+    bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10, const char *partitionLabel = "spiffs");
+    void end() { _mounted = false; }
+    bool format();
+    size_t totalBytes();
+    size_t usedBytes();
+};
+
+} // namespace fs
+
+extern fs::LittleFSFS LittleFS;
+
+#endif
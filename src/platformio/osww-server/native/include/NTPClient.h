@@ -0,0 +1,44 @@
+#ifndef NTPClient_H
+#define NTPClient_H
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+/**
+ * NTP on the host answers with the emulated world clock, no packets are sent
+ */
+class NTPClient
+{
+private:
+    long _timeOffset;
+    unsigned long _lastUpdate = 0;
+    unsigned long _currentEpoch = 0;
+    bool _updated = false;
+
+public:
+    NTPClient(UDP &udp, const char *poolServerName = "pool.ntp.org", long timeOffset = 0, unsigned long updateInterval = 60000)
+        : _timeOffset(timeOffset)
+    {
+        (void)udp;
+        (void)poolServerName;
+        (void)updateInterval;
+    }
+
+    void begin(unsigned int port = 1337) { (void)port; }
+    void end() {}
+    bool update() { return forceUpdate(); }
+    bool forceUpdate();
+    bool isTimeSet() const { return _updated; }
+    void setTimeOffset(int timeOffset) { _timeOffset = timeOffset; }
+    void setPoolServerName(const char *poolServerName) { (void)poolServerName; }
+    void setUpdateInterval(unsigned long updateInterval) { (void)updateInterval; }
+
+    unsigned long getEpochTime() const;
+    int getDay() const { return (((getEpochTime() / 86400L) + 4) % 7); }
+    int getHours() const { return ((getEpochTime() % 86400L) / 3600); }
+    int getMinutes() const { return ((getEpochTime() % 3600) / 60); }
+    int getSeconds() const { return (getEpochTime() % 60); }
+    String getFormattedTime() const;
+};
+
+#endif
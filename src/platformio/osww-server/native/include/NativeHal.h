@@ -0,0 +1,64 @@
+#ifndef NativeHal_H
+#define NativeHal_H
+
+#include <cstdint>
+
+/*
+ * Controls for the emulated hardware behind the native build.
+ *
+ * The clock runs in real time by default. The simulator switches it to a
+ * virtual clock, where delay() advances time instantly instead of sleeping.
+ */
+
+typedef void (*NativePinWriteCallback)(uint8_t pin, uint8_t value, unsigned long atMillis);
+
+void nativeUseVirtualClock(bool enabled);
+bool nativeIsVirtualClock();
+void nativeAdvanceMillis(unsigned long ms);
+void nativeSetMillis(unsigned long ms);
+
+int nativeGetPinValue(uint8_t pin);
+void nativeSetPinInput(uint8_t pin, int value);
+uint32_t nativeGetLedcDuty(uint8_t channel);
+void nativeOnPinWrite(NativePinWriteCallback callback);
+
+void nativeSetAnalogInput(uint8_t pin, uint16_t value);
+
+// Continuous ADC (driver/adc.h): the 12-bit reading of ADC1 `channel` at `atMicros` of uptime.
+// Without a source every sample reads 0.
+typedef uint16_t (*NativeAdcSource)(uint8_t channel, unsigned long long atMicros);
+void nativeSetAdcSource(NativeAdcSource source);
+
+void nativeSetSerialEnabled(bool enabled);
+
+// Heap accounting (operator new/delete are tracked on the host)
+uint32_t nativeHeapInUse();
+uint32_t nativeHeapPeak();
+uint32_t nativeHeapAllocations();
+void nativeResetHeapPeak();
+
+// Wall clock. The RTC (ESP32Time) and "the world" (NTP) are tracked separately,
+// so RTC drift & deep sleep can be emulated.
+unsigned long long nativeWorldEpochMicros();
+unsigned long long nativeRtcEpochMicros();
+void nativeSetRtcEpochMicros(unsigned long long epochMicros);
+void nativeSetWorldEpoch(unsigned long epoch);
+void nativeSetRtcDriftPpm(long ppm);
+
+/**
+ * Thrown by ESP.restart() & esp_deep_sleep_start(). The emulator's main loop
+ * catches it and runs setup() again; RTC memory (plain statics) is kept.
+ */
+struct NativeRestart
+{
+    bool deepSleep;
+    unsigned long long sleepMicros;
+};
+
+/**
+ * Emulates the reboot that follows a NativeRestart: uptime starts from zero,
+ * and after deep sleep both clocks move on by the time spent asleep.
+ */
+void nativeReboot(const NativeRestart &restart);
+
+#endif
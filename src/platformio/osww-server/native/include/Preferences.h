@@ -0,0 +1,58 @@
+#ifndef Preferences_H
+#define Preferences_H
+
+#include <map>
+#include <vector>
+
+#include <Arduino.h>
+
+/**
+ * NVS on the host: one file per namespace, rewritten on every put.
+ * See nativeSetNvsRoot() for where the files live.
+ */
+class Preferences
+{
+private:
+    String _namespace;
+    bool _readOnly = false;
+    bool _open = false;
+    std::map<String, std::vector<uint8_t>> _entries;
+
+    void load();
+    void save();
+    size_t putRaw(const char *key, const void *value, size_t length);
+    size_t getRaw(const char *key, void *buffer, size_t maxLength) const;
+
+public:
+    bool begin(const char *name, bool readOnly = false, const char *partitionLabel = nullptr);
+    void end();
+    bool clear();
+    bool remove(const char *key);
+    bool isKey(const char *key) const { return _entries.count(String(key)) > 0; }
+    size_t freeEntries() { return 500 - _entries.size(); }
+
+    size_t putBytes(const char *key, const void *value, size_t length) { return putRaw(key, value, length); }
+    size_t getBytes(const char *key, void *buffer, size_t maxLength) const { return getRaw(key, buffer, maxLength); }
+    size_t getBytesLength(const char *key) const;
+
+    size_t putUChar(const char *key, uint8_t value) { return putRaw(key, &value, sizeof(value)); }
+    size_t putUShort(const char *key, uint16_t value) { return putRaw(key, &value, sizeof(value)); }
+    size_t putUInt(const char *key, uint32_t value) { return putRaw(key, &value, sizeof(value)); }
+    size_t putInt(const char *key, int32_t value) { return putRaw(key, &value, sizeof(value)); }
+    size_t putULong64(const char *key, uint64_t value) { return putRaw(key, &value, sizeof(value)); }
+    size_t putBool(const char *key, bool value) { return putUChar(key, value ? 1 : 0); }
+    size_t putString(const char *key, const char *value) { return putRaw(key, value, strlen(value) + 1); }
+    size_t putString(const char *key, const String &value) { return putString(key, value.c_str()); }
+
+    uint8_t getUChar(const char *key, uint8_t defaultValue = 0) const;
+    uint16_t getUShort(const char *key, uint16_t defaultValue = 0) const;
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0) const;
+    int32_t getInt(const char *key, int32_t defaultValue = 0) const;
+    uint64_t getULong64(const char *key, uint64_t defaultValue = 0) const;
+    bool getBool(const char *key, bool defaultValue = false) const { return getUChar(key, defaultValue ? 1 : 0) != 0; }
+    String getString(const char *key, const String &defaultValue = String()) const;
+};
+
+void nativeSetNvsRoot(const char *directory);
+
+#endif
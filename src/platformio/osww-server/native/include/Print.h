@@ -0,0 +1,57 @@
+#ifndef Print_H
+#define Print_H
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+
+class Print
+{
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t value) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *value) { return value ? write((const uint8_t *)value, strlen(value)) : 0; }
+    virtual void flush() {}
+
+    size_t print(const char *value) { return write(value); }
+    size_t print(const String &value) { return write((const uint8_t *)value.c_str(), value.length()); }
+    size_t print(char value) { return write((uint8_t)value); }
+    size_t print(int value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+    size_t print(unsigned int value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+    size_t print(long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+    size_t print(unsigned long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+    size_t print(long long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+    size_t print(unsigned long long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+    size_t print(double value, int decimalPlaces = 2) { return print(String(value, (unsigned int)decimalPlaces)); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(const T &value) { return print(value) + println(); }
+    template <typename T> size_t println(const T &value, int format) { return print(value, format) + println(); }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print
+{
+protected:
+    unsigned long _timeout = 1000;
+
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+    size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+    String readString();
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef Update_H
+#define Update_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+/*
+ * Arduino-ESP32's UpdateClass over the emulated partitions. Checks the image
+ * magic byte & selects the new boot partition like the real one; the image
+ * is stored, never run.
+ */
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+#define U_FLASH 0
+#define U_SPIFFS 100
+
+#define UPDATE_ERROR_OK 0
+#define UPDATE_ERROR_WRITE 1
+#define UPDATE_ERROR_ERASE 2
+#define UPDATE_ERROR_SPACE 4
+#define UPDATE_ERROR_SIZE 5
+#define UPDATE_ERROR_MAGIC_BYTE 7
+#define UPDATE_ERROR_NO_PARTITION 10
+#define UPDATE_ERROR_BAD_ARGUMENT 11
+#define UPDATE_ERROR_ABORT 12
+
+class UpdateClass
+{
+private:
+    const esp_partition_t *_partition = nullptr;
+    int _command = U_FLASH;
+    size_t _size = 0;
+    size_t _progress = 0;
+    uint8_t _error = UPDATE_ERROR_OK;
+
+public:
+    bool begin(size_t size = UPDATE_SIZE_UNKNOWN, int command = U_FLASH, int ledPin = -1, uint8_t ledOn = LOW, const char *label = nullptr);
+    size_t write(uint8_t *data, size_t len);
+    bool end(bool evenIfRemaining = false);
+    void abort();
+
+    bool isRunning() const { return _partition != nullptr; }
+    bool hasError() const { return _error != UPDATE_ERROR_OK; }
+    uint8_t getError() const { return _error; }
+    const char *errorString() const;
+    size_t size() const { return _size; }
+    size_t progress() const { return _progress; }
+    size_t remaining() const { return _size - _progress; }
+};
+
+extern UpdateClass Update;
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef WString_H
+#define WString_H
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+/**
+ * Host stand-in for Arduino's String, backed by std::string.
+ * Only covers the parts of the API Winderoo uses.
+ */
+class String
+{
+private:
+    std::string _buffer;
+
+public:
+    String() {}
+    String(const char *value) : _buffer(value ? value : "") {}
+    explicit String(const std::string &value) : _buffer(value) {}
+    String(const String &value) = default;
+    String(String &&value) = default;
+    explicit String(char value) : _buffer(1, value) {}
+    explicit String(unsigned char value, unsigned char base = 10);
+    explicit String(int value, unsigned char base = 10);
+    explicit String(unsigned int value, unsigned char base = 10);
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    explicit String(long long value, unsigned char base = 10);
+    explicit String(unsigned long long value, unsigned char base = 10);
+    explicit String(float value, unsigned int decimalPlaces = 2);
+    explicit String(double value, unsigned int decimalPlaces = 2);
+    explicit String(bool value) : _buffer(value ? "1" : "0") {}
+
+    String &operator=(const String &value) = default;
+    String &operator=(String &&value) = default;
+    String &operator=(const char *value)
+    {
+        _buffer = value ? value : "";
+        return *this;
+    }
+    String &operator=(bool value)
+    {
+        _buffer = value ? "1" : "0";
+        return *this;
+    }
+
+    const char *c_str() const { return _buffer.c_str(); }
+    unsigned int length() const { return _buffer.length(); }
+    bool isEmpty() const { return _buffer.empty(); }
+    void reserve(unsigned int size) { _buffer.reserve(size); }
+
+    long toInt() const { return atol(_buffer.c_str()); }
+    float toFloat() const { return atof(_buffer.c_str()); }
+    double toDouble() const { return atof(_buffer.c_str()); }
+
+    bool concat(const String &value)
+    {
+        _buffer += value._buffer;
+        return true;
+    }
+    bool concat(const char *value)
+    {
+        if (value)
+            _buffer += value;
+        return true;
+    }
+    bool concat(const char *value, unsigned int length)
+    {
+        _buffer.append(value, length);
+        return true;
+    }
+    bool concat(char value)
+    {
+        _buffer += value;
+        return true;
+    }
+    template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+    bool concat(T value) { return concat(String(value)); }
+
+    String &operator+=(const String &value) { concat(value); return *this; }
+    String &operator+=(const char *value) { concat(value); return *this; }
+    String &operator+=(char value) { concat(value); return *this; }
+    template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+    String &operator+=(T value) { concat(String(value)); return *this; }
+
+    bool equals(const String &value) const { return _buffer == value._buffer; }
+    bool equals(const char *value) const { return _buffer == (value ? value : ""); }
+    bool equalsIgnoreCase(const String &value) const;
+    bool operator==(const String &value) const { return equals(value); }
+    bool operator==(const char *value) const { return equals(value); }
+    bool operator!=(const String &value) const { return !equals(value); }
+    bool operator!=(const char *value) const { return !equals(value); }
+    bool operator<(const String &value) const { return _buffer < value._buffer; }
+
+    char charAt(unsigned int index) const { return index < _buffer.length() ? _buffer[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    char &operator[](unsigned int index) { return _buffer[index]; }
+
+    bool startsWith(const String &prefix) const { return _buffer.compare(0, prefix._buffer.length(), prefix._buffer) == 0; }
+    bool endsWith(const String &suffix) const;
+    int indexOf(char value, unsigned int fromIndex = 0) const;
+    int indexOf(const String &value, unsigned int fromIndex = 0) const;
+    int lastIndexOf(char value) const;
+    String substring(unsigned int beginIndex) const;
+    String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+    void replace(const String &find, const String &replacement);
+    void toLowerCase();
+    void toUpperCase();
+    void trim();
+
+    const std::string &str() const { return _buffer; }
+};
+
+inline String operator+(const String &lhs, const String &rhs)
+{
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+inline String operator+(const String &lhs, const char *rhs)
+{
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+inline String operator+(const char *lhs, const String &rhs)
+{
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+inline String operator+(const String &lhs, T rhs)
+{
+    String result(lhs);
+    result.concat(String(rhs));
+    return result;
+}
+
+inline bool operator==(const char *lhs, const String &rhs)
+{
+    return rhs.equals(lhs);
+}
+
+// Arduino's flash string helpers are no-ops on the host
+class __FlashStringHelper;
+#define F(string_literal) (string_literal)
+#define PSTR(string_literal) (string_literal)
+#define PROGMEM
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef WiFi_H
+#define WiFi_H
+
+#include <Arduino.h>
+
+#include "IPAddress.h"
+#include "WiFiClient.h"
+
+typedef enum
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3,
+} wifi_mode_t;
+
+typedef enum
+{
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6,
+    WL_NO_SHIELD = 255,
+} wl_status_t;
+
+/**
+ * Emulated station interface. The host is always "connected" to the
+ * network it runs on; the emulator can tweak RSSI & the lease for testing.
+ */
+class WiFiClass
+{
+private:
+    wifi_mode_t _mode = WIFI_OFF;
+    wl_status_t _status = WL_DISCONNECTED;
+    int8_t _rssi = -55;
+    int32_t _channel = 6;
+    uint8_t _bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    uint8_t _mac[6] = {0x02, 0x57, 0x44, 0x4E, 0x52, 0x01};
+    String _ssid = "native";
+    String _psk = "";
+    String _hostname = "winderoo";
+    IPAddress _localIP = IPAddress(127, 0, 0, 1);
+    IPAddress _gateway = IPAddress(127, 0, 0, 1);
+    IPAddress _subnet = IPAddress(255, 0, 0, 0);
+    IPAddress _dns = IPAddress(127, 0, 0, 1);
+    bool _staticConfig = false;
+
+public:
+    bool mode(wifi_mode_t mode)
+    {
+        _mode = mode;
+        return true;
+    }
+    wifi_mode_t getMode() { return _mode; }
+
+    wl_status_t begin();
+    wl_status_t begin(const char *ssid, const char *passphrase = nullptr, int32_t channel = 0, const uint8_t *bssid = nullptr, bool connect = true);
+    bool config(IPAddress localIP, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress());
+    bool disconnect(bool wifiOff = false, bool eraseAp = false);
+    bool reconnect() { return begin() == WL_CONNECTED; }
+    uint8_t waitForConnectResult(unsigned long timeoutLength = 60000);
+    wl_status_t status() { return _status; }
+    bool isConnected() { return _status == WL_CONNECTED; }
+    bool setSleep(bool enabled) { (void)enabled; return true; }
+    bool setAutoReconnect(bool autoReconnect) { (void)autoReconnect; return true; }
+    bool persistent(bool persistent) { (void)persistent; return true; }
+
+    bool setHostname(const char *hostname)
+    {
+        _hostname = hostname;
+        return true;
+    }
+    const char *getHostname() { return _hostname.c_str(); }
+
+    int8_t RSSI() { return _rssi; }
+    void setRSSI(int8_t rssi) { _rssi = rssi; }
+    int32_t channel() { return _channel; }
+    uint8_t *BSSID() { return _bssid; }
+    String BSSIDstr();
+    uint8_t *macAddress(uint8_t *mac);
+    void setMacAddress(const uint8_t *mac) { memcpy(_mac, mac, sizeof(_mac)); }
+    String macAddress();
+    String SSID() { return _ssid; }
+    String psk() { return _psk; }
+
+    IPAddress localIP() { return _localIP; }
+    IPAddress gatewayIP() { return _gateway; }
+    IPAddress subnetMask() { return _subnet; }
+    IPAddress dnsIP(uint8_t index = 0) { (void)index; return _dns; }
+};
+
+extern WiFiClass WiFi;
+
+#endif
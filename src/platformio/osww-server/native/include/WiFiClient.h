@@ -0,0 +1,37 @@
+#ifndef WiFiClient_H
+#define WiFiClient_H
+
+#include <Arduino.h>
+
+#include "IPAddress.h"
+
+class Client : public Stream
+{
+public:
+    virtual int connect(IPAddress ip, uint16_t port) = 0;
+    virtual int connect(const char *host, uint16_t port) = 0;
+    virtual uint8_t connected() = 0;
+    virtual void stop() = 0;
+    virtual operator bool() = 0;
+};
+
+/**
+ * Only handed to the MQTT client, which the native build never connects
+ */
+class WiFiClient : public Client
+{
+public:
+    int connect(IPAddress ip, uint16_t port) override { (void)ip; (void)port; return 0; }
+    int connect(const char *host, uint16_t port) override { (void)host; (void)port; return 0; }
+    uint8_t connected() override { return 0; }
+    void stop() override {}
+    operator bool() override { return false; }
+
+    size_t write(uint8_t value) override { (void)value; return 0; }
+    size_t write(const uint8_t *buffer, size_t size) override { (void)buffer; (void)size; return 0; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+#endif
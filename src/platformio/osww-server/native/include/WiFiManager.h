@@ -0,0 +1,45 @@
+#ifndef WiFiManager_H
+#define WiFiManager_H
+
+#include <functional>
+
+#include <WiFi.h>
+
+/**
+ * Host stand-in for tzapu's WiFiManager. Credentials are always "saved",
+ * so autoConnect() succeeds and the config portal never opens.
+ */
+class WiFiManager
+{
+private:
+    std::function<void()> _saveConfigCallback;
+    std::function<void()> _saveParamsCallback;
+    String _ssid = "native";
+    String _pass = "";
+
+public:
+    bool autoConnect(const char *apName = nullptr, const char *apPassword = nullptr)
+    {
+        (void)apName;
+        (void)apPassword;
+        WiFi.mode(WIFI_STA);
+        return WiFi.begin(_ssid.c_str(), _pass.c_str()) == WL_CONNECTED;
+    }
+
+    bool process() { return false; }
+    void resetSettings() { Serial.println("[NATIVE] - WiFiManager settings reset"); }
+    bool getWiFiIsSaved() { return true; }
+    String getWiFiSSID(bool persistent = true) { (void)persistent; return _ssid; }
+    String getWiFiPass(bool persistent = true) { (void)persistent; return _pass; }
+
+    void setConfigPortalTimeout(unsigned long seconds) { (void)seconds; }
+    void setConnectTimeout(unsigned long seconds) { (void)seconds; }
+    void setDarkMode(bool enabled) { (void)enabled; }
+    void setConfigPortalBlocking(bool shouldBlock) { (void)shouldBlock; }
+    void setEnableConfigPortal(bool enable) { (void)enable; }
+    bool setHostname(const char *hostname) { return WiFi.setHostname(hostname); }
+    void setSaveConfigCallback(std::function<void()> callback) { _saveConfigCallback = callback; }
+    void setSaveParamsCallback(std::function<void()> callback) { _saveParamsCallback = callback; }
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef WiFiUdp_H
+#define WiFiUdp_H
+
+#include <vector>
+
+#include <Arduino.h>
+
+#include "IPAddress.h"
+
+class UDP : public Stream
+{
+};
+
+/**
+ * WiFiUDP over a real host UDP socket. Multicast loops back, so several
+ * emulator instances on one machine can hear each other.
+ */
+class WiFiUDP : public UDP
+{
+private:
+    int _socket = -1;
+    uint16_t _localPort = 0;
+    IPAddress _remoteIP;
+    uint16_t _remotePort = 0;
+    IPAddress _txIP;
+    uint16_t _txPort = 0;
+    std::vector<uint8_t> _txBuffer;
+    std::vector<uint8_t> _rxBuffer;
+    size_t _rxPosition = 0;
+
+    bool openSocket(uint16_t port, bool reuse);
+
+public:
+    ~WiFiUDP() { stop(); }
+
+    uint8_t begin(uint16_t port);
+    uint8_t beginMulticast(IPAddress multicast, uint16_t port);
+    void stop();
+
+    int beginPacket(IPAddress ip, uint16_t port);
+    int beginPacket(const char *host, uint16_t port);
+    int beginMulticastPacket() { return beginPacket(_txIP, _txPort); }
+    int endPacket();
+    size_t write(uint8_t value) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+
+    int parsePacket();
+    int available() override;
+    int read() override;
+    int read(unsigned char *buffer, size_t length);
+    int read(char *buffer, size_t length) { return read((unsigned char *)buffer, length); }
+    int peek() override;
+    void flush() override {}
+
+    IPAddress remoteIP() { return _remoteIP; }
+    uint16_t remotePort() { return _remotePort; }
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef esp_adc_cal_H
+#define esp_adc_cal_H
+
+#include <cstdint>
+
+#include "driver/adc.h"
+
+/*
+ * ADC calibration on the host: readings are linear, 0 to 4095 spanning the
+ * attenuation's range (950, 1250, 1750 or 2450 mV).
+ */
+
+typedef enum
+{
+    ESP_ADC_CAL_VAL_EFUSE_VREF = 0,
+    ESP_ADC_CAL_VAL_EFUSE_TP = 1,
+    ESP_ADC_CAL_VAL_DEFAULT_VREF = 2
+} esp_adc_cal_value_t;
+
+typedef struct
+{
+    adc_unit_t adc_num;
+    adc_atten_t atten;
+    adc_bits_width_t bit_width;
+    uint32_t vref;
+} esp_adc_cal_characteristics_t;
+
+esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t adc_num, adc_atten_t atten, adc_bits_width_t bit_width, uint32_t default_vref, esp_adc_cal_characteristics_t *chars);
+uint32_t esp_adc_cal_raw_to_voltage(uint32_t adc_reading, const esp_adc_cal_characteristics_t *chars);
+
+/**
+ * The reading the host's ADC gives for a voltage, the inverse of esp_adc_cal_raw_to_voltage()
+ */
+uint16_t nativeAdcRawFromMillivolts(adc_atten_t atten, uint32_t millivolts);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef esp_attr_H
+#define esp_attr_H
+
+// Memory placement attributes have no meaning on the host, except for RTC memory:
+// it gets a section of its own, so the emulator can carry it across a reboot.
+#define RTC_DATA_ATTR __attribute__((section("native_rtc_data")))
+#define RTC_NOINIT_ATTR __attribute__((section("native_rtc_data")))
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define EXT_RAM_ATTR
+
+#endif
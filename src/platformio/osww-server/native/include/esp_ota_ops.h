@@ -0,0 +1,19 @@
+#ifndef esp_ota_ops_H
+#define esp_ota_ops_H
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+/*
+ * OTA slots on the host. Which app partition boots is kept in the otadata image,
+ * so the emulator boots "into" the slot an update selected; the code itself
+ * stays the emulator's own.
+ */
+
+const esp_partition_t *esp_ota_get_running_partition();
+const esp_partition_t *esp_ota_get_boot_partition();
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition);
+esp_err_t esp_ota_mark_app_valid_cancel_rollback();
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef esp_sleep_H
+#define esp_sleep_H
+
+#include <cstdint>
+
+#include "driver/gpio.h"
+#include "esp_err.h"
+
+typedef enum
+{
+    ESP_SLEEP_WAKEUP_UNDEFINED,
+    ESP_SLEEP_WAKEUP_ALL,
+    ESP_SLEEP_WAKEUP_EXT0,
+    ESP_SLEEP_WAKEUP_EXT1,
+    ESP_SLEEP_WAKEUP_TIMER,
+    ESP_SLEEP_WAKEUP_TOUCHPAD,
+    ESP_SLEEP_WAKEUP_ULP,
+    ESP_SLEEP_WAKEUP_GPIO,
+    ESP_SLEEP_WAKEUP_UART,
+} esp_sleep_wakeup_cause_t;
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us);
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t gpio_num, int level);
+
+/**
+ * Throws NativeRestart; the emulator fast-forwards the clocks & reboots
+ */
+[[noreturn]] void esp_deep_sleep_start();
+
+// Native only: lets the emulator restore the wake cause after a reboot
+void nativeSetWakeupCause(esp_sleep_wakeup_cause_t cause);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef FreeRTOS_H
+#define FreeRTOS_H
+
+/*
+ * FreeRTOS on the host: tasks are std::threads, queues & semaphores are
+ * built on std::mutex / std::condition_variable. One tick is one millisecond,
+ * as configured by Arduino-ESP32.
+ */
+
+#include <cstdint>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define errQUEUE_FULL 0
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+struct NativeSpinlock;
+typedef struct
+{
+    NativeSpinlock *lock;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {nullptr}
+#define portMUX_INITIALIZE(mux) ((mux)->lock = nullptr)
+
+void nativeEnterCritical(portMUX_TYPE *mux);
+void nativeExitCritical(portMUX_TYPE *mux);
+
+#define portENTER_CRITICAL(mux) nativeEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) nativeExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) nativeEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux) nativeExitCritical(mux)
+#define taskENTER_CRITICAL(mux) nativeEnterCritical(mux)
+#define taskEXIT_CRITICAL(mux) nativeExitCritical(mux)
+
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef FreeRTOS_task_H
+#define FreeRTOS_task_H
+
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+
+struct NativeTask;
+typedef NativeTask *TaskHandle_t;
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *createdTask);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *createdTask, BaseType_t core);
+
+// Only a task deleting itself (NULL) is supported
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+const char *pcTaskGetName(TaskHandle_t task);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+// Direct-to-task notifications, used as a lightweight binary semaphore
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait);
+
+// Waits for every task created so far to finish; host tools call it before exiting
+void nativeJoinTasks();
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef mdns_H
+#define mdns_H
+
+#include <cstdint>
+
+#include "esp_err.h"
+
+/*
+ * The ESP-IDF mDNS component, as much of it as the firmware calls directly.
+ * Lands in the recording MDNSResponder, see ESPmDNS.h.
+ */
+
+typedef struct
+{
+    const char *key;
+    const char *value;
+} mdns_txt_item_t;
+
+esp_err_t mdns_service_txt_set(const char *service_type, const char *proto, mdns_txt_item_t txt[], uint8_t num_items);
+
+#endif
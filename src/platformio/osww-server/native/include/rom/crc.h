@@ -0,0 +1,23 @@
+#ifndef rom_crc_H
+#define rom_crc_H
+
+#include <cstdint>
+
+/**
+ * The ESP32 ROM's CRC-32 (IEEE 802.3). Pass 0, or the previous result to continue.
+ */
+inline uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *buf++;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+#endif
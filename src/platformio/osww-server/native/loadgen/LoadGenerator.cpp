@@ -0,0 +1,365 @@
+/*
+ * HTTP load generator for Winderoo's API. Works against the emulator or a real device.
+ *
+ * Every client opens a connection per request (the firmware closes it after each
+ * response) and cycles through the selected endpoints. Reports requests, errors,
+ * throughput and p50/p99 latency per endpoint. A 503 from a command endpoint is
+ * the command queue pushing back, counted as busy rather than as an error.
+ *
+ * Usage:
+ *   loadgen [--host 127.0.0.1] [--port 8080] [--clients 8] [--duration 10]
+ *           [--endpoints status,update,power,timer,boot,static] [--json]
+ *
+ * `reset` is accepted in --endpoints but never selected by default: it wipes WiFi
+ * settings & reboots the target.
+ */
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SOCKET_TIMEOUT_SECONDS 10
+
+struct Endpoint
+{
+    const char *name;
+    const char *method;
+    const char *path;
+    const char *body;
+};
+
+// Bodies mirror what the web UI sends
+static const Endpoint endpoints[] = {
+    {"status", "GET", "/api/status", nullptr},
+    {"update", "POST", "/api/update", "{\"tpd\":\"330\",\"hour\":\"08\",\"minutes\":\"00\",\"timerEnabled\":\"0\",\"action\":\"STOP\",\"rotationDirection\":\"BOTH\",\"screenSleep\":false}"},
+    {"power", "POST", "/api/power", "{\"winderEnabled\":1}"},
+    {"timer", "POST", "/api/timer?timerEnabled=0", nullptr},
+    {"boot", "GET", "/api/boot", nullptr},
+    {"static", "GET", "/", nullptr},
+    {"reset", "GET", "/api/reset", nullptr},
+};
+
+#define ENDPOINT_COUNT (sizeof(endpoints) / sizeof(endpoints[0]))
+
+struct Options
+{
+    std::string host = "127.0.0.1";
+    uint16_t port = 8080;
+    int clients = 8;
+    int durationSeconds = 10;
+    std::vector<size_t> selected;
+    bool json = false;
+};
+
+struct Samples
+{
+    std::vector<double> latenciesMs;
+    unsigned long errors = 0;
+    unsigned long busy = 0;
+    unsigned long bytes = 0;
+};
+
+/**
+ * Sends one request on a fresh connection & reads until the server closes it
+ *
+ * @return HTTP status, or -1 on a connection error
+ */
+static int execute(const sockaddr_in &address, const Options &options, const Endpoint &endpoint, unsigned long &bytes)
+{
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    if (client < 0)
+    {
+        return -1;
+    }
+
+    timeval timeout = {SOCKET_TIMEOUT_SECONDS, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    int enable = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    if (connect(client, (const sockaddr *)&address, sizeof(address)) < 0)
+    {
+        close(client);
+        return -1;
+    }
+
+    std::ostringstream request;
+    request << endpoint.method << " " << endpoint.path << " HTTP/1.1\r\n"
+            << "Host: " << options.host << "\r\n"
+            << "Connection: close\r\n";
+    if (endpoint.body)
+    {
+        request << "Content-Type: application/json\r\n"
+                << "Content-Length: " << strlen(endpoint.body) << "\r\n";
+    }
+    else if (!strcmp(endpoint.method, "POST"))
+    {
+        request << "Content-Length: 0\r\n";
+    }
+    request << "\r\n";
+    if (endpoint.body)
+    {
+        request << endpoint.body;
+    }
+
+    std::string raw = request.str();
+    if (send(client, raw.data(), raw.size(), MSG_NOSIGNAL) != (ssize_t)raw.size())
+    {
+        close(client);
+        return -1;
+    }
+
+    std::string response;
+    char buffer[4096];
+    ssize_t received;
+    while ((received = recv(client, buffer, sizeof(buffer), 0)) > 0)
+    {
+        response.append(buffer, received);
+    }
+    close(client);
+
+    bytes += response.size();
+
+    int status = -1;
+    if (sscanf(response.c_str(), "HTTP/1.%*d %d", &status) != 1)
+    {
+        return -1;
+    }
+    return status;
+}
+
+static double percentile(const std::vector<double> &sorted, double fraction)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static bool parseEndpoints(const std::string &list, std::vector<size_t> &selected)
+{
+    std::stringstream stream(list);
+    std::string name;
+    while (std::getline(stream, name, ','))
+    {
+        bool found = false;
+        for (size_t i = 0; i < ENDPOINT_COUNT; i++)
+        {
+            if (name == endpoints[i].name)
+            {
+                if (std::find(selected.begin(), selected.end(), i) == selected.end())
+                {
+                    selected.push_back(i);
+                }
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            fprintf(stderr, "unknown endpoint: %s\n", name.c_str());
+            return false;
+        }
+    }
+    return !selected.empty();
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--host") && hasValue)
+        {
+            options.host = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--port") && hasValue)
+        {
+            options.port = (uint16_t)atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--clients") && hasValue)
+        {
+            options.clients = std::max(1, atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--duration") && hasValue)
+        {
+            options.durationSeconds = std::max(1, atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--endpoints") && hasValue)
+        {
+            if (!parseEndpoints(argv[++i], options.selected))
+            {
+                return false;
+            }
+        }
+        else if (!strcmp(argv[i], "--json"))
+        {
+            options.json = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--host H] [--port N] [--clients N] [--duration S] [--endpoints a,b,...] [--json]\n", argv[0]);
+            return false;
+        }
+    }
+
+    if (options.selected.empty())
+    {
+        parseEndpoints("status,update,power,timer,boot,static", options.selected);
+    }
+    return true;
+}
+
+static bool resolve(const Options &options, sockaddr_in &address)
+{
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result = nullptr;
+    if (getaddrinfo(options.host.c_str(), nullptr, &hints, &result) != 0 || !result)
+    {
+        return false;
+    }
+    address = *(sockaddr_in *)result->ai_addr;
+    address.sin_port = htons(options.port);
+    freeaddrinfo(result);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        return 2;
+    }
+
+    sockaddr_in address;
+    if (!resolve(options, address))
+    {
+        fprintf(stderr, "cannot resolve %s\n", options.host.c_str());
+        return 1;
+    }
+
+    std::vector<Samples> totals(ENDPOINT_COUNT);
+    std::mutex totalsMutex;
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> clients;
+
+    auto started = std::chrono::steady_clock::now();
+    for (int c = 0; c < options.clients; c++)
+    {
+        clients.emplace_back([&, c]() {
+            std::vector<Samples> local(ENDPOINT_COUNT);
+            // Offset each client so the endpoints are mixed at any instant
+            size_t next = c;
+
+            while (!stop)
+            {
+                size_t index = options.selected[next++ % options.selected.size()];
+                auto requestStarted = std::chrono::steady_clock::now();
+                int status = execute(address, options, endpoints[index], local[index].bytes);
+                double latencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - requestStarted).count();
+
+                if (status == 503)
+                {
+                    local[index].busy++;
+                }
+                else if (status < 200 || status >= 300)
+                {
+                    local[index].errors++;
+                }
+                else
+                {
+                    local[index].latenciesMs.push_back(latencyMs);
+                }
+            }
+
+            std::lock_guard<std::mutex> guard(totalsMutex);
+            for (size_t i = 0; i < ENDPOINT_COUNT; i++)
+            {
+                totals[i].latenciesMs.insert(totals[i].latenciesMs.end(), local[i].latenciesMs.begin(), local[i].latenciesMs.end());
+                totals[i].errors += local[i].errors;
+                totals[i].busy += local[i].busy;
+                totals[i].bytes += local[i].bytes;
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(options.durationSeconds));
+    stop = true;
+    for (std::thread &client : clients)
+    {
+        client.join();
+    }
+    double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    if (options.json)
+    {
+        printf("{\"clients\":%d,\"durationSeconds\":%.2f,\"endpoints\":{", options.clients, elapsedSeconds);
+    }
+    else
+    {
+        printf("%d clients, %.1f s against %s:%u\n\n", options.clients, elapsedSeconds, options.host.c_str(), options.port);
+        printf("%-8s %9s %7s %7s %9s %9s %9s %9s\n", "endpoint", "requests", "errors", "busy", "req/s", "p50_ms", "p99_ms", "max_ms");
+    }
+
+    unsigned long allRequests = 0;
+    unsigned long allErrors = 0;
+    unsigned long allBusy = 0;
+    bool first = true;
+    for (size_t index : options.selected)
+    {
+        Samples &samples = totals[index];
+        std::sort(samples.latenciesMs.begin(), samples.latenciesMs.end());
+
+        unsigned long requests = samples.latenciesMs.size() + samples.errors + samples.busy;
+        double throughput = requests / elapsedSeconds;
+        double p50 = percentile(samples.latenciesMs, 0.50);
+        double p99 = percentile(samples.latenciesMs, 0.99);
+        double max = samples.latenciesMs.empty() ? 0 : samples.latenciesMs.back();
+        allRequests += requests;
+        allErrors += samples.errors;
+        allBusy += samples.busy;
+
+        if (options.json)
+        {
+            printf("%s\"%s\":{\"requests\":%lu,\"errors\":%lu,\"busy\":%lu,\"throughput\":%.1f,\"p50Ms\":%.2f,\"p99Ms\":%.2f,\"maxMs\":%.2f}",
+                first ? "" : ",", endpoints[index].name, requests, samples.errors, samples.busy, throughput, p50, p99, max);
+        }
+        else
+        {
+            printf("%-8s %9lu %7lu %7lu %9.1f %9.2f %9.2f %9.2f\n", endpoints[index].name, requests, samples.errors, samples.busy, throughput, p50, p99, max);
+        }
+        first = false;
+    }
+
+    if (options.json)
+    {
+        printf("},\"requests\":%lu,\"errors\":%lu,\"busy\":%lu,\"throughput\":%.1f}\n", allRequests, allErrors, allBusy, allRequests / elapsedSeconds);
+    }
+    else
+    {
+        printf("\n%-8s %9lu %7lu %7lu %9.1f\n", "total", allRequests, allErrors, allBusy, allRequests / elapsedSeconds);
+    }
+
+    return allErrors == 0 ? 0 : 1;
+}
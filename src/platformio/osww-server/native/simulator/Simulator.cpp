@@ -0,0 +1,1213 @@
+/*
+ * Discrete-event simulator for Winderoo's winding sessions.
+ *
+ * Runs the firmware's own WindingRoutine, timer check & MotorControl against a
+ * virtual clock: one event per loop() tick while a session runs, and a jump
+ * straight to the next timer start while idle. Motor on-time is measured from
+ * the GPIO writes, not from what the routine thinks it did.
+ *
+ * A power cut can be dropped into the session: the motor stops, and after the
+ * outage the session resumes from its last checkpoint, as the firmware does.
+ *
+ * With --stepper the motor is a stepper instead of a DC motor: StepWaveform's
+ * items are played out against the virtual clock, as the RMT would send
+ * them, and turns are measured by counting the STEP pulses. The waveform of
+ * single moves is checked too: exact step counts, the speed limit & the time
+ * a trapezoidal profile should take.
+ *
+ * With --pattern the session runs a winding pattern instead of the classic
+ * motion; it must deliver its turns & finish when PatternEngine said it
+ * would. Pattern sources are checked against the compiler too: errors where
+ * they belong, & decompiled code compiling back to the same bytes.
+ *
+ * Also feeds MotorLoad synthetic motor current (ripple, noise, inrush, jams,
+ * a dragging cushion, a loose wire) and checks what it reports.
+ *
+ * Usage:
+ *   simulator                      sweep TPD 100-960 in CW, CCW & BOTH, then the load scenarios; exit 1 on any failure
+ *   simulator --tpd 330 --direction BOTH [--timer 08:00] [--hours 24] [--seed 1] [--power-cut 50] [--stepper] [--verbose]
+ *   simulator --stepper            the stepper sweep & step profiles only
+ *   simulator --pattern "turn 15; pause 10m" [--tpd 330] [--stepper]
+ *   simulator --patterns           the pattern sources & sessions only
+ *   simulator --load               the load scenarios only
+ */
+
+#include <Arduino.h>
+#include <ESP32Time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "NativeHal.h"
+#include "../../src/utils/MotorControl.h"
+#include "../../src/utils/HBridgeDriver.h"
+#include "../../src/utils/StepWaveform.h"
+#include "../../src/utils/WindingRoutine.h"
+#include "../../src/utils/CheckpointStore.h"
+#include "../../src/utils/MotorLoad.h"
+#include "../../src/utils/PatternCompiler.h"
+#include "../../src/utils/Logger.h"
+
+// Must match the configurables in main.cpp
+#define SECONDS_PER_REVOLUTION 8
+#define PIN_A 25
+#define PIN_B 26
+#define STEPS_PER_TURN (200 * 16)
+#define STEPPER_ACCELERATION 1600
+#define STEPPER_CHUNK_ITEMS 64
+
+// 2023-01-01 00:00:00, any midnight will do
+#define SIMULATION_START_EPOCH 1672531200UL
+
+// Regression limits
+#define MAX_TURN_ERROR_PERCENT 2.0
+// A rest right before the finish can carry the last update past it
+#define MAX_ETA_ERROR_SECONDS (WINDING_REST_DURATION_MS / 1000 + 1)
+#define MAX_DIRECTION_IMBALANCE_PERCENT 10.0
+// Power cuts: how long the power stays off, & the turning since the last checkpoint that's repeated
+#define POWER_CUT_OUTAGE_SECONDS 300
+#define MAX_REPEATED_TURNS (CHECKPOINT_INTERVAL_SECONDS / SECONDS_PER_REVOLUTION + 1)
+// Stepper: each stretch ends up to a loop tick before update() notices, & its ramps take a little longer than cruising
+#define MAX_STRETCH_LATENESS_SECONDS 2
+// Patterns: the last segment ends up to a loop tick before update() notices, a stepper's last move a little over its plan
+#define MAX_PATTERN_ETA_ERROR_SECONDS 2
+// Step profiles: the time a move takes, against an ideal trapezoid
+#define MAX_PROFILE_TIME_ERROR_PERCENT 2.0
+
+// Load scenarios: blocks as CurrentSensor delivers them, defaults from main.cpp
+#define LOAD_BLOCK_MS 13
+#define LOAD_STALL_MILLIAMPS 400
+#define LOAD_SUPPLY_MILLIVOLTS 5000
+#define LOAD_DURATION_MS (10 * 60 * 1000UL)
+#define LOAD_INRUSH_MILLIAMPS 450.0
+#define LOAD_INRUSH_DECAY_MS 40.0
+#define LOAD_JAM_MILLIAMPS 650.0
+#define LOAD_SPIKE_MILLIAMPS 900.0
+// From the jam to the stall report: the stall time, plus the moving average catching up
+#define MAX_STALL_DETECT_MS (MOTOR_STALL_MS + MOTOR_LOAD_WINDOW * LOAD_BLOCK_MS + LOAD_BLOCK_MS)
+
+enum MotorState
+{
+    MOTOR_STOPPED,
+    MOTOR_CW,
+    MOTOR_CCW
+};
+
+struct SimulationConfig
+{
+    int rotationsPerDay = 330;
+    String direction = "BOTH";
+    int timerHour = 8;
+    int timerMinute = 0;
+    int hours = 24;
+    unsigned int seed = 1;
+    int powerCutPercent = 0; // of the session's duration, 0 for none
+    bool stepper = false;
+    const char *pattern = nullptr; // source, the classic motion if none
+};
+
+struct SimulationResult
+{
+    bool started = false;
+    bool finished = false;
+    unsigned long startEpoch = 0;
+    unsigned long estimatedFinishEpoch = 0;
+    unsigned long actualFinishEpoch = 0;
+    double cwSeconds = 0;
+    double ccwSeconds = 0;
+    uint64_t cwSteps = 0;
+    uint64_t ccwSteps = 0;
+    std::vector<unsigned long> pauseEpochs;
+    unsigned long events = 0;
+    bool resumed = false;
+    int resumedTurns = 0;
+    unsigned int checkpoints = 0;
+};
+
+/**
+ * Follows the H-bridge inputs and integrates motor on-time per direction
+ */
+static struct
+{
+    int pinA = LOW;
+    int pinB = LOW;
+    MotorState state = MOTOR_STOPPED;
+    unsigned long sinceMs = 0;
+    SimulationResult *result = nullptr;
+} motorProbe;
+
+static MotorState stateFromPins(int pinA, int pinB)
+{
+    if (pinA == HIGH && pinB == LOW)
+    {
+        return MOTOR_CW;
+    }
+    if (pinA == LOW && pinB == HIGH)
+    {
+        return MOTOR_CCW;
+    }
+    return MOTOR_STOPPED;
+}
+
+static void closeInterval(unsigned long atMillis)
+{
+    double seconds = (atMillis - motorProbe.sinceMs) / 1000.0;
+    if (motorProbe.state == MOTOR_CW)
+    {
+        motorProbe.result->cwSeconds += seconds;
+    }
+    else if (motorProbe.state == MOTOR_CCW)
+    {
+        motorProbe.result->ccwSeconds += seconds;
+    }
+    motorProbe.sinceMs = atMillis;
+}
+
+static void onPinWrite(uint8_t pin, uint8_t value, unsigned long atMillis)
+{
+    if (pin == PIN_A)
+    {
+        motorProbe.pinA = value;
+    }
+    else if (pin == PIN_B)
+    {
+        motorProbe.pinB = value;
+    }
+    else
+    {
+        return;
+    }
+
+    MotorState next = stateFromPins(motorProbe.pinA, motorProbe.pinB);
+    if (next == motorProbe.state)
+    {
+        return;
+    }
+
+    closeInterval(atMillis);
+    motorProbe.state = next;
+}
+
+/**
+ * A stepper on the virtual clock: StepWaveform's items go out as time passes,
+ * as the RMT would send them, and every pulse is counted in its direction.
+ * Behaves like StepperDriver, blocking to slow down before a new move.
+ */
+class SimulatedStepper : public MotorDriver
+{
+private:
+    StepWaveform _waveform;
+    STEP_ITEM _items[STEPPER_CHUNK_ITEMS];
+    size_t _count = 0;
+    size_t _next = 0;
+    unsigned long long _nextItemMicros = 0;
+    int _direction = 0; // 0 once the last item is out
+    uint64_t _steps = 0;
+    SimulationResult *_result;
+
+    void advance()
+    {
+        unsigned long long now = micros();
+        while (_direction != 0 && _nextItemMicros <= now)
+        {
+            if (_next == _count)
+            {
+                _count = _waveform.fill(_items, STEPPER_CHUNK_ITEMS);
+                _next = 0;
+                if (_count == 0)
+                {
+                    _direction = 0;
+                    break;
+                }
+            }
+
+            const STEP_ITEM &item = _items[_next++];
+            if (item.level0)
+            {
+                _steps++;
+                (_direction > 0 ? _result->cwSteps : _result->ccwSteps)++;
+            }
+            (_direction > 0 ? _result->cwSeconds : _result->ccwSeconds) += (item.duration0 + item.duration1) / (double)STEP_TICKS_PER_SECOND;
+            _nextItemMicros += item.duration0 + item.duration1;
+        }
+    }
+
+public:
+    SimulatedStepper(SimulationResult *result) : _result(result)
+    {
+    }
+
+    void drive(int direction) override
+    {
+        advance();
+        if (direction == 0)
+        {
+            _waveform.stop();
+        }
+        else if (direction != _direction || _waveform.getPlannedSteps() != UINT32_MAX)
+        {
+            move(direction, UINT32_MAX / STEPS_PER_TURN + 1, 60.0f / SECONDS_PER_REVOLUTION);
+        }
+    }
+
+    bool countsTurns() override
+    {
+        return true;
+    }
+
+    void move(int direction, uint32_t turns, float turnsPerMinute) override
+    {
+        advance();
+        _waveform.stop();
+        while (isMoving())
+        {
+            delay(1);
+        }
+
+        _waveform.begin(StepWaveform::forTurns(turns, turnsPerMinute, STEPS_PER_TURN, STEPPER_ACCELERATION));
+        _count = 0;
+        _next = 0;
+        _nextItemMicros = micros();
+        _direction = direction;
+    }
+
+    bool isMoving() override
+    {
+        advance();
+        return _direction != 0;
+    }
+
+    uint32_t getTurnsMoved() override
+    {
+        advance();
+        return (uint32_t)(_steps / STEPS_PER_TURN);
+    }
+
+    float getRampSeconds(float turnsPerMinute) override
+    {
+        return turnsPerMinute * STEPS_PER_TURN / 60.0f / STEPPER_ACCELERATION;
+    }
+};
+
+/**
+ * Simulates `hours` of the firmware's loop() from midnight, with the timer set
+ * to start one session.
+ */
+static SimulationResult simulate(const SimulationConfig &config)
+{
+    SimulationResult result;
+
+    nativeUseVirtualClock(true);
+    nativeSetMillis(0);
+    srand(config.seed);
+
+    ESP32Time rtc;
+    rtc.setTime(SIMULATION_START_EPOCH);
+
+    HBridgeDriver bridge(PIN_A, PIN_B);
+    SimulatedStepper stepper(&result);
+    MotorControl motor(config.stepper ? (MotorDriver &)stepper : (MotorDriver &)bridge);
+    WindingRoutine winder(motor, SECONDS_PER_REVOLUTION);
+
+    if (config.pattern != nullptr)
+    {
+        // As beginWindingRoutine() does with the active pattern
+        WINDING_PATTERN pattern = {};
+        char error[PATTERN_ERROR_SIZE];
+        if (!PatternCompiler::compile(config.pattern, pattern, error, sizeof(error)))
+        {
+            fprintf(stderr, "pattern: %s\n", error);
+            return result;
+        }
+        winder.setPattern(&pattern);
+    }
+
+    motorProbe = {};
+    motorProbe.result = &result;
+    nativeOnPinWrite(onPinWrite);
+
+    unsigned long endEpoch = SIMULATION_START_EPOCH + (unsigned long)config.hours * 3600UL;
+    unsigned long timerEpoch = SIMULATION_START_EPOCH + config.timerHour * 3600UL + config.timerMinute * 60UL;
+    unsigned long powerCutEpoch = 0;
+    unsigned long checkpointEpoch = 0;
+    WINDING_PROGRESS checkpoint;
+
+    while (rtc.getEpoch() < endEpoch)
+    {
+        result.events++;
+
+        if (!winder.isRunning())
+        {
+            if (winder.isTimerDue(config.timerHour, config.timerMinute, rtc.getHour(true), rtc.getMinute()) && !result.started)
+            {
+                result.started = true;
+                winder.begin(config.rotationsPerDay, config.direction, rtc.getEpoch());
+                result.startEpoch = rtc.getEpoch();
+                result.estimatedFinishEpoch = winder.getEstimatedFinishEpoch();
+                if (config.powerCutPercent > 0)
+                {
+                    powerCutEpoch = result.startEpoch + (result.estimatedFinishEpoch - result.startEpoch) * config.powerCutPercent / 100;
+                }
+
+                // As beginWindingRoutine() does
+                winder.getProgress(checkpoint);
+                checkpointEpoch = rtc.getEpoch();
+                result.checkpoints++;
+            }
+            else
+            {
+                // Nothing happens while idle; jump to the timer or the end of the run
+                unsigned long next = (!result.started && rtc.getEpoch() < timerEpoch) ? timerEpoch : endEpoch;
+                nativeAdvanceMillis((next - rtc.getEpoch()) * 1000UL);
+                continue;
+            }
+        }
+        else if (powerCutEpoch != 0 && rtc.getEpoch() >= powerCutEpoch)
+        {
+            // Everything since the last checkpoint is lost with the power
+            powerCutEpoch = 0;
+            winder.stop();
+            nativeAdvanceMillis(POWER_CUT_OUTAGE_SECONDS * 1000UL);
+
+            // As startMotorStage() does; begin() inside resets all the routine's state, like a restart
+            result.resumed = true;
+            result.resumedTurns = winder.resume(checkpoint, config.direction, rtc.getEpoch());
+            result.estimatedFinishEpoch = winder.getEstimatedFinishEpoch();
+            winder.getProgress(checkpoint);
+            checkpointEpoch = rtc.getEpoch();
+            result.checkpoints++;
+        }
+        else
+        {
+            unsigned long epoch = rtc.getEpoch();
+            unsigned long before = millis();
+            if (!winder.update(epoch))
+            {
+                result.finished = true;
+                result.actualFinishEpoch = epoch;
+            }
+            else if (millis() != before)
+            {
+                // update() only blocks when it rests
+                result.pauseEpochs.push_back(epoch);
+            }
+
+            // As CheckpointStore::update() does
+            if (winder.isRunning() && rtc.getEpoch() - checkpointEpoch >= CHECKPOINT_INTERVAL_SECONDS)
+            {
+                winder.getProgress(checkpoint);
+                checkpointEpoch = rtc.getEpoch();
+                result.checkpoints++;
+            }
+        }
+
+        // loop() listens for the button for a second between updates
+        delay(1000);
+    }
+
+    closeInterval(millis());
+    nativeOnPinWrite(nullptr);
+    return result;
+}
+
+struct Verdict
+{
+    double turns;
+    double cwTurns;
+    double ccwTurns;
+    double turnErrorPercent;
+    long etaErrorSeconds;
+    unsigned long minPauseGap;
+    unsigned long maxPauseGap;
+    bool passed;
+    String failure;
+};
+
+static Verdict judge(const SimulationConfig &config, const SimulationResult &result)
+{
+    Verdict verdict;
+    verdict.cwTurns = config.stepper ? (double)result.cwSteps / STEPS_PER_TURN : result.cwSeconds / SECONDS_PER_REVOLUTION;
+    verdict.ccwTurns = config.stepper ? (double)result.ccwSteps / STEPS_PER_TURN : result.ccwSeconds / SECONDS_PER_REVOLUTION;
+    verdict.turns = verdict.cwTurns + verdict.ccwTurns;
+    verdict.turnErrorPercent = (verdict.turns - config.rotationsPerDay) * 100.0 / config.rotationsPerDay;
+    verdict.etaErrorSeconds = result.finished ? (long)result.actualFinishEpoch - (long)result.estimatedFinishEpoch : 0;
+    verdict.minPauseGap = 0;
+    verdict.maxPauseGap = 0;
+    verdict.passed = true;
+
+    unsigned long previous = result.startEpoch;
+    for (unsigned long pause : result.pauseEpochs)
+    {
+        unsigned long gap = pause - previous;
+        verdict.minPauseGap = verdict.minPauseGap == 0 ? gap : std::min(verdict.minPauseGap, gap);
+        verdict.maxPauseGap = std::max(verdict.maxPauseGap, gap);
+        previous = pause;
+    }
+
+    if (!result.started || !result.finished)
+    {
+        verdict.passed = false;
+        verdict.failure = result.started ? "session did not finish" : "timer did not start a session";
+        return verdict;
+    }
+    if (config.powerCutPercent > 0 && (!result.resumed || result.resumedTurns <= 0))
+    {
+        verdict.passed = false;
+        verdict.failure = "session not resumed after the power cut";
+        return verdict;
+    }
+
+    // A stepper's turns are counted, so exact
+    double allowedTurns = config.stepper ? 0 : std::max(1.0, config.rotationsPerDay * MAX_TURN_ERROR_PERCENT / 100.0);
+    long allowedEtaSeconds = config.pattern != nullptr ? MAX_PATTERN_ETA_ERROR_SECONDS : MAX_ETA_ERROR_SECONDS;
+    if (config.stepper && config.pattern == nullptr)
+    {
+        allowedEtaSeconds += (long)(result.pauseEpochs.size() + 1) * MAX_STRETCH_LATENESS_SECONDS;
+    }
+    if (result.resumed)
+    {
+        // Delivered but not yet checkpointed when the power went, so delivered again; a pattern may turn faster
+        allowedTurns += config.pattern != nullptr ? MAX_REPEATED_TURNS * PATTERN_MAX_SPEED_PERCENT / 100 : MAX_REPEATED_TURNS;
+    }
+    if (std::abs(verdict.turns - config.rotationsPerDay) > allowedTurns)
+    {
+        verdict.passed = false;
+        verdict.failure = "turns delivered off target";
+    }
+    else if (std::abs(verdict.etaErrorSeconds) > allowedEtaSeconds)
+    {
+        verdict.passed = false;
+        verdict.failure = "finished away from the estimate";
+    }
+    // A pattern rests & reverses when it says so, rather than on the classic beat
+    else if (config.pattern != nullptr)
+    {
+        return verdict;
+    }
+    else if (!result.pauseEpochs.empty() && verdict.minPauseGap <= WINDING_REST_INTERVAL_SECONDS)
+    {
+        verdict.passed = false;
+        verdict.failure = "rests closer than the rest interval";
+    }
+    else if (config.direction == "CW" && verdict.ccwTurns > 0)
+    {
+        verdict.passed = false;
+        verdict.failure = "turned CCW in CW mode";
+    }
+    else if (config.direction == "CCW" && verdict.cwTurns > 0)
+    {
+        verdict.passed = false;
+        verdict.failure = "turned CW in CCW mode";
+    }
+    // Directions alternate every rest. Allow one unpaired stretch between rests,
+    // plus some drift since the stretches vary in length
+    else if (config.direction == "BOTH" && std::abs(verdict.cwTurns - verdict.ccwTurns) > (double)verdict.maxPauseGap / SECONDS_PER_REVOLUTION + verdict.turns * MAX_DIRECTION_IMBALANCE_PERCENT / 100.0)
+    {
+        verdict.passed = false;
+        verdict.failure = "directions out of balance";
+    }
+
+    return verdict;
+}
+
+static const char *motorLoadEventNames[] = {"none", "heavy", "disconnected", "stalled", "jammed"};
+
+struct LoadScenario
+{
+    const char *name;
+    double runningMilliamps;
+    double heavyMilliamps;        // from heavyFromMs on, 0 for never
+    unsigned long heavyFromMs;
+    unsigned long jamFromMs[2];   // 0 for no jam
+    unsigned long jamUntilMs[2];  // 0 for for good
+    int spikePercent;             // chance per block of a one block spike
+    MotorLoadEvent expectedWorst;
+    int expectedStalls;
+};
+
+// Rests as in WindingRoutine, so every scenario crosses inrush after restarts
+static const LoadScenario loadScenarios[] = {
+    {"normal", 120, 0, 0, {0, 0}, {0, 0}, 0, MOTOR_LOAD_NONE, 0},
+    {"noise spikes", 120, 0, 0, {0, 0}, {0, 0}, 3, MOTOR_LOAD_NONE, 0},
+    {"jam, freed by a retry", 120, 0, 0, {60000, 0}, {62000, 0}, 0, MOTOR_LOAD_STALLED, 1},
+    {"jams far apart", 120, 0, 0, {60000, 300000}, {61000, 301000}, 0, MOTOR_LOAD_STALLED, 2},
+    {"jam for good", 120, 0, 0, {60000, 0}, {0, 0}, 0, MOTOR_LOAD_JAMMED, MOTOR_STALL_RETRIES + 1},
+    {"jammed from the start", 120, 0, 0, {1, 0}, {0, 0}, 0, MOTOR_LOAD_JAMMED, MOTOR_STALL_RETRIES + 1},
+    {"cushion dragging", 120, 220, 30000, {0, 0}, {0, 0}, 0, MOTOR_LOAD_HEAVY, 0},
+    {"motor disconnected", 0, 0, 0, {0, 0}, {0, 0}, 0, MOTOR_LOAD_DISCONNECTED, 0},
+};
+
+struct LoadResult
+{
+    MotorLoadEvent worst = MOTOR_LOAD_NONE;
+    int events = 0;
+    int stalls = 0;
+    long detectMs = -1; // first stall after the first jam
+    uint32_t milliwattHours = 0;
+    bool passed = true;
+    const char *failure = "";
+};
+
+static bool isJammed(const LoadScenario &scenario, unsigned long ms)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (scenario.jamFromMs[i] > 0 && ms >= scenario.jamFromMs[i] && (scenario.jamUntilMs[i] == 0 || ms < scenario.jamUntilMs[i]))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * One session's worth of blocks through MotorLoad, reacting to its events like main.cpp does
+ */
+static LoadResult simulateLoad(const LoadScenario &scenario, unsigned int seed)
+{
+    LoadResult result;
+    MotorLoad load(LOAD_STALL_MILLIAMPS);
+    load.beginSession();
+    srand(seed);
+
+    bool turning = true;
+    unsigned long turningSinceMs = LOAD_BLOCK_MS;
+    unsigned long pausedUntilMs = 0;
+    unsigned long nextRestMs = WINDING_REST_INTERVAL_SECONDS * 1000UL;
+
+    for (unsigned long ms = LOAD_BLOCK_MS; ms <= LOAD_DURATION_MS; ms += LOAD_BLOCK_MS)
+    {
+        if (!turning && ms >= pausedUntilMs)
+        {
+            turning = true;
+            turningSinceMs = ms;
+        }
+        else if (turning && ms >= nextRestMs)
+        {
+            turning = false;
+            pausedUntilMs = ms + WINDING_REST_DURATION_MS;
+            nextRestMs += WINDING_REST_INTERVAL_SECONDS * 1000UL;
+        }
+
+        double milliamps = 0;
+        if (turning)
+        {
+            double sinceMs = ms - turningSinceMs + LOAD_BLOCK_MS / 2.0;
+            milliamps = scenario.heavyMilliamps > 0 && ms >= scenario.heavyFromMs ? scenario.heavyMilliamps : scenario.runningMilliamps;
+            if (scenario.runningMilliamps > 0)
+            {
+                milliamps += LOAD_INRUSH_MILLIAMPS * exp(-sinceMs / LOAD_INRUSH_DECAY_MS) + (rand() % 17 - 8);
+            }
+            if (isJammed(scenario, ms))
+            {
+                milliamps = LOAD_JAM_MILLIAMPS + (rand() % 17 - 8);
+            }
+            if (scenario.spikePercent > 0 && rand() % 100 < scenario.spikePercent)
+            {
+                milliamps = LOAD_SPIKE_MILLIAMPS;
+            }
+        }
+
+        MotorLoadEvent event = load.addSample((uint16_t)std::max(0.0, milliamps), turning, turningSinceMs, ms);
+        if (event == MOTOR_LOAD_NONE)
+        {
+            continue;
+        }
+
+        result.events++;
+        result.worst = std::max(result.worst, event);
+        if (event == MOTOR_LOAD_STALLED || event == MOTOR_LOAD_JAMMED)
+        {
+            if (result.detectMs < 0 && scenario.jamFromMs[0] > 0)
+            {
+                result.detectMs = (long)(ms - std::max(scenario.jamFromMs[0], turningSinceMs + MOTOR_INRUSH_MS));
+            }
+            if (event == MOTOR_LOAD_JAMMED)
+            {
+                break;
+            }
+            // retryAfterStall()
+            turning = false;
+            pausedUntilMs = ms + WINDING_STALL_PAUSE_MS;
+        }
+    }
+
+    result.stalls = load.getStalls();
+    result.milliwattHours = load.getMilliwattHours(LOAD_SUPPLY_MILLIVOLTS);
+
+    if (result.worst != scenario.expectedWorst)
+    {
+        result.passed = false;
+        result.failure = "unexpected event";
+    }
+    else if (result.stalls != scenario.expectedStalls)
+    {
+        result.passed = false;
+        result.failure = "wrong number of stalls";
+    }
+    else if (result.detectMs > MAX_STALL_DETECT_MS)
+    {
+        result.passed = false;
+        result.failure = "stall noticed too late";
+    }
+    return result;
+}
+
+static int runLoadScenarios(unsigned int seed)
+{
+    int failures = 0;
+
+    printf("%-24s %-12s %6s %6s %9s %5s  %s\n", "load scenario", "worst", "events", "stalls", "detect_ms", "mWh", "result");
+    for (const LoadScenario &scenario : loadScenarios)
+    {
+        LoadResult result = simulateLoad(scenario, seed);
+        printf("%-24s %-12s %6d %6d %9ld %5u  %s\n",
+            scenario.name,
+            motorLoadEventNames[result.worst],
+            result.events,
+            result.stalls,
+            result.detectMs,
+            (unsigned)result.milliwattHours,
+            result.passed ? "ok" : result.failure);
+        failures += result.passed ? 0 : 1;
+    }
+
+    printf("\n%zu load scenarios, %d failed\n", sizeof(loadScenarios) / sizeof(loadScenarios[0]), failures);
+    return failures == 0 ? 0 : 1;
+}
+
+struct ProfileScenario
+{
+    const char *name;
+    STEP_PROFILE profile;
+    uint32_t stopAfter; // steps before stop() is called, 0 for never
+};
+
+// Winder moves at 7.5 rpm with the defaults from main.cpp, then the extremes
+static const ProfileScenario profileScenarios[] = {
+    {"one step", {1, 400, STEPPER_ACCELERATION}, 0},
+    {"two steps", {2, 400, STEPPER_ACCELERATION}, 0},
+    {"too short to cruise", {60, 400, STEPPER_ACCELERATION}, 0},
+    {"one turn", {STEPS_PER_TURN, 400, STEPPER_ACCELERATION}, 0},
+    {"stretch of 23 turns", {23 * STEPS_PER_TURN, 400, STEPPER_ACCELERATION}, 0},
+    {"slow, steps over 65 ms", {200, 10, 5}, 0},
+    {"fast", {64000, 20000, 40000}, 0},
+    {"top speed", {200000, STEP_MAX_STEPS_PER_SECOND, 1000000}, 0},
+    {"stopped speeding up", {STEPS_PER_TURN, 400, STEPPER_ACCELERATION}, 20},
+    {"stopped cruising", {STEPS_PER_TURN, 400, STEPPER_ACCELERATION}, 1000},
+};
+
+struct ProfileResult
+{
+    uint32_t steps = 0;
+    uint32_t items = 0;
+    double peakStepsPerSecond = 0;
+    double seconds = 0;
+    double idealSeconds = 0;
+    double timeErrorPercent = 0;
+    bool passed = true;
+    const char *failure = "";
+};
+
+/**
+ * A trapezoid's duration for `steps`: v/a to get up to speed & as long to stop,
+ * or a triangle if the move is too short to cruise
+ */
+static double idealProfileSeconds(uint32_t steps, double speed, double acceleration)
+{
+    double rampSteps = speed * speed / (2 * acceleration);
+    if (steps >= 2 * rampSteps)
+    {
+        return steps / speed + speed / acceleration;
+    }
+    return 2 * sqrt(steps / acceleration);
+}
+
+/**
+ * Plays one move's items back & checks them the way the RMT & the motor would see them
+ */
+static ProfileResult checkProfile(const ProfileScenario &scenario)
+{
+    ProfileResult result;
+    StepWaveform waveform;
+    waveform.begin(scenario.profile);
+
+    std::vector<uint64_t> pulseTicks; // rising edges
+    uint64_t ticks = 0;
+    STEP_ITEM items[STEPPER_CHUNK_ITEMS];
+    size_t count;
+    while ((count = waveform.fill(items, scenario.stopAfter > 0 ? 1 : STEPPER_CHUNK_ITEMS)) > 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            const STEP_ITEM &item = items[i];
+            if (item.duration0 == 0 || item.duration1 == 0)
+            {
+                result.passed = false;
+                result.failure = "zero duration ends the transmission early";
+            }
+            if (item.level1 || (item.level0 && item.duration0 != STEP_PULSE_TICKS))
+            {
+                result.passed = false;
+                result.failure = "malformed pulse";
+            }
+            if (item.level0)
+            {
+                pulseTicks.push_back(ticks);
+            }
+            ticks += item.duration0 + item.duration1;
+            result.items++;
+        }
+        if (scenario.stopAfter > 0 && waveform.getSteps() == scenario.stopAfter)
+        {
+            waveform.stop();
+        }
+    }
+
+    result.steps = pulseTicks.size();
+    result.seconds = ticks / (double)STEP_TICKS_PER_SECOND;
+    for (size_t i = 1; i < pulseTicks.size(); i++)
+    {
+        result.peakStepsPerSecond = std::max(result.peakStepsPerSecond, STEP_TICKS_PER_SECOND / (double)(pulseTicks[i] - pulseTicks[i - 1]));
+    }
+    uint64_t firstPeriod = pulseTicks.size() > 1 ? pulseTicks[1] : ticks;
+    uint64_t lastPeriod = ticks - (pulseTicks.empty() ? 0 : pulseTicks.back());
+
+    uint32_t speed = std::min(scenario.profile.stepsPerSecond, (uint32_t)STEP_MAX_STEPS_PER_SECOND);
+    result.idealSeconds = idealProfileSeconds(result.steps, speed, scenario.profile.acceleration);
+    result.timeErrorPercent = (result.seconds - result.idealSeconds) * 100.0 / result.idealSeconds;
+    // The first step is the one the approximation gets least right; a move of a few steps is mostly first step
+    double allowedSeconds = result.idealSeconds * MAX_PROFILE_TIME_ERROR_PERCENT / 100.0 + 2.0 * firstPeriod / STEP_TICKS_PER_SECOND;
+
+    uint32_t rampSteps = (uint32_t)ceil((double)speed * speed / (2.0 * scenario.profile.acceleration));
+    if (!result.passed)
+    {
+        return result;
+    }
+    if (scenario.stopAfter == 0 && result.steps != scenario.profile.steps)
+    {
+        result.passed = false;
+        result.failure = "wrong number of steps";
+    }
+    else if (scenario.stopAfter > 0 && (result.steps <= scenario.stopAfter || result.steps > scenario.stopAfter + rampSteps))
+    {
+        result.passed = false;
+        result.failure = "stop() didn't slow down to a stop";
+    }
+    else if (result.steps != waveform.getSteps())
+    {
+        result.passed = false;
+        result.failure = "pulses & counted steps differ";
+    }
+    else if (result.peakStepsPerSecond > speed * 1.01)
+    {
+        result.passed = false;
+        result.failure = "faster than the profile's speed";
+    }
+    else if (std::abs(result.seconds - result.idealSeconds) > allowedSeconds)
+    {
+        result.passed = false;
+        result.failure = "took too long or too short";
+    }
+    // Stopping mirrors starting, down to the first step's speed
+    else if (result.steps > 1 && std::abs((double)lastPeriod - (double)firstPeriod) > firstPeriod * 0.02 + 1)
+    {
+        result.passed = false;
+        result.failure = "doesn't stop the way it started";
+    }
+    return result;
+}
+
+static int runStepProfiles()
+{
+    int failures = 0;
+
+    printf("%-24s %7s %7s %7s %9s %10s %10s %6s  %s\n", "step profile", "sps", "steps", "items", "peak_sps", "time_s", "ideal_s", "err%", "result");
+    for (const ProfileScenario &scenario : profileScenarios)
+    {
+        ProfileResult result = checkProfile(scenario);
+        printf("%-24s %7u %7u %7u %9.0f %10.3f %10.3f %6.2f  %s\n",
+            scenario.name,
+            (unsigned)scenario.profile.stepsPerSecond,
+            (unsigned)result.steps,
+            (unsigned)result.items,
+            result.peakStepsPerSecond,
+            result.seconds,
+            result.idealSeconds,
+            result.timeErrorPercent,
+            result.passed ? "ok" : result.failure);
+        failures += result.passed ? 0 : 1;
+    }
+
+    printf("\n%zu step profiles, %d failed\n", sizeof(profileScenarios) / sizeof(profileScenarios[0]), failures);
+    return failures == 0 ? 0 : 1;
+}
+
+static void printHeader()
+{
+    printf("%-5s %-4s %8s %8s %8s %7s %6s %7s %5s %9s %9s %8s  %s\n",
+        "tpd", "dir", "turns", "cw", "ccw", "err%", "eta_s", "on_s", "rests", "min_gap_s", "max_gap_s", "events", "result");
+}
+
+static void printRow(const SimulationConfig &config, const SimulationResult &result, const Verdict &verdict)
+{
+    printf("%-5d %-4s %8.1f %8.1f %8.1f %7.2f %6ld %7.0f %5zu %9lu %9lu %8lu  %s\n",
+        config.rotationsPerDay,
+        config.direction.c_str(),
+        verdict.turns,
+        verdict.cwTurns,
+        verdict.ccwTurns,
+        verdict.turnErrorPercent,
+        verdict.etaErrorSeconds,
+        result.cwSeconds + result.ccwSeconds,
+        result.pauseEpochs.size(),
+        verdict.minPauseGap,
+        verdict.maxPauseGap,
+        result.events,
+        verdict.passed ? "ok" : verdict.failure.c_str());
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+static int runSweep(const SimulationConfig &base)
+{
+    const char *directions[] = {"CW", "CCW", "BOTH"};
+    int runs = 0;
+    int failures = 0;
+    double slowestMs = 0;
+    auto started = std::chrono::steady_clock::now();
+
+    printHeader();
+    for (const char *direction : directions)
+    {
+        for (int tpd = 100; tpd <= 960; tpd += 10)
+        {
+            SimulationConfig config = base;
+            config.rotationsPerDay = tpd;
+            config.direction = direction;
+
+            auto runStarted = std::chrono::steady_clock::now();
+            SimulationResult result = simulate(config);
+            slowestMs = std::max(slowestMs, elapsedMs(runStarted));
+
+            Verdict verdict = judge(config, result);
+            printRow(config, result, verdict);
+
+            runs++;
+            failures += verdict.passed ? 0 : 1;
+        }
+    }
+
+    printf("\n%d runs of %d h, %d failed, %.0f ms total, slowest run %.1f ms\n", runs, base.hours, failures, elapsedMs(started), slowestMs);
+    return failures == 0 ? 0 : 1;
+}
+
+/**
+ * Cuts the power early, midway & late in sessions of a few lengths; each must
+ * still deliver its TPD, only repeating the turning since the last checkpoint
+ */
+static int runPowerCuts(const SimulationConfig &base)
+{
+    const char *directions[] = {"CW", "CCW", "BOTH"};
+    const int tpds[] = {100, 330, 960};
+    const int cuts[] = {10, 50, 90};
+    int runs = 0;
+    int failures = 0;
+
+    printf("power cut (%d s outage) at %%  ", POWER_CUT_OUTAGE_SECONDS);
+    printHeader();
+    for (const char *direction : directions)
+    {
+        for (int tpd : tpds)
+        {
+            for (int cut : cuts)
+            {
+                SimulationConfig config = base;
+                config.rotationsPerDay = tpd;
+                config.direction = direction;
+                config.powerCutPercent = cut;
+
+                SimulationResult result = simulate(config);
+                Verdict verdict = judge(config, result);
+                printf("%-31d ", cut);
+                printRow(config, result, verdict);
+
+                runs++;
+                failures += verdict.passed ? 0 : 1;
+            }
+        }
+    }
+
+    printf("\n%d power cuts, %d failed\n", runs, failures);
+    return failures == 0 ? 0 : 1;
+}
+
+struct PatternSource
+{
+    const char *source;
+    const char *error; // expected, nullptr if it should compile
+};
+
+static const PatternSource patternSources[] = {
+    {"turn 15; pause 10m", nullptr},
+    {"repeat 3 { turn 20; pause 1m }\nreverse # the other way\npause 5m", nullptr},
+    {"speed 50; turn 5; speed 150; turn 10; pause 30s; reverse", nullptr},
+    {"repeat 2 { repeat 2 { repeat 2 { repeat 2 { turn 1 } pause 1 } } reverse }", nullptr},
+    {"Turn 1\tPAUSE 1h;;", nullptr},
+    {"", "1:1: a pattern needs at least one turn"},
+    {"pause 1m", "1:9: a pattern needs at least one turn"},
+    {"turn", "1:5: expected a number after turn"},
+    {"turn 0", "1:6: turn takes 1 to 1000"},
+    {"turn 5\npause 13h", "2:7: pause takes 1 to 43200 seconds"},
+    {"turn 5 pause 10x", "1:16: unexpected 'x' after pause"},
+    {"speed 300 turn 1", "1:7: speed takes 25 to 200"},
+    {"spin 5", "1:1: expected turn, pause, reverse, speed or repeat"},
+    {"repeat 2 turn 1", "1:10: expected { after repeat"},
+    {"repeat 2 { }", "1:1: nothing to repeat"},
+    {"repeat 2 { turn 1", "1:18: missing }"},
+    {"turn 1 }", "1:8: } without a repeat"},
+    {"repeat 2 { repeat 2 { repeat 2 { repeat 2 { repeat 2 { turn 1 } } } } }", "1:45: repeats nest at most 4 deep"},
+    {"repeat 255 { pause 12h; turn 1 }", "1:33: pauses add up to more than 24 h"},
+    {"turn 1 turn 1 turn 1 turn 1 turn 1 turn 1 turn 1 turn 1 turn 1 turn 1 turn 1 turn 1 turn 1 turn 1 turn 1 turn 1 turn 1", "1:106: pattern too long, it must compile to 64 bytes"},
+};
+
+// Sessions of a few shapes: bursts, alternating sets, mixed speeds & one turn at a time
+static const char *patternSessions[] = {
+    "turn 15; pause 10m",
+    "repeat 3 { turn 20; pause 1m } reverse; pause 5m",
+    "speed 50; turn 5; speed 150; turn 10; pause 30s; reverse",
+    "turn 1; pause 3",
+};
+
+/**
+ * Compiles each source: errors must come out as expected, & what compiles
+ * must verify, & decompile to a source that compiles to the same code
+ */
+static int runPatternSources()
+{
+    int failures = 0;
+
+    printf("%-48s %5s  %s\n", "pattern source", "bytes", "result");
+    for (const PatternSource &entry : patternSources)
+    {
+        WINDING_PATTERN pattern = {};
+        WINDING_PATTERN again = {};
+        char error[PATTERN_ERROR_SIZE];
+        char decompiled[PATTERN_DECOMPILED_SIZE];
+        const char *failure = nullptr;
+
+        bool compiled = PatternCompiler::compile(entry.source, pattern, error, sizeof(error));
+        if (entry.error != nullptr)
+        {
+            failure = compiled ? "compiled, but shouldn't" : strcmp(error, entry.error) != 0 ? error : nullptr;
+        }
+        else if (!compiled)
+        {
+            failure = error;
+        }
+        else if (!PatternCompiler::verify(pattern))
+        {
+            failure = "doesn't verify";
+        }
+        else if (PatternCompiler::decompile(pattern, decompiled, sizeof(decompiled)) == 0 ||
+                 !PatternCompiler::compile(decompiled, again, error, sizeof(error)) ||
+                 again.length != pattern.length || memcmp(again.code, pattern.code, pattern.length) != 0)
+        {
+            failure = "decompiled source compiles differently";
+        }
+
+        char shown[48];
+        snprintf(shown, sizeof(shown), "%s", entry.source);
+        for (char *c = shown; *c != '\0'; c++)
+        {
+            *c = *c == '\n' || *c == '\t' ? ' ' : *c;
+        }
+        printf("%-48s %5u  %s\n", shown, (unsigned)pattern.length, failure == nullptr ? "ok" : failure);
+        failures += failure == nullptr ? 0 : 1;
+    }
+
+    printf("\n%zu pattern sources, %d failed\n", sizeof(patternSources) / sizeof(patternSources[0]), failures);
+    return failures == 0 ? 0 : 1;
+}
+
+/**
+ * Runs each pattern on both motors at a few TPDs, & through a power cut
+ */
+static int runPatterns(const SimulationConfig &base)
+{
+    const int tpds[] = {100, 330, 960};
+    const int cuts[] = {0, 50};
+    int runs = 0;
+    int failures = 0;
+
+    for (const char *source : patternSessions)
+    {
+        printf("pattern \"%s\"\n%-8s %-3s ", source, "motor", "cut");
+        printHeader();
+        for (int stepper = 0; stepper < 2; stepper++)
+        {
+            for (int tpd : tpds)
+            {
+                for (int cut : cuts)
+                {
+                    SimulationConfig config = base;
+                    config.rotationsPerDay = tpd;
+                    config.direction = "CW";
+                    config.stepper = stepper;
+                    config.powerCutPercent = cut;
+                    config.pattern = source;
+
+                    SimulationResult result = simulate(config);
+                    Verdict verdict = judge(config, result);
+                    printf("%-8s %-3d ", stepper ? "stepper" : "dc", cut);
+                    printRow(config, result, verdict);
+
+                    runs++;
+                    failures += verdict.passed ? 0 : 1;
+                }
+            }
+        }
+        printf("\n");
+    }
+
+    printf("%d pattern sessions, %d failed\n", runs, failures);
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    SimulationConfig config;
+    bool single = false;
+    bool loadOnly = false;
+    bool patternsOnly = false;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--tpd") && hasValue)
+        {
+            config.rotationsPerDay = atoi(argv[++i]);
+            single = true;
+        }
+        else if (!strcmp(argv[i], "--direction") && hasValue)
+        {
+            config.direction = argv[++i];
+            single = true;
+        }
+        else if (!strcmp(argv[i], "--timer") && hasValue)
+        {
+            sscanf(argv[++i], "%d:%d", &config.timerHour, &config.timerMinute);
+        }
+        else if (!strcmp(argv[i], "--hours") && hasValue)
+        {
+            config.hours = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--seed") && hasValue)
+        {
+            config.seed = (unsigned int)atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--power-cut") && hasValue)
+        {
+            config.powerCutPercent = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--stepper"))
+        {
+            config.stepper = true;
+        }
+        else if (!strcmp(argv[i], "--pattern") && hasValue)
+        {
+            config.pattern = argv[++i];
+            single = true;
+        }
+        else if (!strcmp(argv[i], "--patterns"))
+        {
+            patternsOnly = true;
+        }
+        else if (!strcmp(argv[i], "--load"))
+        {
+            loadOnly = true;
+        }
+        else if (!strcmp(argv[i], "--verbose"))
+        {
+            verbose = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--tpd N] [--direction CW|CCW|BOTH] [--timer HH:MM] [--hours H] [--seed S] [--power-cut PERCENT] [--stepper] [--pattern SOURCE] [--verbose] [--load] [--patterns]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // The firmware logs every motor write at debug level; keep that out of the report unless asked
+    nativeSetSerialEnabled(verbose);
+    if (verbose)
+    {
+        Log.setLevel(LOG_MOTOR, LOG_LEVEL_DEBUG);
+    }
+
+    if (loadOnly)
+    {
+        return runLoadScenarios(config.seed);
+    }
+    if (patternsOnly)
+    {
+        int sources = runPatternSources();
+        printf("\n");
+        return runPatterns(config) | sources;
+    }
+    if (!single && config.stepper)
+    {
+        int sweep = runSweep(config);
+        printf("\n");
+        return runStepProfiles() | sweep;
+    }
+    if (!single)
+    {
+        int sweep = runSweep(config);
+        printf("\n");
+        int powerCuts = runPowerCuts(config);
+        printf("\n");
+        SimulationConfig stepperConfig = config;
+        stepperConfig.stepper = true;
+        printf("stepper ");
+        int stepperSweep = runSweep(stepperConfig);
+        printf("\n");
+        int stepProfiles = runStepProfiles();
+        printf("\n");
+        int patternSources = runPatternSources();
+        printf("\n");
+        int patterns = runPatterns(config);
+        printf("\n");
+        return runLoadScenarios(config.seed) | sweep | powerCuts | stepperSweep | stepProfiles | patternSources | patterns;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    SimulationResult result = simulate(config);
+    double wallMs = elapsedMs(started);
+    Verdict verdict = judge(config, result);
+
+    printHeader();
+    printRow(config, result, verdict);
+    printf("\nrest starts (s from session start):");
+    for (unsigned long pause : result.pauseEpochs)
+    {
+        printf(" %lu", pause - result.startEpoch);
+    }
+    printf("\ncheckpoints written: %u", result.checkpoints);
+    if (result.resumed)
+    {
+        printf(", resumed after the power cut with %d turns left", result.resumedTurns);
+    }
+    printf("\nsimulated %d h in %.1f ms\n", config.hours, wallMs);
+
+    return verdict.passed ? 0 : 1;
+}
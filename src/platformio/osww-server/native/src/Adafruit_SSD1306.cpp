@@ -0,0 +1,214 @@
+#include <Adafruit_SSD1306.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+// Classic 5x7 font in a 6x8 cell
+#define GLYPH_WIDTH 6
+#define GLYPH_HEIGHT 8
+#define MAX_TEXT_LINES 16
+
+TwoWire Wire;
+
+void Adafruit_GFX::drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color)
+{
+    int16_t dx = abs(x1 - x0);
+    int16_t dy = -abs(y1 - y0);
+    int16_t sx = x0 < x1 ? 1 : -1;
+    int16_t sy = y0 < y1 ? 1 : -1;
+    int16_t error = dx + dy;
+
+    while (true)
+    {
+        drawPixel(x0, y0, color);
+        if (x0 == x1 && y0 == y1)
+        {
+            break;
+        }
+        int16_t doubled = 2 * error;
+        if (doubled >= dy)
+        {
+            error += dy;
+            x0 += sx;
+        }
+        if (doubled <= dx)
+        {
+            error += dx;
+            y0 += sy;
+        }
+    }
+}
+
+void Adafruit_GFX::drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+    drawFastHLine(x, y, w, color);
+    drawFastHLine(x, y + h - 1, w, color);
+    drawFastVLine(x, y, h, color);
+    drawFastVLine(x + w - 1, y, h, color);
+}
+
+void Adafruit_GFX::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+    for (int16_t row = y; row < y + h; row++)
+    {
+        for (int16_t column = x; column < x + w; column++)
+        {
+            drawPixel(column, row, color);
+        }
+    }
+}
+
+void Adafruit_GFX::drawTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color)
+{
+    drawLine(x0, y0, x1, y1, color);
+    drawLine(x1, y1, x2, y2, color);
+    drawLine(x2, y2, x0, y0, color);
+}
+
+void Adafruit_GFX::setCursor(int16_t x, int16_t y)
+{
+    flushText();
+    _cursorX = x;
+    _cursorY = y;
+}
+
+void Adafruit_GFX::flushText()
+{
+    if (_pendingText.length())
+    {
+        onText(_pendingX, _pendingY, _pendingText);
+        _pendingText = "";
+    }
+}
+
+void Adafruit_GFX::getTextBounds(const char *string, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h)
+{
+    *x1 = x;
+    *y1 = y;
+    *w = (uint16_t)(strlen(string) * GLYPH_WIDTH * _textSize);
+    *h = (uint16_t)(GLYPH_HEIGHT * _textSize);
+}
+
+size_t Adafruit_GFX::write(uint8_t value)
+{
+    if (value == '\n')
+    {
+        flushText();
+        _cursorX = 0;
+        _cursorY += GLYPH_HEIGHT * _textSize;
+        return 1;
+    }
+    if (value == '\r')
+    {
+        return 1;
+    }
+    if (!_pendingText.length())
+    {
+        _pendingX = _cursorX;
+        _pendingY = _cursorY;
+    }
+    _pendingText += (char)value;
+    _cursorX += GLYPH_WIDTH * _textSize;
+    return 1;
+}
+
+Adafruit_SSD1306::Adafruit_SSD1306(uint8_t width, uint8_t height, TwoWire *wire, int8_t resetPin, uint32_t clkDuring, uint32_t clkAfter)
+    : Adafruit_GFX(width, height), _buffer(width * height, 0), _shown(width * height, 0)
+{
+    (void)wire;
+    (void)resetPin;
+    (void)clkDuring;
+    (void)clkAfter;
+}
+
+bool Adafruit_SSD1306::begin(uint8_t switchvcc, uint8_t i2caddr, bool reset, bool periphBegin)
+{
+    (void)switchvcc;
+    (void)i2caddr;
+    (void)reset;
+    (void)periphBegin;
+    return true;
+}
+
+void Adafruit_SSD1306::onText(int16_t x, int16_t y, const String &text)
+{
+    // Fits "(-32768,-32768) "
+    char prefix[17];
+    snprintf(prefix, sizeof(prefix), "(%d,%d) ", x, y);
+    _textLines.push_back(String(prefix) + text);
+    if (_textLines.size() > MAX_TEXT_LINES)
+    {
+        _textLines.erase(_textLines.begin());
+    }
+}
+
+void Adafruit_SSD1306::display()
+{
+    flushText();
+    _shown = _buffer;
+    _shownTextLines = _textLines;
+    _frames++;
+}
+
+void Adafruit_SSD1306::clearDisplay()
+{
+    flushText();
+    std::fill(_buffer.begin(), _buffer.end(), 0);
+    _textLines.clear();
+}
+
+void Adafruit_SSD1306::ssd1306_command(uint8_t command)
+{
+    if (command == SSD1306_DISPLAYOFF)
+    {
+        _on = false;
+    }
+    else if (command == SSD1306_DISPLAYON)
+    {
+        _on = true;
+    }
+}
+
+void Adafruit_SSD1306::drawPixel(int16_t x, int16_t y, uint16_t color)
+{
+    if (x < 0 || y < 0 || x >= _width || y >= _height)
+    {
+        return;
+    }
+    uint8_t &pixel = _buffer[y * _width + x];
+    pixel = color == SSD1306_INVERSE ? !pixel : (color ? 1 : 0);
+}
+
+bool Adafruit_SSD1306::getPixel(int16_t x, int16_t y)
+{
+    if (x < 0 || y < 0 || x >= _width || y >= _height)
+    {
+        return false;
+    }
+    return _buffer[y * _width + x];
+}
+
+String Adafruit_SSD1306::renderAscii() const
+{
+    String art;
+    if (!_on)
+    {
+        return "(display off)\n";
+    }
+    for (int16_t y = 0; y < _height; y += 2)
+    {
+        for (int16_t x = 0; x < _width; x++)
+        {
+            bool top = _shown[y * _width + x];
+            bool bottom = y + 1 < _height && _shown[(y + 1) * _width + x];
+            art += (top != _inverted) || (bottom != _inverted) ? '#' : ' ';
+        }
+        art += '\n';
+    }
+    for (const String &line : _shownTextLines)
+    {
+        art += line;
+        art += '\n';
+    }
+    return art;
+}
@@ -0,0 +1,148 @@
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+
+#include <Arduino.h>
+
+#include "NativeHal.h"
+
+#define ADC_MAX_PATTERNS 8
+#define ADC_MAX_READING 4095
+
+static NativeAdcSource adcSource = nullptr;
+static bool adcInitialized = false;
+static bool adcStarted = false;
+static uint32_t adcBufferSamples = 0;
+static uint32_t adcSampleHz = 20000;
+static uint8_t adcPattern[ADC_MAX_PATTERNS];
+static uint32_t adcPatternCount = 0;
+static unsigned long long adcStartMicros = 0;
+// samples handed out since adc_digi_start()
+static unsigned long long adcSamplesRead = 0;
+
+// Range of each attenuation, in adc_atten_t order
+static const uint32_t attenuationMillivolts[] = {950, 1250, 1750, 2450};
+
+void nativeSetAdcSource(NativeAdcSource source)
+{
+    adcSource = source;
+}
+
+esp_err_t adc_digi_initialize(const adc_digi_init_config_t *init_config)
+{
+    if (!init_config || init_config->conv_num_each_intr == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    adcBufferSamples = init_config->max_store_buf_size / sizeof(adc_digi_output_data_t);
+    adcInitialized = true;
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_deinitialize()
+{
+    adcStarted = false;
+    adcInitialized = false;
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_controller_configure(const adc_digi_configuration_t *config)
+{
+    if (!config || config->pattern_num == 0 || config->pattern_num > ADC_MAX_PATTERNS || config->sample_freq_hz == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (uint32_t i = 0; i < config->pattern_num; i++)
+    {
+        adcPattern[i] = config->adc_pattern[i].channel;
+    }
+    adcPatternCount = config->pattern_num;
+    adcSampleHz = config->sample_freq_hz;
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_start()
+{
+    if (!adcInitialized || adcPatternCount == 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    adcStartMicros = micros();
+    adcSamplesRead = 0;
+    adcStarted = true;
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_stop()
+{
+    adcStarted = false;
+    return ESP_OK;
+}
+
+static unsigned long long samplesConverted()
+{
+    return (unsigned long long)(micros() - adcStartMicros) * adcSampleHz / 1000000ULL;
+}
+
+/**
+ * Waits until a full buffer's worth has been converted, or the timeout. Like the
+ * driver, drops the oldest samples & reports ESP_ERR_INVALID_STATE when the
+ * reader fell further behind than the driver's buffer.
+ */
+esp_err_t adc_digi_read_bytes(uint8_t *buf, uint32_t length_max, uint32_t *out_length, uint32_t timeout_ms)
+{
+    *out_length = 0;
+    if (!adcStarted)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    unsigned long long wanted = length_max / sizeof(adc_digi_output_data_t);
+    for (uint32_t waited = 0; samplesConverted() - adcSamplesRead < wanted && waited < timeout_ms; waited++)
+    {
+        delay(1);
+    }
+
+    esp_err_t result = ESP_OK;
+    unsigned long long available = samplesConverted() - adcSamplesRead;
+    if (adcBufferSamples > 0 && available > adcBufferSamples)
+    {
+        adcSamplesRead += available - adcBufferSamples;
+        available = adcBufferSamples;
+        result = ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t count = (uint32_t)std::min(wanted, available);
+    adc_digi_output_data_t *samples = (adc_digi_output_data_t *)buf;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        unsigned long long index = adcSamplesRead + i;
+        uint8_t channel = adcPattern[index % adcPatternCount];
+        unsigned long long atMicros = adcStartMicros + index * 1000000ULL / adcSampleHz;
+        samples[i].val = 0;
+        samples[i].type1.data = std::min<uint16_t>(adcSource ? adcSource(channel, atMicros) : 0, ADC_MAX_READING);
+        samples[i].type1.channel = channel;
+    }
+    adcSamplesRead += count;
+    *out_length = count * sizeof(adc_digi_output_data_t);
+
+    return count == 0 ? ESP_ERR_TIMEOUT : result;
+}
+
+esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t adc_num, adc_atten_t atten, adc_bits_width_t bit_width, uint32_t default_vref, esp_adc_cal_characteristics_t *chars)
+{
+    chars->adc_num = adc_num;
+    chars->atten = atten;
+    chars->bit_width = bit_width;
+    chars->vref = default_vref;
+    return ESP_ADC_CAL_VAL_DEFAULT_VREF;
+}
+
+uint32_t esp_adc_cal_raw_to_voltage(uint32_t adc_reading, const esp_adc_cal_characteristics_t *chars)
+{
+    return adc_reading * attenuationMillivolts[chars->atten & 3] / ADC_MAX_READING;
+}
+
+uint16_t nativeAdcRawFromMillivolts(adc_atten_t atten, uint32_t millivolts)
+{
+    return (uint16_t)std::min<uint32_t>((millivolts * ADC_MAX_READING + attenuationMillivolts[atten & 3] / 2) / attenuationMillivolts[atten & 3], ADC_MAX_READING);
+}
@@ -0,0 +1,344 @@
+#include <Arduino.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <thread>
+
+#include "NativeHal.h"
+
+#define NATIVE_PIN_COUNT 40
+#define NATIVE_LEDC_CHANNELS 16
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static bool virtualClock = false;
+static std::atomic<unsigned long long> virtualMicros(0);
+static auto bootTime = std::chrono::steady_clock::now();
+
+static int pinValues[NATIVE_PIN_COUNT];
+static uint16_t analogValues[NATIVE_PIN_COUNT];
+static uint32_t ledcDuty[NATIVE_LEDC_CHANNELS];
+static NativePinWriteCallback pinWriteCallback = nullptr;
+static uint32_t cpuFrequencyMhz = 240;
+static long long worldOffsetMicros = 0;
+static long long rtcOffsetMicros = 0;
+static long rtcDriftPpm = 0;
+static bool worldClockSet = false;
+
+void nativeUseVirtualClock(bool enabled)
+{
+    virtualClock = enabled;
+}
+
+bool nativeIsVirtualClock()
+{
+    return virtualClock;
+}
+
+void nativeAdvanceMillis(unsigned long ms)
+{
+    virtualMicros += (unsigned long long)ms * 1000ULL;
+}
+
+void nativeSetMillis(unsigned long ms)
+{
+    virtualMicros = (unsigned long long)ms * 1000ULL;
+}
+
+int nativeGetPinValue(uint8_t pin)
+{
+    return pin < NATIVE_PIN_COUNT ? pinValues[pin] : LOW;
+}
+
+void nativeSetPinInput(uint8_t pin, int value)
+{
+    if (pin < NATIVE_PIN_COUNT)
+    {
+        pinValues[pin] = value;
+    }
+}
+
+uint32_t nativeGetLedcDuty(uint8_t channel)
+{
+    return channel < NATIVE_LEDC_CHANNELS ? ledcDuty[channel] : 0;
+}
+
+void nativeOnPinWrite(NativePinWriteCallback callback)
+{
+    pinWriteCallback = callback;
+}
+
+void nativeSetAnalogInput(uint8_t pin, uint16_t value)
+{
+    if (pin < NATIVE_PIN_COUNT)
+    {
+        analogValues[pin] = value;
+    }
+}
+
+void nativeSetSerialEnabled(bool enabled)
+{
+    Serial.setEnabled(enabled);
+}
+
+unsigned long long nativeWorldEpochMicros()
+{
+    if (!worldClockSet)
+    {
+        // Real time by default, so NTP on the host returns something sensible
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        long long realEpochMicros = std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+        worldOffsetMicros = realEpochMicros - (long long)micros();
+        worldClockSet = true;
+    }
+    return (unsigned long long)((long long)micros() + worldOffsetMicros);
+}
+
+unsigned long long nativeRtcEpochMicros()
+{
+    long long uptime = (long long)micros();
+    return (unsigned long long)(uptime + uptime / 1000000LL * rtcDriftPpm + rtcOffsetMicros);
+}
+
+void nativeSetRtcEpochMicros(unsigned long long epochMicros)
+{
+    long long uptime = (long long)micros();
+    rtcOffsetMicros = (long long)epochMicros - (uptime + uptime / 1000000LL * rtcDriftPpm);
+}
+
+void nativeSetWorldEpoch(unsigned long epoch)
+{
+    worldOffsetMicros = (long long)epoch * 1000000LL - (long long)micros();
+    worldClockSet = true;
+}
+
+void nativeReboot(const NativeRestart &restart)
+{
+    unsigned long long world = nativeWorldEpochMicros() + restart.sleepMicros;
+    unsigned long long rtc = nativeRtcEpochMicros() + restart.sleepMicros + (long long)(restart.sleepMicros / 1000000ULL) * rtcDriftPpm;
+
+    bootTime = std::chrono::steady_clock::now();
+    virtualMicros = 0;
+
+    worldOffsetMicros = (long long)world;
+    rtcOffsetMicros = (long long)rtc;
+}
+
+void nativeSetRtcDriftPpm(long ppm)
+{
+    unsigned long long rtcNow = nativeRtcEpochMicros();
+    rtcDriftPpm = ppm;
+    nativeSetRtcEpochMicros(rtcNow);
+}
+
+unsigned long micros()
+{
+    if (virtualClock)
+    {
+        return (unsigned long)virtualMicros.load();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - bootTime;
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+unsigned long millis()
+{
+    if (virtualClock)
+    {
+        return (unsigned long)(virtualMicros.load() / 1000ULL);
+    }
+    return micros() / 1000UL;
+}
+
+void delay(unsigned long ms)
+{
+    if (virtualClock)
+    {
+        nativeAdvanceMillis(ms);
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    if (virtualClock)
+    {
+        virtualMicros += us;
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield()
+{
+    if (!virtualClock)
+    {
+        std::this_thread::yield();
+    }
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin >= NATIVE_PIN_COUNT)
+    {
+        return;
+    }
+    pinValues[pin] = value ? HIGH : LOW;
+    if (pinWriteCallback)
+    {
+        pinWriteCallback(pin, pinValues[pin], millis());
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    return nativeGetPinValue(pin);
+}
+
+uint16_t analogRead(uint8_t pin)
+{
+    return pin < NATIVE_PIN_COUNT ? analogValues[pin] : 0;
+}
+
+/**
+ * ADC1 channels are 0-7, ADC2 channels 10-19, as on the ESP32; -1 for pins without one
+ */
+int8_t digitalPinToAnalogChannel(uint8_t pin)
+{
+    static const int8_t channels[NATIVE_PIN_COUNT] = {
+        11, -1, 12, -1, 10, -1, -1, -1, -1, -1, -1, -1, 15, 14, 16, 13, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, 18, 19, 17, -1, -1, -1, -1, 4, 5, 6, 7, 0, 1, 2, 3};
+    return pin < NATIVE_PIN_COUNT ? channels[pin] : -1;
+}
+
+double ledcSetup(uint8_t channel, double frequency, uint8_t resolution)
+{
+    (void)channel;
+    (void)resolution;
+    return frequency;
+}
+
+void ledcAttachPin(uint8_t pin, uint8_t channel)
+{
+    (void)pin;
+    (void)channel;
+}
+
+void ledcWrite(uint8_t channel, uint32_t duty)
+{
+    if (channel < NATIVE_LEDC_CHANNELS)
+    {
+        ledcDuty[channel] = duty;
+    }
+}
+
+bool setCpuFrequencyMhz(uint32_t mhz)
+{
+    cpuFrequencyMhz = mhz;
+    return true;
+}
+
+uint32_t getCpuFrequencyMhz()
+{
+    return cpuFrequencyMhz;
+}
+
+long random(long max)
+{
+    return max > 0 ? rand() % max : 0;
+}
+
+long random(long min, long max)
+{
+    return min >= max ? min : min + rand() % (max - min);
+}
+
+void EspClass::restart()
+{
+    Serial.println("[NATIVE] - ESP.restart()");
+    throw NativeRestart{false, 0};
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t written = 0;
+    while (size--)
+    {
+        written += write(*buffer++);
+    }
+    return written;
+}
+
+size_t Print::printf(const char *format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    if (length < 0)
+    {
+        return 0;
+    }
+    return write((const uint8_t *)buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+    size_t count = 0;
+    while (count < length)
+    {
+        int c = read();
+        if (c < 0)
+        {
+            break;
+        }
+        buffer[count++] = (char)c;
+    }
+    return count;
+}
+
+String Stream::readString()
+{
+    String result;
+    int c;
+    while ((c = read()) >= 0)
+    {
+        result += (char)c;
+    }
+    return result;
+}
+
+size_t HardwareSerial::write(uint8_t value)
+{
+    if (_enabled)
+    {
+        fputc(value, stdout);
+    }
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    if (_enabled)
+    {
+        fwrite(buffer, 1, size, stdout);
+    }
+    return size;
+}
+
+void HardwareSerial::flush()
+{
+    fflush(stdout);
+}
@@ -0,0 +1,102 @@
+#include <ESP32Time.h>
+
+#include "NativeHal.h"
+
+void ESP32Time::setTime(unsigned long epoch, int ms)
+{
+    nativeSetRtcEpochMicros((unsigned long long)epoch * 1000000ULL + (unsigned long long)ms * 1000ULL);
+}
+
+void ESP32Time::setTime(int sc, int mn, int hr, int dy, int mt, int yr, int ms)
+{
+    struct tm t = {};
+    t.tm_year = yr - 1900;
+    t.tm_mon = mt - 1;
+    t.tm_mday = dy;
+    t.tm_hour = hr;
+    t.tm_min = mn;
+    t.tm_sec = sc;
+    setTime((unsigned long)timegm(&t), ms);
+}
+
+unsigned long ESP32Time::getLocalEpoch()
+{
+    return (unsigned long)(nativeRtcEpochMicros() / 1000000ULL);
+}
+
+unsigned long ESP32Time::getEpoch()
+{
+    return getLocalEpoch() + _offset;
+}
+
+unsigned long ESP32Time::getMillis()
+{
+    return (unsigned long)(nativeRtcEpochMicros() / 1000ULL % 1000ULL);
+}
+
+unsigned long ESP32Time::getMicros()
+{
+    return (unsigned long)(nativeRtcEpochMicros() % 1000000ULL);
+}
+
+struct tm ESP32Time::getTimeStruct()
+{
+    time_t now = (time_t)getEpoch();
+    struct tm t;
+    gmtime_r(&now, &t);
+    return t;
+}
+
+int ESP32Time::getSecond()
+{
+    return getTimeStruct().tm_sec;
+}
+
+int ESP32Time::getMinute()
+{
+    return getTimeStruct().tm_min;
+}
+
+int ESP32Time::getHour(bool mode)
+{
+    int hour = getTimeStruct().tm_hour;
+    if (mode)
+    {
+        return hour;
+    }
+    hour %= 12;
+    return hour == 0 ? 12 : hour;
+}
+
+int ESP32Time::getDay()
+{
+    return getTimeStruct().tm_mday;
+}
+
+int ESP32Time::getMonth()
+{
+    return getTimeStruct().tm_mon;
+}
+
+int ESP32Time::getYear()
+{
+    return getTimeStruct().tm_year + 1900;
+}
+
+String ESP32Time::getTime(String format)
+{
+    struct tm t = getTimeStruct();
+    char buffer[64];
+    strftime(buffer, sizeof(buffer), format.c_str(), &t);
+    return String(buffer);
+}
+
+String ESP32Time::getTime()
+{
+    return getTime("%H:%M:%S");
+}
+
+String ESP32Time::getDateTime(bool mode)
+{
+    return getTime(mode ? "%A, %B %d %Y %H:%M:%S" : "%a, %b %d %Y %H:%M:%S");
+}
@@ -0,0 +1,964 @@
+#include <ESPAsyncWebServer.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+// Matches the TCP MSS the ESP32 sees, so handlers get bodies in realistic pieces
+#define NATIVE_TCP_SEGMENT 1436
+#define NATIVE_MAX_HEADER_BYTES 16384
+#define NATIVE_DEFERRED_RESPONSE_TIMEOUT_MS 30000
+// CONFIG_LWIP_MAX_ACTIVE_TCP of the Arduino-ESP32 sdkconfig
+#define NATIVE_MAX_CONNECTIONS 16
+
+static uint16_t portOverride = 0;
+static std::mutex connectionsMutex;
+static std::condition_variable connectionsChanged;
+static int activeConnections = 0;
+
+std::recursive_mutex &nativeAsyncTcpLock()
+{
+    static std::recursive_mutex lock;
+    return lock;
+}
+
+void nativeSetWebServerPort(uint16_t port)
+{
+    portOverride = port;
+}
+
+static String urlDecode(const std::string &encoded)
+{
+    std::string decoded;
+    for (size_t i = 0; i < encoded.length(); i++)
+    {
+        char c = encoded[i];
+        if (c == '+')
+        {
+            decoded += ' ';
+        }
+        else if (c == '%' && i + 2 < encoded.length() && isxdigit((unsigned char)encoded[i + 1]) && isxdigit((unsigned char)encoded[i + 2]))
+        {
+            decoded += (char)strtol(encoded.substr(i + 1, 2).c_str(), nullptr, 16);
+            i += 2;
+        }
+        else
+        {
+            decoded += c;
+        }
+    }
+    return String(decoded);
+}
+
+static void parseParams(const std::string &query, std::vector<AsyncWebParameter> &params, bool form)
+{
+    size_t start = 0;
+    while (start < query.length())
+    {
+        size_t end = query.find('&', start);
+        if (end == std::string::npos)
+        {
+            end = query.length();
+        }
+        std::string pair = query.substr(start, end - start);
+        if (!pair.empty())
+        {
+            size_t equals = pair.find('=');
+            String name = urlDecode(pair.substr(0, equals));
+            String value = equals == std::string::npos ? String() : urlDecode(pair.substr(equals + 1));
+            params.push_back(AsyncWebParameter(name, value, form));
+        }
+        start = end + 1;
+    }
+}
+
+static const char *reasonPhrase(int code)
+{
+    switch (code)
+    {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 409: return "Conflict";
+        case 413: return "Payload Too Large";
+        case 415: return "Unsupported Media Type";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "";
+    }
+}
+
+static String contentTypeFor(const String &path)
+{
+    String lower = path;
+    lower.toLowerCase();
+    if (lower.endsWith(".html") || lower.endsWith(".htm")) return "text/html";
+    if (lower.endsWith(".css")) return "text/css";
+    if (lower.endsWith(".js")) return "application/javascript";
+    if (lower.endsWith(".json")) return "application/json";
+    if (lower.endsWith(".png")) return "image/png";
+    if (lower.endsWith(".ico")) return "image/x-icon";
+    if (lower.endsWith(".svg")) return "image/svg+xml";
+    if (lower.endsWith(".txt")) return "text/plain";
+    return "application/octet-stream";
+}
+
+static bool sendAll(int socket, const char *data, size_t length)
+{
+    while (length)
+    {
+        ssize_t sent = ::send(socket, data, length, MSG_NOSIGNAL);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+size_t AsyncBasicResponse::fill(uint8_t *buffer, size_t maxLen, size_t index)
+{
+    if (index >= _content.length())
+    {
+        return 0;
+    }
+    size_t count = std::min<size_t>(maxLen, _content.length() - index);
+    memcpy(buffer, _content.c_str() + index, count);
+    return count;
+}
+
+size_t AsyncResponseStream::write(uint8_t value)
+{
+    _content += (char)value;
+    return 1;
+}
+
+size_t AsyncResponseStream::write(const uint8_t *buffer, size_t size)
+{
+    _content.append((const char *)buffer, size);
+    return size;
+}
+
+size_t AsyncResponseStream::fill(uint8_t *buffer, size_t maxLen, size_t index)
+{
+    if (index >= _content.length())
+    {
+        return 0;
+    }
+    size_t count = std::min<size_t>(maxLen, _content.length() - index);
+    memcpy(buffer, _content.data() + index, count);
+    return count;
+}
+
+size_t AsyncFileResponse::fill(uint8_t *buffer, size_t maxLen, size_t index)
+{
+    if (!_file || !_file.seek(index))
+    {
+        return 0;
+    }
+    return _file.read(buffer, maxLen);
+}
+
+static std::string formatEvent(const char *message, const char *event, uint32_t id, uint32_t reconnect)
+{
+    std::string formatted;
+    if (reconnect)
+    {
+        formatted += "retry: " + std::to_string(reconnect) + "\n";
+    }
+    if (id)
+    {
+        formatted += "id: " + std::to_string(id) + "\n";
+    }
+    if (event)
+    {
+        formatted += std::string("event: ") + event + "\n";
+    }
+
+    // Every line of the message is its own data field
+    const char *line = message;
+    while (true)
+    {
+        const char *end = strchr(line, '\n');
+        formatted += "data: ";
+        formatted.append(line, end ? end - line : strlen(line));
+        formatted += "\n";
+        if (!end)
+        {
+            break;
+        }
+        line = end + 1;
+    }
+    formatted += "\n";
+    return formatted;
+}
+
+void AsyncEventSourceClient::send(const char *message, const char *event, uint32_t id, uint32_t reconnect)
+{
+    std::lock_guard<std::recursive_mutex> lock(nativeAsyncTcpLock());
+    if (_connected)
+    {
+        _queue += formatEvent(message, event, id, reconnect);
+        if (id)
+        {
+            _lastId = id;
+        }
+    }
+}
+
+size_t AsyncEventSourceClient::take(uint8_t *buffer, size_t maxLen)
+{
+    if (!_connected)
+    {
+        return 0;
+    }
+    if (_queue.empty())
+    {
+        return RESPONSE_TRY_AGAIN;
+    }
+    size_t count = std::min(maxLen, _queue.length());
+    memcpy(buffer, _queue.data(), count);
+    _queue.erase(0, count);
+    return count;
+}
+
+AsyncEventSourceResponse::AsyncEventSourceResponse(AsyncEventSourceClient *client)
+    : AsyncWebServerResponse(200, "text/event-stream"), _client(client)
+{
+    addHeader("Cache-Control", "no-cache");
+}
+
+AsyncEventSourceResponse::~AsyncEventSourceResponse()
+{
+    // Runs under nativeAsyncTcpLock, once the connection is gone
+    std::vector<AsyncEventSourceClient *> &clients = _client->source()->_clients;
+    clients.erase(std::remove(clients.begin(), clients.end(), _client), clients.end());
+    delete _client;
+}
+
+size_t AsyncEventSourceResponse::fill(uint8_t *buffer, size_t maxLen, size_t index)
+{
+    (void)index;
+    return _client->take(buffer, maxLen);
+}
+
+AsyncEventSource::~AsyncEventSource()
+{
+    close();
+}
+
+void AsyncEventSource::close()
+{
+    std::lock_guard<std::recursive_mutex> lock(nativeAsyncTcpLock());
+    for (AsyncEventSourceClient *client : _clients)
+    {
+        client->close();
+    }
+}
+
+void AsyncEventSource::send(const char *message, const char *event, uint32_t id, uint32_t reconnect)
+{
+    std::lock_guard<std::recursive_mutex> lock(nativeAsyncTcpLock());
+    for (AsyncEventSourceClient *client : _clients)
+    {
+        client->send(message, event, id, reconnect);
+    }
+}
+
+size_t AsyncEventSource::count() const
+{
+    std::lock_guard<std::recursive_mutex> lock(nativeAsyncTcpLock());
+    size_t connected = 0;
+    for (AsyncEventSourceClient *client : _clients)
+    {
+        connected += client->connected();
+    }
+    return connected;
+}
+
+bool AsyncEventSource::canHandle(AsyncWebServerRequest *request)
+{
+    return request->method() == HTTP_GET && request->url() == _url;
+}
+
+void AsyncEventSource::handleRequest(AsyncWebServerRequest *request)
+{
+    uint32_t lastId = 0;
+    if (request->hasHeader("Last-Event-ID"))
+    {
+        lastId = strtoul(request->getHeader("Last-Event-ID")->value().c_str(), nullptr, 10);
+    }
+
+    AsyncEventSourceClient *client = new AsyncEventSourceClient(this, lastId);
+    _clients.push_back(client);
+    if (_connectcb)
+    {
+        _connectcb(client);
+    }
+    request->send(new AsyncEventSourceResponse(client));
+}
+
+AsyncWebServerRequest::~AsyncWebServerRequest()
+{
+    delete _response;
+    if (_onDisconnect)
+    {
+        _onDisconnect();
+    }
+}
+
+const char *AsyncWebServerRequest::methodToString() const
+{
+    switch (_method)
+    {
+        case HTTP_GET: return "GET";
+        case HTTP_POST: return "POST";
+        case HTTP_DELETE: return "DELETE";
+        case HTTP_PUT: return "PUT";
+        case HTTP_PATCH: return "PATCH";
+        case HTTP_HEAD: return "HEAD";
+        case HTTP_OPTIONS: return "OPTIONS";
+        default: return "UNKNOWN";
+    }
+}
+
+bool AsyncWebServerRequest::hasHeader(const String &name) const
+{
+    for (const AsyncWebHeader &header : _headers)
+    {
+        if (header.name().equalsIgnoreCase(name))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+AsyncWebHeader *AsyncWebServerRequest::getHeader(const String &name)
+{
+    for (AsyncWebHeader &header : _headers)
+    {
+        if (header.name().equalsIgnoreCase(name))
+        {
+            return &header;
+        }
+    }
+    return nullptr;
+}
+
+const String &AsyncWebServerRequest::header(const char *name)
+{
+    static const String empty;
+    AsyncWebHeader *found = getHeader(name);
+    return found ? found->value() : empty;
+}
+
+bool AsyncWebServerRequest::hasParam(const String &name, bool post, bool file) const
+{
+    for (const AsyncWebParameter &param : _params)
+    {
+        if (param.name() == name && param.isPost() == post && param.isFile() == file)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+AsyncWebParameter *AsyncWebServerRequest::getParam(const String &name, bool post, bool file)
+{
+    for (AsyncWebParameter &param : _params)
+    {
+        if (param.name() == name && param.isPost() == post && param.isFile() == file)
+        {
+            return &param;
+        }
+    }
+    return nullptr;
+}
+
+const String &AsyncWebServerRequest::arg(const String &name)
+{
+    static const String empty;
+    for (AsyncWebParameter &param : _params)
+    {
+        if (param.name() == name)
+        {
+            return param.value();
+        }
+    }
+    return empty;
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse *response)
+{
+    // The first response wins; like on the device, later ones are dropped
+    if (_response || !response)
+    {
+        delete response;
+        return;
+    }
+    _response = response;
+}
+
+void AsyncWebServerRequest::send(int code, const String &contentType, const String &content)
+{
+    send(beginResponse(code, contentType, content));
+}
+
+void AsyncWebServerRequest::send(FS &fs, const String &path, const String &contentType, bool download)
+{
+    send(beginResponse(fs, path, contentType, download));
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(int code, const String &contentType, const String &content)
+{
+    return new AsyncBasicResponse(code, contentType, content);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(FS &fs, const String &path, const String &contentType, bool download)
+{
+    (void)download;
+    File file = fs.open(path, "r");
+    if (!file)
+    {
+        return new AsyncBasicResponse(404);
+    }
+    return new AsyncFileResponse(file, contentType.length() ? contentType : contentTypeFor(path));
+}
+
+AsyncResponseStream *AsyncWebServerRequest::beginResponseStream(const String &contentType, size_t bufferSize)
+{
+    return new AsyncResponseStream(contentType, bufferSize);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginChunkedResponse(const String &contentType, AwsResponseFiller callback)
+{
+    return new AsyncChunkedResponse(contentType, callback);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::takeResponse()
+{
+    AsyncWebServerResponse *response = _response;
+    _response = nullptr;
+    return response;
+}
+
+bool AsyncCallbackWebHandler::canHandle(AsyncWebServerRequest *request)
+{
+    if (!(_method & request->method()))
+    {
+        return false;
+    }
+    if (_uri.length() && _uri.endsWith("*"))
+    {
+        return request->url().startsWith(_uri.substring(0, _uri.length() - 1));
+    }
+    if (_uri.length() && _uri != request->url() && !request->url().startsWith(_uri + "/"))
+    {
+        return false;
+    }
+    return true;
+}
+
+void AsyncCallbackWebHandler::handleRequest(AsyncWebServerRequest *request)
+{
+    if (_onRequest)
+    {
+        _onRequest(request);
+    }
+    else
+    {
+        request->send(500);
+    }
+}
+
+void AsyncCallbackWebHandler::handleUpload(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)
+{
+    if (_onUpload)
+    {
+        _onUpload(request, filename, index, data, len, final);
+    }
+}
+
+void AsyncCallbackWebHandler::handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    if (_onBody)
+    {
+        _onBody(request, data, len, index, total);
+    }
+}
+
+AsyncStaticWebHandler::AsyncStaticWebHandler(const String &uri, FS &fs, const String &path, const char *cacheControl)
+    : _uri(uri), _fs(fs), _path(path), _cacheControl(cacheControl ? cacheControl : "")
+{
+}
+
+bool AsyncStaticWebHandler::resolve(AsyncWebServerRequest *request, String &path, bool &gzipped)
+{
+    if (!request->url().startsWith(_uri))
+    {
+        return false;
+    }
+
+    path = _path + request->url().substring(_uri.length());
+    path.replace("//", "/");
+    if (path.endsWith("/"))
+    {
+        path += _defaultFile;
+    }
+
+    gzipped = _fs.exists(path + ".gz");
+    if (gzipped || _fs.exists(path))
+    {
+        File file = _fs.open(gzipped ? path + ".gz" : path, "r");
+        if (file && !file.isDirectory())
+        {
+            return true;
+        }
+    }
+
+    // Directory without a trailing slash
+    path += "/" + _defaultFile;
+    gzipped = _fs.exists(path + ".gz");
+    return gzipped || _fs.exists(path);
+}
+
+bool AsyncStaticWebHandler::canHandle(AsyncWebServerRequest *request)
+{
+    if (request->method() != HTTP_GET && request->method() != HTTP_HEAD)
+    {
+        return false;
+    }
+    String path;
+    bool gzipped;
+    return resolve(request, path, gzipped);
+}
+
+void AsyncStaticWebHandler::handleRequest(AsyncWebServerRequest *request)
+{
+    String path;
+    bool gzipped;
+    if (!resolve(request, path, gzipped))
+    {
+        request->send(404);
+        return;
+    }
+
+    AsyncWebServerResponse *response = request->beginResponse(_fs, gzipped ? path + ".gz" : path, contentTypeFor(path));
+    if (gzipped)
+    {
+        response->addHeader("Content-Encoding", "gzip");
+    }
+    if (_cacheControl.length())
+    {
+        response->addHeader("Cache-Control", _cacheControl);
+    }
+    request->send(response);
+}
+
+AsyncWebServer::AsyncWebServer(uint16_t port) : _port(port)
+{
+    _catchAllHandler.setMethod(HTTP_ANY);
+}
+
+AsyncWebServer::~AsyncWebServer()
+{
+    end();
+    reset();
+}
+
+void AsyncWebServer::begin()
+{
+    if (_running)
+    {
+        return;
+    }
+    if (portOverride)
+    {
+        _port = portOverride;
+    }
+
+    _listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int enable = 1;
+    setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(_port);
+    if (bind(_listener, (sockaddr *)&address, sizeof(address)) < 0 || listen(_listener, 64) < 0)
+    {
+        Serial.printf("[NATIVE] - Webserver failed to listen on port %u\n", _port);
+        close(_listener);
+        _listener = -1;
+        return;
+    }
+
+    _running = true;
+    _acceptThread = std::thread(&AsyncWebServer::acceptLoop, this);
+    Serial.printf("[NATIVE] - Webserver listening on http://localhost:%u/\n", _port);
+}
+
+void AsyncWebServer::end()
+{
+    if (!_running)
+    {
+        return;
+    }
+    _running = false;
+    shutdown(_listener, SHUT_RDWR);
+    close(_listener);
+    _listener = -1;
+    if (_acceptThread.joinable())
+    {
+        _acceptThread.join();
+    }
+}
+
+void AsyncWebServer::reset()
+{
+    for (AsyncWebHandler *handler : _handlers)
+    {
+        delete handler;
+    }
+    _handlers.clear();
+    _catchAllHandler.onRequest(nullptr);
+    _catchAllHandler.onUpload(nullptr);
+    _catchAllHandler.onBody(nullptr);
+}
+
+AsyncWebHandler &AsyncWebServer::addHandler(AsyncWebHandler *handler)
+{
+    _handlers.push_back(handler);
+    return *handler;
+}
+
+bool AsyncWebServer::removeHandler(AsyncWebHandler *handler)
+{
+    auto found = std::find(_handlers.begin(), _handlers.end(), handler);
+    if (found == _handlers.end())
+    {
+        return false;
+    }
+    _handlers.erase(found);
+    return true;
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, ArRequestHandlerFunction onRequest)
+{
+    return on(uri, HTTP_ANY, onRequest);
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest)
+{
+    return on(uri, method, onRequest, nullptr, nullptr);
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload)
+{
+    return on(uri, method, onRequest, onUpload, nullptr);
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody)
+{
+    AsyncCallbackWebHandler *handler = new AsyncCallbackWebHandler();
+    handler->setUri(uri);
+    handler->setMethod(method);
+    handler->onRequest(onRequest);
+    handler->onUpload(onUpload);
+    handler->onBody(onBody);
+    addHandler(handler);
+    return *handler;
+}
+
+AsyncStaticWebHandler &AsyncWebServer::serveStatic(const char *uri, FS &fs, const char *path, const char *cacheControl)
+{
+    AsyncStaticWebHandler *handler = new AsyncStaticWebHandler(uri, fs, path, cacheControl);
+    addHandler(handler);
+    return *handler;
+}
+
+void AsyncWebServer::acceptLoop()
+{
+    while (_running)
+    {
+        // lwIP only has so many PCBs; further clients wait in the backlog
+        {
+            std::unique_lock<std::mutex> lock(connectionsMutex);
+            connectionsChanged.wait(lock, []() { return activeConnections < NATIVE_MAX_CONNECTIONS; });
+        }
+
+        int client = accept4(_listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0)
+        {
+            continue;
+        }
+        int enable = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        {
+            std::lock_guard<std::mutex> guard(connectionsMutex);
+            activeConnections++;
+        }
+        std::thread([this, client]() {
+            serveConnection(client);
+
+            std::lock_guard<std::mutex> guard(connectionsMutex);
+            activeConnections--;
+            connectionsChanged.notify_one();
+        }).detach();
+    }
+}
+
+void AsyncWebServer::serveConnection(int client)
+{
+    std::string buffer;
+    char chunk[NATIVE_TCP_SEGMENT];
+    size_t headerEnd;
+
+    while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos)
+    {
+        ssize_t received = recv(client, chunk, sizeof(chunk), 0);
+        if (received <= 0 || buffer.length() > NATIVE_MAX_HEADER_BYTES)
+        {
+            close(client);
+            return;
+        }
+        buffer.append(chunk, received);
+    }
+
+    AsyncWebServerRequest *request = new AsyncWebServerRequest(this);
+
+    // Request line & headers
+    std::string head = buffer.substr(0, headerEnd);
+    std::string body = buffer.substr(headerEnd + 4);
+    size_t lineEnd = head.find("\r\n");
+    std::string requestLine = head.substr(0, lineEnd);
+
+    size_t firstSpace = requestLine.find(' ');
+    size_t secondSpace = requestLine.find(' ', firstSpace + 1);
+    std::string method = requestLine.substr(0, firstSpace);
+    std::string target = requestLine.substr(firstSpace + 1, secondSpace - firstSpace - 1);
+
+    if (method == "GET") request->_method = HTTP_GET;
+    else if (method == "POST") request->_method = HTTP_POST;
+    else if (method == "DELETE") request->_method = HTTP_DELETE;
+    else if (method == "PUT") request->_method = HTTP_PUT;
+    else if (method == "PATCH") request->_method = HTTP_PATCH;
+    else if (method == "HEAD") request->_method = HTTP_HEAD;
+    else if (method == "OPTIONS") request->_method = HTTP_OPTIONS;
+
+    size_t question = target.find('?');
+    request->_url = urlDecode(target.substr(0, question));
+    if (question != std::string::npos)
+    {
+        parseParams(target.substr(question + 1), request->_params, false);
+    }
+
+    size_t position = lineEnd == std::string::npos ? head.length() : lineEnd + 2;
+    while (position < head.length())
+    {
+        size_t end = head.find("\r\n", position);
+        if (end == std::string::npos)
+        {
+            end = head.length();
+        }
+        std::string line = head.substr(position, end - position);
+        size_t colon = line.find(':');
+        if (colon != std::string::npos)
+        {
+            String name(line.substr(0, colon));
+            String value(line.substr(colon + 1));
+            value.trim();
+            request->_headers.push_back(AsyncWebHeader(name, value));
+
+            if (name.equalsIgnoreCase("Host")) request->_host = value;
+            else if (name.equalsIgnoreCase("Content-Type")) request->_contentType = value;
+            else if (name.equalsIgnoreCase("Content-Length")) request->_contentLength = strtoul(value.c_str(), nullptr, 10);
+        }
+        position = end + 2;
+    }
+
+    // Pick a handler before the body arrives, as ESPAsyncWebServer does
+    AsyncWebHandler *handler = &_catchAllHandler;
+    {
+        std::lock_guard<std::recursive_mutex> lock(nativeAsyncTcpLock());
+        for (AsyncWebHandler *candidate : _handlers)
+        {
+            if (candidate->canHandle(request))
+            {
+                handler = candidate;
+                break;
+            }
+        }
+    }
+
+    bool formBody = request->_contentType.startsWith("application/x-www-form-urlencoded");
+    std::string form;
+    size_t delivered = 0;
+    bool connected = true;
+
+    while (delivered < request->_contentLength && connected)
+    {
+        if (body.empty())
+        {
+            ssize_t received = recv(client, chunk, sizeof(chunk), 0);
+            if (received <= 0)
+            {
+                connected = false;
+                break;
+            }
+            body.assign(chunk, received);
+        }
+
+        size_t length = std::min(body.length(), request->_contentLength - delivered);
+        if (formBody)
+        {
+            form.append(body, 0, length);
+        }
+        else
+        {
+            // Handlers commonly treat the body as a C string, so terminate it
+            std::vector<uint8_t> piece(body.begin(), body.begin() + length);
+            piece.push_back(0);
+            std::lock_guard<std::recursive_mutex> lock(nativeAsyncTcpLock());
+            handler->handleBody(request, piece.data(), length, delivered, request->_contentLength);
+        }
+        delivered += length;
+        body.erase(0, length);
+    }
+
+    if (!connected)
+    {
+        delete request;
+        close(client);
+        return;
+    }
+
+    if (formBody)
+    {
+        parseParams(form, request->_params, true);
+    }
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(nativeAsyncTcpLock());
+        handler->handleRequest(request);
+    }
+
+    // Some handlers respond later from another task
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(NATIVE_DEFERRED_RESPONSE_TIMEOUT_MS);
+    AsyncWebServerResponse *response = nullptr;
+    while (!response && std::chrono::steady_clock::now() < deadline)
+    {
+        {
+            std::lock_guard<std::recursive_mutex> lock(nativeAsyncTcpLock());
+            response = request->takeResponse();
+        }
+        if (!response)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    if (!response)
+    {
+        response = new AsyncBasicResponse(500, "text/plain", "No response");
+    }
+
+    long length = response->contentLength();
+    String headers = String("HTTP/1.1 ") + String(response->code()) + " " + reasonPhrase(response->code()) + "\r\n";
+    if (response->contentType().length())
+    {
+        headers += "Content-Type: " + response->contentType() + "\r\n";
+    }
+    bool streaming = length == NATIVE_STREAMING_RESPONSE;
+    if (length >= 0)
+    {
+        headers += "Content-Length: " + String(length) + "\r\n";
+    }
+    else if (!streaming)
+    {
+        headers += "Transfer-Encoding: chunked\r\n";
+    }
+    headers += "Connection: close\r\n";
+    for (const auto &header : DefaultHeaders::Instance().headers())
+    {
+        headers += header.first + ": " + header.second + "\r\n";
+    }
+    for (const auto &header : response->headers())
+    {
+        headers += header.first + ": " + header.second + "\r\n";
+    }
+    headers += "\r\n";
+
+    bool ok = sendAll(client, headers.c_str(), headers.length());
+    size_t index = 0;
+    uint8_t out[NATIVE_TCP_SEGMENT];
+
+    while (ok && request->method() != HTTP_HEAD)
+    {
+        size_t filled;
+        {
+            std::lock_guard<std::recursive_mutex> lock(nativeAsyncTcpLock());
+            filled = response->fill(out, sizeof(out), index);
+        }
+        if (filled == RESPONSE_TRY_AGAIN)
+        {
+            // A stream idles until the peer hangs up or the server stops
+            char probe;
+            if (streaming && (!_running || recv(client, &probe, 1, MSG_PEEK | MSG_DONTWAIT) == 0))
+            {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        if (filled == 0)
+        {
+            break;
+        }
+
+        if (length >= 0 || streaming)
+        {
+            ok = sendAll(client, (const char *)out, filled);
+        }
+        else
+        {
+            // Every hex digit of a size_t, CRLF & the terminator
+            char size[sizeof(size_t) * 2 + 3];
+            snprintf(size, sizeof(size), "%zx\r\n", filled);
+            ok = sendAll(client, size, strlen(size)) && sendAll(client, (const char *)out, filled) && sendAll(client, "\r\n", 2);
+        }
+        index += filled;
+    }
+
+    if (ok && length == -1 && request->method() != HTTP_HEAD)
+    {
+        sendAll(client, "0\r\n\r\n", 5);
+    }
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(nativeAsyncTcpLock());
+        delete response;
+        delete request;
+    }
+    shutdown(client, SHUT_WR);
+    close(client);
+}
@@ -0,0 +1,71 @@
+#include <ESPmDNS.h>
+
+MDNSResponder MDNS;
+
+MDNSResponder::Service *MDNSResponder::findService(const char *service, const char *proto)
+{
+    for (Service &entry : _services)
+    {
+        if (entry.service == service && entry.proto == proto)
+        {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+bool MDNSResponder::begin(const char *hostname)
+{
+    _hostname = hostname;
+    return true;
+}
+
+void MDNSResponder::end()
+{
+    _services.clear();
+}
+
+bool MDNSResponder::addService(const char *service, const char *proto, uint16_t port)
+{
+    if (findService(service, proto))
+    {
+        return false;
+    }
+    _services.push_back(Service{String(service), String(proto), port, {}});
+    return true;
+}
+
+bool MDNSResponder::addServiceTxt(const char *service, const char *proto, const char *key, const char *value)
+{
+    Service *entry = findService(service, proto);
+    if (!entry)
+    {
+        return false;
+    }
+    entry->txt[String(key)] = String(value);
+    _txtUpdates++;
+    _txtUpdatedMs = millis();
+    return true;
+}
+
+bool MDNSResponder::setServiceTxt(const char *service, const char *proto, const mdns_txt_item_t *txt, uint8_t count)
+{
+    Service *entry = findService(service, proto);
+    if (!entry)
+    {
+        return false;
+    }
+    entry->txt.clear();
+    for (uint8_t i = 0; i < count; i++)
+    {
+        entry->txt[String(txt[i].key)] = String(txt[i].value);
+    }
+    _txtUpdates++;
+    _txtUpdatedMs = millis();
+    return true;
+}
+
+esp_err_t mdns_service_txt_set(const char *service_type, const char *proto, mdns_txt_item_t txt[], uint8_t num_items)
+{
+    return MDNS.setServiceTxt(service_type, proto, txt, num_items) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
@@ -0,0 +1,323 @@
+#include <FS.h>
+#include <LittleFS.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+fs::LittleFSFS LittleFS;
+
+// Mirrors the 1.5MB spiffs partition of the default ESP32 partition table
+#define NATIVE_FS_SIZE (1536 * 1024)
+
+namespace fs
+{
+
+class FileImpl
+{
+public:
+    FILE *handle = nullptr;
+    String path;
+    String hostPath;
+    bool directory = false;
+    std::vector<std::string> entries;
+    size_t nextEntry = 0;
+
+    ~FileImpl()
+    {
+        if (handle)
+        {
+            fclose(handle);
+        }
+    }
+};
+
+static bool createParentDirectories(const std::string &hostPath)
+{
+    size_t index = 0;
+    while ((index = hostPath.find('/', index + 1)) != std::string::npos)
+    {
+        std::string directory = hostPath.substr(0, index);
+        ::mkdir(directory.c_str(), 0755);
+    }
+    return true;
+}
+
+String FS::hostPath(const String &path) const
+{
+    String result = _root;
+    if (!path.startsWith("/"))
+    {
+        result += "/";
+    }
+    result += path;
+    return result;
+}
+
+File FS::open(const char *path, const char *mode, bool create)
+{
+    std::shared_ptr<FileImpl> impl = std::make_shared<FileImpl>();
+    impl->path = path;
+    impl->hostPath = hostPath(path);
+
+    struct stat info;
+    if (stat(impl->hostPath.c_str(), &info) == 0 && S_ISDIR(info.st_mode))
+    {
+        impl->directory = true;
+        DIR *directory = opendir(impl->hostPath.c_str());
+        if (directory)
+        {
+            while (struct dirent *entry = readdir(directory))
+            {
+                if (entry->d_name[0] != '.')
+                {
+                    impl->entries.push_back(entry->d_name);
+                }
+            }
+            closedir(directory);
+        }
+        return File(impl);
+    }
+
+    bool writing = mode[0] == 'w' || mode[0] == 'a';
+    if (writing || create)
+    {
+        createParentDirectories(impl->hostPath.str());
+    }
+
+    std::string hostMode = mode;
+    if (hostMode.find('b') == std::string::npos)
+    {
+        hostMode += 'b';
+    }
+    impl->handle = fopen(impl->hostPath.c_str(), hostMode.c_str());
+    if (!impl->handle)
+    {
+        return File();
+    }
+    return File(impl);
+}
+
+bool FS::exists(const char *path)
+{
+    struct stat info;
+    return stat(hostPath(path).c_str(), &info) == 0;
+}
+
+bool FS::remove(const char *path)
+{
+    return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char *pathFrom, const char *pathTo)
+{
+    return ::rename(hostPath(pathFrom).c_str(), hostPath(pathTo).c_str()) == 0;
+}
+
+bool FS::mkdir(const char *path)
+{
+    return ::mkdir(hostPath(path).c_str(), 0755) == 0;
+}
+
+size_t File::write(uint8_t value)
+{
+    return write(&value, 1);
+}
+
+size_t File::write(const uint8_t *buffer, size_t size)
+{
+    if (!_impl || !_impl->handle)
+    {
+        return 0;
+    }
+    return fwrite(buffer, 1, size, _impl->handle);
+}
+
+void File::flush()
+{
+    if (_impl && _impl->handle)
+    {
+        fflush(_impl->handle);
+    }
+}
+
+int File::available()
+{
+    if (!_impl || !_impl->handle)
+    {
+        return 0;
+    }
+    long remaining = (long)size() - (long)position();
+    return remaining > 0 ? (int)remaining : 0;
+}
+
+int File::read()
+{
+    if (!_impl || !_impl->handle)
+    {
+        return -1;
+    }
+    int c = fgetc(_impl->handle);
+    return c == EOF ? -1 : c;
+}
+
+int File::peek()
+{
+    if (!_impl || !_impl->handle)
+    {
+        return -1;
+    }
+    int c = fgetc(_impl->handle);
+    if (c == EOF)
+    {
+        return -1;
+    }
+    ungetc(c, _impl->handle);
+    return c;
+}
+
+size_t File::read(uint8_t *buffer, size_t size)
+{
+    if (!_impl || !_impl->handle)
+    {
+        return 0;
+    }
+    return fread(buffer, 1, size, _impl->handle);
+}
+
+bool File::seek(uint32_t position)
+{
+    return _impl && _impl->handle && fseek(_impl->handle, position, SEEK_SET) == 0;
+}
+
+size_t File::position() const
+{
+    if (!_impl || !_impl->handle)
+    {
+        return 0;
+    }
+    long position = ftell(_impl->handle);
+    return position < 0 ? 0 : (size_t)position;
+}
+
+size_t File::size() const
+{
+    if (!_impl)
+    {
+        return 0;
+    }
+    if (_impl->handle)
+    {
+        fflush(_impl->handle);
+    }
+    struct stat info;
+    return stat(_impl->hostPath.c_str(), &info) == 0 ? (size_t)info.st_size : 0;
+}
+
+void File::close()
+{
+    _impl.reset();
+}
+
+File::operator bool() const
+{
+    return _impl && (_impl->handle || _impl->directory);
+}
+
+const char *File::path() const
+{
+    return _impl ? _impl->path.c_str() : "";
+}
+
+const char *File::name() const
+{
+    if (!_impl)
+    {
+        return "";
+    }
+    int slash = _impl->path.lastIndexOf('/');
+    return _impl->path.c_str() + slash + 1;
+}
+
+bool File::isDirectory() const
+{
+    return _impl && _impl->directory;
+}
+
+File File::openNextFile(const char *mode)
+{
+    if (!_impl || !_impl->directory || _impl->nextEntry >= _impl->entries.size())
+    {
+        return File();
+    }
+    String child = _impl->path;
+    if (!child.endsWith("/"))
+    {
+        child += "/";
+    }
+    child += _impl->entries[_impl->nextEntry++].c_str();
+    return LittleFS.open(child, mode);
+}
+
+bool LittleFSFS::begin(bool formatOnFail, const char *basePath, uint8_t maxOpenFiles, const char *partitionLabel)
+{
+    (void)basePath;
+    (void)maxOpenFiles;
+    (void)partitionLabel;
+
+    struct stat info;
+    if (stat(_root.c_str(), &info) != 0 || !S_ISDIR(info.st_mode))
+    {
+        if (!formatOnFail || ::mkdir(_root.c_str(), 0755) != 0)
+        {
+            return false;
+        }
+    }
+    _mounted = true;
+    return true;
+}
+
+bool LittleFSFS::format()
+{
+    return false;
+}
+
+size_t LittleFSFS::totalBytes()
+{
+    return NATIVE_FS_SIZE;
+}
+
+static size_t directorySize(const std::string &path)
+{
+    size_t total = 0;
+    DIR *directory = opendir(path.c_str());
+    if (!directory)
+    {
+        return 0;
+    }
+    while (struct dirent *entry = readdir(directory))
+    {
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+        std::string child = path + "/" + entry->d_name;
+        struct stat info;
+        if (stat(child.c_str(), &info) == 0)
+        {
+            total += S_ISDIR(info.st_mode) ? directorySize(child) : (size_t)info.st_size;
+        }
+    }
+    closedir(directory);
+    return total;
+}
+
+size_t LittleFSFS::usedBytes()
+{
+    return directorySize(_root.str());
+}
+
+} // namespace fs
@@ -0,0 +1,397 @@
+#include <freertos/FreeRTOS.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Arduino.h>
+
+struct NativeSpinlock
+{
+    std::recursive_mutex mutex;
+};
+
+struct NativeTask
+{
+    std::string name;
+    std::thread thread;
+    std::mutex notifyMutex;
+    std::condition_variable notifyCondition;
+    uint32_t notifications = 0;
+};
+
+struct NativeQueue
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<uint8_t>> items;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+};
+
+struct NativeSemaphore
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    UBaseType_t count;
+    UBaseType_t maxCount;
+    bool recursive = false;
+    std::thread::id owner;
+    UBaseType_t depth = 0;
+};
+
+// Thrown by vTaskDelete(NULL) to unwind the task's thread
+struct NativeTaskExit
+{
+};
+
+static std::mutex spinlockCreation;
+static std::mutex tasksMutex;
+static std::vector<NativeTask *> tasks;
+static thread_local NativeTask *currentTask = nullptr;
+
+template <typename Predicate>
+static bool waitFor(std::condition_variable &condition, std::unique_lock<std::mutex> &lock, TickType_t ticks, Predicate ready)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        condition.wait(lock, ready);
+        return true;
+    }
+    return condition.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+void nativeEnterCritical(portMUX_TYPE *mux)
+{
+    {
+        std::lock_guard<std::mutex> guard(spinlockCreation);
+        if (!mux->lock)
+        {
+            mux->lock = new NativeSpinlock();
+        }
+    }
+    mux->lock->mutex.lock();
+}
+
+void nativeExitCritical(portMUX_TYPE *mux)
+{
+    mux->lock->mutex.unlock();
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *createdTask)
+{
+    return xTaskCreatePinnedToCore(function, name, stackDepth, parameters, priority, createdTask, tskNO_AFFINITY);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *createdTask, BaseType_t core)
+{
+    (void)stackDepth;
+    (void)priority;
+    (void)core;
+
+    NativeTask *task = new NativeTask();
+    task->name = name ? name : "";
+    if (createdTask)
+    {
+        *createdTask = task;
+    }
+
+    std::lock_guard<std::mutex> guard(tasksMutex);
+    tasks.push_back(task);
+    task->thread = std::thread([task, function, parameters]() {
+        currentTask = task;
+        try
+        {
+            function(parameters);
+        }
+        catch (const NativeTaskExit &)
+        {
+        }
+    });
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == nullptr || task == currentTask)
+    {
+        throw NativeTaskExit();
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    delay(ticks);
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return millis();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return currentTask;
+}
+
+const char *pcTaskGetName(TaskHandle_t task)
+{
+    task = task ? task : currentTask;
+    return task ? task->name.c_str() : "loopTask";
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    (void)task;
+    return 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> guard(task->notifyMutex);
+        task->notifications++;
+    }
+    task->notifyCondition.notify_all();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait)
+{
+    NativeTask *task = currentTask;
+    if (!task)
+    {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(task->notifyMutex);
+    waitFor(task->notifyCondition, lock, ticksToWait, [task]() { return task->notifications > 0; });
+
+    uint32_t value = task->notifications;
+    if (value)
+    {
+        task->notifications = clearOnExit ? 0 : value - 1;
+    }
+    return value;
+}
+
+void nativeJoinTasks()
+{
+    std::vector<NativeTask *> joining;
+    {
+        std::lock_guard<std::mutex> guard(tasksMutex);
+        joining.swap(tasks);
+    }
+    for (NativeTask *task : joining)
+    {
+        if (task->thread.joinable())
+        {
+            task->thread.join();
+        }
+    }
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    NativeQueue *queue = new NativeQueue();
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+static BaseType_t queueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait, bool front)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!waitFor(queue->changed, lock, ticksToWait, [queue]() { return queue->items.size() < queue->length; }))
+    {
+        return errQUEUE_FULL;
+    }
+
+    const uint8_t *bytes = (const uint8_t *)item;
+    std::vector<uint8_t> copy(bytes, bytes + queue->itemSize);
+    if (front)
+    {
+        queue->items.push_front(copy);
+    }
+    else
+    {
+        queue->items.push_back(copy);
+    }
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+    return queueSend(queue, item, ticksToWait, false);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+    return queueSend(queue, item, ticksToWait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+    return queueSend(queue, item, ticksToWait, true);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item)
+{
+    std::lock_guard<std::mutex> guard(queue->mutex);
+    const uint8_t *bytes = (const uint8_t *)item;
+    queue->items.clear();
+    queue->items.emplace_back(bytes, bytes + queue->itemSize);
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticksToWait)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!waitFor(queue->changed, lock, ticksToWait, [queue]() { return !queue->items.empty(); }))
+    {
+        return pdFALSE;
+    }
+
+    memcpy(buffer, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *buffer, TickType_t ticksToWait)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!waitFor(queue->changed, lock, ticksToWait, [queue]() { return !queue->items.empty(); }))
+    {
+        return pdFALSE;
+    }
+
+    memcpy(buffer, queue->items.front().data(), queue->itemSize);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> guard(queue->mutex);
+    queue->items.clear();
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> guard(queue->mutex);
+    return queue->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> guard(queue->mutex);
+    return queue->length - queue->items.size();
+}
+
+static SemaphoreHandle_t createSemaphore(UBaseType_t maxCount, UBaseType_t initialCount, bool recursive)
+{
+    NativeSemaphore *semaphore = new NativeSemaphore();
+    semaphore->maxCount = maxCount;
+    semaphore->count = initialCount;
+    semaphore->recursive = recursive;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return createSemaphore(1, 1, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex()
+{
+    return createSemaphore(1, 1, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+    return createSemaphore(1, 0, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount)
+{
+    return createSemaphore(maxCount, initialCount, false);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    delete semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait)
+{
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+    if (!waitFor(semaphore->changed, lock, ticksToWait, [semaphore]() { return semaphore->count > 0; }))
+    {
+        return pdFALSE;
+    }
+    semaphore->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    std::lock_guard<std::mutex> guard(semaphore->mutex);
+    if (semaphore->count >= semaphore->maxCount)
+    {
+        return pdFALSE;
+    }
+    semaphore->count++;
+    semaphore->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticksToWait)
+{
+    std::thread::id self = std::this_thread::get_id();
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+    if (semaphore->depth > 0 && semaphore->owner == self)
+    {
+        semaphore->depth++;
+        return pdTRUE;
+    }
+    if (!waitFor(semaphore->changed, lock, ticksToWait, [semaphore]() { return semaphore->depth == 0; }))
+    {
+        return pdFALSE;
+    }
+    semaphore->owner = self;
+    semaphore->depth = 1;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore)
+{
+    std::lock_guard<std::mutex> guard(semaphore->mutex);
+    if (semaphore->depth == 0 || semaphore->owner != std::this_thread::get_id())
+    {
+        return pdFALSE;
+    }
+    if (--semaphore->depth == 0)
+    {
+        semaphore->changed.notify_all();
+    }
+    return pdTRUE;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore)
+{
+    std::lock_guard<std::mutex> guard(semaphore->mutex);
+    return semaphore->count;
+}
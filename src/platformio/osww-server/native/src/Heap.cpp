@@ -0,0 +1,99 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include <Arduino.h>
+
+#include "NativeHal.h"
+
+/*
+ * Tracks heap use on the host so ESP.getFreeHeap() & friends report
+ * something meaningful, and so tools can measure allocations per request.
+ * Sizes are stored in a small header in front of every block.
+ */
+
+// Roughly what an ESP32 has left for the heap once WiFi is up
+#define NATIVE_HEAP_SIZE (300 * 1024)
+
+static std::atomic<uint32_t> heapInUse(0);
+static std::atomic<uint32_t> heapPeak(0);
+static std::atomic<uint32_t> heapAllocations(0);
+
+static void *trackedAllocate(size_t size)
+{
+    size_t *block = (size_t *)malloc(size + sizeof(max_align_t));
+    if (!block)
+    {
+        throw std::bad_alloc();
+    }
+    *block = size;
+
+    uint32_t inUse = heapInUse += (uint32_t)size;
+    uint32_t peak = heapPeak;
+    while (inUse > peak && !heapPeak.compare_exchange_weak(peak, inUse))
+    {
+    }
+    heapAllocations++;
+
+    return (char *)block + sizeof(max_align_t);
+}
+
+static void trackedFree(void *pointer)
+{
+    if (!pointer)
+    {
+        return;
+    }
+    size_t *block = (size_t *)((char *)pointer - sizeof(max_align_t));
+    heapInUse -= (uint32_t)*block;
+    free(block);
+}
+
+void *operator new(size_t size) { return trackedAllocate(size); }
+void *operator new[](size_t size) { return trackedAllocate(size); }
+void operator delete(void *pointer) noexcept { trackedFree(pointer); }
+void operator delete[](void *pointer) noexcept { trackedFree(pointer); }
+void operator delete(void *pointer, size_t) noexcept { trackedFree(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { trackedFree(pointer); }
+
+uint32_t nativeHeapInUse()
+{
+    return heapInUse;
+}
+
+uint32_t nativeHeapPeak()
+{
+    return heapPeak;
+}
+
+uint32_t nativeHeapAllocations()
+{
+    return heapAllocations;
+}
+
+void nativeResetHeapPeak()
+{
+    heapPeak = heapInUse.load();
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+    uint32_t inUse = heapInUse;
+    return inUse < NATIVE_HEAP_SIZE ? NATIVE_HEAP_SIZE - inUse : 0;
+}
+
+uint32_t EspClass::getMinFreeHeap()
+{
+    uint32_t peak = heapPeak;
+    return peak < NATIVE_HEAP_SIZE ? NATIVE_HEAP_SIZE - peak : 0;
+}
+
+uint32_t EspClass::getHeapSize()
+{
+    return NATIVE_HEAP_SIZE;
+}
+
+uint32_t EspClass::getMaxAllocHeap()
+{
+    return getFreeHeap();
+}
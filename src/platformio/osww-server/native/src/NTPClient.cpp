@@ -0,0 +1,23 @@
+#include <NTPClient.h>
+
+#include "NativeHal.h"
+
+bool NTPClient::forceUpdate()
+{
+    _currentEpoch = (unsigned long)(nativeWorldEpochMicros() / 1000000ULL);
+    _lastUpdate = millis();
+    _updated = true;
+    return true;
+}
+
+unsigned long NTPClient::getEpochTime() const
+{
+    return _timeOffset + _currentEpoch + ((millis() - _lastUpdate) / 1000);
+}
+
+String NTPClient::getFormattedTime() const
+{
+    char buffer[9];
+    snprintf(buffer, sizeof(buffer), "%02d:%02d:%02d", getHours(), getMinutes(), getSeconds());
+    return String(buffer);
+}
@@ -0,0 +1,196 @@
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Mirrors partitions.csv; NVS & LittleFS are emulated as directories instead
+static esp_partition_t partitions[] = {
+    {ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_OTA, 0xE000, 0x2000, "otadata", false},
+    {ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x10000, 0x140000, "app0", false},
+    {ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x150000, 0x140000, "app1", false},
+    {ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, 0x290000, 0x160000, "spiffs", false},
+    {ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x40, 0x3F0000, 0x10000, "history", false},
+};
+
+static const esp_partition_t *runningPartition = nullptr;
+
+static std::string partitionRoot = ".partitions";
+static std::mutex flashMutex;
+
+void nativeSetPartitionRoot(const char *directory)
+{
+    partitionRoot = directory;
+}
+
+static std::string imagePath(const esp_partition_t *partition)
+{
+    return partitionRoot + "/" + partition->label + ".bin";
+}
+
+/**
+ * Opens the partition's image, creating it erased on first use
+ */
+static FILE *openImage(const esp_partition_t *partition)
+{
+    std::string path = imagePath(partition);
+    FILE *file = fopen(path.c_str(), "r+b");
+    if (file)
+    {
+        return file;
+    }
+
+    file = fopen(path.c_str(), "w+b");
+    if (!file)
+    {
+        return nullptr;
+    }
+    std::vector<uint8_t> erased(partition->size, 0xFF);
+    fwrite(erased.data(), 1, erased.size(), file);
+    fflush(file);
+    return file;
+}
+
+static bool inBounds(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    return partition && offset <= partition->size && size <= partition->size - offset;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    for (const esp_partition_t &partition : partitions)
+    {
+        if (partition.type == type &&
+            (subtype == ESP_PARTITION_SUBTYPE_ANY || partition.subtype == subtype) &&
+            (label == nullptr || strcmp(partition.label, label) == 0))
+        {
+            return &partition;
+        }
+    }
+    return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    if (!inBounds(partition, src_offset, size))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    std::lock_guard<std::mutex> lock(flashMutex);
+    FILE *file = openImage(partition);
+    if (!file)
+    {
+        return ESP_FAIL;
+    }
+    fseek(file, src_offset, SEEK_SET);
+    size_t read = fread(dst, 1, size, file);
+    fclose(file);
+    return read == size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    if (!inBounds(partition, dst_offset, size))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    std::lock_guard<std::mutex> lock(flashMutex);
+    FILE *file = openImage(partition);
+    if (!file)
+    {
+        return ESP_FAIL;
+    }
+
+    // NOR flash: programming only turns 1s into 0s
+    std::vector<uint8_t> current(size);
+    fseek(file, dst_offset, SEEK_SET);
+    size_t read = fread(current.data(), 1, size, file);
+    for (size_t i = 0; i < size; i++)
+    {
+        current[i] &= ((const uint8_t *)src)[i];
+    }
+    fseek(file, dst_offset, SEEK_SET);
+    size_t written = fwrite(current.data(), 1, size, file);
+    fclose(file);
+    return read == size && written == size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    if (!inBounds(partition, offset, size) || offset % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    std::lock_guard<std::mutex> lock(flashMutex);
+    FILE *file = openImage(partition);
+    if (!file)
+    {
+        return ESP_FAIL;
+    }
+    std::vector<uint8_t> erased(size, 0xFF);
+    fseek(file, offset, SEEK_SET);
+    size_t written = fwrite(erased.data(), 1, size, file);
+    fclose(file);
+    return written == size ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * The app partition otadata selects, app0 until an update picks another
+ */
+const esp_partition_t *esp_ota_get_boot_partition()
+{
+    char label[17] = "app0";
+    const esp_partition_t *otadata = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_OTA, nullptr);
+    if (esp_partition_read(otadata, 0, label, sizeof(label) - 1) != ESP_OK || (uint8_t)label[0] == 0xFF)
+    {
+        strcpy(label, "app0");
+    }
+    label[sizeof(label) - 1] = '\0';
+
+    const esp_partition_t *boot = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, label);
+    return boot ? boot : &partitions[1];
+}
+
+const esp_partition_t *esp_ota_get_running_partition()
+{
+    if (!runningPartition)
+    {
+        runningPartition = esp_ota_get_boot_partition();
+    }
+    return runningPartition;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    const esp_partition_t *from = start_from ? start_from : esp_ota_get_running_partition();
+    return from == &partitions[1] ? &partitions[2] : &partitions[1];
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    if (!partition || partition->type != ESP_PARTITION_TYPE_APP)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const esp_partition_t *otadata = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_OTA, nullptr);
+    char label[SPI_FLASH_SEC_SIZE];
+    memset(label, 0xFF, sizeof(label));
+    strcpy(label, partition->label);
+    if (esp_partition_erase_range(otadata, 0, SPI_FLASH_SEC_SIZE) != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+    return esp_partition_write(otadata, 0, label, strlen(label) + 1);
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback()
+{
+    return ESP_OK;
+}
@@ -0,0 +1,168 @@
+#include <Preferences.h>
+
+#include <sys/stat.h>
+
+#include <cstdio>
+
+static String nvsRoot = ".nvs";
+
+void nativeSetNvsRoot(const char *directory)
+{
+    nvsRoot = directory;
+}
+
+bool Preferences::begin(const char *name, bool readOnly, const char *partitionLabel)
+{
+    (void)partitionLabel;
+    _namespace = name;
+    _readOnly = readOnly;
+    _open = true;
+    load();
+    return true;
+}
+
+void Preferences::end()
+{
+    _open = false;
+    _entries.clear();
+}
+
+void Preferences::load()
+{
+    _entries.clear();
+    String path = nvsRoot + "/" + _namespace + ".nvs";
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        return;
+    }
+
+    uint16_t keyLength;
+    while (fread(&keyLength, sizeof(keyLength), 1, file) == 1)
+    {
+        std::string key(keyLength, '\0');
+        uint32_t valueLength;
+        if (fread(&key[0], 1, keyLength, file) != keyLength || fread(&valueLength, sizeof(valueLength), 1, file) != 1)
+        {
+            break;
+        }
+        std::vector<uint8_t> value(valueLength);
+        if (valueLength && fread(value.data(), 1, valueLength, file) != valueLength)
+        {
+            break;
+        }
+        _entries[String(key)] = value;
+    }
+    fclose(file);
+}
+
+void Preferences::save()
+{
+    mkdir(nvsRoot.c_str(), 0755);
+    String path = nvsRoot + "/" + _namespace + ".nvs";
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        return;
+    }
+    for (const auto &entry : _entries)
+    {
+        uint16_t keyLength = entry.first.length();
+        uint32_t valueLength = entry.second.size();
+        fwrite(&keyLength, sizeof(keyLength), 1, file);
+        fwrite(entry.first.c_str(), 1, keyLength, file);
+        fwrite(&valueLength, sizeof(valueLength), 1, file);
+        fwrite(entry.second.data(), 1, valueLength, file);
+    }
+    fclose(file);
+}
+
+size_t Preferences::putRaw(const char *key, const void *value, size_t length)
+{
+    if (!_open || _readOnly)
+    {
+        return 0;
+    }
+    const uint8_t *bytes = (const uint8_t *)value;
+    _entries[String(key)] = std::vector<uint8_t>(bytes, bytes + length);
+    save();
+    return length;
+}
+
+size_t Preferences::getRaw(const char *key, void *buffer, size_t maxLength) const
+{
+    auto found = _entries.find(String(key));
+    if (found == _entries.end() || found->second.size() > maxLength)
+    {
+        return 0;
+    }
+    memcpy(buffer, found->second.data(), found->second.size());
+    return found->second.size();
+}
+
+size_t Preferences::getBytesLength(const char *key) const
+{
+    auto found = _entries.find(String(key));
+    return found == _entries.end() ? 0 : found->second.size();
+}
+
+bool Preferences::clear()
+{
+    if (!_open || _readOnly)
+    {
+        return false;
+    }
+    _entries.clear();
+    save();
+    return true;
+}
+
+bool Preferences::remove(const char *key)
+{
+    if (!_open || _readOnly || !_entries.erase(String(key)))
+    {
+        return false;
+    }
+    save();
+    return true;
+}
+
+uint8_t Preferences::getUChar(const char *key, uint8_t defaultValue) const
+{
+    uint8_t value;
+    return getRaw(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+uint16_t Preferences::getUShort(const char *key, uint16_t defaultValue) const
+{
+    uint16_t value;
+    return getRaw(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+uint32_t Preferences::getUInt(const char *key, uint32_t defaultValue) const
+{
+    uint32_t value;
+    return getRaw(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+int32_t Preferences::getInt(const char *key, int32_t defaultValue) const
+{
+    int32_t value;
+    return getRaw(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+uint64_t Preferences::getULong64(const char *key, uint64_t defaultValue) const
+{
+    uint64_t value;
+    return getRaw(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+String Preferences::getString(const char *key, const String &defaultValue) const
+{
+    auto found = _entries.find(String(key));
+    if (found == _entries.end() || found->second.empty())
+    {
+        return defaultValue;
+    }
+    return String((const char *)found->second.data());
+}
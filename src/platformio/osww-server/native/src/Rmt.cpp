@@ -0,0 +1,107 @@
+#include <driver/rmt.h>
+
+#include <Arduino.h>
+
+// The RMT counts in ticks of the 80 MHz APB clock, divided
+#define RMT_SOURCE_CLOCK_MHZ 80
+
+static struct
+{
+    bool configured;
+    bool installed;
+    uint8_t clockDivider;
+    // when the items written last are all out
+    unsigned long long busyUntilMicros;
+} rmtChannels[RMT_CHANNEL_MAX];
+
+static bool isInstalled(rmt_channel_t channel)
+{
+    return channel >= RMT_CHANNEL_0 && channel < RMT_CHANNEL_MAX && rmtChannels[channel].installed;
+}
+
+/**
+ * Waits out the transmission in progress, or until the timeout
+ */
+static bool waitIdle(rmt_channel_t channel, TickType_t ticks)
+{
+    for (TickType_t waited = 0; micros() < rmtChannels[channel].busyUntilMicros; waited++)
+    {
+        if (waited >= ticks)
+        {
+            return false;
+        }
+        delay(1);
+    }
+    return true;
+}
+
+esp_err_t rmt_config(const rmt_config_t *rmt_param)
+{
+    if (!rmt_param || rmt_param->channel >= RMT_CHANNEL_MAX || rmt_param->rmt_mode != RMT_MODE_TX || rmt_param->clk_div == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    rmtChannels[rmt_param->channel].configured = true;
+    rmtChannels[rmt_param->channel].clockDivider = rmt_param->clk_div;
+    return ESP_OK;
+}
+
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rx_buf_size, int intr_alloc_flags)
+{
+    if (channel < RMT_CHANNEL_0 || channel >= RMT_CHANNEL_MAX || !rmtChannels[channel].configured)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    rmtChannels[channel].installed = true;
+    rmtChannels[channel].busyUntilMicros = 0;
+    return ESP_OK;
+}
+
+esp_err_t rmt_driver_uninstall(rmt_channel_t channel)
+{
+    if (!isInstalled(channel))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    rmtChannels[channel].installed = false;
+    return ESP_OK;
+}
+
+/**
+ * Like the driver, waits for the previous transmission to end before starting this one
+ */
+esp_err_t rmt_write_items(rmt_channel_t channel, const rmt_item32_t *rmt_item, int item_num, bool wait_tx_done)
+{
+    if (!isInstalled(channel) || !rmt_item || item_num <= 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    waitIdle(channel, portMAX_DELAY);
+
+    unsigned long long ticks = 0;
+    for (int i = 0; i < item_num; i++)
+    {
+        ticks += rmt_item[i].duration0 + rmt_item[i].duration1;
+        // A zero duration ends the transmission there
+        if (rmt_item[i].duration0 == 0 || rmt_item[i].duration1 == 0)
+        {
+            break;
+        }
+    }
+    rmtChannels[channel].busyUntilMicros = micros() + ticks * rmtChannels[channel].clockDivider / RMT_SOURCE_CLOCK_MHZ;
+
+    if (wait_tx_done)
+    {
+        waitIdle(channel, portMAX_DELAY);
+    }
+    return ESP_OK;
+}
+
+esp_err_t rmt_wait_tx_done(rmt_channel_t channel, TickType_t wait_time)
+{
+    if (!isInstalled(channel))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return waitIdle(channel, wait_time) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
@@ -0,0 +1,38 @@
+#include <Arduino.h>
+#include <esp_sleep.h>
+
+#include "NativeHal.h"
+
+static esp_sleep_wakeup_cause_t wakeupCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+static uint64_t timerWakeupMicros = 0;
+
+void nativeSetWakeupCause(esp_sleep_wakeup_cause_t cause)
+{
+    wakeupCause = cause;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause()
+{
+    return wakeupCause;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+    timerWakeupMicros = time_in_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t gpio_num, int level)
+{
+    (void)gpio_num;
+    (void)level;
+    return ESP_OK;
+}
+
+void esp_deep_sleep_start()
+{
+    // Nobody presses the button on the host, so the timer always wins
+    wakeupCause = timerWakeupMicros ? ESP_SLEEP_WAKEUP_TIMER : ESP_SLEEP_WAKEUP_UNDEFINED;
+    Serial.println("[NATIVE] - esp_deep_sleep_start()");
+    throw NativeRestart{true, timerWakeupMicros};
+}
@@ -0,0 +1,141 @@
+#include <Update.h>
+#include <esp_ota_ops.h>
+
+#define ESP_IMAGE_HEADER_MAGIC 0xE9
+
+UpdateClass Update;
+
+bool UpdateClass::begin(size_t size, int command, int ledPin, uint8_t ledOn, const char *label)
+{
+    (void)ledPin;
+    (void)ledOn;
+
+    if (_partition)
+    {
+        _error = UPDATE_ERROR_BAD_ARGUMENT;
+        return false;
+    }
+
+    _command = command;
+    _error = UPDATE_ERROR_OK;
+    _progress = 0;
+
+    if (command == U_FLASH)
+    {
+        _partition = esp_ota_get_next_update_partition(nullptr);
+    }
+    else if (command == U_SPIFFS)
+    {
+        _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, label);
+    }
+    if (!_partition)
+    {
+        _error = UPDATE_ERROR_NO_PARTITION;
+        return false;
+    }
+
+    _size = size == UPDATE_SIZE_UNKNOWN ? _partition->size : size;
+    if (_size == 0 || _size > _partition->size)
+    {
+        _partition = nullptr;
+        _error = UPDATE_ERROR_SIZE;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Erases each sector as the image reaches it, then writes
+ */
+size_t UpdateClass::write(uint8_t *data, size_t len)
+{
+    if (!_partition || hasError())
+    {
+        return 0;
+    }
+    if (len > remaining())
+    {
+        _error = UPDATE_ERROR_SPACE;
+        return 0;
+    }
+    if (_command == U_FLASH && _progress == 0 && len > 0 && data[0] != ESP_IMAGE_HEADER_MAGIC)
+    {
+        _error = UPDATE_ERROR_MAGIC_BYTE;
+        return 0;
+    }
+
+    size_t sectorEnd = (_progress + len + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+    size_t erasedEnd = (_progress + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+    if (sectorEnd > erasedEnd && esp_partition_erase_range(_partition, erasedEnd, sectorEnd - erasedEnd) != ESP_OK)
+    {
+        _error = UPDATE_ERROR_ERASE;
+        return 0;
+    }
+    if (esp_partition_write(_partition, _progress, data, len) != ESP_OK)
+    {
+        _error = UPDATE_ERROR_WRITE;
+        return 0;
+    }
+    _progress += len;
+    return len;
+}
+
+bool UpdateClass::end(bool evenIfRemaining)
+{
+    if (!_partition || hasError())
+    {
+        abort();
+        return false;
+    }
+    if (remaining() > 0 && !evenIfRemaining)
+    {
+        _error = UPDATE_ERROR_SIZE;
+        abort();
+        return false;
+    }
+
+    if (_command == U_FLASH && esp_ota_set_boot_partition(_partition) != ESP_OK)
+    {
+        _error = UPDATE_ERROR_WRITE;
+        abort();
+        return false;
+    }
+    _partition = nullptr;
+    return true;
+}
+
+void UpdateClass::abort()
+{
+    if (_partition && !hasError())
+    {
+        _error = UPDATE_ERROR_ABORT;
+    }
+    _partition = nullptr;
+}
+
+const char *UpdateClass::errorString() const
+{
+    switch (_error)
+    {
+        case UPDATE_ERROR_OK:
+            return "No Error";
+        case UPDATE_ERROR_WRITE:
+            return "Flash Write Failed";
+        case UPDATE_ERROR_ERASE:
+            return "Flash Erase Failed";
+        case UPDATE_ERROR_SPACE:
+            return "Not Enough Space";
+        case UPDATE_ERROR_SIZE:
+            return "Bad Size Given";
+        case UPDATE_ERROR_MAGIC_BYTE:
+            return "Wrong Magic Byte";
+        case UPDATE_ERROR_NO_PARTITION:
+            return "Partition Could Not be Found";
+        case UPDATE_ERROR_BAD_ARGUMENT:
+            return "Bad Argument";
+        case UPDATE_ERROR_ABORT:
+            return "Aborted";
+        default:
+            return "UNKNOWN";
+    }
+}
@@ -0,0 +1,152 @@
+#include "WString.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+static std::string formatInteger(unsigned long long value, bool negative, unsigned char base)
+{
+    if (base < 2 || base > 36)
+    {
+        base = 10;
+    }
+
+    std::string digits;
+    do
+    {
+        int digit = value % base;
+        digits += (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+        value /= base;
+    } while (value);
+
+    if (negative)
+    {
+        digits += '-';
+    }
+    std::reverse(digits.begin(), digits.end());
+    return digits;
+}
+
+static std::string formatSigned(long long value, unsigned char base)
+{
+    if (base == 10 && value < 0)
+    {
+        return formatInteger(0ULL - (unsigned long long)value, true, base);
+    }
+    return formatInteger((unsigned long long)value, false, base);
+}
+
+static std::string formatFloat(double value, unsigned int decimalPlaces)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimalPlaces, value);
+    return buffer;
+}
+
+String::String(unsigned char value, unsigned char base) : _buffer(formatInteger(value, false, base)) {}
+String::String(int value, unsigned char base) : _buffer(formatSigned(value, base)) {}
+String::String(unsigned int value, unsigned char base) : _buffer(formatInteger(value, false, base)) {}
+String::String(long value, unsigned char base) : _buffer(formatSigned(value, base)) {}
+String::String(unsigned long value, unsigned char base) : _buffer(formatInteger(value, false, base)) {}
+String::String(long long value, unsigned char base) : _buffer(formatSigned(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : _buffer(formatInteger(value, false, base)) {}
+String::String(float value, unsigned int decimalPlaces) : _buffer(formatFloat(value, decimalPlaces)) {}
+String::String(double value, unsigned int decimalPlaces) : _buffer(formatFloat(value, decimalPlaces)) {}
+
+bool String::equalsIgnoreCase(const String &value) const
+{
+    if (_buffer.length() != value._buffer.length())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < _buffer.length(); i++)
+    {
+        if (tolower((unsigned char)_buffer[i]) != tolower((unsigned char)value._buffer[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+    if (suffix._buffer.length() > _buffer.length())
+    {
+        return false;
+    }
+    return _buffer.compare(_buffer.length() - suffix._buffer.length(), suffix._buffer.length(), suffix._buffer) == 0;
+}
+
+int String::indexOf(char value, unsigned int fromIndex) const
+{
+    size_t index = _buffer.find(value, fromIndex);
+    return index == std::string::npos ? -1 : (int)index;
+}
+
+int String::indexOf(const String &value, unsigned int fromIndex) const
+{
+    size_t index = _buffer.find(value._buffer, fromIndex);
+    return index == std::string::npos ? -1 : (int)index;
+}
+
+int String::lastIndexOf(char value) const
+{
+    size_t index = _buffer.rfind(value);
+    return index == std::string::npos ? -1 : (int)index;
+}
+
+String String::substring(unsigned int beginIndex) const
+{
+    return substring(beginIndex, _buffer.length());
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const
+{
+    if (beginIndex > endIndex)
+    {
+        std::swap(beginIndex, endIndex);
+    }
+    if (beginIndex >= _buffer.length())
+    {
+        return String();
+    }
+    endIndex = std::min<unsigned int>(endIndex, _buffer.length());
+    return String(_buffer.substr(beginIndex, endIndex - beginIndex));
+}
+
+void String::replace(const String &find, const String &replacement)
+{
+    if (find._buffer.empty())
+    {
+        return;
+    }
+    size_t index = 0;
+    while ((index = _buffer.find(find._buffer, index)) != std::string::npos)
+    {
+        _buffer.replace(index, find._buffer.length(), replacement._buffer);
+        index += replacement._buffer.length();
+    }
+}
+
+void String::toLowerCase()
+{
+    std::transform(_buffer.begin(), _buffer.end(), _buffer.begin(), [](unsigned char c) { return tolower(c); });
+}
+
+void String::toUpperCase()
+{
+    std::transform(_buffer.begin(), _buffer.end(), _buffer.begin(), [](unsigned char c) { return toupper(c); });
+}
+
+void String::trim()
+{
+    size_t begin = _buffer.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos)
+    {
+        _buffer.clear();
+        return;
+    }
+    size_t end = _buffer.find_last_not_of(" \t\r\n");
+    _buffer = _buffer.substr(begin, end - begin + 1);
+}
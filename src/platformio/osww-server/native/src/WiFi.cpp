@@ -0,0 +1,97 @@
+#include <WiFi.h>
+
+#include <cstdio>
+
+WiFiClass WiFi;
+
+bool IPAddress::fromString(const char *address)
+{
+    unsigned int a, b, c, d;
+    char trailing;
+    if (!address || sscanf(address, "%u.%u.%u.%u%c", &a, &b, &c, &d, &trailing) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+    {
+        return false;
+    }
+    *this = IPAddress(a, b, c, d);
+    return true;
+}
+
+String IPAddress::toString() const
+{
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", _octets[0], _octets[1], _octets[2], _octets[3]);
+    return String(buffer);
+}
+
+wl_status_t WiFiClass::begin()
+{
+    _status = WL_CONNECTED;
+    return _status;
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *passphrase, int32_t channel, const uint8_t *bssid, bool connect)
+{
+    _ssid = ssid ? ssid : "";
+    _psk = passphrase ? passphrase : "";
+    if (channel)
+    {
+        _channel = channel;
+    }
+    if (bssid)
+    {
+        memcpy(_bssid, bssid, sizeof(_bssid));
+    }
+    _status = connect ? WL_CONNECTED : WL_DISCONNECTED;
+    return _status;
+}
+
+bool WiFiClass::config(IPAddress localIP, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress dns2)
+{
+    (void)dns2;
+    _staticConfig = (uint32_t)localIP != 0;
+    if (_staticConfig)
+    {
+        // Keep answering on loopback; only remember what we were asked to use
+        _gateway = gateway;
+        _subnet = subnet;
+        _dns = dns1;
+    }
+    return true;
+}
+
+bool WiFiClass::disconnect(bool wifiOff, bool eraseAp)
+{
+    (void)eraseAp;
+    _status = WL_DISCONNECTED;
+    if (wifiOff)
+    {
+        _mode = WIFI_OFF;
+    }
+    return true;
+}
+
+uint8_t WiFiClass::waitForConnectResult(unsigned long timeoutLength)
+{
+    (void)timeoutLength;
+    return _status;
+}
+
+String WiFiClass::BSSIDstr()
+{
+    char buffer[18];
+    snprintf(buffer, sizeof(buffer), "%02X:%02X:%02X:%02X:%02X:%02X", _bssid[0], _bssid[1], _bssid[2], _bssid[3], _bssid[4], _bssid[5]);
+    return String(buffer);
+}
+
+uint8_t *WiFiClass::macAddress(uint8_t *mac)
+{
+    memcpy(mac, _mac, sizeof(_mac));
+    return mac;
+}
+
+String WiFiClass::macAddress()
+{
+    char buffer[18];
+    snprintf(buffer, sizeof(buffer), "%02X:%02X:%02X:%02X:%02X:%02X", _mac[0], _mac[1], _mac[2], _mac[3], _mac[4], _mac[5]);
+    return String(buffer);
+}
@@ -0,0 +1,195 @@
+#include <WiFiUdp.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define NATIVE_UDP_MAX_PACKET 1460
+
+static in_addr_t toInAddr(IPAddress ip)
+{
+    return (in_addr_t)(uint32_t)ip;
+}
+
+bool WiFiUDP::openSocket(uint16_t port, bool reuse)
+{
+    stop();
+
+    _socket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (_socket < 0)
+    {
+        return false;
+    }
+
+    if (reuse)
+    {
+        int enable = 1;
+        setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        setsockopt(_socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+    }
+
+    fcntl(_socket, F_SETFL, fcntl(_socket, F_GETFL) | O_NONBLOCK);
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(_socket, (sockaddr *)&address, sizeof(address)) < 0)
+    {
+        stop();
+        return false;
+    }
+
+    _localPort = port;
+    return true;
+}
+
+uint8_t WiFiUDP::begin(uint16_t port)
+{
+    return openSocket(port, false) ? 1 : 0;
+}
+
+uint8_t WiFiUDP::beginMulticast(IPAddress multicast, uint16_t port)
+{
+    if (!openSocket(port, true))
+    {
+        return 0;
+    }
+
+    ip_mreq membership = {};
+    membership.imr_multiaddr.s_addr = toInAddr(multicast);
+    membership.imr_interface.s_addr = htonl(INADDR_LOOPBACK);
+    if (setsockopt(_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0)
+    {
+        membership.imr_interface.s_addr = htonl(INADDR_ANY);
+        setsockopt(_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership));
+    }
+
+    in_addr outgoing = {};
+    outgoing.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_IF, &outgoing, sizeof(outgoing));
+    unsigned char loop = 1;
+    setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+    _txIP = multicast;
+    _txPort = port;
+    return 1;
+}
+
+void WiFiUDP::stop()
+{
+    if (_socket >= 0)
+    {
+        close(_socket);
+        _socket = -1;
+    }
+    _rxBuffer.clear();
+    _rxPosition = 0;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+    if (_socket < 0 && !openSocket(0, false))
+    {
+        return 0;
+    }
+    _txIP = ip;
+    _txPort = port;
+    _txBuffer.clear();
+    return 1;
+}
+
+int WiFiUDP::beginPacket(const char *host, uint16_t port)
+{
+    IPAddress ip;
+    if (!ip.fromString(host))
+    {
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        addrinfo *result = nullptr;
+        if (getaddrinfo(host, nullptr, &hints, &result) != 0 || !result)
+        {
+            return 0;
+        }
+        ip = IPAddress((uint32_t)((sockaddr_in *)result->ai_addr)->sin_addr.s_addr);
+        freeaddrinfo(result);
+    }
+    return beginPacket(ip, port);
+}
+
+int WiFiUDP::endPacket()
+{
+    if (_socket < 0)
+    {
+        return 0;
+    }
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = toInAddr(_txIP);
+    address.sin_port = htons(_txPort);
+    ssize_t sent = sendto(_socket, _txBuffer.data(), _txBuffer.size(), 0, (sockaddr *)&address, sizeof(address));
+    _txBuffer.clear();
+    return sent >= 0 ? 1 : 0;
+}
+
+size_t WiFiUDP::write(uint8_t value)
+{
+    _txBuffer.push_back(value);
+    return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t *buffer, size_t size)
+{
+    _txBuffer.insert(_txBuffer.end(), buffer, buffer + size);
+    return size;
+}
+
+int WiFiUDP::parsePacket()
+{
+    if (_socket < 0)
+    {
+        return 0;
+    }
+    uint8_t buffer[NATIVE_UDP_MAX_PACKET];
+    sockaddr_in from = {};
+    socklen_t fromLength = sizeof(from);
+    ssize_t received = recvfrom(_socket, buffer, sizeof(buffer), 0, (sockaddr *)&from, &fromLength);
+    if (received <= 0)
+    {
+        return 0;
+    }
+    _rxBuffer.assign(buffer, buffer + received);
+    _rxPosition = 0;
+    _remoteIP = IPAddress((uint32_t)from.sin_addr.s_addr);
+    _remotePort = ntohs(from.sin_port);
+    return (int)received;
+}
+
+int WiFiUDP::available()
+{
+    return (int)(_rxBuffer.size() - _rxPosition);
+}
+
+int WiFiUDP::read()
+{
+    return _rxPosition < _rxBuffer.size() ? _rxBuffer[_rxPosition++] : -1;
+}
+
+int WiFiUDP::read(unsigned char *buffer, size_t length)
+{
+    size_t count = std::min(length, _rxBuffer.size() - _rxPosition);
+    memcpy(buffer, _rxBuffer.data() + _rxPosition, count);
+    _rxPosition += count;
+    return (int)count;
+}
+
+int WiFiUDP::peek()
+{
+    return _rxPosition < _rxBuffer.size() ? _rxBuffer[_rxPosition] : -1;
+}
@@ -0,0 +1,237 @@
+# Flash & RAM used by each firmware variant, see the esp32 envs in platformio.ini.
+#
+# After a build, records this env's use next to its firmware and compares it
+# with every other variant built so far, so what each feature costs (or what
+# leaving it out saves) shows up without reading two build logs side by side.
+#
+# The linker map then splits the firmware by library & source module. Each
+# build fails if one of them outgrows its budget (custom_footprint_budgets).
+#
+#   pio run -e esp32doit-devkit-v1 -t footprint
+#
+# prints the whole breakdown, and also checks the heap high-water mark the
+# emulator recorded (see native/emulator/Emulator.cpp) against its budget.
+
+Import("env")
+
+import json
+import os
+import re
+import subprocess
+
+MAP_FILE = "$BUILD_DIR/${PROGNAME}.map"
+HEAP_REPORT = os.path.join(".pio", "native-emulator", "heap.json")
+# Components listed by -t footprint; the rest are summed into one line
+TOP_COMPONENTS = 30
+
+env.Append(LINKFLAGS=["-Wl,-Map=" + env.subst(MAP_FILE)])
+
+
+def measure(elf):
+    # Same sections & regexes PlatformIO's own "RAM: / Flash:" summary uses
+    output = subprocess.check_output([env.subst("$SIZETOOL"), "-A", "-d", elf]).decode()
+    flash = sum(int(size) for size in re.findall(env.get("SIZEPROGREGEXP"), output, re.M))
+    ram = sum(int(size) for size in re.findall(env.get("SIZEDATAREGEXP"), output, re.M))
+    return {"flash": flash, "ram": ram}
+
+
+def regions_of(section):
+    """
+    Where an output section ends up. Code in IRAM & initialized data are
+    copied from flash at boot, so they count towards the flash image too.
+    """
+    if section.startswith(".iram0."):
+        return ("flash", "iram")
+    if section == ".dram0.data":
+        return ("flash", "dram")
+    if section.startswith(".dram0.") or section == ".noinit":
+        return ("dram",)
+    if section.startswith(".flash.") and "noload" not in section:
+        return ("flash",)
+    return ()
+
+
+def component_of(path):
+    """
+    Library, ESP-IDF component, toolchain library or source module an input
+    section came from, e.g. ESPAsyncWebServer-esphome, idf/net80211, MotorControl.cpp
+    """
+    archive = re.match(r"(.*)\((.*)\)$", path)
+    if archive:
+        name = os.path.basename(archive.group(1))
+        name = re.sub(r"^lib|\.a$", "", name)
+        if "toolchain-" in archive.group(1):
+            return "toolchain/" + name
+        if "framework-arduinoespressif32" in archive.group(1):
+            return "idf/" + name
+        return name
+    return re.sub(r"\.o$", "", os.path.basename(path))
+
+
+def parse_map(path):
+    """
+    Bytes per component & region, from the input sections in a GNU ld map
+    """
+    components = {}
+    section = None
+    pending = None
+    in_memory_map = False
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if not in_memory_map:
+                in_memory_map = line.startswith("Linker script and memory map")
+                continue
+
+            if line and not line[0].isspace():
+                # An output section, or the end of the ones that are kept
+                section = line.split()[0] if line.startswith(".") else None
+                pending = None
+                continue
+            if section is None:
+                continue
+
+            match = re.match(r"^ (?:\.\S+|COMMON)\s+0x[0-9a-f]+\s+0x([0-9a-f]+)\s+(\S.*)$", line)
+            if not match and pending:
+                # Long input section names get a line of their own, the rest follows
+                match = re.match(r"^\s+0x[0-9a-f]+\s+0x([0-9a-f]+)\s+(\S.*)$", line)
+            pending = re.match(r"^ (?:\.\S+|COMMON)\s*$", line) is not None
+            if not match:
+                continue
+
+            size = int(match.group(1), 16)
+            if size == 0:
+                continue
+            name = component_of(match.group(2))
+            usage = components.setdefault(name, {"flash": 0, "dram": 0, "iram": 0})
+            for region in regions_of(section):
+                usage[region] += size
+    return components
+
+
+def read_budgets():
+    """
+    Lines of "<component|total|heap> <flash|dram|iram|peak> <bytes>"
+    """
+    budgets = []
+    for line in env.GetProjectOption("custom_footprint_budgets", "").splitlines():
+        fields = line.split()
+        if len(fields) == 3:
+            budgets.append((fields[0], fields[1], int(fields[2], 0)))
+        elif fields:
+            print("Ignoring footprint budget '%s', expected <component> <region> <bytes>" % line.strip())
+    return budgets
+
+
+def check_budgets(components, heap):
+    """
+    @return the budgets that were exceeded, as messages
+    """
+    totals = {"flash": 0, "dram": 0, "iram": 0}
+    for usage in components.values():
+        for region in totals:
+            totals[region] += usage[region]
+
+    exceeded = []
+    for name, region, limit in read_budgets():
+        if name == "heap":
+            if heap is None:
+                continue
+            used = heap.get(region, 0)
+        elif name == "total":
+            used = totals.get(region, 0)
+        else:
+            used = components.get(name, {}).get(region, 0)
+        if used > limit:
+            exceeded.append("%s %s is %d bytes, over its budget of %d by %d" % (name, region, used, limit, used - limit))
+    return exceeded
+
+
+def report_variants(source, target, env):
+    build_dir = env.subst("$BUILD_DIR")
+    this_env = env.subst("$PIOENV")
+    footprint = measure(str(source[0]))
+    with open(os.path.join(build_dir, "footprint.json"), "w") as f:
+        json.dump(footprint, f)
+
+    variants = {}
+    builds_dir = env.subst("$PROJECT_BUILD_DIR")
+    for name in sorted(os.listdir(builds_dir)):
+        path = os.path.join(builds_dir, name, "footprint.json")
+        if os.path.isfile(path):
+            with open(path) as f:
+                variants[name] = json.load(f)
+
+    print("")
+    print("%-36s %10s %10s %10s %10s" % ("Variant", "Flash", "vs this", "RAM", "vs this"))
+    for name, used in sorted(variants.items(), key=lambda item: item[1]["flash"]):
+        print("%-36s %10d %+10d %10d %+10d%s" % (
+            name,
+            used["flash"], used["flash"] - footprint["flash"],
+            used["ram"], used["ram"] - footprint["ram"],
+            "  <- this build" if name == this_env else ""))
+    if len(variants) == 1:
+        print("Build the other esp32doit-devkit-v1 envs to compare them with this one")
+    print("")
+
+    map_file = env.subst(MAP_FILE)
+    if not os.path.isfile(map_file):
+        return 0
+    exceeded = check_budgets(parse_map(map_file), None)
+    for message in exceeded:
+        print("Footprint budget exceeded: " + message)
+    return 1 if exceeded else 0
+
+
+def read_heap_report():
+    path = os.path.join(env.subst("$PROJECT_DIR"), HEAP_REPORT)
+    if not os.path.isfile(path):
+        return None
+    with open(path) as f:
+        return json.load(f)
+
+
+def report_components(source, target, env):
+    components = parse_map(env.subst(MAP_FILE))
+    ranked = sorted(components.items(), key=lambda item: item[1]["flash"] + item[1]["dram"], reverse=True)
+
+    print("")
+    print("%-40s %10s %10s %10s" % ("Component", "Flash", "DRAM", "IRAM"))
+    for name, usage in ranked[:TOP_COMPONENTS]:
+        print("%-40s %10d %10d %10d" % (name, usage["flash"], usage["dram"], usage["iram"]))
+    rest = ranked[TOP_COMPONENTS:]
+    if rest:
+        print("%-40s %10d %10d %10d" % (
+            "(%d more)" % len(rest),
+            sum(usage["flash"] for _, usage in rest),
+            sum(usage["dram"] for _, usage in rest),
+            sum(usage["iram"] for _, usage in rest)))
+    print("%-40s %10d %10d %10d" % (
+        "total",
+        sum(usage["flash"] for usage in components.values()),
+        sum(usage["dram"] for usage in components.values()),
+        sum(usage["iram"] for usage in components.values())))
+
+    heap = read_heap_report()
+    if heap is None:
+        print("\nNo heap report yet; run the native-emulator env (and some load) to record one")
+    else:
+        # The emulator runs its own feature set, on a 64-bit host; a guide, not a measurement
+        print("\nHeap in the emulator: %d bytes at most, %d in use, %d allocations" % (heap["peak"], heap["inUse"], heap["allocations"]))
+
+    print("")
+    exceeded = check_budgets(components, heap)
+    for message in exceeded:
+        print("Footprint budget exceeded: " + message)
+    if not exceeded:
+        print("Within every footprint budget")
+    return 1 if exceeded else 0
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", report_variants)
+env.AddCustomTarget(
+    name="footprint",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=report_components,
+    title="Footprint",
+    description="Flash, DRAM & IRAM per library & module, checked against the budgets")
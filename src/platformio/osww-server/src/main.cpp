@@ -1,21 +1,52 @@
 #include <Arduino.h>
 #include <WiFiManager.h>
 #include <LittleFS.h>
-#include <ArduinoJson.h>
 #include <ESPmDNS.h>
 #include <ESP32Time.h>
 #include <NTPClient.h>
 #include <WiFiUdp.h>
+#include <memory>
 
-#ifdef OLED_ENABLED
+// Picks the features, so it comes before anything that tests them
+#include "./utils/BoardProfile.h"
+
+#if OLED_ENABLED
 	#include <SPI.h>
 	#include <Wire.h>
 	#include <Adafruit_GFX.h>
 	#include <Adafruit_SSD1306.h>
 #endif
 
+#if HOME_ASSISTANT_ENABLED
+	#include <ArduinoHA.h>
+#endif
+
 #include "./utils/LedControl.h"
 #include "./utils/MotorControl.h"
+#include "./utils/HBridgeDriver.h"
+#include "./utils/StepperDriver.h"
+#include "./utils/WindingRoutine.h"
+#include "./utils/SleepControl.h"
+#include "./utils/WifiCache.h"
+#include "./utils/BootProfiler.h"
+#include "./utils/StartupGraph.h"
+#include "./utils/ApiSchema.h"
+#include "./utils/StateStore.h"
+#include "./utils/SessionHistory.h"
+#include "./utils/HistoryStream.h"
+#include "./utils/OtaUpdate.h"
+#include "./utils/Logger.h"
+#include "./utils/WinderGroup.h"
+#include "./utils/CurrentSensor.h"
+#include "./utils/Tracer.h"
+#include "./utils/HaDiscovery.h"
+#include "./utils/LatencyStats.h"
+#include "./utils/CommandQueue.h"
+#include "./utils/SettingsStore.h"
+#include "./utils/CheckpointStore.h"
+#include "./utils/Telemetry.h"
+#include "./utils/MdnsAdvert.h"
+#include "./utils/PatternStore.h"
 
 #include "FS.h"
 #include "ESPAsyncWebServer.h"
@@ -27,32 +58,44 @@
  *
  * If you purchased the motor listed in the guide / Bill Of Materials, these default values are correct!
  *
- * durationInSecondsToCompleteOneRevolution = how long it takes the watch to complete one rotation on the winder.
- * directionalPinA = this is the pin that's wired to IN1 on your L298N circuit board
- * directionalPinB = this is the pin that's wired to IN2 on your L298N circuit board
- * ledPin = by default this is set to the ESP32's onboard LED. If you've wired an external LED, change this value to the GPIO pin the LED is wired to.
- * externalButton = OPTIONAL - If you want to use an external ON/OFF button, connect it to this pin 13. If you need to use another pin, change the value here.
+ * Pins & the OLED's size are in the board profile, see utils/BoardProfile.h. The features Winderoo
+ * is built with (OLED, Home Assistant, ...) are picked per env in platformio.ini.
  *
- * If you're using a NeoPixel equipped board, you'll need to change directionalPinA, directionalPinB and ledPin (pin 18 on most, I think) to appropriate GPIOs.
- * Failure to set these pins on NeoPixel boards will result in kernel panics.
- */
-int durationInSecondsToCompleteOneRevolution = 8;
-int directionalPinA = 25;
-int directionalPinB = 26;
-int ledPin = 0;
-int externalButton = 13;
-
-// OLED CONFIG
-bool OLED_INVERT_SCREEN = false;
-bool OLED_ROTATE_SCREEN_180 = false;
-int SCREEN_WIDTH = 128; // OLED display width, in pixels
-int SCREEN_HEIGHT = 64; // OLED display height, in pixels
-int OLED_RESET = -1; // Reset pin number (or -1 if sharing Arduino reset pin)
+ * durationInSecondsToCompleteOneRevolution = how long it takes the watch to complete one rotation on the winder.
+ */
+constexpr int durationInSecondsToCompleteOneRevolution = 8;
+
+// OLED CONFIG - only used when built with OLED_ENABLED=true
+constexpr bool OLED_INVERT_SCREEN = false;
+constexpr bool OLED_ROTATE_SCREEN_180 = false;
+
+// DEEP SLEEP CONFIG - only used when built with DEEP_SLEEP_ENABLED=true
+constexpr int DEEP_SLEEP_GRACE_PERIOD_SECONDS = 120; // How long to stay awake (and reachable) after a timed session before sleeping
+
+// FAST BOOT CONFIG
+constexpr int FAST_RECONNECT_TIMEOUT_MS = 5000; // How long to try the cached access point, DHCP included, before falling back to a full WiFi connect
+
+// GROUP CONFIG - only used when built with GROUP_ENABLED=true
+const char* GROUP_NAME = "winderoo"; // Winders with the same name, on the same network, take turns starting
+constexpr int GROUP_MAX_RUNNING_MOTORS = 1; // How many of them may wind at the same time, e.g. what their shared supply can take
+
+// CURRENT SENSE CONFIG - only used when built with CURRENT_SENSE_ENABLED=true
+constexpr int CURRENT_SENSE_SHUNT_MILLIOHMS = 1000; // The shunt's resistance, on the board's currentSensePin; 1 ohm reads up to about 950 mA
+constexpr int MOTOR_STALL_MILLIAMPS = 400; // Drawing this much for a moment means the motor can't turn
+constexpr int MOTOR_SUPPLY_MILLIVOLTS = 5000; // The motor's supply, for the energy a session used
+
+// STEPPER CONFIG - only used when built with STEPPER_MOTOR_ENABLED=true
+constexpr int STEPPER_STEPS_PER_TURN = 200 * 16; // The motor's full steps per turn, times the driver's microstepping
+constexpr int STEPPER_ACCELERATION = 1600; // In steps/s², how gently the cushion gets up to speed & stops
 
 // Home Assistant Configuration
 const char* HOME_ASSISTANT_BROKER_IP = "192.168.1.251";
 const char* HOME_ASSISTANT_USERNAME = "tulio";
 const char* HOME_ASSISTANT_PASSWORD = "fyt202729";
+constexpr int MQTT_POLL_INTERVAL_MS = 10; // How often the MQTT task reads the socket; commands wait at most this long for it
+constexpr unsigned long NTP_RESYNC_INTERVAL_MS = 6UL * 60 * 60 * 1000; // How often the clock is set again from NTP, it drifts a few seconds a day
+constexpr unsigned long NTP_RETRY_INTERVAL_MS = 60UL * 1000; // Until NTP first answers
+constexpr int HOME_ASSISTANT_RECEPTION_INTERVAL_MS = 10000; // How often the WiFi reception is checked, it's only published when it changes
 /*
  * *************************************************************************************
  * ******************************* END CONFIGURABLES ***********************************
@@ -62,71 +105,228 @@ const char* HOME_ASSISTANT_PASSWORD = "fyt202729";
 /*
  * DO NOT CHANGE THESE VARIABLES!
  */
-String settingsFile = "/settings.json";
+// Where older firmware kept the settings; moved to NVS on the first boot, see loadSettings()
+const char *legacySettingsFile = "/settings.json";
+// Until anything is saved, as in the data/settings.json older firmware shipped with
+constexpr WINDER_SETTINGS defaultSettings = {220, 2, 0, 0, false, false};
+// Fixed buffers for JSON bodies, see ApiSchema.h
+#define SETTINGS_FILE_MAX_SIZE 256
+#define STATUS_RESPONSE_MAX_SIZE 512
+#define BOOT_RESPONSE_MAX_SIZE (BOOT_PROFILER_MAX_PHASES * 64 + 160)
+#define OTA_RESPONSE_MAX_SIZE 320
+#define GROUP_RESPONSE_MAX_SIZE (GROUP_MAX_MEMBERS * 200 + 160)
+#define MOTOR_RESPONSE_MAX_SIZE 192
+#define HOME_ASSISTANT_RESPONSE_MAX_SIZE 320
+#define COMMAND_RESPONSE_MAX_SIZE 160
+#define SETTINGS_RESPONSE_MAX_SIZE 128
+#define PATTERN_RESPONSE_MAX_SIZE (PATTERN_DECOMPILED_SIZE + 320)
+#define PATTERNS_RESPONSE_MAX_SIZE (PATTERN_SLOTS * 256 + 32)
 unsigned long rtc_offset;
 unsigned long rtc_epoch;
-unsigned long estimatedRoutineFinishEpoch;
-unsigned long previousEpoch;
-unsigned long startTimeEpoch;
 bool reset = false;
-bool routineRunning = false;
 bool configPortalRunning = false;
-bool screenSleep = false;
-bool screenEquipped = OLED_ENABLED;
-struct RUNTIME_VARS
-{
-	String status = "";
-	String rotationsPerDay = "";
-	String direction = "";
-	String hour = "00";
-	String minutes = "00";
-	String winderEnabled = "1";
-	String timerEnabled = "0";
-};
+constexpr bool screenEquipped = OLED_ENABLED;
+// Set by the loop once it has stepped the RTC to NTP's time, see applyTime()
+volatile bool timeSynced = false;
+volatile bool homeAssistantReady = false;
+// Guards mounting & unmounting LittleFS, a filesystem upload does it from the webserver's task
+SemaphoreHandle_t fileSystemMutex;
+bool fileSystemUnmounted = false;
+// Guards what fetchTime() leaves for applyTime(), it's never held while waiting on the network
+SemaphoreHandle_t timeMutex;
+bool timePending = false;
+unsigned long fetchedEpoch = 0;
+unsigned long fetchedMs = 0;
+// The NTP startup stage has had its try; from then on the loop fetches the time, see resyncTime()
+volatile bool ntpStageFinished = false;
+volatile bool ntpTaskRunning = false;
+unsigned long ntpAttemptMs = 0;
+#define NTP_TASK_STACK_SIZE 4096
+#if DEEP_SLEEP_ENABLED
+	bool deepSleepPending = false;
+	unsigned long sessionCompletedMillis = 0;
+#endif
 
 /*
  * DO NOT CHANGE THESE VARIABLES!
  */
-RUNTIME_VARS userDefinedSettings;
-LedControl LED(ledPin);
+// Change state through the store's setters only; subscribers redraw, publish & save it
+StateStore store;
+const WINDER_STATE &userDefinedSettings = store.get();
+LedControl LED(board.ledPin);
 WiFiManager wm;
 AsyncWebServer server(80);
+AsyncEventSource events("/api/events");
+SessionHistory history;
+// Actuation from the webserver & MQTT, applied by the loop
+CommandQueue commands;
+SettingsStore settingsStore;
+// Trends of RSSI, heap, loop time & the motor, see /api/telemetry
+Telemetry telemetry;
+// Live state in the TXT record of _winderoo._tcp, see MdnsAdvert.h
+MdnsAdvert mdnsAdvert;
+// Uploaded winding patterns & the one sessions run, see PatternStore.h
+PatternStore patterns;
+unsigned long loopStartedMs = 0;
+OtaUpdate ota;
 WiFiClient client;
 ESP32Time rtc;
+SleepControl sleepControl(board.buttonPin);
+WifiCache wifiCache;
+BootProfiler bootProfiler;
+StartupGraph startup(bootProfiler);
 WiFiUDP ntpUDP;
 NTPClient timeClient(ntpUDP, "192.168.1.246"); // Replace with your local NTP server IP
 String winderooVersion = "3.0.0";
 
-#if PWM_MOTOR_CONTROL
-	MotorControl motor(directionalPinA, directionalPinB, true);
+#if STEPPER_MOTOR_ENABLED
+	// STEP on motorPinA, DIR on motorPinB; drive() turns at the winder's usual speed
+	StepperDriver motorDriver(board.motorPinA, board.motorPinB, STEPPER_STEPS_PER_TURN, STEPPER_ACCELERATION, 60.0f / durationInSecondsToCompleteOneRevolution);
 #else
-	MotorControl motor(directionalPinA, directionalPinB);
+	HBridgeDriver motorDriver(board.motorPinA, board.motorPinB);
+#endif
+MotorControl motor(motorDriver);
+WindingRoutine winder(motor, durationInSecondsToCompleteOneRevolution);
+// The running session's progress, so a power cut doesn't start it over
+CheckpointStore checkpoints(winder);
+int resumedTurns = 0;
+
+#if GROUP_ENABLED
+	WinderGroup group;
 #endif
 
-#ifdef OLED_ENABLED
-	Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
+#if CURRENT_SENSE_ENABLED
+	CurrentSensor currentSensor(motor, MOTOR_STALL_MILLIAMPS);
 #endif
 
-#ifdef HOME_ASSISTANT_ENABLED
-	#include <ArduinoHA.h>
+#if OLED_ENABLED
+	Adafruit_SSD1306 display(board.screenWidth, board.screenHeight, &Wire, board.screenResetPin);
+#endif
 
+#if HOME_ASSISTANT_ENABLED
 	HADevice device;
 	HAMqtt mqtt(client, device);
+	HaDiscovery haDiscovery;
+	// Retained hash of the discovery configs the broker holds, "aha/<device id>/discovery"
+	char haDiscoveryTopic[48];
+	// Set on connect; the next state dispatch publishes every entity's state, changed or not
+	volatile bool homeAssistantResync = false;
+	#define MQTT_TASK_STACK_SIZE 4096
+
+	// WiFi reception, reported as an extra bit next to the StateField ones
+	#define HA_RECEPTION (STATE_ALL + 1)
+	#define HA_STATE_QUEUE_LENGTH 4
+
+	/**
+	 * States for Home Assistant, as the loop hands them to the MQTT task.
+	 * Only the MQTT task touches the client, so a broker reconnect never
+	 * holds up the loop.
+	 */
+	struct HA_STATE_UPDATE
+	{
+		uint32_t changed; // StateField bits & HA_RECEPTION
+		bool force;       // sent even if it matches what was last sent
+		char activity[32];
+		int32_t rotationsPerDay;
+		int8_t direction;
+		int8_t hour;
+		int8_t minutes;
+		bool timerEnabled;
+		bool winderEnabled;
+		bool screenSleep;
+		const char *reception;
+	};
+	QueueHandle_t haStateQueue = NULL;
+	// Loop only: changes not handed over yet because the queue was full
+	uint32_t haPendingChanged = 0;
+	bool haPendingForce = false;
+	const char *haReception = "";
+	unsigned long haReceptionCheckedMs = 0;
+	// MQTT receive -> motor pins, for commands that start, stop or reverse it
+	LatencyStats haCommandLatency;
+
+	/**
+	 * An entity whose discovery config is hashed as it's set up, and only
+	 * published when haDiscovery says the broker doesn't have it
+	 */
+	template <class T>
+	class CachedEntity : public T
+	{
+	protected:
+		void buildSerializer() override
+		{
+			if (haDiscovery.isPublishing())
+			{
+				T::buildSerializer();
+			}
+		}
+
+	public:
+		CachedEntity(const char *uniqueId) : T(uniqueId)
+		{
+			haDiscovery.add(uniqueId);
+		}
+
+		void setName(const char *name) { haDiscovery.add(name); T::setName(name); }
+		void setIcon(const char *icon) { haDiscovery.add(icon); T::setIcon(icon); }
+		void setOptions(const char *options) { haDiscovery.add(options); T::setOptions(options); }
+		void setMin(float min) { haDiscovery.add(min); T::setMin(min); }
+		void setMax(float max) { haDiscovery.add(max); T::setMax(max); }
+		void setStep(float step) { haDiscovery.add(step); T::setStep(step); }
+		void setOptimistic(bool optimistic) { haDiscovery.add(optimistic ? "optimistic" : ""); T::setOptimistic(optimistic); }
+
+		void publishDiscovery()
+		{
+			this->publishConfig();
+		}
+	};
 
 	// Define HA Sensors
-	HASwitch ha_oledSwitch("oled");
-	HANumber ha_rpd("rpd");
-	HASelect ha_selectDirection("direction");
-	HASwitch ha_timerSwitch("timerEnabled");
-	HAButton ha_startButton("startButton");
-	HAButton ha_stopButton("stopButton");
-	HASelect ha_selectHours("hour");
-	HASelect ha_selectMinutes("minutes");
-	HASwitch ha_powerSwitch("power");
-	HASensor ha_rssiReception("rssiReception");
-	HASensor ha_activityState("activity");
+	CachedEntity<HASwitch> ha_oledSwitch("oled");
+	CachedEntity<HANumber> ha_rpd("rpd");
+	CachedEntity<HASelect> ha_selectDirection("direction");
+	CachedEntity<HASwitch> ha_timerSwitch("timerEnabled");
+	CachedEntity<HAButton> ha_startButton("startButton");
+	CachedEntity<HAButton> ha_stopButton("stopButton");
+	CachedEntity<HASelect> ha_selectHours("hour");
+	CachedEntity<HASelect> ha_selectMinutes("minutes");
+	CachedEntity<HASwitch> ha_powerSwitch("power");
+	CachedEntity<HASensor> ha_rssiReception("rssiReception");
+	CachedEntity<HASensor> ha_activityState("activity");
+#endif
+
+/**
+ * WiFi reception as the OLED's bars, 1 to 4; also reported to Home Assistant
+ */
+int getWifiBars()
+{
+	int rssi = WiFi.RSSI();
+	if (rssi > -50)
+	{
+		return 4;
+	}
+	if (rssi > -60)
+	{
+		return 3;
+	}
+	return rssi > -70 ? 2 : 1;
+}
+
+#if HOME_ASSISTANT_ENABLED
+// Home Assistant's rssiReception, by getWifiBars()
+static const char *wifiReceptionNames[] = {"", "Poor", "Fair", "Good", "Excellent"};
 #endif
 
+#if OLED_ENABLED
+/**
+ * Sends the frame buffer over I2C, the slow part of any drawing
+ */
+static void showDisplay()
+{
+	TRACE_SCOPE("display.display");
+	display.display();
+}
+
 void drawCentreStringToMemory(const char *buf, int x, int y)
 {
     int16_t x1, y1;
@@ -137,96 +337,66 @@ void drawCentreStringToMemory(const char *buf, int x, int y)
 }
 
 static void drawStaticGUI(bool drawHeaderTitle = false, String title = "Winderoo") {
-	if (OLED_ENABLED)
-	{
-		display.clearDisplay();
+	display.clearDisplay();
 
-		display.setTextSize(1);
-		display.setTextColor(WHITE);
+	display.setTextSize(1);
+	display.setTextColor(WHITE);
 
-		if (drawHeaderTitle)
-		{
-			drawCentreStringToMemory(title.c_str(), 64, 3);
-		}
-		// top horizontal line
-		display.drawLine(0, 14, display.width(), 14, WHITE);
-		// vertical line
-		display.drawLine(64, 14, 64, 50, WHITE);
-		// bottom horizontal line
-		display.drawLine(0, 50, display.width(), 50, WHITE);
+	if (drawHeaderTitle)
+	{
+		drawCentreStringToMemory(title.c_str(), 64, 3);
+	}
+	// top horizontal line
+	display.drawLine(0, 14, display.width(), 14, WHITE);
+	// vertical line
+	display.drawLine(64, 14, 64, 50, WHITE);
+	// bottom horizontal line
+	display.drawLine(0, 50, display.width(), 50, WHITE);
 
-		display.setCursor(4, 18);
-		display.println(F("TPD"));
+	display.setCursor(4, 18);
+	display.println(F("TPD"));
 
-		display.setCursor(71, 18);
-		display.println(F("DIR"));
+	display.setCursor(71, 18);
+	display.println(F("DIR"));
 
-		display.display();
-	}
+	showDisplay();
 }
 
 static void drawTimerStatus() {
-	if (OLED_ENABLED)
+	if (userDefinedSettings.timerEnabled == "1")
 	{
-		if (userDefinedSettings.timerEnabled == "1")
-		{
-			// right aligned timer
-			display.fillRect(60, 51, 64, 13, BLACK);
-			display.setCursor(60, 56);
-			display.print("TIMER " + userDefinedSettings.hour + ":" + userDefinedSettings.minutes);
-		}
-		else
-		{
-			display.fillRect(60, 51, 68, 13, BLACK);
-		}
+		// right aligned timer
+		display.fillRect(60, 51, 64, 13, BLACK);
+		display.setCursor(60, 56);
+		display.print("TIMER " + userDefinedSettings.hour + ":" + userDefinedSettings.minutes);
+	}
+	else
+	{
+		display.fillRect(60, 51, 68, 13, BLACK);
 	}
 }
 
 static void drawWifiStatus() {
-	if (OLED_ENABLED)
-	{
-		// left aligned cell reception icon
-		display.drawTriangle(4, 54, 10, 54, 7, 58, WHITE);
-		display.drawLine(7, 58, 7, 62, WHITE);
+	// left aligned cell reception icon
+	display.drawTriangle(4, 54, 10, 54, 7, 58, WHITE);
+	display.drawLine(7, 58, 7, 62, WHITE);
 
-		// Clear reception bars
-		display.fillRect(12, 54, 58, 10, BLACK);
+	// Clear reception bars
+	display.fillRect(12, 54, 58, 10, BLACK);
 
-		if (WiFi.RSSI() > -50)
-		{
-			// Excellent reception - 4 bars
-			display.fillRect(14, 55+8, 2, 2, WHITE);
-			display.fillRect(18, 55+6, 2, 4, WHITE);
-			display.fillRect(22, 55+4, 2, 6, WHITE);
-			display.fillRect(26, 55+2, 2, 8, WHITE);
-			if (HOME_ASSISTANT_ENABLED)	ha_rssiReception.setValue("Excellent");
-		}
-		else if (WiFi.RSSI() > -60)
-		{
-			// Good reception - 3 bars
-			display.fillRect(14, 55+8, 2, 2, WHITE);
-			display.fillRect(18, 55+6, 2, 4, WHITE);
-			display.fillRect(22, 55+4, 2, 6, WHITE);
-			if (HOME_ASSISTANT_ENABLED) ha_rssiReception.setValue("Good");
-		}
-		else if (WiFi.RSSI() > -70)
-		{
-			// Fair reception - 2 bars
-			display.fillRect(14, 55+8, 2, 2, WHITE);
-			display.fillRect(18, 55+6, 2, 4, WHITE);
-			if (HOME_ASSISTANT_ENABLED) ha_rssiReception.setValue("Fair");
-		}
-		else
-		{
-			// Terrible reception - 1 bar
-			display.fillRect(14, 55+8, 2, 2, WHITE);
-			if (HOME_ASSISTANT_ENABLED) ha_rssiReception.setValue("Poor");
-		}
+	// Excellent reception - 4 bars, down to terrible - 1 bar
+	int bars = getWifiBars();
+	for (int bar = 0; bar < bars; bar++)
+	{
+		display.fillRect(14 + bar * 4, 55 + 8 - bar * 2, 2, 2 + bar * 2, WHITE);
 	}
 }
+#endif
 
+// Called whatever the build; without OLED_ENABLED they're empty & compile away
 static void drawDynamicGUI() {
-	if (OLED_ENABLED && !screenSleep)
+#if OLED_ENABLED
+	if (!userDefinedSettings.screenSleep)
 	{
 
 		display.fillRect(8, 25, 54, 25, BLACK);
@@ -242,19 +412,21 @@ static void drawDynamicGUI() {
 		drawWifiStatus();
 		drawTimerStatus();
 
-		display.display();
+		showDisplay();
 	}
+#endif
 }
 
 static void drawNotification(String message) {
-	if (OLED_ENABLED && !screenSleep)
+#if OLED_ENABLED
+	if (!userDefinedSettings.screenSleep)
 	{
 		display.setCursor(0, 0);
 		display.drawRect(0, 0, 128, 14, WHITE);
 		display.fillRect(0, 0, 128, 14, WHITE);
 		display.setTextColor(BLACK);
 		drawCentreStringToMemory(message.c_str(), 64, 3);
-		display.display();
+		showDisplay();
 		display.setTextColor(WHITE);
 		delay(200);
 		display.setCursor(0, 0);
@@ -265,12 +437,14 @@ static void drawNotification(String message) {
 
 		// Underline notification, which is shared with Static GUI
 		display.drawLine(0, 14, display.width(), 14, WHITE);
-		display.display();
+		showDisplay();
 	}
+#endif
 }
 
 template <int N> static void drawMultiLineText(const String (&message)[N]) {
-	if (OLED_ENABLED && !screenSleep)
+#if OLED_ENABLED
+	if (!userDefinedSettings.screenSleep)
 	{
 		int yInitial = 20;
 		int yOffset = 16;
@@ -288,10 +462,12 @@ template <int N> static void drawMultiLineText(const String (&message)[N]) {
 				drawCentreStringToMemory(message[i].c_str(), 64, yInitial + (yOffset * i));
 			}
 		}
-	display.display();
+	showDisplay();
 	}
+#endif
 }
 
+#if HOME_ASSISTANT_ENABLED
 // Home Assistant Helper Functions
 /**
  * @brief Returns the index corresponding to a given direction for Home Assistant.
@@ -359,405 +535,1850 @@ int getTimerMinutesIndexForHomeAssistant(int minuteValue)
 			return 0;
 	}
 }
+#endif
 
 /**
- * Calculates the duration and estimated finish time of the winding routine
+ * Sets running conditions to TRUE & calculates winding time parameters
  *
- * @return epoch - estimated epoch when winding routine will finish
+ * @param notice shown on the OLED
+ * @param checkpoint progress of a session cut short, to deliver only the turns it still owed
  */
-unsigned long calculateWindingTime()
+void beginWindingRoutine(const char *notice = "Winding", const WINDING_PROGRESS *checkpoint = NULL)
 {
-	int tpd = atoi(userDefinedSettings.rotationsPerDay.c_str());
+#if DEEP_SLEEP_ENABLED
+	deepSleepPending = false;
+#endif
+#if GROUP_ENABLED
+	// Started by hand or on its turn, either way nothing is left to wait for
+	group.cancelStart();
+#endif
+	store.setStatus("Winding");
+	store.notify(notice);
+	Log.status(LOG_MAIN, "Begin winding routine");
 
-	long totalSecondsSpentTurning = tpd * durationInSecondsToCompleteOneRevolution;
+#if CURRENT_SENSE_ENABLED
+	currentSensor.beginSession();
+#endif
+	WINDING_PATTERN pattern;
+	bool patterned = patterns.getActivePattern(pattern);
+	winder.setPattern(patterned ? &pattern : NULL);
+	if (patterned)
+	{
+		Log.status(LOG_MAIN, "Winding pattern %d, %s", patterns.getActive(), pattern.name);
+	}
 
-	// We want to rest every 3 minutes for 15 seconds
-	long totalNumberOfRestingPeriods = totalSecondsSpentTurning / 180;
-	long totalRestDuration = totalNumberOfRestingPeriods * 180;
-	long finalRoutineDuration = totalRestDuration + totalSecondsSpentTurning;
+	if (checkpoint != NULL)
+	{
+		resumedTurns = winder.resume(*checkpoint, userDefinedSettings.direction, rtc.getEpoch());
+		Log.status(LOG_MAIN, "Resuming the session, %d of %u turns left", resumedTurns, (unsigned)checkpoint->plannedTurns);
+	}
+	else
+	{
+		winder.begin(userDefinedSettings.rotationsPerDay.toInt(), userDefinedSettings.direction, rtc.getEpoch());
+	}
+	checkpoints.save(millis());
 
-	Serial.print("[STATUS] - Total winding duration: ");
-	Serial.println(finalRoutineDuration);
+	Log.status(LOG_MAIN, "Current time: %lu", rtc.getEpoch());
 
-	unsigned long epoch = rtc.getEpoch();
-	unsigned long estimatedFinishTime = epoch + finalRoutineDuration;
+	Log.status(LOG_MAIN, "Estimated finish time: %ld", winder.getEstimatedFinishEpoch());
 
-	return estimatedFinishTime;
+	sleepControl.recordMotorStart();
 }
 
 /**
- * Sets running conditions to TRUE & calculates winding time parameters
+ * Queues the session that just ended for the history, see SessionHistory
  */
-void beginWindingRoutine()
+void recordSession(HistoryStopReason reason)
 {
-	startTimeEpoch = rtc.getEpoch();
-	previousEpoch = startTimeEpoch;
-	routineRunning = true;
-	userDefinedSettings.status = "Winding";
-	Serial.println("[STATUS] - Begin winding routine");
-
-	unsigned long finishTime = calculateWindingTime();
-	estimatedRoutineFinishEpoch = finishTime;
+	int direction = 0;
+	while (direction < 2 && userDefinedSettings.direction != directionChoices[direction])
+	{
+		direction++;
+	}
 
-	Serial.print("[STATUS] - Current time: ");
-	Serial.println(rtc.getEpoch());
+	SESSION_RECORD record = {};
+	record.startEpoch = winder.getStartEpoch();
+	record.endEpoch = rtc.getEpoch();
+	record.plannedTurns = winder.getPlannedTurns();
+	record.deliveredTurns = winder.getDeliveredTurns();
+	record.clockwiseSeconds = min(winder.getClockwiseSeconds(), 0xFFFFUL);
+	record.counterClockwiseSeconds = min(winder.getCounterClockwiseSeconds(), 0xFFFFUL);
+	record.pauses = min(winder.getPauses(), 0xFFFFU);
+	record.pausedSeconds = min(winder.getPausedSeconds(), 0xFFFFUL);
+	record.direction = direction;
+	record.stopReason = reason;
+#if CURRENT_SENSE_ENABLED
+	record.energyMilliwattHours = currentSensor.isRunning() ? min(currentSensor.getMilliwattHours(MOTOR_SUPPLY_MILLIVOLTS), (uint32_t)HISTORY_ENERGY_UNKNOWN - 1) : HISTORY_ENERGY_UNKNOWN;
+#else
+	record.energyMilliwattHours = HISTORY_ENERGY_UNKNOWN;
+#endif
+	history.record(record);
+}
 
-	Serial.print("[STATUS] - Estimated finish time: ");
-	Serial.println(finishTime);
+/**
+ * Stops the motor & the session, if any
+ *
+ * @param reason why, for the history
+ * @param notice shown on the OLED
+ */
+void stopWindingRoutine(HistoryStopReason reason = HISTORY_STOP_USER, const char *notice = "Stopped")
+{
+	winder.stop();
+#if GROUP_ENABLED
+	group.cancelStart();
+#endif
+	if (userDefinedSettings.status == "Winding" && winder.getStartEpoch() > 0)
+	{
+		recordSession(reason);
+	}
+	store.setStatus("Stopped");
+	store.notify(notice);
+}
 
-	drawNotification("Winding");
-	if (HOME_ASSISTANT_ENABLED) ha_activityState.setValue("Winding");
+/**
+ * Hard on/off. Switching off also stops a running session.
+ */
+void setWinderEnabled(bool enabled)
+{
+	store.setWinderEnabled(enabled ? "1" : "0");
+	if (!enabled)
+	{
+		Log.status(LOG_MAIN, "Switched off!");
+		stopWindingRoutine(HISTORY_STOP_SWITCHED_OFF);
+	}
 }
 
 /**
- * Calls external time API & updates ESP32's onboard real time clock
+ * Applies a new TPD, to a running session too
  */
-void getTime() {
-    timeClient.begin();
-    timeClient.update();
-    
-    time_t epochTime = timeClient.getEpochTime();
-    struct tm *ptm = gmtime ((time_t *)&epochTime);
-    
-    int currentYear = ptm->tm_year + 1900;
-    int currentMonth = ptm->tm_mon + 1;
-    int currentDay = ptm->tm_mday;
-    int currentHour = timeClient.getHours();
-    int currentMinute = timeClient.getMinutes();
-    int currentSecond = timeClient.getSeconds();
-    
-    Serial.printf("[STATUS] - Date: %d-%02d-%02d Time: %02d:%02d:%02d\n", 
-        currentYear, currentMonth, currentDay,
-        currentHour, currentMinute, currentSecond);
-    
-    rtc.setTime(currentSecond, currentMinute, currentHour, currentDay, currentMonth, currentYear);
-    
-    timeClient.end();
+void setRotationsPerDay(const String &rotationsPerDay)
+{
+	if (rotationsPerDay != userDefinedSettings.rotationsPerDay)
+	{
+		store.setRotationsPerDay(rotationsPerDay);
+		winder.setRotationsPerDay(rotationsPerDay.toInt(), rtc.getEpoch());
+	}
 }
 
 /**
- * Loads user defined settings from data file
- *
- * @param file_name fully qualified name of file to load
- * @return contents of file as a single string
+ * Turns the session to a direction already in the store, pausing the motor before it reverses
  */
-void loadConfigVarsFromFile(String file_name)
+void reverseMotor(const String &direction)
 {
-	String result = "";
+	motor.stop();
+	delay(250);
 
-	File this_file = LittleFS.open(file_name, "r");
+	// Update motor direction
+	winder.setDirection(direction);
 
-	JsonDocument json;
-	DeserializationError error = deserializeJson(json, this_file);
+	Log.status(LOG_MAIN, "direction set: %s", direction);
+}
 
-	if (!this_file || error)
+/**
+ * Applies a new direction, pausing the motor before it reverses
+ */
+void setDirection(const String &direction)
+{
+	if (direction != userDefinedSettings.direction)
 	{
-		Serial.println("[STATUS] - Failed to open configuration file, returning empty result");
+		store.setDirection(direction);
+		reverseMotor(direction);
 	}
-	while (this_file.available())
+}
+
+/**
+ * Applies the settings of an update or settings command. The store is only
+ * locked while it's written, so the webserver's reads never wait on the
+ * motor; subscribers see all of it at the next dispatch either way.
+ *
+ * @param withScreen false for a settings command, which has no screenSleep
+ */
+void applyCommandSettings(const COMMAND_UPDATE_ARGS &settings, bool withScreen)
+{
+	char text[4];
+	String direction = directionChoices[settings.direction];
+	String rotationsPerDay = String(settings.rotationsPerDay);
+
+	store.lock();
+	bool directionChanged = direction != userDefinedSettings.direction;
+	bool rotationsChanged = rotationsPerDay != userDefinedSettings.rotationsPerDay;
+	snprintf(text, sizeof(text), "%02u", (unsigned)settings.hour);
+	store.setHour(text);
+	snprintf(text, sizeof(text), "%02u", (unsigned)settings.minutes);
+	store.setMinutes(text);
+	store.setTimerEnabled(settings.timerEnabled ? "1" : "0");
+	if (withScreen)
 	{
-		result += (char)this_file.read();
+		store.setScreenSleep(settings.screenSleep);
 	}
+	store.setDirection(direction);
+	store.setRotationsPerDay(rotationsPerDay);
+	store.unlock();
 
-	userDefinedSettings.status = json["savedStatus"].as<String>();						// Winding || Stopped = 7char
-	userDefinedSettings.rotationsPerDay = json["savedTPD"].as<String>();				// min = 100 || max = 960
-	userDefinedSettings.hour = json["savedHour"].as<String>();							// 00
-	userDefinedSettings.minutes = json["savedMinutes"].as<String>();					// 00
-	userDefinedSettings.timerEnabled = json["savedTimerState"].as<String>();			// 0 || 1
-	userDefinedSettings.direction = json["savedDirection"].as<String>();				// CW || CCW || BOTH
-
-	this_file.close();
+	if (directionChanged)
+	{
+		reverseMotor(direction);
+	}
+	if (rotationsChanged)
+	{
+		winder.setRotationsPerDay(settings.rotationsPerDay, rtc.getEpoch());
+	}
 }
 
 /**
- * Saves user defined settings to data file
+ * Asks the external time API for the time. Waits on the network, so it runs
+ * on a background task; the loop steps the RTC to it, see applyTime().
  *
- * @param file_name fully qualified name of file to save data to
- * @param contents entire contents to write to file
- * @return true if successfully wrote to file; else false
+ * @return true if the server answered
  */
-bool writeConfigVarsToFile(String file_name, const RUNTIME_VARS& userDefinedSettings)
+bool fetchTime()
 {
-	File this_file = LittleFS.open(file_name, "w");
+	TRACE_SCOPE("fetchTime");
+	timeClient.begin();
+	bool synced = timeClient.update();
+	unsigned long epoch = timeClient.getEpochTime();
+	timeClient.end();
 
-	JsonDocument json;
+	if (synced)
+	{
+		xSemaphoreTake(timeMutex, portMAX_DELAY);
+		fetchedEpoch = epoch;
+		fetchedMs = millis();
+		timePending = true;
+		xSemaphoreGive(timeMutex);
+	}
+	return synced;
+}
 
-	if (!this_file)
+/**
+ * Updates ESP32's onboard real time clock to what fetchTime() got. On the
+ * loop, between two winder.update()s, so the session sees the step at once.
+ */
+void applyTime()
+{
+	xSemaphoreTake(timeMutex, portMAX_DELAY);
+	bool pending = timePending;
+	// Seconds passed since the answer arrived count too
+	unsigned long epoch = fetchedEpoch + (millis() - fetchedMs) / 1000;
+	timePending = false;
+	xSemaphoreGive(timeMutex);
+	if (!pending)
 	{
-		Serial.println("[STATUS] - Failed to open configuration file");
-		return false;
+		return;
 	}
 
-	json["savedStatus"] = userDefinedSettings.status;
-	json["savedTPD"] = userDefinedSettings.rotationsPerDay;
-	json["savedHour"] = userDefinedSettings.hour;
-	json["savedMinutes"] = userDefinedSettings.minutes;
-	json["savedTimerState"] = userDefinedSettings.timerEnabled;
-	json["savedDirection"] = userDefinedSettings.direction;
+	sleepControl.calibrateClock(rtc.getEpoch(), epoch);
 
-	if (serializeJson(json, this_file) == 0)
+	// A session may have started before the clock was set; keep its duration intact
+	if (winder.isRunning())
 	{
-		Serial.println("[STATUS] - Failed to write to configuration file");
-		return false;
+		winder.shiftEpochs((long)epoch - (long)rtc.getEpoch());
 	}
+	rtc.setTime(epoch);
+	timeSynced = true;
+
+	time_t time = epoch;
+	struct tm *ptm = gmtime(&time);
+	Log.status(LOG_MAIN, "Date: %d-%02d-%02d Time: %02d:%02d:%02d",
+		ptm->tm_year + 1900, ptm->tm_mon + 1, ptm->tm_mday,
+		ptm->tm_hour, ptm->tm_min, ptm->tm_sec);
+}
 
-	this_file.close();
-	return true;
+void ntpTask(void *parameters)
+{
+	fetchTime();
+	ntpTaskRunning = false;
+	vTaskDelete(NULL);
 }
 
 /**
- * 404 handler for webserver
+ * Fetches the time again now & then, on a task of its own, as the clock drifts
  */
-void notFound(AsyncWebServerRequest *request)
+void resyncTime()
 {
-	// Handle HTTP_OPTIONS requests
-	if (request->method() == 64)
+	unsigned long interval = timeSynced ? NTP_RESYNC_INTERVAL_MS : NTP_RETRY_INTERVAL_MS;
+	if (!ntpStageFinished || ntpTaskRunning || millis() - ntpAttemptMs < interval)
 	{
-		AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", "Ok");
-		request->send(response);
+		return;
 	}
-	else
+
+	ntpAttemptMs = millis();
+	ntpTaskRunning = true;
+	if (xTaskCreate(ntpTask, "ntp", NTP_TASK_STACK_SIZE, NULL, 1, NULL) != pdPASS)
 	{
-		request->send(404, "text/plain", "Winderoo\n\n404 - Resource Not found");
+		ntpTaskRunning = false;
 	}
 }
 
 /**
- * API for front end
+ * The settings worth keeping from the store's state
  */
-void startWebserver()
+WINDER_SETTINGS settingsFromState(const WINDER_STATE &state)
 {
-
-	server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest *request)
-	{
-		AsyncResponseStream *response = request->beginResponseStream("application/json");
-		JsonDocument json;
-		json["status"] = userDefinedSettings.status;
-		json["rotationsPerDay"] = userDefinedSettings.rotationsPerDay;
-		json["direction"] = userDefinedSettings.direction;
-		json["hour"] = userDefinedSettings.hour;
-		json["minutes"] = userDefinedSettings.minutes;
-		json["durationInSecondsToCompleteOneRevolution"] = durationInSecondsToCompleteOneRevolution;
-		json["startTimeEpoch"] = startTimeEpoch;
-		json["currentTimeEpoch"] = rtc.getEpoch();
-		json["estimatedRoutineFinishEpoch"] = estimatedRoutineFinishEpoch;
-		json["winderEnabled"] = userDefinedSettings.winderEnabled;
-		json["timerEnabled"] = userDefinedSettings.timerEnabled;
-		json["db"] = WiFi.RSSI();
-		json["screenSleep"] = screenSleep;
-		json["screenEquipped"] = screenEquipped;
-		serializeJson(json, *response);
-
-		request->send(response);
-
-		// Update RTC time ref
-		getTime();
-	});
-
-	server.on("/api/timer", HTTP_POST, [](AsyncWebServerRequest *request)
+	WINDER_SETTINGS settings = defaultSettings;
+	for (uint8_t i = 0; i < 3; i++)
 	{
-		int params = request->params();
-
-		for ( int i = 0; i < params; i++ )
+		if (state.direction == directionChoices[i])
 		{
-			AsyncWebParameter* p = request->getParam(i);
-
-			if( strcmp(p->name().c_str(), "timerEnabled") == 0 )
-			{
-				userDefinedSettings.timerEnabled = p->value().c_str();
-				if (HOME_ASSISTANT_ENABLED) ha_timerSwitch.setState(userDefinedSettings.timerEnabled.toInt());
-			}
+			settings.direction = i;
 		}
+	}
 
-		bool writeSuccess = writeConfigVarsToFile(settingsFile, userDefinedSettings);
-		if ( !writeSuccess )
-		{
-			Serial.println("[ERROR] - Failed to write [timer] endpoint data to file");
-			request->send(500, "text/plain", "Failed to write new configuration to file");
-		}
+	// Empty or mangled fields keep the defaults, so what's saved always loads
+	long rotationsPerDay = state.rotationsPerDay.toInt();
+	long hour = state.hour.toInt();
+	long minutes = state.minutes.toInt();
+	if (rotationsPerDay >= 100 && rotationsPerDay <= 960)
+	{
+		settings.rotationsPerDay = rotationsPerDay;
+	}
+	if (hour >= 0 && hour <= 23)
+	{
+		settings.hour = hour;
+	}
+	if (minutes >= 0 && minutes <= 59)
+	{
+		settings.minutes = minutes;
+	}
+	settings.timerEnabled = state.timerEnabled == "1";
+	settings.winding = state.status == "Winding";
+	return settings;
+}
 
-		request->send(204);
-	});
+/**
+ * Puts saved settings into the store, as they were before the restart
+ */
+void applySettings(const WINDER_SETTINGS &settings)
+{
+	char text[4];
+
+	store.lock();
+	store.setStatus(settings.winding ? "Winding" : "Stopped");
+	store.setRotationsPerDay(String(settings.rotationsPerDay));
+	store.setDirection(directionChoices[settings.direction]);
+	snprintf(text, sizeof(text), "%02u", (unsigned)settings.hour);
+	store.setHour(text);
+	snprintf(text, sizeof(text), "%02u", (unsigned)settings.minutes);
+	store.setMinutes(text);
+	store.setTimerEnabled(settings.timerEnabled ? "1" : "0");
+	store.unlock();
+}
 
-	server.onRequestBody([](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+/**
+ * Moves the settings of older firmware, in /settings.json, to NVS. The file
+ * is removed once they're stored.
+ *
+ * @return false if there's no file
+ */
+bool migrateLegacySettings()
+{
+	File this_file = LittleFS.open(legacySettingsFile, "r");
+	if (!this_file)
 	{
+		return false;
+	}
 
-		if (request->url() == "/api/power")
-		{
-			JsonDocument json;
-			DeserializationError error = deserializeJson(json, data);
+	char contents[SETTINGS_FILE_MAX_SIZE];
+	size_t length = this_file.read((uint8_t *)contents, sizeof(contents));
+	this_file.close();
 
-			if (error)
-			{
-				Serial.println("[ERROR] - Failed to deserialize [power] request body");
-				request->send(500, "text/plain", "Failed to deserialize request body");
-				return;
-			}
+	JsonMessage json(legacySettingsSchema);
+	if (!json.parse(contents, length))
+	{
+		Log.warn(LOG_MAIN, "Unreadable %s, using the default settings", legacySettingsFile);
+	}
 
-			if (!json["winderEnabled"].is<bool>())
-			{
-				request->send(400, "text/plain", "Missing required field: 'winderEnabled'");
-			}
+	applySettings(defaultSettings);
+	if (json.has(LEGACY_SETTINGS_STATUS)) store.setStatus(json.getText(LEGACY_SETTINGS_STATUS));						// Winding || Stopped = 7char
+	if (json.has(LEGACY_SETTINGS_TPD)) store.setRotationsPerDay(json.getText(LEGACY_SETTINGS_TPD));					// min = 100 || max = 960
+	if (json.has(LEGACY_SETTINGS_HOUR)) store.setHour(json.getText(LEGACY_SETTINGS_HOUR));							// 00
+	if (json.has(LEGACY_SETTINGS_MINUTES)) store.setMinutes(json.getText(LEGACY_SETTINGS_MINUTES));					// 00
+	if (json.has(LEGACY_SETTINGS_TIMER_STATE)) store.setTimerEnabled(json.getText(LEGACY_SETTINGS_TIMER_STATE));	// 0 || 1
+	if (json.has(LEGACY_SETTINGS_DIRECTION)) store.setDirection(json.getText(LEGACY_SETTINGS_DIRECTION));			// CW || CCW || BOTH
+
+	// Round tripped, so the store holds exactly what NVS will give back next boot
+	WINDER_SETTINGS settings = settingsFromState(userDefinedSettings);
+	applySettings(settings);
+	if (settingsStore.save(settings))
+	{
+		LittleFS.remove(legacySettingsFile);
+		Log.status(LOG_MAIN, "Settings moved from %s to NVS", legacySettingsFile);
+	}
+	return true;
+}
 
-			userDefinedSettings.winderEnabled = json["winderEnabled"].as<String>();
+/**
+ * Loads the settings saved before the restart, from NVS
+ */
+void loadSettings()
+{
+	WINDER_SETTINGS settings;
+	SettingsLoad result = settingsStore.load(settings);
+	if (result == SETTINGS_LOADED)
+	{
+		applySettings(settings);
+		Log.status(LOG_MAIN, "Settings loaded in %lu us", settingsStore.getLoadMicros());
+		return;
+	}
 
-			if (userDefinedSettings.winderEnabled == "0")
-			{
-				Serial.println("[STATUS] - Switched off!");
-				userDefinedSettings.status = "Stopped";
-				routineRunning = false;
-				motor.stop();
-				display.clearDisplay();
-				display.display();
-				
-				if (HOME_ASSISTANT_ENABLED) 
-				{
-					ha_powerSwitch.setState(false);
-					ha_activityState.setValue("Stopped");
-				}
-			} else {
-				drawStaticGUI(true);
-				drawDynamicGUI();
-				if (HOME_ASSISTANT_ENABLED) ha_powerSwitch.setState(true);
-			}
+	if (result == SETTINGS_INVALID)
+	{
+		Log.error(LOG_MAIN, "Saved settings are corrupt or from an unknown version, using the defaults");
+	}
+	else if (migrateLegacySettings())
+	{
+		return;
+	}
+	applySettings(defaultSettings);
+}
 
-			request->send(204);
+/**
+ * Reads how the client wants a response: MessagePack or CBOR when its Accept
+ * header names one (whichever comes first), JSON otherwise; only the fields
+ * ?fields= lists, if it's given
+ *
+ * @return false once it has answered 400 for an unknown field
+ */
+bool negotiateFormat(AsyncWebServerRequest *request, const JSON_SCHEMA &schema, JSON_FORMAT &format)
+{
+	format = jsonFormat;
+	if (request->hasHeader("Accept"))
+	{
+		String accept = request->getHeader("Accept")->value();
+		// application/msgpack, or application/x-msgpack as older clients send it
+		int msgpack = accept.indexOf("msgpack");
+		int cbor = accept.indexOf("application/cbor");
+		if (msgpack >= 0 && (cbor < 0 || msgpack < cbor))
+		{
+			format.encoding = JSON_ENCODING_MSGPACK;
 		}
-
-		if (request->url() == "/api/update")
+		else if (cbor >= 0)
 		{
-			JsonDocument json;
-			DeserializationError error = deserializeJson(json, data);
-			int arraySize = 7;
-			String requiredKeys[arraySize] = {"rotationDirection", "tpd", "action", "hour", "minutes", "timerEnabled", "screenSleep"};
-
-			if (error)
-			{
-				Serial.println("[ERROR] - Failed to deserialize [update] request body");
-				request->send(500, "text/plain", "Failed to deserialize request body");
-				return;
-			}
-
-			// validate request body
-				for (int i = 0; i < arraySize; i++)
-				{
-					if(!json[requiredKeys[i]].is<JsonVariant>())
-					{
-						request->send(400, "text/plain", "Missing required field: '" + requiredKeys[i] +"'");
-					}
-				}
-
-			// These values can be mutated / saved directly
-			userDefinedSettings.hour = json["hour"].as<String>();
-			userDefinedSettings.minutes = json["minutes"].as<String>();
-			userDefinedSettings.timerEnabled = json["timerEnabled"].as<String>();
-
-			// These values need to be compared to the current settings / running state
-			String requestRotationDirection = json["rotationDirection"].as<String>();
-			String requestTPD = json["tpd"].as<String>();
-			String requestAction = json["action"].as<String>();
-			screenSleep = json["screenSleep"].as<bool>();
+			format.encoding = JSON_ENCODING_CBOR;
+		}
+	}
 
-			// Update Home Assistant state
+	if (request->hasParam("fields") && !JsonMessage::selectFields(schema, request->getParam("fields")->value().c_str(), format.fields))
+	{
+		request->send(400, "text/plain", "Unknown field in parameter: 'fields'");
+		return false;
+	}
+	return true;
+}
 
-			if (HOME_ASSISTANT_ENABLED)
-			{
-				ha_timerSwitch.setState(userDefinedSettings.timerEnabled.toInt());
-				ha_selectHours.setState(userDefinedSettings.hour.toInt());
-				ha_selectMinutes.setState(getTimerMinutesIndexForHomeAssistant(userDefinedSettings.minutes.toInt()));
-				ha_oledSwitch.setState(!screenSleep); // Invert state because naming is hard...
-				ha_rpd.setState(static_cast<int>(requestTPD.toInt()));
-				ha_selectDirection.setState(getDirectionIndexForHomeAssistant(requestRotationDirection));
-			}
+/**
+ * Sends a body serialized in the negotiated format, see negotiateFormat()
+ *
+ * @param length as serialize() returned it
+ */
+void sendFormatted(AsyncWebServerRequest *request, int code, const JSON_FORMAT &format, const char *body, size_t length)
+{
+	if (length == 0)
+	{
+		request->send(500, "text/plain", "Response didn't fit");
+		return;
+	}
+
+	AsyncWebServerResponse *response;
+	if (format.encoding == JSON_ENCODING_JSON)
+	{
+		response = request->beginResponse(code, "application/json", body);
+	}
+	else
+	{
+		// Binary, so sent by length rather than up to a NUL
+		AsyncResponseStream *stream = request->beginResponseStream(jsonEncodingContentTypes[format.encoding]);
+		stream->setCode(code);
+		stream->write((const uint8_t *)body, length);
+		response = stream;
+	}
+	response->addHeader("Vary", "Accept");
+	request->send(response);
+}
+
+/**
+ * Writes the /api/settings body, the settings as saved
+ *
+ * @return length written, 0 if it didn't fit
+ */
+size_t serializeSettings(char *buffer, size_t size, const JSON_FORMAT &format = jsonFormat)
+{
+	store.lock();
+	WINDER_SETTINGS settings = settingsFromState(userDefinedSettings);
+	store.unlock();
+
+	JsonMessage json(settingsSchema);
+	json.set(SETTINGS_VERSION, SETTINGS_BLOB_VERSION);
+	json.set(SETTINGS_ROTATIONS_PER_DAY, (int)settings.rotationsPerDay);
+	json.set(SETTINGS_DIRECTION, directionChoices[settings.direction]);
+	json.set(SETTINGS_HOUR, (int)settings.hour);
+	json.set(SETTINGS_MINUTES, (int)settings.minutes);
+	json.set(SETTINGS_TIMER_ENABLED, (int)settings.timerEnabled);
+	return json.serialize(buffer, size, format);
+}
+
+/**
+ * Writes the /api/status body, also pushed to /api/events subscribers
+ *
+ * @return length written, 0 if it didn't fit
+ */
+size_t serializeStatus(char *buffer, size_t size, const JSON_FORMAT &format = jsonFormat)
+{
+	// Settings from one consistent moment
+	store.lock();
+	JsonMessage json(statusSchema);
+	json.set(STATUS_STATUS, userDefinedSettings.status.c_str());
+	json.set(STATUS_ROTATIONS_PER_DAY, userDefinedSettings.rotationsPerDay.c_str());
+	json.set(STATUS_DIRECTION, userDefinedSettings.direction.c_str());
+	json.set(STATUS_HOUR, userDefinedSettings.hour.c_str());
+	json.set(STATUS_MINUTES, userDefinedSettings.minutes.c_str());
+	json.set(STATUS_SECONDS_PER_REVOLUTION, durationInSecondsToCompleteOneRevolution);
+	json.set(STATUS_START_EPOCH, winder.getStartEpoch());
+	json.set(STATUS_CURRENT_EPOCH, (long)rtc.getEpoch());
+	json.set(STATUS_FINISH_EPOCH, winder.getEstimatedFinishEpoch());
+	json.set(STATUS_WINDER_ENABLED, userDefinedSettings.winderEnabled.c_str());
+	json.set(STATUS_TIMER_ENABLED, userDefinedSettings.timerEnabled.c_str());
+	json.set(STATUS_DB, (int)WiFi.RSSI());
+	json.set(STATUS_SCREEN_SLEEP, userDefinedSettings.screenSleep);
+	json.set(STATUS_SCREEN_EQUIPPED, screenEquipped);
+	json.set(STATUS_BOOT_TO_MOTOR_START_MS, sleepControl.getBootToMotorStartMs());
+	json.set(STATUS_AVERAGE_POWER_MW, sleepControl.getAveragePowerMilliwatts());
+
+	size_t length = json.serialize(buffer, size, format);
+	store.unlock();
+	return length;
+}
+
+#if GROUP_ENABLED
+/**
+ * Tells the group where this winder stands; called while listening, see awaitWhileListening()
+ */
+void pollGroup()
+{
+	GROUP_SELF self;
+	store.lock();
+	self.sessionSeconds = winder.calculateDuration(userDefinedSettings.rotationsPerDay.toInt());
+	self.remainingSeconds = winder.isRunning() ? max(0L, (long)(winder.getEstimatedFinishEpoch() - rtc.getEpoch())) : 0;
+	self.running = winder.isRunning();
+	self.timerEnabled = userDefinedSettings.timerEnabled == "1" && userDefinedSettings.winderEnabled == "1";
+	self.hour = userDefinedSettings.hour.toInt();
+	self.minute = userDefinedSettings.minutes.toInt();
+	store.unlock();
+
+	group.poll(self);
+}
+
+/**
+ * Writes the /api/group body
+ *
+ * @return length written, 0 if it didn't fit
+ */
+size_t serializeGroupStatus(char *buffer, size_t size)
+{
+	GROUP_MEMBER members[GROUP_MAX_MEMBERS];
+	int memberCount = group.copyMembers(members, GROUP_MAX_MEMBERS);
+
+	// Each member is its own small object, gathered into an array
+	char membersJson[GROUP_MAX_MEMBERS * 200];
+	JsonArray membersArray(membersJson, sizeof(membersJson));
+	for (int i = 0; i < memberCount; i++)
+	{
+		char id[9];
+		char ip[16];
+		char timer[6];
+		snprintf(id, sizeof(id), "%08x", (unsigned)members[i].id);
+		snprintf(ip, sizeof(ip), "%s", i == 0 ? WiFi.localIP().toString().c_str() : IPAddress(members[i].ip).toString().c_str());
+		snprintf(timer, sizeof(timer), "%02u:%02u", members[i].state.hour % 24, members[i].state.minute % 60);
+
+		JsonMessage entry(groupMemberSchema);
+		entry.set(GROUP_MEMBER_ID, id);
+		entry.set(GROUP_MEMBER_IP, ip);
+		entry.set(GROUP_MEMBER_RUNNING, members[i].state.running);
+		entry.set(GROUP_MEMBER_SESSION_SECONDS, (unsigned long)members[i].state.sessionSeconds);
+		entry.set(GROUP_MEMBER_REMAINING_SECONDS, (unsigned long)members[i].state.remainingSeconds);
+		entry.set(GROUP_MEMBER_TIMER, members[i].state.timerEnabled ? timer : "");
+		entry.set(GROUP_MEMBER_GROUP_START_OFFSET, (unsigned long)members[i].groupStartOffset);
+		entry.set(GROUP_MEMBER_TIMER_OFFSET, (unsigned long)members[i].timerOffset);
+		if (!membersArray.add(entry))
+		{
+			return 0;
+		}
+	}
+	if (membersArray.finish() == 0)
+	{
+		return 0;
+	}
+
+	char id[9];
+	char coordinator[9];
+	snprintf(id, sizeof(id), "%08x", (unsigned)group.getId());
+	snprintf(coordinator, sizeof(coordinator), "%08x", (unsigned)group.getCoordinatorId());
+
+	JsonMessage json(groupSchema);
+	json.set(GROUP_ID, id);
+	json.set(GROUP_COORDINATOR, coordinator);
+	json.set(GROUP_MAX_RUNNING, (int)group.getMaxRunning());
+	json.set(GROUP_TIMER_OFFSET, (unsigned long)group.getTimerOffset());
+	json.set(GROUP_START_IN_SECONDS, group.getSecondsUntilStart());
+	json.setRaw(GROUP_MEMBERS, membersJson);
+	return json.serialize(buffer, size);
+}
+#endif
+
+#if CURRENT_SENSE_ENABLED
+/**
+ * Writes the /api/motor body
+ *
+ * @return length written, 0 if it didn't fit
+ */
+size_t serializeMotorStatus(char *buffer, size_t size, const JSON_FORMAT &format = jsonFormat)
+{
+	JsonMessage json(motorSchema);
+	json.set(MOTOR_MILLIAMPS, currentSensor.getMilliamps());
+	json.set(MOTOR_AVERAGE_MILLIAMPS, currentSensor.getAverageMilliamps());
+	json.set(MOTOR_PEAK_MILLIAMPS, currentSensor.getPeakMilliamps());
+	json.set(MOTOR_BASELINE_MILLIAMPS, currentSensor.getBaselineMilliamps());
+	json.set(MOTOR_ENERGY, (unsigned long)currentSensor.getMilliwattHours(MOTOR_SUPPLY_MILLIVOLTS));
+	json.set(MOTOR_STALLS, currentSensor.getStalls());
+	json.set(MOTOR_LAST_EVENT, motorLoadEventChoices[currentSensor.getLastEvent()]);
+	return json.serialize(buffer, size, format);
+}
+
+/**
+ * Acts on what the current sensor noticed: a stall is retried, a jam ends the session
+ */
+void handleMotorLoad()
+{
+	MotorLoadEvent event = currentSensor.takeEvent();
+	if (event == MOTOR_LOAD_NONE || !winder.isRunning())
+	{
+		return;
+	}
+
+	int milliamps = currentSensor.getAverageMilliamps();
+	if (event == MOTOR_LOAD_JAMMED)
+	{
+		Log.error(LOG_MOTOR, "Motor still stalled after %d retries at %d mA, stopping", MOTOR_STALL_RETRIES, milliamps);
+		stopWindingRoutine(HISTORY_STOP_STALLED, "Motor jammed");
+	}
+	else if (event == MOTOR_LOAD_STALLED)
+	{
+		Log.warn(LOG_MOTOR, "Motor stalled at %d mA, retrying", milliamps);
+		store.notify("Motor stalled");
+		winder.retryAfterStall(rtc.getEpoch());
+	}
+	else if (event == MOTOR_LOAD_DISCONNECTED)
+	{
+		Log.warn(LOG_MOTOR, "No motor current while driven, check the motor's wiring");
+		store.notify("No motor current");
+	}
+	else if (event == MOTOR_LOAD_HEAVY)
+	{
+		Log.warn(LOG_MOTOR, "Motor drawing %d mA, %d mA is normal; is the cushion rubbing?", milliamps, currentSensor.getBaselineMilliamps());
+		store.notify("Heavy motor load");
+	}
+}
+#endif
+
+#if HOME_ASSISTANT_ENABLED
+/**
+ * Writes the /api/homeassistant body
+ *
+ * @return length written, 0 if it didn't fit
+ */
+size_t serializeHomeAssistantStatus(char *buffer, size_t size, const JSON_FORMAT &format = jsonFormat)
+{
+	char hash[9];
+	haDiscovery.formatHash(hash, sizeof(hash));
+
+	JsonMessage json(homeAssistantSchema);
+	json.set(HOME_ASSISTANT_CONNECTED, mqtt.isConnected());
+	json.set(HOME_ASSISTANT_DISCOVERY, homeAssistantDiscoveryChoices[haDiscovery.getState()]);
+	json.set(HOME_ASSISTANT_DISCOVERY_HASH, hash);
+	json.set(HOME_ASSISTANT_DISCOVERY_PUBLISHES, (unsigned long)haDiscovery.getPublishes());
+	json.set(HOME_ASSISTANT_CONNECTS, (unsigned long)haDiscovery.getConnects());
+	json.set(HOME_ASSISTANT_RECONNECT_TO_READY_MS, haDiscovery.getReconnectToReadyMs());
+	json.set(HOME_ASSISTANT_CONNECT_TO_READY_MS, haDiscovery.getConnectToReadyMs());
+	json.set(HOME_ASSISTANT_COMMANDS, (unsigned long)haCommandLatency.getCount());
+	json.set(HOME_ASSISTANT_COMMAND_LATENCY_US, (unsigned long)haCommandLatency.getLastUs());
+	json.set(HOME_ASSISTANT_AVERAGE_COMMAND_LATENCY_US, (unsigned long)haCommandLatency.getAverageUs());
+	json.set(HOME_ASSISTANT_MAX_COMMAND_LATENCY_US, (unsigned long)haCommandLatency.getMaxUs());
+	return json.serialize(buffer, size, format);
+}
+#endif
+
+/**
+ * Writes a command's record: the 202 body of the command endpoints & the /api/commands/{id} body
+ *
+ * @return length written, 0 if it didn't fit
+ */
+size_t serializeCommand(const COMMAND_RECORD &record, char *buffer, size_t size, const JSON_FORMAT &format = jsonFormat)
+{
+	unsigned long now = millis();
+	unsigned long startedMs = record.state == COMMAND_QUEUED ? now : record.startedMs;
+	unsigned long doneMs = record.state == COMMAND_DONE ? record.doneMs : now;
+
+	JsonMessage json(commandSchema);
+	json.set(COMMAND_FIELD_ID, (unsigned long)record.id);
+	json.set(COMMAND_FIELD_TYPE, commandTypeChoices[record.type]);
+	json.set(COMMAND_FIELD_SOURCE, commandSourceChoices[record.source]);
+	json.set(COMMAND_FIELD_STATE, commandStateChoices[record.state]);
+	json.set(COMMAND_FIELD_WAIT_MS, startedMs - record.queuedMs);
+	json.set(COMMAND_FIELD_RUN_MS, record.state == COMMAND_QUEUED ? 0UL : doneMs - startedMs);
+	return json.serialize(buffer, size, format);
+}
+
+/**
+ * Queues a command from the API & answers 202 with its record, or 503 if the queue is full.
+ * A request repeating an earlier Idempotency-Key gets the earlier command's record instead.
+ */
+void acceptCommand(AsyncWebServerRequest *request, COMMAND &command)
+{
+	command.source = COMMAND_SOURCE_API;
+	command.receivedMicros = micros();
+
+	String key = "";
+	if (request->hasHeader("Idempotency-Key"))
+	{
+		key = request->getHeader("Idempotency-Key")->value();
+	}
+
+	bool duplicate;
+	COMMAND_RECORD record;
+	uint32_t id = commands.submit(command, key.c_str(), &duplicate);
+	if (id == 0 || !commands.find(id, record))
+	{
+		request->send(503, "text/plain", "Too many commands waiting, try again");
+		return;
+	}
+
+	char body[COMMAND_RESPONSE_MAX_SIZE];
+	char location[32];
+	serializeCommand(record, body, sizeof(body));
+	snprintf(location, sizeof(location), "/api/commands/%u", (unsigned)id);
+
+	AsyncWebServerResponse *response = request->beginResponse(202, "application/json", body);
+	response->addHeader("Location", location);
+	request->send(response);
+}
+
+/**
+ * Request handler of the command endpoints. A request with a body was
+ * already answered by the body handler.
+ */
+void requireCommandBody(AsyncWebServerRequest *request)
+{
+	if (request->contentLength() == 0)
+	{
+		request->send(400, "text/plain", "Request body is empty");
+	}
+}
+
+/**
+ * Body handler of POST /api/update
+ */
+void receiveUpdate(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+	TRACE_SCOPE("POST /api/update");
+	// Parsed & validated against updateSchema, see ApiSchema.h
+	JsonMessage json(updateSchema);
+
+	if (!json.parse((const char *)data, len))
+	{
+		Log.error(LOG_MAIN, "Invalid [update] request body");
+		request->send(400, "text/plain", json.getError());
+		return;
+	}
+
+	COMMAND command = {};
+	command.type = COMMAND_UPDATE;
+	command.update.direction = json.getChoice(UPDATE_ROTATION_DIRECTION);
+	command.update.rotationsPerDay = json.getInt(UPDATE_TPD);
+	command.update.hour = json.getInt(UPDATE_HOUR);
+	command.update.minutes = json.getInt(UPDATE_MINUTES);
+	command.update.timerEnabled = json.getInt(UPDATE_TIMER_ENABLED) != 0;
+	command.update.screenSleep = json.getBool(UPDATE_SCREEN_SLEEP);
+	command.update.start = json.getChoice(UPDATE_ACTION) == 0;
+	acceptCommand(request, command);
+}
+
+/**
+ * Body handler of POST /api/power
+ */
+void receivePower(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+	TRACE_SCOPE("POST /api/power");
+	JsonMessage json(powerSchema);
+
+	if (!json.parse((const char *)data, len))
+	{
+		Log.error(LOG_MAIN, "Invalid [power] request body");
+		request->send(400, "text/plain", json.getError());
+		return;
+	}
+
+	COMMAND command = {};
+	command.type = COMMAND_POWER;
+	command.value = json.getInt(POWER_WINDER_ENABLED);
+	acceptCommand(request, command);
+}
+
+/**
+ * Body handler of POST /api/settings, a GET /api/settings body to restore
+ */
+void receiveSettings(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+	TRACE_SCOPE("POST /api/settings");
+	JsonMessage json(settingsSchema);
+
+	if (!json.parse((const char *)data, len))
+	{
+		Log.error(LOG_MAIN, "Invalid [settings] request body");
+		request->send(400, "text/plain", json.getError());
+		return;
+	}
+
+	COMMAND command = {};
+	command.type = COMMAND_SETTINGS;
+	command.update.direction = json.getChoice(SETTINGS_DIRECTION);
+	command.update.rotationsPerDay = json.getInt(SETTINGS_ROTATIONS_PER_DAY);
+	command.update.hour = json.getInt(SETTINGS_HOUR);
+	command.update.minutes = json.getInt(SETTINGS_MINUTES);
+	command.update.timerEnabled = json.getInt(SETTINGS_TIMER_ENABLED) != 0;
+	acceptCommand(request, command);
+}
+
+/**
+ * Sets one pattern's entry, but its source: its size, & how long it runs on this motor
+ */
+void setPatternEntry(JsonMessage &json, int slot, const WINDING_PATTERN &pattern)
+{
+	store.lock();
+	int rotationsPerDay = userDefinedSettings.rotationsPerDay.toInt();
+	store.unlock();
+
+	PatternEngine engine;
+	engine.load(pattern, winder.getPatternTiming());
+
+	json.set(PATTERN_ENTRY_SLOT, slot);
+	json.set(PATTERN_ENTRY_NAME, pattern.name);
+	json.set(PATTERN_ENTRY_BYTES, (int)pattern.length);
+	json.set(PATTERN_ENTRY_TURNS_PER_PASS, (unsigned long)engine.getTurnsPerPass());
+	json.set(PATTERN_ENTRY_SECONDS_PER_PASS, (long long)engine.getSecondsPerPass());
+	json.set(PATTERN_ENTRY_SESSION_SECONDS, engine.measure(rotationsPerDay));
+}
+
+/**
+ * Writes the GET /api/patterns/{slot} body, the entry with its source
+ *
+ * @return length written, 0 if it didn't fit
+ */
+size_t serializePattern(int slot, const WINDING_PATTERN &pattern, char *buffer, size_t size, const JSON_FORMAT &format = jsonFormat)
+{
+	char source[PATTERN_DECOMPILED_SIZE];
+
+	JsonMessage json(patternEntrySchema);
+	setPatternEntry(json, slot, pattern);
+	if (PatternCompiler::decompile(pattern, source, sizeof(source)) > 0)
+	{
+		json.set(PATTERN_ENTRY_SOURCE, source);
+	}
+	return json.serialize(buffer, size, format);
+}
+
+/**
+ * Writes the GET /api/patterns body: the active slot & every stored pattern, without its source
+ *
+ * @return length written, 0 if it didn't fit
+ */
+size_t serializePatterns(char *buffer, size_t size)
+{
+	char patternsJson[PATTERN_SLOTS * 256];
+	JsonArray patternsArray(patternsJson, sizeof(patternsJson));
+	for (int slot = 1; slot <= PATTERN_SLOTS; slot++)
+	{
+		WINDING_PATTERN pattern;
+		if (!patterns.get(slot, pattern))
+		{
+			continue;
+		}
+
+		JsonMessage entry(patternEntrySchema);
+		setPatternEntry(entry, slot, pattern);
+		if (!patternsArray.add(entry))
+		{
+			return 0;
+		}
+	}
+	if (patternsArray.finish() == 0)
+	{
+		return 0;
+	}
+
+	JsonMessage json(patternListSchema);
+	json.set(PATTERN_LIST_ACTIVE, patterns.getActive());
+	json.setRaw(PATTERN_LIST_PATTERNS, patternsJson);
+	return json.serialize(buffer, size);
+}
+
+/**
+ * Slot of /api/patterns/{slot}
+ *
+ * @return 0 if the URL names none, or one that doesn't exist
+ */
+int patternSlotFromUrl(AsyncWebServerRequest *request)
+{
+	// The handler matches the prefix
+	const char *prefix = "/api/patterns/";
+	if (!request->url().startsWith(prefix))
+	{
+		return 0;
+	}
+
+	long slot = strtol(request->url().c_str() + strlen(prefix), NULL, 10);
+	return slot >= 1 && slot <= PATTERN_SLOTS ? (int)slot : 0;
+}
+
+/**
+ * Body handler of POST /api/patterns/{slot}: compiles the source & queues it
+ * for the slot, answering 400 with where it's wrong if it doesn't compile.
+ * The session running keeps the pattern it began with.
+ */
+void receivePattern(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+	TRACE_SCOPE("POST /api/patterns");
+	JsonMessage json(patternUploadSchema);
+
+	int slot = patternSlotFromUrl(request);
+	if (slot == 0)
+	{
+		request->send(404, "text/plain", "Unknown pattern slot");
+		return;
+	}
+	if (!json.parse((const char *)data, len))
+	{
+		Log.error(LOG_MAIN, "Invalid [pattern] request body");
+		request->send(400, "text/plain", json.getError());
+		return;
+	}
+
+	COMMAND command = {};
+	command.value = slot;
+	if (json.getText(PATTERN_UPLOAD_SOURCE)[0] == '\0')
+	{
+		command.type = COMMAND_PATTERN_REMOVE;
+		acceptCommand(request, command);
+		return;
+	}
+
+	char error[PATTERN_ERROR_SIZE];
+	if (!PatternCompiler::compile(json.getText(PATTERN_UPLOAD_SOURCE), command.pattern, error, sizeof(error)))
+	{
+		request->send(400, "text/plain", error);
+		return;
+	}
+	snprintf(command.pattern.name, sizeof(command.pattern.name), "%s", json.has(PATTERN_UPLOAD_NAME) ? json.getText(PATTERN_UPLOAD_NAME) : "");
+	command.type = COMMAND_PATTERN_PUT;
+	acceptCommand(request, command);
+}
+
+/**
+ * Body handler of POST /api/patterns/active: the pattern the sessions run from the next one on
+ */
+void receivePatternSelect(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+	TRACE_SCOPE("POST /api/patterns/active");
+	JsonMessage json(patternSelectSchema);
+
+	if (!json.parse((const char *)data, len))
+	{
+		request->send(400, "text/plain", json.getError());
+		return;
+	}
+	WINDING_PATTERN pattern;
+	int slot = json.getInt(PATTERN_SELECT_SLOT);
+	if (slot != 0 && !patterns.get(slot, pattern))
+	{
+		request->send(409, "text/plain", "No pattern in that slot");
+		return;
+	}
+
+	COMMAND command = {};
+	command.type = COMMAND_PATTERN_SELECT;
+	command.value = slot;
+	acceptCommand(request, command);
+}
+
+/**
+ * Does what a command asks for. Commands only change the store & the
+ * session; subscribers redraw, publish & save the new state.
+ */
+void applyCommand(const COMMAND &command)
+{
+	char text[4];
+
+	switch (command.type)
+	{
+		case COMMAND_UPDATE:
+			applyCommandSettings(command.update, true);
+			if (command.update.start)
+			{
+				if (!winder.isRunning())
+				{
+					beginWindingRoutine();
+				}
+			}
+			else
+			{
+				stopWindingRoutine();
+			}
+			break;
+		case COMMAND_SETTINGS:
+			// Like an update, without starting or stopping anything
+			applyCommandSettings(command.update, false);
+			break;
+		case COMMAND_POWER:
+			setWinderEnabled(command.value != 0);
+			break;
+		case COMMAND_SCREEN:
+			store.setScreenSleep(!command.value);
+			break;
+		case COMMAND_ROTATIONS_PER_DAY:
+			setRotationsPerDay(String(command.value));
+			break;
+		case COMMAND_DIRECTION:
+			if (command.value >= 0 && command.value < 3)
+			{
+				setDirection(directionChoices[command.value]);
+			}
+			break;
+		case COMMAND_TIMER:
+			store.setTimerEnabled(command.value ? "1" : "0");
+			break;
+		case COMMAND_START:
+			if (!winder.isRunning())
+			{
+				beginWindingRoutine();
+			}
+			break;
+		case COMMAND_STOP:
+			stopWindingRoutine();
+			break;
+		case COMMAND_HOUR:
+			if (command.value >= 0 && command.value < 24)
+			{
+				snprintf(text, sizeof(text), "%02d", (int)command.value);
+				store.setHour(text);
+			}
+			break;
+		case COMMAND_MINUTES:
+			// "00;10;20;30;40;50"
+			if (command.value >= 0 && command.value < 6)
+			{
+				snprintf(text, sizeof(text), "%02d", (int)command.value * 10);
+				store.setMinutes(text);
+			}
+			break;
+		case COMMAND_PATTERN_PUT:
+			// Written to NVS by patterns.flush(), from the loop
+			patterns.put(command.value, command.pattern);
+			Log.status(LOG_MAIN, "Winding pattern %d stored, %u bytes", (int)command.value, (unsigned)command.pattern.length);
+			break;
+		case COMMAND_PATTERN_REMOVE:
+			patterns.remove(command.value);
+			Log.status(LOG_MAIN, "Winding pattern %d removed", (int)command.value);
+			break;
+		case COMMAND_PATTERN_SELECT:
+			// The slot may have been emptied by a command queued before this one
+			if (patterns.select(command.value))
+			{
+				Log.status(LOG_MAIN, "Winding pattern %d selected", patterns.getActive());
+			}
+			else
+			{
+				Log.warn(LOG_MAIN, "Winding pattern %d not selected, its slot is empty", (int)command.value);
+			}
+			break;
+	}
+}
+
+/**
+ * Applies the commands queued since the last call, in order; called while listening, see awaitWhileListening()
+ */
+void applyCommands()
+{
+	COMMAND command;
+	while (commands.receive(command))
+	{
+		{
+			TRACE_SCOPE("applyCommand");
+			applyCommand(command);
+		}
+		commands.complete(command.id);
+
+#if HOME_ASSISTANT_ENABLED
+		// Only the commands that moved the motor; the pins changed during apply, after receiving
+		uint32_t drivenSince = motor.getDrivenSinceMicros();
+		if (command.source == COMMAND_SOURCE_HOME_ASSISTANT && (int32_t)(drivenSince - command.receivedMicros) >= 0)
+		{
+			haCommandLatency.record(drivenSince - command.receivedMicros);
+			Log.debug(LOG_MAIN, "Home Assistant command reached the motor in %u us", (unsigned)(drivenSince - command.receivedMicros));
+		}
+#endif
+	}
+}
+
+/**
+ * Writes the /api/ota body
+ *
+ * @return length written, 0 if it didn't fit
+ */
+size_t serializeOtaStatus(char *buffer, size_t size, const JSON_FORMAT &format = jsonFormat)
+{
+	JsonMessage json(otaSchema);
+	json.set(OTA_STATE, otaStateChoices[ota.getState()]);
+	json.set(OTA_TARGET, otaTargetChoices[ota.getTarget()]);
+	json.set(OTA_BYTES_WRITTEN, (unsigned long)ota.getBytesWritten());
+	json.set(OTA_TOTAL_BYTES, (unsigned long)ota.getTotalBytes());
+	json.set(OTA_BYTES_PER_SECOND, ota.getBytesPerSecond());
+	json.set(OTA_SHA256, ota.getSha256());
+	json.set(OTA_ERROR, ota.getError());
+	json.set(OTA_RESTART_PENDING, ota.isRestartPending());
+	return json.serialize(buffer, size, format);
+}
+
+/**
+ * Safe from any task; the loop may be mounting it again after an upload
+ */
+void unmountFileSystem()
+{
+	xSemaphoreTake(fileSystemMutex, portMAX_DELAY);
+	if (!fileSystemUnmounted)
+	{
+		LittleFS.end();
+		fileSystemUnmounted = true;
+	}
+	xSemaphoreGive(fileSystemMutex);
+}
+
+/**
+ * Body handler of the /api/ota/ uploads. Each chunk goes straight to flash.
+ */
+void receiveOtaChunk(AsyncWebServerRequest *request, OtaTarget target, uint8_t *data, size_t len, size_t index, size_t total)
+{
+	if (index == 0)
+	{
+		String expectedSha256 = "";
+		if (request->hasHeader("X-Sha256"))
+		{
+			expectedSha256 = request->getHeader("X-Sha256")->value();
+		}
+		else if (request->hasParam("sha256"))
+		{
+			expectedSha256 = request->getParam("sha256")->value();
+		}
+
+		if (!ota.begin(target, total, expectedSha256.c_str(), request))
+		{
+			// Another upload is running, see the 409 in finishOtaUpload()
+			return;
+		}
+
+		if (target == OTA_TARGET_FILESYSTEM)
+		{
+			// Its partition is about to be overwritten, loop() mounts it again
+			unmountFileSystem();
+		}
+
+		request->onDisconnect([request]()
+		{
+			if (ota.isOwner(request))
+			{
+				ota.abort("Client disconnected");
+			}
+		});
+	}
+
+	if (!ota.isOwner(request))
+	{
+		return;
+	}
+
+	ota.write(data, len);
+	if (index + len == total)
+	{
+		ota.end();
+	}
+}
+
+/**
+ * Request handler of the /api/ota/ uploads, called once the body is in
+ */
+void finishOtaUpload(AsyncWebServerRequest *request)
+{
+	if (request->contentLength() == 0)
+	{
+		request->send(400, "text/plain", "Request body is empty");
+		return;
+	}
 
+	if (!ota.isOwner(request))
+	{
+		request->send(409, "text/plain", "Another update is in progress");
+		return;
+	}
+
+	// The body was shorter than announced
+	ota.abort("Upload incomplete");
+	ota.release();
+
+	char body[OTA_RESPONSE_MAX_SIZE];
+	serializeOtaStatus(body, sizeof(body));
+	request->send(ota.getState() == OTA_DONE ? 200 : 400, "application/json", body);
+}
+
+/**
+ * Mounts LittleFS again after a filesystem upload, once it has finished one way or another
+ */
+void remountFileSystemAfterOta()
+{
+	xSemaphoreTake(fileSystemMutex, portMAX_DELAY);
+	if (!fileSystemUnmounted || ota.getState() == OTA_RECEIVING)
+	{
+		xSemaphoreGive(fileSystemMutex);
+		return;
+	}
+
+	fileSystemUnmounted = false;
+	bool mounted = LittleFS.begin();
+	xSemaphoreGive(fileSystemMutex);
+
+	if (!mounted)
+	{
+		Log.error(LOG_OTA, "LittleFS didn't mount after the update, upload a valid image");
+		return;
+	}
+
+	Log.status(LOG_OTA, "LittleFS mounted");
+}
+
+/*
+ * State subscribers, woken by store.dispatch() on the loop task
+ */
+#if OLED_ENABLED
+void displaySubscriber(uint32_t changed, const WINDER_STATE &state)
+{
+	if (state.winderEnabled == "0" || state.screenSleep)
+	{
+		if (changed & (STATE_WINDER_ENABLED | STATE_SCREEN_SLEEP))
+		{
+			display.clearDisplay();
+			showDisplay();
+		}
+		return;
+	}
+
+	if (changed & (STATE_STATUS | STATE_WINDER_ENABLED | STATE_SCREEN_SLEEP))
+	{
+		display.clearDisplay();
+		drawStaticGUI(true, state.status);
+		drawDynamicGUI();
+	}
+
+	if (changed & STATE_NOTICE)
+	{
+		drawNotification(state.notice);
+	}
+}
+#endif
+
+#if HOME_ASSISTANT_ENABLED
+/**
+ * Hands the pending changes to the MQTT task, without waiting. If its queue
+ * is full they stay pending, and go with the next changes or the next try.
+ */
+void queueHomeAssistantState()
+{
+	if (haPendingChanged == 0)
+	{
+		return;
+	}
+
+	const WINDER_STATE &state = store.get();
+	HA_STATE_UPDATE update = {};
+	update.changed = haPendingChanged;
+	update.force = haPendingForce;
+	// A notice such as "Winding Complete" says more than the bare status
+	snprintf(update.activity, sizeof(update.activity), "%s", haPendingChanged & STATE_NOTICE ? state.notice : state.status.c_str());
+	update.rotationsPerDay = state.rotationsPerDay.toInt();
+	update.direction = getDirectionIndexForHomeAssistant(state.direction);
+	update.hour = state.hour.toInt();
+	update.minutes = getTimerMinutesIndexForHomeAssistant(state.minutes.toInt());
+	update.timerEnabled = state.timerEnabled == "1";
+	update.winderEnabled = state.winderEnabled == "1";
+	update.screenSleep = state.screenSleep;
+	update.reception = haReception;
+
+	if (xQueueSend(haStateQueue, &update, 0) == pdTRUE)
+	{
+		haPendingChanged = 0;
+		haPendingForce = false;
+	}
+}
+
+void homeAssistantSubscriber(uint32_t changed, const WINDER_STATE &state)
+{
+	if (!homeAssistantReady)
+	{
+		return;
+	}
+
+	haPendingChanged |= changed;
+	// After a reconnect, states go out even if they match what was last sent
+	if (homeAssistantResync)
+	{
+		homeAssistantResync = false;
+		haPendingForce = true;
+		haPendingChanged |= HA_RECEPTION;
+	}
+	queueHomeAssistantState();
+}
+
+/**
+ * Checks the WiFi reception now & then, and retries changes the MQTT task had no room for
+ */
+void updateHomeAssistantState()
+{
+	if (!homeAssistantReady)
+	{
+		return;
+	}
+
+	if (millis() - haReceptionCheckedMs >= HOME_ASSISTANT_RECEPTION_INTERVAL_MS)
+	{
+		haReceptionCheckedMs = millis();
+		const char *reception = wifiReceptionNames[getWifiBars()];
+		if (reception != haReception)
+		{
+			haReception = reception;
+			haPendingChanged |= HA_RECEPTION;
+		}
+	}
+	queueHomeAssistantState();
+}
+
+/**
+ * Publishes what the loop handed over; on the MQTT task, the only one using the client
+ */
+void publishHomeAssistantState(const HA_STATE_UPDATE &update)
+{
+	if (update.changed & (STATE_STATUS | STATE_NOTICE))
+	{
+		ha_activityState.setValue(update.activity, update.force);
+	}
+	if (update.changed & STATE_ROTATIONS_PER_DAY)
+	{
+		ha_rpd.setState(update.rotationsPerDay, update.force);
+	}
+	if (update.changed & STATE_DIRECTION)
+	{
+		ha_selectDirection.setState(update.direction, update.force);
+	}
+	if (update.changed & STATE_TIMER)
+	{
+		ha_timerSwitch.setState(update.timerEnabled, update.force);
+		ha_selectHours.setState(update.hour, update.force);
+		ha_selectMinutes.setState(update.minutes, update.force);
+	}
+	if (update.changed & STATE_WINDER_ENABLED)
+	{
+		ha_powerSwitch.setState(update.winderEnabled, update.force);
+	}
+	if (update.changed & STATE_SCREEN_SLEEP)
+	{
+		ha_oledSwitch.setState(!update.screenSleep, update.force); // Invert state because naming is hard...
+	}
+	if ((update.changed & HA_RECEPTION) && update.reception[0] != '\0')
+	{
+		ha_rssiReception.setValue(update.reception, update.force);
+	}
+}
+#endif
+
+void persistenceSubscriber(uint32_t changed, const WINDER_STATE &state)
+{
+	TRACE_SCOPE("settings.save");
+	if (!settingsStore.save(settingsFromState(state)))
+	{
+		Log.error(LOG_MAIN, "Failed to save the settings");
+	}
+}
+
+void eventsSubscriber(uint32_t changed, const WINDER_STATE &state)
+{
+	if (events.count() == 0)
+	{
+		return;
+	}
+
+	char body[STATUS_RESPONSE_MAX_SIZE];
+	if (serializeStatus(body, sizeof(body)) > 0)
+	{
+		events.send(body, "state");
+	}
+}
+
+/**
+ * Copies the state into the mDNS TXT record; MdnsAdvert sends it once it changed
+ */
+void advertiseState(const WINDER_STATE &state)
+{
+	mdnsAdvert.set(MDNS_TXT_STATUS, state.status.c_str());
+	mdnsAdvert.set(MDNS_TXT_TPD, state.rotationsPerDay.c_str());
+	mdnsAdvert.set(MDNS_TXT_DIRECTION, state.direction.c_str());
+	mdnsAdvert.set(MDNS_TXT_TIMER, state.timerEnabled == "1" ? (state.hour + ":" + state.minutes).c_str() : "off");
+	mdnsAdvert.set(MDNS_TXT_STATE_VERSION, (unsigned long)store.getVersion());
+}
+
+void mdnsSubscriber(uint32_t changed, const WINDER_STATE &state)
+{
+	advertiseState(state);
+}
+
+/**
+ * 404 handler for webserver
+ */
+void notFound(AsyncWebServerRequest *request)
+{
+	// Handle HTTP_OPTIONS requests
+	if (request->method() == 64)
+	{
+		AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", "Ok");
+		request->send(response);
+	}
+	else
+	{
+		request->send(404, "text/plain", "Winderoo\n\n404 - Resource Not found");
+	}
+}
+
+/**
+ * Sees every request before the real handlers do, only to timestamp the first one
+ */
+class FirstRequestObserver : public AsyncWebHandler
+{
+public:
+	bool canHandle(AsyncWebServerRequest *request) override
+	{
+		bootProfiler.recordFirstHttpRequest();
+		return false;
+	}
+};
+
+/**
+ * API for front end
+ */
+void startWebserver()
+{
+	server.addHandler(new FirstRequestObserver());
+
+	server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest *request)
+	{
+		TRACE_SCOPE("GET /api/status");
+		JSON_FORMAT format;
+		if (!negotiateFormat(request, statusSchema, format))
+		{
+			return;
+		}
+		char body[STATUS_RESPONSE_MAX_SIZE];
+		sendFormatted(request, 200, format, body, serializeStatus(body, sizeof(body), format));
+	});
+
+	// Pushes the /api/status body on every change, instead of polling for it
+	events.onConnect([](AsyncEventSourceClient *client)
+	{
+		char body[STATUS_RESPONSE_MAX_SIZE];
+		if (serializeStatus(body, sizeof(body)) > 0)
+		{
+			client->send(body, "state");
+		}
+	});
+	server.addHandler(&events);
+
+	server.on("/api/boot", HTTP_GET, [](AsyncWebServerRequest *request)
+	{
+		TRACE_SCOPE("GET /api/boot");
+		// Each phase is its own small object, gathered into an array
+		char phases[BOOT_PROFILER_MAX_PHASES * 64];
+		JsonArray phasesArray(phases, sizeof(phases));
+		for (int i = 0; i < bootProfiler.getPhaseCount(); i++)
+		{
+			const BOOT_PHASE &phase = bootProfiler.getPhase(i);
+			JsonMessage entry(bootPhaseSchema);
+			entry.set(BOOT_PHASE_NAME, phase.name);
+			entry.set(BOOT_PHASE_START_MS, phase.startMs);
+			entry.set(BOOT_PHASE_DURATION_MS, phase.durationMs);
+			phasesArray.add(entry);
+		}
+
+		char body[BOOT_RESPONSE_MAX_SIZE];
+		if (phasesArray.finish() == 0)
+		{
+			sendFormatted(request, 200, jsonFormat, body, 0);
+			return;
+		}
+
+		JsonMessage json(bootSchema);
+		json.set(BOOT_VERSION, winderooVersion.c_str());
+		json.set(BOOT_WIFI_FAST_RECONNECT, wifiCache.usedFastReconnect());
+		json.set(BOOT_FIRST_HTTP_REQUEST_MS, bootProfiler.getFirstHttpRequestMs());
+		json.set(BOOT_BOOT_TO_MOTOR_START_MS, sleepControl.getBootToMotorStartMs());
+		json.set(BOOT_RESUMED_TURNS, resumedTurns);
+		json.set(BOOT_CHECKPOINT_WRITES, (long)checkpoints.getWrites());
+		json.setRaw(BOOT_PHASES, phases);
+		sendFormatted(request, 200, jsonFormat, body, json.serialize(body, sizeof(body)));
+	});
+
+	server.on("/api/history", HTTP_GET, [](AsyncWebServerRequest *request)
+	{
+		TRACE_SCOPE("GET /api/history");
+		HistoryFormat format = HISTORY_FORMAT_JSON;
+		if (request->hasParam("format"))
+		{
+			String requested = request->getParam("format")->value();
+			if (requested == "csv")
+			{
+				format = HISTORY_FORMAT_CSV;
+			}
+			else if (requested != "json")
+			{
+				request->send(400, "text/plain", "Invalid value for parameter: 'format'");
+				return;
+			}
+		}
+
+		uint32_t before = request->hasParam("before") ? strtoul(request->getParam("before")->value().c_str(), NULL, 10) : 0;
+		long limit = request->hasParam("limit") ? request->getParam("limit")->value().toInt() : HISTORY_PAGE_DEFAULT;
+		if (limit < 1 || limit > (long)history.getCapacity())
+		{
+			request->send(400, "text/plain", "Value out of range for parameter: 'limit'");
+			return;
+		}
+
+		// Streamed a record at a time, the page is never in RAM as a whole
+		std::shared_ptr<HistoryStream> stream = std::make_shared<HistoryStream>(history, format, before, limit);
+		request->send(request->beginChunkedResponse(format == HISTORY_FORMAT_CSV ? "text/csv" : "application/json",
+			[stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+			{
+				return stream->fill(buffer, maxLen);
+			}));
+	});
+
+	// Before /api/logs, which would match it too
+	server.on("/api/logs/level", HTTP_GET, [](AsyncWebServerRequest *request)
+	{
+		TRACE_SCOPE("GET /api/logs/level");
+		char body[LOG_MODULE_COUNT * 24 + 8];
+		size_t length = 0;
+		body[length++] = '{';
+		for (int i = 0; i < LOG_MODULE_COUNT; i++)
+		{
+			length += snprintf(body + length, sizeof(body) - length, "%s\"%s\":\"%s\"", i ? "," : "",
+				logModuleChoices[i], logLevelChoices[Log.getLevel((LogModule)i)]);
+		}
+		body[length++] = '}';
+		body[length] = '\0';
+		request->send(200, "application/json", body);
+	});
 
-			// Update motor direction
-			if (strcmp(requestRotationDirection.c_str(), userDefinedSettings.direction.c_str()) != 0)
+	server.on("/api/logs", HTTP_GET, [](AsyncWebServerRequest *request)
+	{
+		TRACE_SCOPE("GET /api/logs");
+		LogLevel maxLevel = LOG_LEVEL_DEBUG;
+		if (request->hasParam("level"))
+		{
+			String requested = request->getParam("level")->value();
+			int level = 0;
+			while (level <= LOG_LEVEL_DEBUG && requested != logLevelChoices[level])
 			{
-				userDefinedSettings.direction = requestRotationDirection;
-				motor.stop();
-				delay(250);
-
-				// Update motor direction
-				if (userDefinedSettings.direction == "CW" )
-				{
-					motor.setMotorDirection(1);
-				}
-				else if (userDefinedSettings.direction == "CCW")
-				{
-					motor.setMotorDirection(0);
-				}
-
-				Serial.println("[STATUS] - direction set: " + userDefinedSettings.direction);
+				level++;
 			}
-			else
+			if (level > LOG_LEVEL_DEBUG)
 			{
-				userDefinedSettings.direction = requestRotationDirection;
+				request->send(400, "text/plain", "Invalid value for parameter: 'level'");
+				return;
 			}
+			maxLevel = (LogLevel)level;
+		}
+
+		long limit = request->hasParam("limit") ? request->getParam("limit")->value().toInt() : LOG_TAIL_DEFAULT;
+		if (limit < 1 || limit > LOG_RING_SLOTS)
+		{
+			request->send(400, "text/plain", "Value out of range for parameter: 'limit'");
+			return;
+		}
 
-			// Update (turns) rotations per day
-			if (strcmp(requestTPD.c_str(), userDefinedSettings.rotationsPerDay .c_str()) != 0)
+		// Formatted a record at a time, oldest first
+		std::shared_ptr<LogTail> tail = std::make_shared<LogTail>(Log, limit, maxLevel);
+		request->send(request->beginChunkedResponse("text/plain",
+			[tail](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
 			{
-				userDefinedSettings.rotationsPerDay = requestTPD;
+				return tail->fill(buffer, maxLen);
+			}));
+	});
 
-				unsigned long finishTime = calculateWindingTime();
-				estimatedRoutineFinishEpoch = finishTime;
-			}
+	server.on("/api/telemetry", HTTP_GET, [](AsyncWebServerRequest *request)
+	{
+		TRACE_SCOPE("GET /api/telemetry");
+		String metricName = request->hasParam("metric") ? request->getParam("metric")->value() : "";
+		int metric = 0;
+		while (metric < TELEMETRY_METRIC_COUNT && metricName != telemetryMetricChoices[metric])
+		{
+			metric++;
+		}
+		if (metric == TELEMETRY_METRIC_COUNT)
+		{
+			request->send(400, "text/plain", "Invalid value for parameter: 'metric'");
+			return;
+		}
+#if !CURRENT_SENSE_ENABLED
+		if (metric == TELEMETRY_CURRENT)
+		{
+			request->send(404, "text/plain", "Built without CURRENT_SENSE_ENABLED");
+			return;
+		}
+#endif
+
+		String resolutionName = request->hasParam("resolution") ? request->getParam("resolution")->value() : "minute";
+		int resolution = 0;
+		while (resolution <= TELEMETRY_HOUR && resolutionName != telemetryResolutionChoices[resolution])
+		{
+			resolution++;
+		}
+		if (resolution > TELEMETRY_HOUR)
+		{
+			request->send(400, "text/plain", "Invalid value for parameter: 'resolution'");
+			return;
+		}
 
-			// Update action (START/STOP)
-			if ( strcmp(requestAction.c_str(), "START") == 0 )
+		// A sample at a time, the series is never copied as a whole
+		std::shared_ptr<TelemetryStream> stream = std::make_shared<TelemetryStream>(telemetry, (TelemetryMetric)metric, (TelemetryResolution)resolution);
+		request->send(request->beginChunkedResponse("application/json",
+			[stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
 			{
-				if (!routineRunning)
-				{
-					userDefinedSettings.status = "Winding";
-					beginWindingRoutine();
-				}
-			}
-			else
+				return stream->fill(buffer, maxLen);
+			}));
+	});
+
+#if TRACE_ENABLED
+	server.on("/api/trace", HTTP_GET, [](AsyncWebServerRequest *request)
+	{
+		// An event at a time; whatever is recorded meanwhile, this request included, waits for the next one
+		std::shared_ptr<TraceExport> trace = std::make_shared<TraceExport>(Trace);
+		AsyncWebServerResponse *response = request->beginChunkedResponse("application/json",
+			[trace](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
 			{
-				motor.stop();
-				routineRunning = false;
-				userDefinedSettings.status = "Stopped";
-				drawNotification("Stopped");
-				if (HOME_ASSISTANT_ENABLED) ha_activityState.setValue("Stopped");
-			}
+				return trace->fill(buffer, maxLen);
+			});
+		response->addHeader("Content-Disposition", "attachment; filename=\"winderoo-trace.json\"");
+		request->send(response);
+	});
+#endif
+
+#if GROUP_ENABLED
+	server.on("/api/group/start", HTTP_POST, [](AsyncWebServerRequest *request)
+	{
+		TRACE_SCOPE("POST /api/group/start");
+		if (!group.isEnabled())
+		{
+			request->send(409, "text/plain", "Not connected to the group");
+			return;
+		}
+
+		// One packet reaches every member, this one included
+		group.requestStart();
+		request->send(202);
+	});
+
+	server.on("/api/group", HTTP_GET, [](AsyncWebServerRequest *request)
+	{
+		TRACE_SCOPE("GET /api/group");
+		char body[GROUP_RESPONSE_MAX_SIZE];
+		sendFormatted(request, 200, jsonFormat, body, serializeGroupStatus(body, sizeof(body)));
+	});
+#endif
+
+#if HOME_ASSISTANT_ENABLED
+	server.on("/api/homeassistant", HTTP_GET, [](AsyncWebServerRequest *request)
+	{
+		TRACE_SCOPE("GET /api/homeassistant");
+		JSON_FORMAT format;
+		if (!negotiateFormat(request, homeAssistantSchema, format))
+		{
+			return;
+		}
+		char body[HOME_ASSISTANT_RESPONSE_MAX_SIZE];
+		sendFormatted(request, 200, format, body, serializeHomeAssistantStatus(body, sizeof(body), format));
+	});
+#endif
+
+#if CURRENT_SENSE_ENABLED
+	server.on("/api/motor", HTTP_GET, [](AsyncWebServerRequest *request)
+	{
+		TRACE_SCOPE("GET /api/motor");
+		JSON_FORMAT format;
+		if (!negotiateFormat(request, motorSchema, format))
+		{
+			return;
+		}
+		char body[MOTOR_RESPONSE_MAX_SIZE];
+		sendFormatted(request, 200, format, body, serializeMotorStatus(body, sizeof(body), format));
+	});
+#endif
+
+	server.on("/api/ota", HTTP_GET, [](AsyncWebServerRequest *request)
+	{
+		TRACE_SCOPE("GET /api/ota");
+		JSON_FORMAT format;
+		if (!negotiateFormat(request, otaSchema, format))
+		{
+			return;
+		}
+		char body[OTA_RESPONSE_MAX_SIZE];
+		sendFormatted(request, 200, format, body, serializeOtaStatus(body, sizeof(body), format));
+	});
+
+	// Raw images, streamed into flash as they arrive
+	server.on("/api/ota/firmware", HTTP_POST, finishOtaUpload, NULL,
+		[](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+		{
+			receiveOtaChunk(request, OTA_TARGET_FIRMWARE, data, len, index, total);
+		});
+
+	server.on("/api/ota/fs", HTTP_POST, finishOtaUpload, NULL,
+		[](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+		{
+			receiveOtaChunk(request, OTA_TARGET_FILESYSTEM, data, len, index, total);
+		});
+
+	// Answered with 202 & applied by the loop, follow them at /api/commands/{id}
+	server.on("/api/timer", HTTP_POST, [](AsyncWebServerRequest *request)
+	{
+		TRACE_SCOPE("POST /api/timer");
+		const AsyncWebParameter *timerEnabled = request->getParam("timerEnabled");
+		if (timerEnabled == NULL || (timerEnabled->value() != "0" && timerEnabled->value() != "1"))
+		{
+			request->send(400, "text/plain", "timerEnabled must be 0 or 1");
+			return;
+		}
+
+		COMMAND command = {};
+		command.type = COMMAND_TIMER;
+		command.value = timerEnabled->value() == "1";
+		acceptCommand(request, command);
+	});
+	server.on("/api/update", HTTP_POST, requireCommandBody, NULL, receiveUpdate);
+	server.on("/api/power", HTTP_POST, requireCommandBody, NULL, receivePower);
+	server.on("/api/settings", HTTP_POST, requireCommandBody, NULL, receiveSettings);
+
+	server.on("/api/settings", HTTP_GET, [](AsyncWebServerRequest *request)
+	{
+		TRACE_SCOPE("GET /api/settings");
+		JSON_FORMAT format;
+		if (!negotiateFormat(request, settingsSchema, format))
+		{
+			return;
+		}
+		char body[SETTINGS_RESPONSE_MAX_SIZE];
+		sendFormatted(request, 200, format, body, serializeSettings(body, sizeof(body), format));
+	});
+
+	server.on("/api/patterns", HTTP_GET, [](AsyncWebServerRequest *request)
+	{
+		TRACE_SCOPE("GET /api/patterns");
+		if (!request->url().startsWith("/api/patterns/"))
+		{
+			char body[PATTERNS_RESPONSE_MAX_SIZE];
+			sendFormatted(request, 200, jsonFormat, body, serializePatterns(body, sizeof(body)));
+			return;
+		}
+
+		JSON_FORMAT format;
+		if (!negotiateFormat(request, patternEntrySchema, format))
+		{
+			return;
+		}
+
+		int slot = patternSlotFromUrl(request);
+		WINDING_PATTERN pattern;
+		if (slot == 0 || !patterns.get(slot, pattern))
+		{
+			request->send(404, "text/plain", "No pattern in that slot");
+			return;
+		}
+
+		char body[PATTERN_RESPONSE_MAX_SIZE];
+		sendFormatted(request, 200, format, body, serializePattern(slot, pattern, body, sizeof(body), format));
+	});
+
+	// More specific first, the handlers match prefixes
+	server.on("/api/patterns/active", HTTP_POST, requireCommandBody, NULL, receivePatternSelect);
+	server.on("/api/patterns", HTTP_POST, requireCommandBody, NULL, receivePattern);
+
+	server.on("/api/commands", HTTP_GET, [](AsyncWebServerRequest *request)
+	{
+		TRACE_SCOPE("GET /api/commands");
+		JSON_FORMAT format;
+		if (!negotiateFormat(request, commandSchema, format))
+		{
+			return;
+		}
+
+		// "/api/commands/{id}", the handler matches the prefix
+		const char *prefix = "/api/commands/";
+		COMMAND_RECORD record;
+		if (!request->url().startsWith(prefix) || !commands.find(strtoul(request->url().c_str() + strlen(prefix), NULL, 10), record))
+		{
+			request->send(404, "text/plain", "Unknown command");
+			return;
+		}
+
+		char body[COMMAND_RESPONSE_MAX_SIZE];
+		sendFormatted(request, 200, format, body, serializeCommand(record, body, sizeof(body), format));
+	});
+
+	server.onRequestBody([](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+	{
 
-			// Update screen sleep state
-			if (screenSleep && OLED_ENABLED)
+		if (request->url() == "/api/logs/level")
+		{
+			TRACE_SCOPE("POST /api/logs/level");
+			JsonMessage json(logLevelSchema);
+
+			if (!json.parse((const char *)data, len))
 			{
-				display.clearDisplay();
-				display.display();
+				request->send(400, "text/plain", json.getError());
+				return;
 			}
-			else
+
+			LogLevel level = (LogLevel)json.getChoice(LOG_LEVEL_FIELD_LEVEL);
+			for (int i = 0; i < LOG_MODULE_COUNT; i++)
 			{
-				if (OLED_ENABLED)
+				if (!json.has(LOG_LEVEL_FIELD_MODULE) || json.getChoice(LOG_LEVEL_FIELD_MODULE) == i)
 				{
-					// Draw gui with updated values from _this_ update request
-					drawStaticGUI(true, userDefinedSettings.status);
-					drawDynamicGUI();
+					Log.setLevel((LogModule)i, level);
 				}
 			}
 
-			// Write new parameters to file
-			bool writeSuccess = writeConfigVarsToFile(settingsFile, userDefinedSettings);
-			if ( !writeSuccess )
-			{
-				Serial.println("[ERROR] - Failed to write [update] endpoint data to file");
-				request->send(500, "text/plain", "Failed to write new configuration to file");
-			}
-
 			request->send(204);
 		}
 	});
 
 	server.on("/api/reset", HTTP_GET, [](AsyncWebServerRequest *request)
 	{
-		Serial.println("[STATUS] - Received reset command");
-		AsyncResponseStream *response = request->beginResponseStream("application/json");
-		JsonDocument json;
-		json["status"] = "Resetting";
-		serializeJson(json, *response);
-		request->send(response);
+		TRACE_SCOPE("GET /api/reset");
+		Log.status(LOG_MAIN, "Received reset command");
+		request->send(200, "application/json", "{\"status\":\"Resetting\"}");
 
 		reset = true;
 	});
@@ -770,7 +2391,8 @@ void startWebserver()
 
 	DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
 	DefaultHeaders::Instance().addHeader("Access-Control-Allow-Methods", "GET,POST,OPTIONS");
-	DefaultHeaders::Instance().addHeader("Access-Control-Allow-Headers", "Content-Type, Access-Control-Allow-Headers, Authorization, X-Requested-With");
+	DefaultHeaders::Instance().addHeader("Access-Control-Allow-Headers", "Content-Type, Access-Control-Allow-Headers, Authorization, X-Requested-With, Idempotency-Key");
+	DefaultHeaders::Instance().addHeader("Access-Control-Expose-Headers", "Location");
 
 	server.begin();
 }
@@ -782,9 +2404,9 @@ void initFS()
 {
 	if (!LittleFS.begin(true))
 	{
-		Serial.println("[STATUS] - An error has occurred while mounting LittleFS");
+		Log.status(LOG_MAIN, "An error has occurred while mounting LittleFS");
 	}
-	Serial.println("[STATUS] - LittleFS mounted");
+	Log.status(LOG_MAIN, "LittleFS mounted");
 }
 
 /**
@@ -810,11 +2432,161 @@ void triggerLEDCondition(int blinkState)
 			LED.pwm();
 			break;
 		default:
-			Serial.println("[WARN] - blinkState not recognized");
+			Log.warn(LOG_MAIN, "blinkState not recognized");
 			break;
 	}
 }
 
+#if HOME_ASSISTANT_ENABLED
+// MQTT & Home Assistant Handlers
+void mqttOnConnected()
+{
+	Log.status(LOG_MAIN, "MQTT connected!");
+
+	// The broker sends the retained marker back if it still has our discovery configs
+	haDiscovery.onConnected(millis());
+	mqtt.subscribe(haDiscoveryTopic);
+
+	// Home Assistant may have missed changes while we were away; states only, no configs
+	homeAssistantResync = true;
+	store.touch(STATE_ALL & ~STATE_NOTICE);
+}
+
+void mqttOnDisconnected()
+{
+	Log.status(LOG_MAIN, "MQTT disconnected!");
+	haDiscovery.onDisconnected(millis());
+}
+
+void mqttOnMessage(const char *topic, const uint8_t *payload, uint16_t length)
+{
+	if (strcmp(topic, haDiscoveryTopic) == 0)
+	{
+		haDiscovery.onMarker(payload, length, millis());
+	}
+}
+
+/**
+ * Publishes discovery when haDiscovery decides the broker needs it, see HaDiscovery.h
+ */
+void updateHomeAssistantDiscovery()
+{
+	HaDiscoveryStep step = haDiscovery.update(millis());
+	if (step == HA_DISCOVERY_NOTHING)
+	{
+		return;
+	}
+
+	if (step == HA_DISCOVERY_ALL)
+	{
+		ha_oledSwitch.publishDiscovery();
+		ha_rpd.publishDiscovery();
+		ha_selectDirection.publishDiscovery();
+		ha_timerSwitch.publishDiscovery();
+		ha_startButton.publishDiscovery();
+		ha_stopButton.publishDiscovery();
+		ha_selectHours.publishDiscovery();
+		ha_selectMinutes.publishDiscovery();
+		ha_powerSwitch.publishDiscovery();
+		ha_rssiReception.publishDiscovery();
+		ha_activityState.publishDiscovery();
+	}
+
+	// Last, so a broker holding the marker holds the configs too
+	char hash[9];
+	haDiscovery.formatHash(hash, sizeof(hash));
+	if (mqtt.publish(haDiscoveryTopic, hash, true))
+	{
+		haDiscovery.published(millis());
+	}
+}
+
+
+/**
+ * Hands a command from the MQTT task to the loop, which owns the motor & the session
+ */
+void queueHomeAssistantCommand(CommandType type, int32_t value = 0)
+{
+	COMMAND command = {};
+	command.type = type;
+	command.source = COMMAND_SOURCE_HOME_ASSISTANT;
+	command.value = value;
+	command.receivedMicros = micros();
+
+	bool duplicate;
+	commands.submit(command, NULL, &duplicate);
+}
+
+void onOledSwitchCommand(bool state, HASwitch* sender)
+{
+	queueHomeAssistantCommand(COMMAND_SCREEN, state);
+}
+
+void onRpdChangeCommand(HANumeric number, HANumber* sender)
+{
+	queueHomeAssistantCommand(COMMAND_ROTATIONS_PER_DAY, number.toInt32());
+}
+
+void onSelectDirectionCommand(int8_t index, HASelect* sender)
+{
+	// "CCW;BOTH;CW" as directionChoices indexes
+	static const int8_t directions[] = {1, 2, 0};
+	queueHomeAssistantCommand(COMMAND_DIRECTION, index >= 0 && index < 3 ? directions[index] : -1);
+}
+
+void onTimerSwitchCommand(bool state, HASwitch* sender)
+{
+	queueHomeAssistantCommand(COMMAND_TIMER, state);
+}
+
+void handleHAStartButton(HAButton* sender)
+{
+	queueHomeAssistantCommand(COMMAND_START);
+}
+
+void handleHAStopButton(HAButton* sender)
+{
+	queueHomeAssistantCommand(COMMAND_STOP);
+}
+
+void onSelectHoursCommand(int8_t index, HASelect* sender)
+{
+	queueHomeAssistantCommand(COMMAND_HOUR, index);
+}
+
+void onSelectMinutesCommand(int8_t index, HASelect* sender)
+{
+	queueHomeAssistantCommand(COMMAND_MINUTES, index);
+}
+
+void onPowerSwitchCommand(bool state, HASwitch* sender)
+{
+	queueHomeAssistantCommand(COMMAND_POWER, state);
+}
+
+/**
+ * Reads the socket & keeps the connection up, so commands arrive whatever the loop is doing
+ */
+void mqttTask(void *parameters)
+{
+	HA_STATE_UPDATE update;
+	for (;;)
+	{
+		while (xQueueReceive(haStateQueue, &update, 0) == pdTRUE)
+		{
+			publishHomeAssistantState(update);
+		}
+		{
+			// Reconnecting resyncs the states, discovery only when the broker needs it; see mqttOnConnected()
+			TRACE_SCOPE("mqtt.loop");
+			mqtt.loop();
+			updateHomeAssistantDiscovery();
+		}
+		vTaskDelay(pdMS_TO_TICKS(MQTT_POLL_INTERVAL_MS));
+	}
+}
+#endif
+
 /**
  * This is a non-block button listener function.
  * Credit to github OSWW contribution from user @danagarcia
@@ -827,38 +2599,110 @@ void awaitWhileListening(int pauseInSeconds)
   int delayEnd = millis() + (1000 * pauseInSeconds);
   while (millis() < delayEnd) {
     // get physical button state
-    int buttonState = digitalRead(externalButton);
+    int buttonState = digitalRead(board.buttonPin);
 
 	if (buttonState == HIGH)
 	{
-		if (userDefinedSettings.winderEnabled == "0")
+		if (userDefinedSettings.winderEnabled == "0" && (winder.isRunning() || userDefinedSettings.status != "Stopped"))
 		{
-			motor.stop();
-			routineRunning = false;
-			userDefinedSettings.status = "Stopped";
-			Serial.println("[STATUS] - Switched off!");
-			if (HOME_ASSISTANT_ENABLED) ha_activityState.setValue("Stopped");
+			Log.status(LOG_MAIN, "Switched off!");
+			stopWindingRoutine(HISTORY_STOP_SWITCHED_OFF);
 		}
 	}
-	else
+
+	applyCommands();
+
+	// Changes from the webserver & MQTT reach subscribers & flash while we wait;
+	// flash writes stay off those tasks
+	store.dispatch();
+#if HOME_ASSISTANT_ENABLED
+	updateHomeAssistantState();
+#endif
+	// The ETA also moves without the state changing, e.g. when NTP sets the clock
+	mdnsAdvert.set(MDNS_TXT_ETA, winder.isRunning() ? winder.getEstimatedFinishEpoch() : 0UL);
+	mdnsAdvert.update(millis());
+	history.flush();
+	patterns.flush();
+#if GROUP_ENABLED
+	pollGroup();
+#endif
+  }
+}
+
+#if DEEP_SLEEP_ENABLED
+/**
+ * Restores the schedule kept in RTC memory and starts winding straight away,
+ * before WiFi, the file system & the webserver are brought up
+ */
+void resumeWindingFromDeepSleep()
+{
+	const RTC_SLEEP_STATE &state = sleepControl.getState();
+
+	store.setRotationsPerDay(state.rotationsPerDay);
+	store.setDirection(state.direction);
+	store.setHour(state.hour);
+	store.setMinutes(state.minutes);
+	store.setTimerEnabled(state.timerEnabled ? "1" : "0");
+	store.setWinderEnabled("1");
+
+	Log.status(LOG_MAIN, "Resuming timed session from deep sleep");
+	beginWindingRoutine();
+}
+
+/**
+ * Saves the schedule to RTC memory & deep sleeps until the next timed session.
+ * Backs out if the user disabled the timer or the winder during the grace period.
+ */
+void enterDeepSleep()
+{
+	deepSleepPending = false;
+
+	if (userDefinedSettings.timerEnabled != "1" || userDefinedSettings.winderEnabled != "1")
 	{
-		userDefinedSettings.winderEnabled == "1";
+		return;
 	}
 
-  }
+	sleepControl.saveSchedule(
+		userDefinedSettings.rotationsPerDay,
+		userDefinedSettings.direction,
+		userDefinedSettings.hour,
+		userDefinedSettings.minutes,
+		userDefinedSettings.timerEnabled
+	);
+
+	unsigned long secondsUntilNextSession = sleepControl.secondsUntil(
+		userDefinedSettings.hour.toInt(),
+		userDefinedSettings.minutes.toInt(),
+		rtc.getHour(true),
+		rtc.getMinute(),
+		rtc.getSecond()
+	);
+
+	motor.stop();
+	LED.off();
+
+#if OLED_ENABLED
+	drawNotification("Sleeping");
+	display.ssd1306_command(SSD1306_DISPLAYOFF);
+#endif
+
+	server.end();
+	unmountFileSystem();
+
+	sleepControl.sleepFor(secondsUntilNextSession, rtc.getEpoch());
 }
+#endif
 
 /**
  * Callback triggered from WifiManager when successfully connected to new WiFi network
  */
 void saveParamsCallback()
 {
-	if (OLED_ENABLED)
-	{
-		display.clearDisplay();
-		display.display();
-		drawNotification("Connecting...");
-	}
+#if OLED_ENABLED
+	display.clearDisplay();
+	showDisplay();
+	drawNotification("Connecting...");
+#endif
 }
 
 /**
@@ -866,295 +2710,321 @@ void saveParamsCallback()
  */
 void saveWifiCallback()
 {
-	if (OLED_ENABLED)
-	{
-		display.clearDisplay();
-		display.display();
-		drawNotification("Connected to WiFi");
-		String rebootingMessage[2] = {"Device is", "rebooting..."};
-		drawMultiLineText(rebootingMessage);
-	}
+#if OLED_ENABLED
+	display.clearDisplay();
+	showDisplay();
+	drawNotification("Connected to WiFi");
+	String rebootingMessage[2] = {"Device is", "rebooting..."};
+	drawMultiLineText(rebootingMessage);
+#endif
+
+	// new network, the cached access point no longer applies
+	wifiCache.invalidate();
 
 	// slow blink to confirm connection success
 	triggerLEDCondition(1);
 
+	Log.flush();
 	ESP.restart();
 	delay(1500);
 }
 
-// MQTT & Home Assistant Handlers
-void mqttOnConnected()
-{
-	Serial.println("[STATUS] - MQTT connected!");
-}
-
-void mqttOnDisconnected()
-{
-	Serial.println("[STATUS] - MQTT disconnected!");
-}
-
-void onOledSwitchCommand(bool state, HASwitch* sender)
+/**
+ * Startup stages, see setup() for how they depend on each other
+ */
+bool startDisplayStage()
 {
-	if (state)
-	{
-		screenSleep = false;
-		display.clearDisplay();
-		drawStaticGUI(true);
-		drawDynamicGUI();
-	}
-	else
+#if OLED_ENABLED
+	if (!display.begin(SSD1306_SWITCHCAPVCC, board.screenAddress))
 	{
-		screenSleep = true;
-		display.clearDisplay();
-		display.display();
+		Log.error(LOG_MAIN, "SSD1306 allocation failed");
+		Log.flush();
+		for(;;); // Don't proceed, loop forever
 	}
+	drawStaticGUI();
 
-	sender->setState(state);
+	int rotate = OLED_ROTATE_SCREEN_180 ? 2 : 4;
+	display.clearDisplay();
+	display.invertDisplay(OLED_INVERT_SCREEN);
+	display.setRotation(rotate);
+	drawNotification("Winderoo");
+#endif
+	return true;
 }
 
-void onRpdChangeCommand(HANumeric number, HANumber* sender)
+bool startFileSystemStage()
 {
-	char buffer[10];
-	number.toStr(buffer);
-	userDefinedSettings.rotationsPerDay = String(buffer);
+	initFS();
+	history.begin();
 
-	bool writeSuccess = writeConfigVarsToFile(settingsFile, userDefinedSettings);
-	if ( !writeSuccess )
+	// retrieve & read saved settings, unless RTC memory already gave us a running session
+	if (!winder.isRunning())
 	{
-		Serial.println("[ERROR] - Failed to write number state [MQTT]");
+		loadSettings();
 	}
-
-	sender->setCurrentState(number);
+	return true;
 }
 
-void onSelectDirectionCommand(int8_t index, HASelect* sender) {
-   switch (index) {
-    case 0:
-        // Option "CCW" was selected
-		userDefinedSettings.direction = "CCW";
-        break;
-
-    case 1:
-        // Option "BOTH" was selected
-		userDefinedSettings.direction = "BOTH";
-        break;
-
-    case 2:
-        // Option "CW" was selected
-		userDefinedSettings.direction = "CW";
-        break;
-
-    default:
-        // unknown option
-        return;
-    }
-
-	bool writeSuccess = writeConfigVarsToFile(settingsFile, userDefinedSettings);
-	if ( !writeSuccess )
+/**
+ * Resumes an interrupted session straight away. The RTC may not be set yet;
+ * applyTime() shifts the session's epochs once NTP answers.
+ */
+bool startMotorStage()
+{
+	if (!winder.isRunning() && strcmp(userDefinedSettings.status.c_str(), "Winding") == 0)
 	{
-		Serial.println("[ERROR] - Failed to write direction select state [MQTT]");
+		// Checkpointed when the session began, so any checkpoint is this session's
+		WINDING_PROGRESS progress;
+		if (!checkpoints.load(progress))
+		{
+			Log.warn(LOG_MAIN, "No checkpoint of the interrupted session, starting it over");
+			beginWindingRoutine();
+		}
+		else if (progress.plannedTurns <= (progress.clockwiseSeconds + progress.counterClockwiseSeconds) / durationInSecondsToCompleteOneRevolution)
+		{
+			// Finished as the power went
+			Log.status(LOG_MAIN, "Interrupted session had already delivered its turns");
+			store.setStatus("Stopped");
+		}
+		else
+		{
+			beginWindingRoutine("Winding Resumed", &progress);
+		}
 	}
-
-	sender->setState(index);
+	return true;
 }
 
-void onTimerSwitchCommand(bool state, HASwitch* sender)
+/**
+ * Tries the last good access point first, it skips the scan.
+ * Otherwise connects using saved credentials, if they exist.
+ * If connection fails, starts the setup Access Point and fails the stage.
+ */
+bool startWifiStage()
 {
-	userDefinedSettings.timerEnabled = state ? "1" : "0";
-	bool writeSuccess = writeConfigVarsToFile(settingsFile, userDefinedSettings);
-	if ( !writeSuccess )
+	String savedNetworkMessage[2] = {"Connecting to", "saved network..."};
+	drawMultiLineText(savedNetworkMessage);
+
+	bool connected = false;
+	if (wifiCache.load())
 	{
-		Serial.println("[ERROR] - Failed to write timer switch state [MQTT]");
+		connected = wifiCache.reconnect(wm.getWiFiSSID(), wm.getWiFiPass(), FAST_RECONNECT_TIMEOUT_MS);
 	}
 
-	sender->setState(state);
-}
-
-void handleHAStartButton(HAButton* sender)
-{
-	if (!routineRunning)
+	if (!connected && !wm.autoConnect("Winderoo Setup"))
 	{
-		beginWindingRoutine();
+		configPortalRunning = true;
+		Log.status(LOG_WIFI, "WiFi Config Portal running");
+		ledcWrite(LED.getChannel(), 255);
+
+		String setupNetworkMessage[3] = {"Connect to", "\"Winderoo Setup\"", "wifi to begin"};
+		drawMultiLineText(setupNetworkMessage);
+		return false;
 	}
-}
 
-void handleHAStopButton(HAButton* sender)
-{
-	motor.stop();
-	routineRunning = false;
-	userDefinedSettings.status = "Stopped";
-	drawNotification("Stopped");
-	ha_activityState.setValue("Stopped");
+	wifiCache.save();
+	Log.status(LOG_WIFI, "connected to saved network");
+
+#if OLED_ENABLED
+	display.clearDisplay();
+	drawStaticGUI();
+	drawNotification("Connected to WiFi");
+#endif
+	return true;
 }
 
-void onSelectHoursCommand(int8_t index, HASelect* sender)
+bool startWebserverStage()
 {
-	// Ugly but more reliable
-	switch (index) 
-	{
-		case 0:
-			userDefinedSettings.hour = "00";
-			break;
-		case 1:
-			userDefinedSettings.hour = "01";
-			break;
-		case 2:
-			userDefinedSettings.hour = "02";
-			break;
-		case 3:
-			userDefinedSettings.hour = "03";
-			break;
-		case 4:
-			userDefinedSettings.hour = "04";
-			break;
-		case 5:
-			userDefinedSettings.hour = "05";
-			break;
-		case 6:
-			userDefinedSettings.hour = "06";
-			break;
-		case 7:
-			userDefinedSettings.hour = "07";
-			break;
-		case 8:
-			userDefinedSettings.hour = "08";
-			break;
-		case 9:
-			userDefinedSettings.hour = "09";
-			break;
-		case 10:
-			userDefinedSettings.hour = "10";
-			break;
-		case 11:
-			userDefinedSettings.hour = "11";
-			break;
-		case 12:	
-			userDefinedSettings.hour = "12";
-			break;
-		case 13:
-			userDefinedSettings.hour = "13";
-			break;
-		case 14:
-			userDefinedSettings.hour = "14";
-			break;
-		case 15:
-			userDefinedSettings.hour = "15";
-			break;
-		case 16:
-			userDefinedSettings.hour = "16";
-			break;
-		case 17:
-			userDefinedSettings.hour = "17";
-			break;
-		case 18:
-			userDefinedSettings.hour = "18";
-			break;
-		case 19:
-			userDefinedSettings.hour = "19";
-			break;
-		case 20:
-			userDefinedSettings.hour = "20";
-			break;
-		case 21:
-			userDefinedSettings.hour = "21";
-			break;
-		case 22:
-			userDefinedSettings.hour = "22";
-			break;
-		case 23:
-			userDefinedSettings.hour = "23";
-			break;
-		default:
-			return;
-    }
+	startWebserver();
 
-	bool writeSuccess = writeConfigVarsToFile(settingsFile, userDefinedSettings);
-	if ( !writeSuccess )
+	if (!winder.isRunning())
 	{
-		Serial.println("[ERROR] - Failed to write hours select state [MQTT]");
+		drawNotification("Winderoo");
 	}
-
-	sender->setState(index);
+	return true;
 }
 
-void onSelectMinutesCommand(int8_t index, HASelect* sender)
+/**
+ * Background stage - must not touch the display, loop() owns it by now
+ */
+bool startMdnsStage()
 {
-	switch(index)
-	{
-		case 0:
-			userDefinedSettings.minutes = "00";
-			break;
-		case 1:
-			userDefinedSettings.minutes = "10";
-			break;
-		case 2:
-			userDefinedSettings.minutes = "20";
-			break;
-		case 3:
-			userDefinedSettings.minutes = "30";
-			break;
-		case 4:
-			userDefinedSettings.minutes = "40";
-			break;
-		case 5:
-			userDefinedSettings.minutes = "50";
-			break;
-		default:
-			return;
-	}
-
-	bool writeSuccess = writeConfigVarsToFile(settingsFile, userDefinedSettings);
-	if ( !writeSuccess )
+	if (!MDNS.begin("winderoo"))
 	{
-		Serial.println("[ERROR] - Failed to write minutes select state [MQTT]");
+		Log.warn(LOG_WIFI, "Failed to start mDNS");
+		return false;
 	}
-
-	sender->setState(index);
+	MDNS.addService("_winderoo", "_tcp", 80);
+	mdnsAdvert.begin("_winderoo", "_tcp");
+	Log.status(LOG_WIFI, "mDNS started");
+	return true;
 }
 
-void onPowerSwitchCommand(bool state, HASwitch* sender)
+#if GROUP_ENABLED
+/**
+ * Background stage - joins the group of winders on this network, see WinderGroup.h
+ */
+bool startGroupStage()
 {
-	userDefinedSettings.winderEnabled = state ? "1" : "0";
+	uint8_t mac[6];
+	WiFi.macAddress(mac);
+	uint32_t id = (uint32_t)mac[2] << 24 | (uint32_t)mac[3] << 16 | (uint32_t)mac[4] << 8 | mac[5];
+	return group.begin(id, GROUP_NAME, GROUP_MAX_RUNNING_MOTORS);
+}
+#endif
 
-	if (userDefinedSettings.winderEnabled == "0")
+#if HOME_ASSISTANT_ENABLED
+/**
+ * Background stage - configures the entities; loop() connects to the broker once this is done
+ */
+bool startHomeAssistantStage()
+{
+	byte mac[6];
+	WiFi.macAddress(mac);
+	device.setUniqueId(mac, sizeof(mac));
+
+	device.setName("Winderoo");
+	device.setManufacturer("mwood77");
+	device.setModel("Winderoo");
+	device.setSoftwareVersion(winderooVersion.c_str());
+	device.enableSharedAvailability();
+
+	// The device's part of every config, see CachedEntity for the entities' part
+	char deviceId[13];
+	snprintf(deviceId, sizeof(deviceId), "%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+	snprintf(haDiscoveryTopic, sizeof(haDiscoveryTopic), "aha/%s/discovery", deviceId);
+	haDiscovery.add(deviceId);
+	haDiscovery.add(winderooVersion.c_str());
+
+	ha_oledSwitch.setName("OLED");
+	ha_oledSwitch.setIcon("mdi:overscan");
+	ha_oledSwitch.setCurrentState(!userDefinedSettings.screenSleep);
+	ha_oledSwitch.onCommand(onOledSwitchCommand);
+
+	ha_rpd.setName("Rotations Per Day");
+	ha_rpd.setIcon("mdi:rotate-3d-variant");
+	ha_rpd.setMin(100);
+	ha_rpd.setMax(960);
+	ha_rpd.setStep(10);
+	ha_rpd.setCurrentState(static_cast<int32_t>(userDefinedSettings.rotationsPerDay.toInt()));
+	ha_rpd.setOptimistic(true);
+	ha_rpd.onCommand(onRpdChangeCommand);
+
+	ha_selectDirection.setName("Direction");
+	ha_selectDirection.setIcon("mdi:arrow-left-right");
+	ha_selectDirection.setOptions("CCW;BOTH;CW");
+	ha_selectDirection.onCommand(onSelectDirectionCommand);
+	ha_selectDirection.setCurrentState(getDirectionIndexForHomeAssistant(userDefinedSettings.direction));
+
+	ha_timerSwitch.setName("Timer Enabled");
+	ha_timerSwitch.setIcon("mdi:timer");
+	ha_timerSwitch.setCurrentState(userDefinedSettings.timerEnabled.toInt());
+	ha_timerSwitch.onCommand(onTimerSwitchCommand);
+
+	ha_startButton.setName("Start");
+	ha_startButton.setIcon("mdi:play");
+	ha_startButton.onCommand(handleHAStartButton);
+
+	ha_stopButton.setName("Stop");
+	ha_stopButton.setIcon("mdi:stop");
+	ha_stopButton.onCommand(handleHAStopButton);
+
+	ha_selectHours.setName("Hour");
+	ha_selectHours.setIcon("mdi:timer-sand-full");
+	ha_selectHours.setOptions("00;01;02;03;04;05;06;07;08;09;10;11;12;13;14;15;16;17;18;19;20;21;22;23");
+	ha_selectHours.setCurrentState(userDefinedSettings.hour.toInt());
+	ha_selectHours.onCommand(onSelectHoursCommand);
+
+	ha_selectMinutes.setName("Minutes");
+	ha_selectMinutes.setIcon("mdi:timer-sand-empty");
+	ha_selectMinutes.setOptions("00;10;20;30;40;50");
+	ha_selectMinutes.setCurrentState(userDefinedSettings.minutes.toInt());
+	ha_selectMinutes.onCommand(onSelectMinutesCommand);
+
+	ha_powerSwitch.setName("Power");
+	ha_powerSwitch.setIcon("mdi:power");
+	ha_powerSwitch.setCurrentState(userDefinedSettings.winderEnabled.toInt());
+	ha_powerSwitch.onCommand(onPowerSwitchCommand);
+
+	ha_activityState.setName("Status");
+	ha_activityState.setIcon("mdi:information");
+	ha_activityState.setValue(userDefinedSettings.status.c_str());
+
+	ha_rssiReception.setName("WiFi Reception");
+	ha_rssiReception.setIcon("mdi:antenna");
+
+	haDiscovery.begin(millis());
+
+	mqtt.onConnected(mqttOnConnected);
+	mqtt.onDisconnected(mqttOnDisconnected);
+	mqtt.onMessage(mqttOnMessage);
+	mqtt.begin(HOME_ASSISTANT_BROKER_IP, HOME_ASSISTANT_USERNAME, HOME_ASSISTANT_PASSWORD);
+	Log.status(LOG_MAIN, "HA Configured - Will attempt to connect to MQTT broker");
+
+	haStateQueue = xQueueCreate(HA_STATE_QUEUE_LENGTH, sizeof(HA_STATE_UPDATE));
+	if (xTaskCreate(mqttTask, "mqtt", MQTT_TASK_STACK_SIZE, NULL, 2, NULL) != pdPASS)
 	{
-		Serial.println("[STATUS] - Switched off!");
-		userDefinedSettings.status = "Stopped";
-		routineRunning = false;
-		motor.stop();
-		display.clearDisplay();
-		display.display();
-		ha_activityState.setValue("Stopped");
-	} else {
-		drawStaticGUI(true);
-		drawDynamicGUI();
+		Log.error(LOG_MAIN, "Failed to start the MQTT task");
+		return false;
 	}
 
-	bool writeSuccess = writeConfigVarsToFile(settingsFile, userDefinedSettings);
-	if ( !writeSuccess )
-	{
-		Serial.println("[ERROR] - Failed to write power switch state [MQTT]");
-	}
+	homeAssistantReady = true;
+	return true;
+}
+#endif
 
-	sender->setState(state);
+/**
+ * Background stage; the loop applies the time, then fetches it again now & then
+ */
+bool startNtpStage()
+{
+	bool fetched = fetchTime();
+	ntpAttemptMs = millis();
+	ntpStageFinished = true;
+	return fetched;
 }
 
 void setup()
 {
+	unsigned long setupStartMs = millis();
+	store.begin();
+	commands.begin();
+	telemetry.begin();
 	WiFi.mode(WIFI_STA);
 	Serial.begin(115200);
+	Log.begin();
+	// Before anything else can crash a new firmware again
+	ota.checkBoot();
 	setCpuFrequencyMhz(160);
 
 	// Timezone Brazil, Sao_Paulo
 	timeClient.setTimeOffset(-10800);  // GMT-3 offset in seconds (-3 * 60 * 60)
+	timeMutex = xSemaphoreCreateMutex();
+	fileSystemMutex = xSemaphoreCreateMutex();
 
 	// Prepare pins
-	pinMode(directionalPinA, OUTPUT);
-	pinMode(directionalPinB, OUTPUT);
-	pinMode(externalButton, INPUT);
+	pinMode(board.motorPinA, OUTPUT);
+	pinMode(board.motorPinB, OUTPUT);
+	pinMode(board.buttonPin, INPUT);
+	motorDriver.begin();
+#if CURRENT_SENSE_ENABLED
+	// Watches the motor from its first start, a deep sleep resume included
+	currentSensor.begin(board.currentSensePin, CURRENT_SENSE_SHUNT_MILLIOHMS);
+#endif
 	ledcSetup(LED.getChannel(), LED.getFrequency(), LED.getResolution());
 	ledcAttachPin(LED_BUILTIN, LED.getChannel());
 
+	// Before any session can begin, a deep sleep resume included
+	patterns.begin();
+	sleepControl.begin();
+#if DEEP_SLEEP_ENABLED
+	if (sleepControl.resumedFromTimer())
+	{
+		// the RTC kept running through deep sleep
+		timeSynced = true;
+		resumeWindingFromDeepSleep();
+	}
+#endif
+
 	// WiFi Manager config
 	wm.setConfigPortalTimeout(3600);
 	wm.setDarkMode(true);
@@ -1163,264 +3033,189 @@ void setup()
 	wm.setSaveConfigCallback(saveWifiCallback);
 	wm.setSaveParamsCallback(saveParamsCallback);
 
-	userDefinedSettings.winderEnabled = true;
-
-	if(OLED_ENABLED)
-	{
-		display.begin(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
-		if (!display.begin(SSD1306_SWITCHCAPVCC, 0x3C))
-		{
-			Serial.println(F("SSD1306 allocation failed"));
-			for(;;); // Don't proceed, loop forever
-		}
-		drawStaticGUI();
-
-		int rotate = OLED_ROTATE_SCREEN_180 ? 2 : 4;
-		display.clearDisplay();
-		display.invertDisplay(OLED_INVERT_SCREEN);
-		display.setRotation(rotate);
-		drawNotification("Winderoo");
-	}
+	store.setWinderEnabled("1");
+#if OLED_ENABLED
+	store.subscribe("display", STATE_ALL, displaySubscriber);
+#endif
+#if HOME_ASSISTANT_ENABLED
+	store.subscribe("homeAssistant", STATE_ALL, homeAssistantSubscriber);
+#endif
+	store.subscribe("persistence", STATE_STATUS | STATE_ROTATIONS_PER_DAY | STATE_DIRECTION | STATE_TIMER, persistenceSubscriber);
+	store.subscribe("events", STATE_ALL & ~STATE_NOTICE, eventsSubscriber);
+	store.subscribe("mdns", STATE_ALL & ~STATE_NOTICE, mdnsSubscriber);
+	mdnsAdvert.set(MDNS_TXT_FIRMWARE, winderooVersion.c_str());
+#if GROUP_ENABLED
+	mdnsAdvert.set(MDNS_TXT_GROUP, GROUP_NAME);
+#endif
+	bootProfiler.recordPhase("init", setupStartMs, millis() - setupStartMs);
+
+	// The webserver & motor come up as soon as their own dependencies are ready,
+	// the rest connects in the background
+	int displayStage = startup.addStage("display", startDisplayStage);
+	int fileSystemStage = startup.addStage("fs", startFileSystemStage);
+	startup.addStage("motor", startMotorStage, bit(fileSystemStage) | bit(displayStage));
+	int wifiStage = startup.addStage("wifi", startWifiStage, bit(displayStage));
+	startup.addStage("webserver", startWebserverStage, bit(wifiStage) | bit(fileSystemStage));
+	startup.addStage("ntp", startNtpStage, bit(wifiStage), true);
+	startup.addStage("mdns", startMdnsStage, bit(wifiStage), true);
+#if GROUP_ENABLED
+	startup.addStage("group", startGroupStage, bit(wifiStage) | bit(fileSystemStage), true);
+#endif
+#if HOME_ASSISTANT_ENABLED
+	startup.addStage("homeAssistant", startHomeAssistantStage, bit(wifiStage) | bit(fileSystemStage), true);
+#endif
+	startup.run();
 
-	String savedNetworkMessage[2] = {"Connecting to", "saved network..."};
-	drawMultiLineText(savedNetworkMessage);
+	// Startup drew, published & loaded all of it already
+	store.discardChanges();
+	advertiseState(userDefinedSettings);
+}
 
-	// Connect using saved credentials, if they exist
-	// If connection fails, start setup Access Point
-	if (wm.autoConnect("Winderoo Setup"))
+/**
+ * Takes the once a second telemetry sample, see Telemetry.h
+ *
+ * @param loopMs how long the previous loop() pass took
+ */
+void recordTelemetry(unsigned long loopMs)
+{
+	unsigned long now = millis();
+	if (!telemetry.isSampleDue(now))
 	{
-		initFS();
-		Serial.println("[STATUS] - connected to saved network");
-
-		// retrieve & read saved settings
-		loadConfigVarsFromFile(settingsFile);
-		
-		if (!MDNS.begin("winderoo"))
-		{
-			Serial.println("[STATUS] - Failed to start mDNS");
-			drawNotification("Failed to start mDNS");
-		}
-		MDNS.addService("_winderoo", "_tcp", 80);
-		Serial.println("[STATUS] - mDNS started");
-
-		// Configure Home Assistant
-		if (HOME_ASSISTANT_ENABLED) 
-		{
-			byte mac[6];
-			WiFi.macAddress(mac);
-			device.setUniqueId(mac, sizeof(mac));
-
-			device.setName("Winderoo");
-			device.setManufacturer("mwood77");
-			device.setModel("Winderoo");
-			device.setSoftwareVersion(winderooVersion.c_str());
-			device.enableSharedAvailability();
-
-			ha_oledSwitch.setName("OLED");
-			ha_oledSwitch.setIcon("mdi:overscan");
-			ha_oledSwitch.setCurrentState(!screenSleep);
-			ha_oledSwitch.onCommand(onOledSwitchCommand);
-
-			ha_rpd.setName("Rotations Per Day");
-			ha_rpd.setIcon("mdi:rotate-3d-variant");
-			ha_rpd.setMin(100);
-			ha_rpd.setMax(960);
-			ha_rpd.setStep(10);
-			ha_rpd.setCurrentState(static_cast<int32_t>(userDefinedSettings.rotationsPerDay.toInt()));
-			ha_rpd.setOptimistic(true);
-			ha_rpd.onCommand(onRpdChangeCommand);
-
-			ha_selectDirection.setName("Direction");
-			ha_selectDirection.setIcon("mdi:arrow-left-right");
-			ha_selectDirection.setOptions("CCW;BOTH;CW");
-			ha_selectDirection.onCommand(onSelectDirectionCommand);
-			ha_selectDirection.setCurrentState(getDirectionIndexForHomeAssistant(userDefinedSettings.direction));
-
-			ha_timerSwitch.setName("Timer Enabled");
-			ha_timerSwitch.setIcon("mdi:timer");
-			ha_timerSwitch.setCurrentState(userDefinedSettings.timerEnabled.toInt());
-			ha_timerSwitch.onCommand(onTimerSwitchCommand);
-
-			ha_startButton.setName("Start");
-			ha_startButton.setIcon("mdi:play");
-			ha_startButton.onCommand(handleHAStartButton);
-
-			ha_stopButton.setName("Stop");
-			ha_stopButton.setIcon("mdi:stop");
-			ha_stopButton.onCommand(handleHAStopButton);
-
-			ha_selectHours.setName("Hour");
-			ha_selectHours.setIcon("mdi:timer-sand-full");
-			ha_selectHours.setOptions("00;01;02;03;04;05;06;07;08;09;10;11;12;13;14;15;16;17;18;19;20;21;22;23");
-			ha_selectHours.setCurrentState(userDefinedSettings.hour.toInt());
-			ha_selectHours.onCommand(onSelectHoursCommand);
-
-			ha_selectMinutes.setName("Minutes");
-			ha_selectMinutes.setIcon("mdi:timer-sand-empty");
-			ha_selectMinutes.setOptions("00;10;20;30;40;50");
-			ha_selectMinutes.setCurrentState(userDefinedSettings.minutes.toInt());
-			ha_selectMinutes.onCommand(onSelectMinutesCommand);
-
-			ha_powerSwitch.setName("Power");
-			ha_powerSwitch.setIcon("mdi:power");
-			ha_powerSwitch.setCurrentState(userDefinedSettings.winderEnabled.toInt());
-			ha_powerSwitch.onCommand(onPowerSwitchCommand);
-
-			ha_activityState.setName("Status");
-			ha_activityState.setIcon("mdi:information");
-			ha_activityState.setValue(userDefinedSettings.status.c_str());
-
-			ha_rssiReception.setName("WiFi Reception");
-			ha_rssiReception.setIcon("mdi:antenna");
-
-			mqtt.onConnected(mqttOnConnected);
-			mqtt.onDisconnected(mqttOnDisconnected);
-			mqtt.begin(HOME_ASSISTANT_BROKER_IP, HOME_ASSISTANT_USERNAME, HOME_ASSISTANT_PASSWORD);
-			Serial.println("[STATUS] - HA Configured - Will attempt to connect to MQTT broker");
-
-			if (OLED_ENABLED)
-			{
-				String configuredHomeAssistantMessage[2] = {"Configured for", "Home Assistant"};
-				drawMultiLineText(configuredHomeAssistantMessage);
-				delay(1500);
-			}
-		}
-
-		if (OLED_ENABLED)
-		{
-			display.clearDisplay();
-			drawStaticGUI();
-			drawNotification("Connected to WiFi");
-		}
-
-		drawNotification("Getting time...");
-		getTime();
-
-		drawNotification("Starting webserver...");
-		startWebserver();
-
-		if (strcmp(userDefinedSettings.status.c_str(), "Winding") == 0)
-		{
-			beginWindingRoutine();
-		}
-		else
-		{
-			drawNotification("Winderoo");
-		}
+		return;
 	}
-	else
-	{
-		configPortalRunning = true;
-		Serial.println("[STATUS] - WiFi Config Portal running");
-		ledcWrite(LED.getChannel(), 255);
 
-		String setupNetworkMessage[3] = {"Connect to", "\"Winderoo Setup\"", "wifi to begin"};
-		drawMultiLineText(setupNetworkMessage);
-	};
+	TELEMETRY_SAMPLE sample;
+	sample.values[TELEMETRY_RSSI] = WiFi.RSSI();
+	sample.values[TELEMETRY_HEAP] = ESP.getFreeHeap() / 1024;
+	sample.values[TELEMETRY_LOOP] = min(loopMs, (unsigned long)INT16_MAX);
+	sample.values[TELEMETRY_MOTOR] = motor.isTurning() ? 1000 : 0;
+#if CURRENT_SENSE_ENABLED
+	sample.values[TELEMETRY_CURRENT] = currentSensor.getMilliamps();
+#else
+	sample.values[TELEMETRY_CURRENT] = 0;
+#endif
+	telemetry.record(sample, now, rtc.getEpoch());
 }
 
 void loop()
 {
+	// Whatever runs up to here has kept a new firmware alive
+	ota.confirmBoot();
+
 	if (configPortalRunning)
 	{
 		wm.process();
 		return;
 	}
 
+	unsigned long now = millis();
+	recordTelemetry(loopStartedMs == 0 ? 0 : now - loopStartedMs);
+	loopStartedMs = now;
+
 	if (reset)
 	{
-		if (OLED_ENABLED)
-		{
-			display.clearDisplay();
-			drawNotification("Resetting");
+#if OLED_ENABLED
+		display.clearDisplay();
+		drawNotification("Resetting");
 
-			String rebootingMessage[2] = {"Device is", "rebooting..."};
-			drawMultiLineText(rebootingMessage);
-		}
+		String rebootingMessage[2] = {"Device is", "rebooting..."};
+		drawMultiLineText(rebootingMessage);
+#endif
 		// fast blink
 		triggerLEDCondition(2);
 
-		Serial.println("[STATUS] - Stopping webserver");
+		Log.status(LOG_MAIN, "Stopping webserver");
 		server.end();
 		delay(600);
-		Serial.println("[STATUS] - Stopping File System");
-		LittleFS.end();
+		Log.status(LOG_MAIN, "Stopping File System");
+		unmountFileSystem();
 		delay(200);
-		Serial.println("[STATUS] - Resetting Wifi Manager settings");
+		Log.status(LOG_MAIN, "Resetting Wifi Manager settings");
 		wm.resetSettings();
+		wifiCache.invalidate();
 		delay(200);
-		Serial.println("[STATUS] - Restart device...");
+		Log.status(LOG_MAIN, "Restart device...");
+		Log.flush();
 		ESP.restart();
 		delay(2000);
 	}
 
-	if (userDefinedSettings.timerEnabled == "1")
+	applyTime();
+	resyncTime();
+
+	// Until NTP answers, the RTC's hour is meaningless
+	if (userDefinedSettings.timerEnabled == "1" && timeSynced)
 	{
-		if (rtc.getHour(true) == userDefinedSettings.hour.toInt() &&
-			rtc.getMinute() == userDefinedSettings.minutes.toInt() &&
-			!routineRunning &&
+		if (winder.isTimerDue(userDefinedSettings.hour.toInt(), userDefinedSettings.minutes.toInt(), rtc.getHour(true), rtc.getMinute()) &&
 			userDefinedSettings.winderEnabled == "1")
 		{
-			beginWindingRoutine();
-			drawNotification("Winding Started");
+#if GROUP_ENABLED
+			if (group.isEnabled())
+			{
+				// Takes its turn, see the check below
+				if (!group.isStartPending())
+				{
+					group.deferStart(group.getTimerOffset());
+				}
+			}
+			else
+#endif
+			{
+				beginWindingRoutine("Winding Started");
+			}
 		}
 	}
 
-	if (routineRunning)
+#if GROUP_ENABLED
+	if (group.takeDueStart() && !winder.isRunning() && userDefinedSettings.winderEnabled == "1")
 	{
-		unsigned long currentTime = rtc.getEpoch();
-
-		if (rtc.getEpoch() < estimatedRoutineFinishEpoch)
-		{
-
-			// turn motor in direction
-			motor.determineMotorDirectionAndBegin();
-			int r = rand() % 100;
+		beginWindingRoutine("Winding Started");
+	}
+#endif
 
-			if (r <= 25)
-			{
-				if ((strcmp(userDefinedSettings.direction.c_str(), "BOTH") == 0) && (currentTime - previousEpoch) > 180)
-				{
-					motor.stop();
-					delay(3000);
+	if (winder.isRunning() && !winder.update(rtc.getEpoch()))
+	{
+		// Routine has finished
+		stopWindingRoutine(HISTORY_STOP_COMPLETED, "Winding Complete");
 
-					previousEpoch = currentTime;
+		sleepControl.recordSession(winder.getStartEpoch(), rtc.getEpoch());
+#if DEEP_SLEEP_ENABLED
+		if (userDefinedSettings.timerEnabled == "1")
+		{
+			deepSleepPending = true;
+			sessionCompletedMillis = millis();
+		}
+#endif
+	}
+	else if (winder.isRunning())
+	{
+		TRACE_SCOPE("checkpoint");
+		checkpoints.update(millis());
+	}
 
-					int currentDirection = motor.getMotorDirection();
-					motor.setMotorDirection(!currentDirection);
-					Serial.println("[STATUS] - Motor changing direction, mode: " + userDefinedSettings.direction);
+#if CURRENT_SENSE_ENABLED
+	handleMotorLoad();
+#endif
 
-					motor.determineMotorDirectionAndBegin();
-				}
+	ota.poll();
+	remountFileSystemAfterOta();
 
-				if ((currentTime - previousEpoch) > 180)
-				{
-					Serial.println("[STATUS] - Pause");
-					previousEpoch = currentTime;
-					motor.stop();
-					delay(3000);
-				}
-			}
-		}
-		else
-		{
-			// Routine has finished
-			userDefinedSettings.status = "Stopped";
-			routineRunning = false;
-			motor.stop();
-			if (OLED_ENABLED && !screenSleep)
-			{
-				drawNotification("Winding Complete");
-				if (HOME_ASSISTANT_ENABLED) ha_activityState.setValue("Winding Complete");
-			}
+	// New firmware waits for the session to end, the motor isn't cut mid-routine
+	if (ota.isRestartPending() && !winder.isRunning())
+	{
+		Log.status(LOG_OTA, "Restarting into the new firmware");
+		Log.flush();
+		server.end();
+		delay(200);
+		ESP.restart();
+	}
 
-			bool writeSuccess = writeConfigVarsToFile(settingsFile, userDefinedSettings);
-			if ( !writeSuccess )
-			{
-				Serial.println("[ERROR] - Failed to write updated configuration to file");
-			}
-		}
+#if DEEP_SLEEP_ENABLED
+	if (deepSleepPending && millis() - sessionCompletedMillis > DEEP_SLEEP_GRACE_PERIOD_SECONDS * 1000UL)
+	{
+		enterDeepSleep();
 	}
+#endif
 
 	// non-blocking button listener
 	awaitWhileListening(1);	// 1 second
@@ -1434,15 +3229,5 @@ void loop()
 		drawDynamicGUI();
 	}
 
-	if (HOME_ASSISTANT_ENABLED)
-	{
-		mqtt.loop();
-		// We report these every cycle as if the device's MQTT connection is dropped,
-		// it will not be able to report its up-to-date state to Home Assistant.
-		// This mitigates de-sync between HA and the web gui.
-		ha_powerSwitch.setState(userDefinedSettings.winderEnabled.toInt());
-		ha_activityState.setValue(userDefinedSettings.status.c_str());
-	}
-
 	wm.process();
 }
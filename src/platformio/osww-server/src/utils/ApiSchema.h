@@ -0,0 +1,478 @@
+#include "JsonSchema.h"
+
+#ifndef ApiSchema_H
+#define ApiSchema_H
+
+/*
+ * Request & response bodies of the HTTP API, see openapi.yml.
+ * The enums index into the tables below and must stay in the same order.
+ */
+
+static constexpr const char *directionChoices[] = {"CW", "CCW", "BOTH"};
+static constexpr const char *actionChoices[] = {"START", "STOP"};
+// In HistoryStopReason order, see SessionHistory.h
+static constexpr const char *stopReasonChoices[] = {"completed", "stopped", "switchedOff", "stalled"};
+// In OtaState & OtaTarget order, see OtaUpdate.h
+static constexpr const char *otaStateChoices[] = {"idle", "receiving", "done", "failed"};
+static constexpr const char *otaTargetChoices[] = {"firmware", "filesystem"};
+// In LogLevel & LogModule order, see Logger.h
+static constexpr const char *logLevelChoices[] = {"error", "warn", "status", "debug"};
+static constexpr const char *logModuleChoices[] = {"main", "motor", "winder", "led", "sleep", "wifi", "startup", "state", "history", "ota", "group"};
+// In MotorLoadEvent order, see MotorLoad.h
+static constexpr const char *motorLoadEventChoices[] = {"none", "heavy", "disconnected", "stalled", "jammed"};
+// In HaDiscoveryState order, see HaDiscovery.h
+static constexpr const char *homeAssistantDiscoveryChoices[] = {"disconnected", "published", "checking", "lost", "ready"};
+// In CommandType, CommandSource & CommandState order, see CommandQueue.h
+static constexpr const char *commandTypeChoices[] = {"update", "power", "screen", "rotationsPerDay", "direction", "timer", "start", "stop", "hour", "minutes", "settings", "patternPut", "patternRemove", "patternSelect"};
+static constexpr const char *commandSourceChoices[] = {"api", "homeAssistant"};
+static constexpr const char *commandStateChoices[] = {"queued", "running", "done"};
+// In TelemetryMetric & TelemetryResolution order, see Telemetry.h
+static constexpr const char *telemetryMetricChoices[] = {"rssi", "heap", "loop", "motor", "current"};
+static constexpr const char *telemetryResolutionChoices[] = {"second", "minute", "hour"};
+// In MdnsTxtKey order, see MdnsAdvert.h; TXT keys, not part of the HTTP API
+static constexpr const char *mdnsTxtKeys[] = {"txtvers", "fw", "status", "tpd", "dir", "timer", "eta", "statever", "group"};
+
+// POST /api/update
+enum UpdateField
+{
+    UPDATE_ROTATION_DIRECTION,
+    UPDATE_TPD,
+    UPDATE_ACTION,
+    UPDATE_HOUR,
+    UPDATE_MINUTES,
+    UPDATE_TIMER_ENABLED,
+    UPDATE_SCREEN_SLEEP,
+    UPDATE_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD updateFields[] = {
+    jsonEnum("rotationDirection", directionChoices),
+    jsonInt("tpd", 100, 960),
+    jsonEnum("action", actionChoices),
+    jsonInt("hour", 0, 23),
+    jsonInt("minutes", 0, 50, 10),
+    jsonInt("timerEnabled", 0, 1),
+    jsonBool("screenSleep"),
+};
+static_assert(sizeof(updateFields) / sizeof(updateFields[0]) == UPDATE_FIELD_COUNT, "updateFields out of sync");
+static constexpr JSON_SCHEMA updateSchema = jsonSchema(updateFields);
+
+// POST /api/power
+enum PowerField
+{
+    POWER_WINDER_ENABLED,
+    POWER_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD powerFields[] = {
+    jsonInt("winderEnabled", 0, 1),
+};
+static_assert(sizeof(powerFields) / sizeof(powerFields[0]) == POWER_FIELD_COUNT, "powerFields out of sync");
+static constexpr JSON_SCHEMA powerSchema = jsonSchema(powerFields);
+
+// GET /api/status. Settings go out as strings, as they always have.
+enum StatusField
+{
+    STATUS_STATUS,
+    STATUS_ROTATIONS_PER_DAY,
+    STATUS_DIRECTION,
+    STATUS_HOUR,
+    STATUS_MINUTES,
+    STATUS_SECONDS_PER_REVOLUTION,
+    STATUS_START_EPOCH,
+    STATUS_CURRENT_EPOCH,
+    STATUS_FINISH_EPOCH,
+    STATUS_WINDER_ENABLED,
+    STATUS_TIMER_ENABLED,
+    STATUS_DB,
+    STATUS_SCREEN_SLEEP,
+    STATUS_SCREEN_EQUIPPED,
+    STATUS_BOOT_TO_MOTOR_START_MS,
+    STATUS_AVERAGE_POWER_MW,
+    STATUS_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD statusFields[] = {
+    jsonString("status"),
+    jsonString("rotationsPerDay"),
+    jsonString("direction"),
+    jsonString("hour"),
+    jsonString("minutes"),
+    jsonInt("durationInSecondsToCompleteOneRevolution"),
+    jsonInt("startTimeEpoch"),
+    jsonInt("currentTimeEpoch"),
+    jsonInt("estimatedRoutineFinishEpoch"),
+    jsonString("winderEnabled"),
+    jsonString("timerEnabled"),
+    jsonInt("db"),
+    jsonBool("screenSleep"),
+    jsonBool("screenEquipped"),
+    jsonInt("bootToMotorStartMs"),
+    jsonInt("averagePowerMilliwatts"),
+};
+static_assert(sizeof(statusFields) / sizeof(statusFields[0]) == STATUS_FIELD_COUNT, "statusFields out of sync");
+static constexpr JSON_SCHEMA statusSchema = jsonSchema(statusFields);
+
+// GET /api/boot
+enum BootField
+{
+    BOOT_VERSION,
+    BOOT_WIFI_FAST_RECONNECT,
+    BOOT_FIRST_HTTP_REQUEST_MS,
+    BOOT_BOOT_TO_MOTOR_START_MS,
+    BOOT_RESUMED_TURNS,
+    BOOT_CHECKPOINT_WRITES,
+    BOOT_PHASES,
+    BOOT_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD bootFields[] = {
+    jsonString("version"),
+    jsonBool("wifiFastReconnect"),
+    jsonInt("firstHttpRequestMs"),
+    jsonInt("bootToMotorStartMs"),
+    jsonInt("resumedTurns"),
+    jsonInt("checkpointWrites"),
+    jsonRaw("phases"),
+};
+static_assert(sizeof(bootFields) / sizeof(bootFields[0]) == BOOT_FIELD_COUNT, "bootFields out of sync");
+static constexpr JSON_SCHEMA bootSchema = jsonSchema(bootFields);
+
+enum BootPhaseField
+{
+    BOOT_PHASE_NAME,
+    BOOT_PHASE_START_MS,
+    BOOT_PHASE_DURATION_MS,
+    BOOT_PHASE_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD bootPhaseFields[] = {
+    jsonString("name"),
+    jsonInt("startMs"),
+    jsonInt("durationMs"),
+};
+static_assert(sizeof(bootPhaseFields) / sizeof(bootPhaseFields[0]) == BOOT_PHASE_FIELD_COUNT, "bootPhaseFields out of sync");
+static constexpr JSON_SCHEMA bootPhaseSchema = jsonSchema(bootPhaseFields);
+
+// GET /api/history, one per record
+enum HistoryField
+{
+    HISTORY_ID,
+    HISTORY_START_EPOCH,
+    HISTORY_END_EPOCH,
+    HISTORY_PLANNED_TURNS,
+    HISTORY_DELIVERED_TURNS,
+    HISTORY_DIRECTION,
+    HISTORY_CLOCKWISE_SECONDS,
+    HISTORY_COUNTER_CLOCKWISE_SECONDS,
+    HISTORY_PAUSES,
+    HISTORY_PAUSED_SECONDS,
+    HISTORY_STOP_REASON,
+    HISTORY_ENERGY,
+    HISTORY_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD historyFields[] = {
+    jsonInt("id"),
+    jsonInt("startEpoch"),
+    jsonInt("endEpoch"),
+    jsonInt("plannedTurns"),
+    jsonInt("deliveredTurns"),
+    jsonString("direction"),
+    jsonInt("clockwiseSeconds"),
+    jsonInt("counterClockwiseSeconds"),
+    jsonInt("pauses"),
+    jsonInt("pausedSeconds"),
+    jsonString("stopReason"),
+    jsonInt("energyMilliwattHours"),
+};
+static_assert(sizeof(historyFields) / sizeof(historyFields[0]) == HISTORY_FIELD_COUNT, "historyFields out of sync");
+static constexpr JSON_SCHEMA historySchema = jsonSchema(historyFields);
+
+// GET /api/ota, and the reply to an upload
+enum OtaField
+{
+    OTA_STATE,
+    OTA_TARGET,
+    OTA_BYTES_WRITTEN,
+    OTA_TOTAL_BYTES,
+    OTA_BYTES_PER_SECOND,
+    OTA_SHA256,
+    OTA_ERROR,
+    OTA_RESTART_PENDING,
+    OTA_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD otaFields[] = {
+    jsonString("state"),
+    jsonString("target"),
+    jsonInt("bytesWritten"),
+    jsonInt("totalBytes"),
+    jsonInt("bytesPerSecond"),
+    jsonString("sha256"),
+    jsonString("error"),
+    jsonBool("restartPending"),
+};
+static_assert(sizeof(otaFields) / sizeof(otaFields[0]) == OTA_FIELD_COUNT, "otaFields out of sync");
+static constexpr JSON_SCHEMA otaSchema = jsonSchema(otaFields);
+
+// POST /api/logs/level, every module if module is left out
+enum LogLevelField
+{
+    LOG_LEVEL_FIELD_MODULE,
+    LOG_LEVEL_FIELD_LEVEL,
+    LOG_LEVEL_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD logLevelFields[] = {
+    jsonOptional(jsonEnum("module", logModuleChoices)),
+    jsonEnum("level", logLevelChoices),
+};
+static_assert(sizeof(logLevelFields) / sizeof(logLevelFields[0]) == LOG_LEVEL_FIELD_COUNT, "logLevelFields out of sync");
+static constexpr JSON_SCHEMA logLevelSchema = jsonSchema(logLevelFields);
+
+// GET /api/motor
+enum MotorField
+{
+    MOTOR_MILLIAMPS,
+    MOTOR_AVERAGE_MILLIAMPS,
+    MOTOR_PEAK_MILLIAMPS,
+    MOTOR_BASELINE_MILLIAMPS,
+    MOTOR_ENERGY,
+    MOTOR_STALLS,
+    MOTOR_LAST_EVENT,
+    MOTOR_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD motorFields[] = {
+    jsonInt("milliamps"),
+    jsonInt("averageMilliamps"),
+    jsonInt("peakMilliamps"),
+    jsonInt("baselineMilliamps"),
+    jsonInt("sessionMilliwattHours"),
+    jsonInt("stalls"),
+    jsonEnum("lastEvent", motorLoadEventChoices),
+};
+static_assert(sizeof(motorFields) / sizeof(motorFields[0]) == MOTOR_FIELD_COUNT, "motorFields out of sync");
+static constexpr JSON_SCHEMA motorSchema = jsonSchema(motorFields);
+
+// GET /api/homeassistant
+enum HomeAssistantField
+{
+    HOME_ASSISTANT_CONNECTED,
+    HOME_ASSISTANT_DISCOVERY,
+    HOME_ASSISTANT_DISCOVERY_HASH,
+    HOME_ASSISTANT_DISCOVERY_PUBLISHES,
+    HOME_ASSISTANT_CONNECTS,
+    HOME_ASSISTANT_RECONNECT_TO_READY_MS,
+    HOME_ASSISTANT_CONNECT_TO_READY_MS,
+    HOME_ASSISTANT_COMMANDS,
+    HOME_ASSISTANT_COMMAND_LATENCY_US,
+    HOME_ASSISTANT_AVERAGE_COMMAND_LATENCY_US,
+    HOME_ASSISTANT_MAX_COMMAND_LATENCY_US,
+    HOME_ASSISTANT_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD homeAssistantFields[] = {
+    jsonBool("connected"),
+    jsonEnum("discovery", homeAssistantDiscoveryChoices),
+    jsonString("discoveryHash"),
+    jsonInt("discoveryPublishes"),
+    jsonInt("connects"),
+    jsonInt("reconnectToReadyMs"),
+    jsonInt("connectToReadyMs"),
+    jsonInt("motorCommands"),
+    jsonInt("commandLatencyUs"),
+    jsonInt("averageCommandLatencyUs"),
+    jsonInt("maxCommandLatencyUs"),
+};
+static_assert(sizeof(homeAssistantFields) / sizeof(homeAssistantFields[0]) == HOME_ASSISTANT_FIELD_COUNT, "homeAssistantFields out of sync");
+static constexpr JSON_SCHEMA homeAssistantSchema = jsonSchema(homeAssistantFields);
+
+// 202 of POST /api/update & /api/power, GET /api/commands/{id}
+enum CommandField
+{
+    COMMAND_FIELD_ID,
+    COMMAND_FIELD_TYPE,
+    COMMAND_FIELD_SOURCE,
+    COMMAND_FIELD_STATE,
+    COMMAND_FIELD_WAIT_MS,
+    COMMAND_FIELD_RUN_MS,
+    COMMAND_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD commandFields[] = {
+    jsonInt("id"),
+    jsonEnum("type", commandTypeChoices),
+    jsonEnum("source", commandSourceChoices),
+    jsonEnum("state", commandStateChoices),
+    jsonInt("waitMs"),
+    jsonInt("runMs"),
+};
+static_assert(sizeof(commandFields) / sizeof(commandFields[0]) == COMMAND_FIELD_COUNT, "commandFields out of sync");
+static constexpr JSON_SCHEMA commandSchema = jsonSchema(commandFields);
+
+// GET /api/group
+enum GroupField
+{
+    GROUP_ID,
+    GROUP_COORDINATOR,
+    GROUP_MAX_RUNNING,
+    GROUP_TIMER_OFFSET,
+    GROUP_START_IN_SECONDS,
+    GROUP_MEMBERS,
+    GROUP_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD groupFields[] = {
+    jsonString("id"),
+    jsonString("coordinator"),
+    jsonInt("maxRunning"),
+    jsonInt("timerOffsetSeconds"),
+    jsonInt("startInSeconds"),
+    jsonRaw("members"),
+};
+static_assert(sizeof(groupFields) / sizeof(groupFields[0]) == GROUP_FIELD_COUNT, "groupFields out of sync");
+static constexpr JSON_SCHEMA groupSchema = jsonSchema(groupFields);
+
+enum GroupMemberField
+{
+    GROUP_MEMBER_ID,
+    GROUP_MEMBER_IP,
+    GROUP_MEMBER_RUNNING,
+    GROUP_MEMBER_SESSION_SECONDS,
+    GROUP_MEMBER_REMAINING_SECONDS,
+    GROUP_MEMBER_TIMER,
+    GROUP_MEMBER_GROUP_START_OFFSET,
+    GROUP_MEMBER_TIMER_OFFSET,
+    GROUP_MEMBER_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD groupMemberFields[] = {
+    jsonString("id"),
+    jsonString("ip"),
+    jsonBool("running"),
+    jsonInt("sessionSeconds"),
+    jsonInt("remainingSeconds"),
+    jsonString("timer"),
+    jsonInt("groupStartOffsetSeconds"),
+    jsonInt("timerOffsetSeconds"),
+};
+static_assert(sizeof(groupMemberFields) / sizeof(groupMemberFields[0]) == GROUP_MEMBER_FIELD_COUNT, "groupMemberFields out of sync");
+static constexpr JSON_SCHEMA groupMemberSchema = jsonSchema(groupMemberFields);
+
+// The old /settings.json on LittleFS, only read to move it to NVS. Read leniently, older files may miss fields.
+enum LegacySettingsField
+{
+    LEGACY_SETTINGS_STATUS,
+    LEGACY_SETTINGS_TPD,
+    LEGACY_SETTINGS_HOUR,
+    LEGACY_SETTINGS_MINUTES,
+    LEGACY_SETTINGS_TIMER_STATE,
+    LEGACY_SETTINGS_DIRECTION,
+    LEGACY_SETTINGS_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD legacySettingsFields[] = {
+    jsonOptional(jsonString("savedStatus")),
+    jsonOptional(jsonString("savedTPD")),
+    jsonOptional(jsonString("savedHour")),
+    jsonOptional(jsonString("savedMinutes")),
+    jsonOptional(jsonString("savedTimerState")),
+    jsonOptional(jsonString("savedDirection")),
+};
+static_assert(sizeof(legacySettingsFields) / sizeof(legacySettingsFields[0]) == LEGACY_SETTINGS_FIELD_COUNT, "legacySettingsFields out of sync");
+static constexpr JSON_SCHEMA legacySettingsSchema = jsonSchema(legacySettingsFields);
+
+// GET & POST /api/settings; version is SETTINGS_BLOB_VERSION, see SettingsStore.h
+enum SettingsField
+{
+    SETTINGS_VERSION,
+    SETTINGS_ROTATIONS_PER_DAY,
+    SETTINGS_DIRECTION,
+    SETTINGS_HOUR,
+    SETTINGS_MINUTES,
+    SETTINGS_TIMER_ENABLED,
+    SETTINGS_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD settingsFields[] = {
+    jsonOptional(jsonInt("version", 1, 1)),
+    jsonInt("rotationsPerDay", 100, 960),
+    jsonEnum("direction", directionChoices),
+    jsonInt("hour", 0, 23),
+    jsonInt("minutes", 0, 50, 10),
+    jsonInt("timerEnabled", 0, 1),
+};
+static_assert(sizeof(settingsFields) / sizeof(settingsFields[0]) == SETTINGS_FIELD_COUNT, "settingsFields out of sync");
+static constexpr JSON_SCHEMA settingsSchema = jsonSchema(settingsFields);
+
+// POST /api/patterns/{slot}; an empty source empties the slot, see PatternCompiler.h
+enum PatternUploadField
+{
+    PATTERN_UPLOAD_NAME,
+    PATTERN_UPLOAD_SOURCE,
+    PATTERN_UPLOAD_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD patternUploadFields[] = {
+    jsonOptional(jsonString("name")),
+    jsonString("source"),
+};
+static_assert(sizeof(patternUploadFields) / sizeof(patternUploadFields[0]) == PATTERN_UPLOAD_FIELD_COUNT, "patternUploadFields out of sync");
+static constexpr JSON_SCHEMA patternUploadSchema = jsonSchema(patternUploadFields);
+
+// POST /api/patterns/active; slot 0 is the classic motion, the rest are PatternStore.h's slots
+enum PatternSelectField
+{
+    PATTERN_SELECT_SLOT,
+    PATTERN_SELECT_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD patternSelectFields[] = {
+    jsonInt("slot", 0, 4),
+};
+static_assert(sizeof(patternSelectFields) / sizeof(patternSelectFields[0]) == PATTERN_SELECT_FIELD_COUNT, "patternSelectFields out of sync");
+static constexpr JSON_SCHEMA patternSelectSchema = jsonSchema(patternSelectFields);
+
+// GET & 200 of POST /api/patterns/{slot}; the entries of GET /api/patterns leave the source out
+enum PatternEntryField
+{
+    PATTERN_ENTRY_SLOT,
+    PATTERN_ENTRY_NAME,
+    PATTERN_ENTRY_SOURCE,
+    PATTERN_ENTRY_BYTES,
+    PATTERN_ENTRY_TURNS_PER_PASS,
+    PATTERN_ENTRY_SECONDS_PER_PASS,
+    PATTERN_ENTRY_SESSION_SECONDS,
+    PATTERN_ENTRY_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD patternEntryFields[] = {
+    jsonInt("slot"),
+    jsonString("name"),
+    jsonString("source"),
+    jsonInt("bytes"),
+    jsonInt("turnsPerPass"),
+    jsonInt("secondsPerPass"),
+    jsonInt("sessionSeconds"),
+};
+static_assert(sizeof(patternEntryFields) / sizeof(patternEntryFields[0]) == PATTERN_ENTRY_FIELD_COUNT, "patternEntryFields out of sync");
+static constexpr JSON_SCHEMA patternEntrySchema = jsonSchema(patternEntryFields);
+
+// GET /api/patterns
+enum PatternListField
+{
+    PATTERN_LIST_ACTIVE,
+    PATTERN_LIST_PATTERNS,
+    PATTERN_LIST_FIELD_COUNT
+};
+
+static constexpr JSON_FIELD patternListFields[] = {
+    jsonInt("active"),
+    jsonRaw("patterns"),
+};
+static_assert(sizeof(patternListFields) / sizeof(patternListFields[0]) == PATTERN_LIST_FIELD_COUNT, "patternListFields out of sync");
+static constexpr JSON_SCHEMA patternListSchema = jsonSchema(patternListFields);
+
+#endif
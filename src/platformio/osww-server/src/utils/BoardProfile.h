@@ -0,0 +1,71 @@
+#include <Arduino.h>
+
+#ifndef BoardProfile_H
+#define BoardProfile_H
+
+// Features are picked per env in platformio.ini. A feature that's off isn't
+// compiled in at all, so these must be tested with #if, never #ifdef.
+#ifndef OLED_ENABLED
+#define OLED_ENABLED false
+#endif
+#ifndef PWM_MOTOR_CONTROL
+#define PWM_MOTOR_CONTROL false
+#endif
+#ifndef HOME_ASSISTANT_ENABLED
+#define HOME_ASSISTANT_ENABLED false
+#endif
+#ifndef DEEP_SLEEP_ENABLED
+#define DEEP_SLEEP_ENABLED false
+#endif
+#ifndef GROUP_ENABLED
+#define GROUP_ENABLED false
+#endif
+#ifndef CURRENT_SENSE_ENABLED
+#define CURRENT_SENSE_ENABLED false
+#endif
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED false
+#endif
+#ifndef STEPPER_MOTOR_ENABLED
+#define STEPPER_MOTOR_ENABLED false
+#endif
+
+/**
+ * How a board is wired. Fixed at compile time, so the pins fold into the code
+ * that uses them.
+ *
+ * If you're using a NeoPixel equipped board, you'll need to change the motor
+ * pins and ledPin (pin 18 on most, I think) to appropriate GPIOs. Failure to
+ * set these pins on NeoPixel boards will result in kernel panics.
+ */
+struct BOARD_PROFILE
+{
+    const char *name;
+    uint8_t motorPinA;       // wired to IN1 on your L298N circuit board, or STEP with STEPPER_MOTOR_ENABLED
+    uint8_t motorPinB;       // wired to IN2 on your L298N circuit board, or DIR with STEPPER_MOTOR_ENABLED
+    uint8_t ledPin;          // the ESP32's onboard LED, or the GPIO an external LED is wired to
+    uint8_t buttonPin;       // OPTIONAL external ON/OFF button
+    uint8_t currentSensePin; // OPTIONAL shunt for CURRENT_SENSE_ENABLED, ADC1 pins only
+    uint8_t screenWidth;     // OLED, in pixels
+    uint8_t screenHeight;
+    int8_t screenResetPin;   // -1 if sharing the board's reset
+    uint8_t screenAddress;   // I2C
+};
+
+// The board in the guide / Bill Of Materials
+constexpr BOARD_PROFILE doitDevkitV1 = {"DOIT ESP32 DevKit V1", 25, 26, 0, 13, 34, 128, 64, -1, 0x3C};
+
+// Picked per env in platformio.ini with -D WINDEROO_BOARD=...
+#ifndef WINDEROO_BOARD
+#define WINDEROO_BOARD doitDevkitV1
+#endif
+
+constexpr BOARD_PROFILE board = WINDEROO_BOARD;
+
+static_assert(board.motorPinA != board.motorPinB, "The motor needs two pins");
+static_assert(!(STEPPER_MOTOR_ENABLED && PWM_MOTOR_CONTROL), "PWM_MOTOR_CONTROL is for DC motors, a stepper is driven by STEP & DIR");
+// ADC2 can't be read while WiFi is on
+static_assert(!CURRENT_SENSE_ENABLED || (board.currentSensePin >= 32 && board.currentSensePin <= 39), "currentSensePin must be an ADC1 pin, GPIO32-39");
+static_assert(!OLED_ENABLED || (board.screenWidth == 128 && board.screenHeight == 64), "The OLED layout is drawn for 128x64");
+
+#endif
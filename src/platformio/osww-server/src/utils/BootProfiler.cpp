@@ -0,0 +1,47 @@
+#include "BootProfiler.h"
+
+BootProfiler::BootProfiler()
+{
+    _phaseCount = 0;
+    _firstHttpRequestMs = -1;
+    portMUX_INITIALIZE(&_lock);
+}
+
+/**
+ * Records a phase timed elsewhere. Safe to call from any task.
+ */
+void BootProfiler::recordPhase(const char *name, unsigned long startMs, unsigned long durationMs)
+{
+    portENTER_CRITICAL(&_lock);
+    if (_phaseCount < BOOT_PROFILER_MAX_PHASES)
+    {
+        _phases[_phaseCount].name = name;
+        _phases[_phaseCount].startMs = startMs;
+        _phases[_phaseCount].durationMs = durationMs;
+        _phaseCount++;
+    }
+    portEXIT_CRITICAL(&_lock);
+}
+
+void BootProfiler::recordFirstHttpRequest()
+{
+    if (_firstHttpRequestMs < 0)
+    {
+        _firstHttpRequestMs = millis();
+    }
+}
+
+int BootProfiler::getPhaseCount()
+{
+    return _phaseCount;
+}
+
+const BOOT_PHASE &BootProfiler::getPhase(int index)
+{
+    return _phases[index];
+}
+
+long BootProfiler::getFirstHttpRequestMs()
+{
+    return _firstHttpRequestMs;
+}
@@ -0,0 +1,42 @@
+#include <Arduino.h>
+
+#ifndef BootProfiler_H
+#define BootProfiler_H
+
+#define BOOT_PROFILER_MAX_PHASES 12
+
+struct BOOT_PHASE
+{
+    const char *name;
+    unsigned long startMs;
+    unsigned long durationMs;
+};
+
+/**
+ * Timestamps the phases of startup relative to power on, plus the moment
+ * the first HTTP request reached a handler. Phases may overlap when they
+ * run in background tasks.
+ */
+class BootProfiler
+{
+private:
+    BOOT_PHASE _phases[BOOT_PROFILER_MAX_PHASES];
+    int _phaseCount;
+    long _firstHttpRequestMs;
+    portMUX_TYPE _lock;
+
+public:
+    BootProfiler();
+
+    void recordPhase(const char *name, unsigned long startMs, unsigned long durationMs);
+
+    void recordFirstHttpRequest();
+
+    int getPhaseCount();
+
+    const BOOT_PHASE &getPhase(int index);
+
+    long getFirstHttpRequestMs();
+};
+
+#endif
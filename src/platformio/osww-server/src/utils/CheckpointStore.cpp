@@ -0,0 +1,124 @@
+#include "CheckpointStore.h"
+
+#include <Preferences.h>
+#include <rom/crc.h>
+
+#include "Logger.h"
+
+#define CHECKPOINT_NAMESPACE "checkpoint"
+#define CHECKPOINT_KEY "session"
+
+static_assert(sizeof(CHECKPOINT_BLOB) <= 32, "CHECKPOINT_BLOB outgrew one NVS entry, see CHECKPOINT_NVS_ENTRIES_PER_WRITE");
+static_assert(CHECKPOINT_LIFETIME_YEARS >= CHECKPOINT_MIN_LIFETIME_YEARS, "Checkpoints would wear the flash out, raise CHECKPOINT_INTERVAL_SECONDS");
+
+static uint32_t blobCrc(const CHECKPOINT_BLOB &blob)
+{
+    return crc32_le(0, (const uint8_t *)&blob, offsetof(CHECKPOINT_BLOB, crc));
+}
+
+CheckpointStore::CheckpointStore(WindingRoutine &winder) : _winder(winder)
+{
+    memset(&_saved, 0, sizeof(_saved));
+    _hasSaved = false;
+    _savedMs = 0;
+    _writes = 0;
+}
+
+/**
+ * Reads the last checkpoint. Call once at boot.
+ *
+ * @return false if there's none, or it's torn, corrupt or from another version
+ */
+bool CheckpointStore::load(WINDING_PROGRESS &progress)
+{
+    Preferences preferences;
+    if (!preferences.begin(CHECKPOINT_NAMESPACE, true))
+    {
+        return false;
+    }
+
+    CHECKPOINT_BLOB blob;
+    size_t length = preferences.getBytes(CHECKPOINT_KEY, &blob, sizeof(blob));
+    preferences.end();
+
+    if (length != sizeof(blob) || blob.size != sizeof(blob) || blob.version != CHECKPOINT_BLOB_VERSION || blob.crc != blobCrc(blob))
+    {
+        return false;
+    }
+
+    progress = blob.progress;
+    _saved = blob;
+    _hasSaved = true;
+    return true;
+}
+
+/**
+ * Writes the progress, unless it's already what's stored
+ */
+bool CheckpointStore::write(const WINDING_PROGRESS &progress)
+{
+    CHECKPOINT_BLOB blob;
+    memset(&blob, 0, sizeof(blob));
+    blob.version = CHECKPOINT_BLOB_VERSION;
+    blob.size = sizeof(blob);
+    blob.progress = progress;
+    blob.crc = blobCrc(blob);
+    if (_hasSaved && memcmp(&blob, &_saved, sizeof(blob)) == 0)
+    {
+        return true;
+    }
+
+    Preferences preferences;
+    if (!preferences.begin(CHECKPOINT_NAMESPACE, false))
+    {
+        Log.error(LOG_WINDER, "Failed to open the checkpoint in NVS");
+        return false;
+    }
+
+    size_t written = preferences.putBytes(CHECKPOINT_KEY, &blob, sizeof(blob));
+    preferences.end();
+    if (written != sizeof(blob))
+    {
+        Log.error(LOG_WINDER, "Failed to write the checkpoint to NVS");
+        return false;
+    }
+
+    _saved = blob;
+    _hasSaved = true;
+    _writes++;
+    return true;
+}
+
+/**
+ * Checkpoints the session now, whatever the interval. Call when it begins.
+ *
+ * @return false if NVS couldn't be written
+ */
+bool CheckpointStore::save(unsigned long now)
+{
+    WINDING_PROGRESS progress;
+    _winder.getProgress(progress);
+    _savedMs = now;
+    return write(progress);
+}
+
+/**
+ * Call on the loop after the winder's update()
+ */
+void CheckpointStore::update(unsigned long now)
+{
+    if (!_winder.isRunning() || now - _savedMs < CHECKPOINT_INTERVAL_SECONDS * 1000UL)
+    {
+        return;
+    }
+
+    save(now);
+}
+
+/**
+ * Checkpoints written since boot
+ */
+uint32_t CheckpointStore::getWrites()
+{
+    return _writes;
+}
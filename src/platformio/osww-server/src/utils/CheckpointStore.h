@@ -0,0 +1,69 @@
+#include <Arduino.h>
+
+#include "WindingRoutine.h"
+
+#ifndef CheckpointStore_H
+#define CheckpointStore_H
+
+// Bump when CHECKPOINT_BLOB changes; an older checkpoint is then ignored, not converted
+#define CHECKPOINT_BLOB_VERSION 1
+// While winding, progress is checkpointed at most this often; a power cut repeats at most this much turning
+#define CHECKPOINT_INTERVAL_SECONDS 60
+
+// Flash endurance. NVS writes round robin over its pages, erasing a full one
+// to move on, so wear spreads over the whole partition: 5 pages in
+// partitions.csv, one always kept free.
+#define CHECKPOINT_NVS_PAGES 4
+#define CHECKPOINT_NVS_ENTRIES_PER_PAGE 126
+// A blob write: its index, its header & one 32 byte entry of data
+#define CHECKPOINT_NVS_ENTRIES_PER_WRITE 3
+#define CHECKPOINT_FLASH_ERASE_CYCLES 100000ULL
+#define CHECKPOINT_LIFETIME_WRITES (CHECKPOINT_NVS_PAGES * CHECKPOINT_NVS_ENTRIES_PER_PAGE * CHECKPOINT_FLASH_ERASE_CYCLES / CHECKPOINT_NVS_ENTRIES_PER_WRITE)
+// Worst case, winding around the clock all year
+#define CHECKPOINT_WRITES_PER_YEAR (365ULL * 24 * 3600 / CHECKPOINT_INTERVAL_SECONDS)
+#define CHECKPOINT_LIFETIME_YEARS (CHECKPOINT_LIFETIME_WRITES / CHECKPOINT_WRITES_PER_YEAR)
+#define CHECKPOINT_MIN_LIFETIME_YEARS 10
+
+/**
+ * A session's progress as kept in NVS
+ */
+struct CHECKPOINT_BLOB
+{
+    uint16_t version;
+    uint16_t size; // sizeof(CHECKPOINT_BLOB) of the version that wrote it
+    WINDING_PROGRESS progress;
+    uint32_t crc; // of everything above
+};
+
+/**
+ * Checkpoints the running session, so one cut short by a power loss carries
+ * on with the turns it still owed rather than starting over.
+ *
+ * A checkpoint is written when a session begins, then at most every
+ * CHECKPOINT_INTERVAL_SECONDS while it runs, and only if the progress
+ * changed. See CHECKPOINT_LIFETIME_YEARS for what that costs the flash.
+ */
+class CheckpointStore
+{
+private:
+    WindingRoutine &_winder;
+    CHECKPOINT_BLOB _saved; // as last loaded or saved
+    bool _hasSaved;
+    unsigned long _savedMs;
+    uint32_t _writes;
+
+    bool write(const WINDING_PROGRESS &progress);
+
+public:
+    CheckpointStore(WindingRoutine &winder);
+
+    bool load(WINDING_PROGRESS &progress);
+
+    bool save(unsigned long now);
+
+    void update(unsigned long now);
+
+    uint32_t getWrites();
+};
+
+#endif
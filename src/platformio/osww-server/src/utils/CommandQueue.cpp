@@ -0,0 +1,168 @@
+#include "CommandQueue.h"
+
+#include "ApiSchema.h"
+#include "Logger.h"
+
+static_assert(sizeof(commandTypeChoices) / sizeof(commandTypeChoices[0]) == COMMAND_PATTERN_SELECT + 1, "commandTypeChoices out of sync");
+static_assert(sizeof(commandSourceChoices) / sizeof(commandSourceChoices[0]) == COMMAND_SOURCE_HOME_ASSISTANT + 1, "commandSourceChoices out of sync");
+static_assert(sizeof(commandStateChoices) / sizeof(commandStateChoices[0]) == COMMAND_DONE + 1, "commandStateChoices out of sync");
+// Queued & running commands must never lose their record to a newer one
+static_assert(COMMAND_HISTORY_SIZE > COMMAND_QUEUE_LENGTH + 1, "COMMAND_HISTORY_SIZE must outlast the queue");
+
+CommandQueue::CommandQueue()
+{
+    _queue = NULL;
+    _mutex = NULL;
+    _nextId = 1;
+
+    for (int i = 0; i < COMMAND_HISTORY_SIZE; i++)
+    {
+        _records[i].id = 0;
+    }
+}
+
+/**
+ * Call once before the webserver & MQTT start
+ */
+bool CommandQueue::begin()
+{
+    if (_queue == NULL)
+    {
+        _queue = xQueueCreate(COMMAND_QUEUE_LENGTH, sizeof(COMMAND));
+        _mutex = xSemaphoreCreateMutex();
+    }
+    return _queue != NULL && _mutex != NULL;
+}
+
+void CommandQueue::lock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+    }
+}
+
+void CommandQueue::unlock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreGive(_mutex);
+    }
+}
+
+COMMAND_RECORD *CommandQueue::findRecord(uint32_t id)
+{
+    COMMAND_RECORD &record = _records[id % COMMAND_HISTORY_SIZE];
+    return id != 0 && record.id == id ? &record : NULL;
+}
+
+/**
+ * Queues a command for the loop. Safe from any task.
+ *
+ * @param command its id is filled in
+ * @param key idempotency key, NULL or empty if none
+ * @param duplicate set when the key was seen before & nothing was queued
+ * @return the ID to follow the command by, 0 if the queue is full
+ */
+uint32_t CommandQueue::submit(COMMAND &command, const char *key, bool *duplicate)
+{
+    bool keyed = key != NULL && key[0] != '\0';
+    *duplicate = false;
+
+    lock();
+
+    if (keyed)
+    {
+        for (int i = 0; i < COMMAND_HISTORY_SIZE; i++)
+        {
+            if (_records[i].id != 0 && strncmp(_records[i].key, key, COMMAND_KEY_SIZE - 1) == 0)
+            {
+                uint32_t id = _records[i].id;
+                unlock();
+                *duplicate = true;
+                Log.debug(LOG_MAIN, "Command %u submitted again, not queued", (unsigned)id);
+                return id;
+            }
+        }
+    }
+
+    // Under the lock, so IDs go into the queue in order
+    command.id = _nextId;
+    if (_queue == NULL || xQueueSend(_queue, &command, 0) != pdTRUE)
+    {
+        unlock();
+        Log.warn(LOG_MAIN, "Command refused, the queue is full");
+        return 0;
+    }
+    _nextId = _nextId == UINT32_MAX ? 1 : _nextId + 1;
+
+    COMMAND_RECORD &record = _records[command.id % COMMAND_HISTORY_SIZE];
+    record.id = command.id;
+    record.type = command.type;
+    record.source = command.source;
+    record.state = COMMAND_QUEUED;
+    record.queuedMs = millis();
+    record.startedMs = 0;
+    record.doneMs = 0;
+    strncpy(record.key, keyed ? key : "", COMMAND_KEY_SIZE - 1);
+    record.key[COMMAND_KEY_SIZE - 1] = '\0';
+
+    unlock();
+    return command.id;
+}
+
+/**
+ * Takes the next command off the queue & marks it running. Call from the loop only.
+ *
+ * @return false if there's none
+ */
+bool CommandQueue::receive(COMMAND &command)
+{
+    if (_queue == NULL || xQueueReceive(_queue, &command, 0) != pdTRUE)
+    {
+        return false;
+    }
+
+    lock();
+    COMMAND_RECORD *record = findRecord(command.id);
+    if (record != NULL)
+    {
+        record->state = COMMAND_RUNNING;
+        record->startedMs = millis();
+    }
+    unlock();
+    return true;
+}
+
+/**
+ * The loop has applied the command
+ */
+void CommandQueue::complete(uint32_t id)
+{
+    lock();
+    COMMAND_RECORD *record = findRecord(id);
+    if (record != NULL)
+    {
+        record->state = COMMAND_DONE;
+        record->doneMs = millis();
+    }
+    unlock();
+}
+
+/**
+ * Copies out a command's record
+ *
+ * @return false if the ID is unknown or forgotten
+ */
+bool CommandQueue::find(uint32_t id, COMMAND_RECORD &record)
+{
+    lock();
+    COMMAND_RECORD *found = findRecord(id);
+    if (found != NULL)
+    {
+        record = *found;
+    }
+    unlock();
+    return found != NULL;
+}
+
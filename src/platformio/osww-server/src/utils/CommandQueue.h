@@ -0,0 +1,125 @@
+#include <Arduino.h>
+
+#include "PatternCompiler.h"
+
+#ifndef CommandQueue_H
+#define CommandQueue_H
+
+// Commands waiting for the loop; more are refused until it catches up
+#define COMMAND_QUEUE_LENGTH 8
+// Commands remembered for /api/commands/{id} & idempotency keys, the oldest are forgotten
+#define COMMAND_HISTORY_SIZE 16
+#define COMMAND_KEY_SIZE 40
+
+enum CommandType
+{
+    COMMAND_UPDATE,
+    COMMAND_POWER,
+    COMMAND_SCREEN,
+    COMMAND_ROTATIONS_PER_DAY,
+    COMMAND_DIRECTION,
+    COMMAND_TIMER,
+    COMMAND_START,
+    COMMAND_STOP,
+    COMMAND_HOUR,
+    COMMAND_MINUTES,
+    COMMAND_SETTINGS,
+    COMMAND_PATTERN_PUT,
+    COMMAND_PATTERN_REMOVE,
+    COMMAND_PATTERN_SELECT
+};
+
+enum CommandSource
+{
+    COMMAND_SOURCE_API,
+    COMMAND_SOURCE_HOME_ASSISTANT
+};
+
+enum CommandState
+{
+    COMMAND_QUEUED,
+    COMMAND_RUNNING,
+    COMMAND_DONE
+};
+
+/**
+ * The settings of a POST /api/update or /api/settings, as validated by updateSchema or settingsSchema
+ */
+struct COMMAND_UPDATE_ARGS
+{
+    uint8_t direction; // index into directionChoices
+    uint16_t rotationsPerDay;
+    uint8_t hour;
+    uint8_t minutes;
+    bool timerEnabled;
+    bool screenSleep;
+    bool start;
+};
+
+/**
+ * What goes through the queue, copied in & out by value
+ */
+struct COMMAND
+{
+    uint32_t id;
+    uint8_t type;   // CommandType
+    uint8_t source; // CommandSource
+    int32_t value;  // every type but COMMAND_UPDATE; the slot of the COMMAND_PATTERN_ ones
+    COMMAND_UPDATE_ARGS update;
+    WINDING_PATTERN pattern; // COMMAND_PATTERN_PUT, compiled by the webserver
+    uint32_t receivedMicros;
+};
+
+/**
+ * What's remembered of a command once it's queued
+ */
+struct COMMAND_RECORD
+{
+    uint32_t id; // 0 while the slot is free
+    uint8_t type;
+    uint8_t source;
+    uint8_t state; // CommandState
+    unsigned long queuedMs;
+    unsigned long startedMs;
+    unsigned long doneMs;
+    char key[COMMAND_KEY_SIZE]; // idempotency key, empty if none
+};
+
+/**
+ * Actuation requested by the webserver & MQTT tasks, applied by the loop in
+ * the order received. Submitting hands back an ID right away; the record of
+ * the command follows it through queued, running & done.
+ *
+ * A command submitted again with the same idempotency key isn't queued
+ * twice, the first one's ID comes back instead. Keys are remembered as long
+ * as their command is, the last COMMAND_HISTORY_SIZE commands.
+ */
+class CommandQueue
+{
+private:
+    QueueHandle_t _queue;
+    SemaphoreHandle_t _mutex;
+    uint32_t _nextId;
+    COMMAND_RECORD _records[COMMAND_HISTORY_SIZE];
+
+    void lock();
+
+    void unlock();
+
+    COMMAND_RECORD *findRecord(uint32_t id);
+
+public:
+    CommandQueue();
+
+    bool begin();
+
+    uint32_t submit(COMMAND &command, const char *key, bool *duplicate);
+
+    bool receive(COMMAND &command);
+
+    void complete(uint32_t id);
+
+    bool find(uint32_t id, COMMAND_RECORD &record);
+};
+
+#endif
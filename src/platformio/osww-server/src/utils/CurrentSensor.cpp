@@ -0,0 +1,229 @@
+#include "CurrentSensor.h"
+
+#include "Logger.h"
+
+// Bytes per sample in the DMA frames, ADC_DIGI_OUTPUT_FORMAT_TYPE1 on the ESP32
+#define CURRENT_SENSE_SAMPLE_BYTES sizeof(adc_digi_output_data_t)
+#define CURRENT_SENSE_FRAME_BYTES (CURRENT_SENSE_FRAME_SAMPLES * CURRENT_SENSE_SAMPLE_BYTES)
+// Nominal reference, for chips without one burned into eFuse
+#define CURRENT_SENSE_DEFAULT_VREF 1100
+
+CurrentSensor::CurrentSensor(MotorControl &motor, int stallMilliamps) : _motor(motor), _load(stallMilliamps)
+{
+    _shuntMilliohms = 1000;
+    _channel = 0;
+    _running = false;
+    _pendingEvent = MOTOR_LOAD_NONE;
+    _lastEvent = MOTOR_LOAD_NONE;
+    _mutex = NULL;
+}
+
+void CurrentSensor::lock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+    }
+}
+
+void CurrentSensor::unlock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreGive(_mutex);
+    }
+}
+
+/**
+ * Starts continuous sampling & the task that reads it. Call once, before the motor first runs.
+ *
+ * @param pin an ADC1 pin, ADC2 can't be used alongside WiFi
+ * @param shuntMilliohms the shunt between the motor driver & ground
+ * @return false if the pin or the ADC can't be used
+ */
+bool CurrentSensor::begin(int pin, int shuntMilliohms)
+{
+    int channel = digitalPinToAnalogChannel(pin);
+    if (channel < 0 || channel >= ADC1_CHANNEL_MAX)
+    {
+        Log.error(LOG_MOTOR, "Pin %d is not an ADC1 pin, current sensing is off", pin);
+        return false;
+    }
+
+    _channel = channel;
+    _shuntMilliohms = max(1, shuntMilliohms);
+    esp_adc_cal_characterize(ADC_UNIT_1, CURRENT_SENSE_ATTENUATION, ADC_WIDTH_BIT_12, CURRENT_SENSE_DEFAULT_VREF, &_calibration);
+
+    adc_digi_init_config_t initConfig = {};
+    initConfig.max_store_buf_size = CURRENT_SENSE_FRAME_BYTES * CURRENT_SENSE_BUFFER_FRAMES;
+    initConfig.conv_num_each_intr = CURRENT_SENSE_FRAME_BYTES;
+    initConfig.adc1_chan_mask = BIT(_channel);
+    initConfig.adc2_chan_mask = 0;
+
+    adc_digi_pattern_config_t pattern = {};
+    pattern.atten = CURRENT_SENSE_ATTENUATION;
+    pattern.channel = _channel;
+    pattern.unit = 0;
+    pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+    adc_digi_configuration_t config = {};
+    // The ESP32 needs a conversion limit in continuous mode
+    config.conv_limit_en = true;
+    config.conv_limit_num = 250;
+    config.pattern_num = 1;
+    config.adc_pattern = &pattern;
+    config.sample_freq_hz = CURRENT_SENSE_SAMPLE_HZ;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+
+    if (adc_digi_initialize(&initConfig) != ESP_OK ||
+        adc_digi_controller_configure(&config) != ESP_OK ||
+        adc_digi_start() != ESP_OK)
+    {
+        Log.error(LOG_MOTOR, "Couldn't start the ADC, current sensing is off");
+        adc_digi_deinitialize();
+        return false;
+    }
+
+    _mutex = xSemaphoreCreateMutex();
+    _running = xTaskCreate(samplingTask, "current", CURRENT_SENSE_STACK_SIZE, this, 2, NULL) == pdPASS;
+    Log.status(LOG_MOTOR, "Current sensing on ADC1 channel %d, %d mOhm shunt", _channel, _shuntMilliohms);
+    return _running;
+}
+
+void CurrentSensor::samplingTask(void *parameters)
+{
+    CurrentSensor *sensor = (CurrentSensor *)parameters;
+    for (;;)
+    {
+        sensor->readFrame();
+    }
+}
+
+/**
+ * Waits for the next frame, averages it & judges the block
+ */
+void CurrentSensor::readFrame()
+{
+    uint8_t frame[CURRENT_SENSE_FRAME_BYTES];
+    uint32_t length = 0;
+    esp_err_t result = adc_digi_read_bytes(frame, sizeof(frame), &length, 100);
+    if (result == ESP_ERR_INVALID_STATE)
+    {
+        // The task fell behind & the driver's buffer overflowed; what's left is still good
+        Log.debug(LOG_MOTOR, "ADC buffer overflowed");
+    }
+    else if (result != ESP_OK)
+    {
+        return;
+    }
+
+    uint32_t sum = 0;
+    uint32_t count = 0;
+    for (uint32_t offset = 0; offset + CURRENT_SENSE_SAMPLE_BYTES <= length; offset += CURRENT_SENSE_SAMPLE_BYTES)
+    {
+        const adc_digi_output_data_t *sample = (const adc_digi_output_data_t *)(frame + offset);
+        if (sample->type1.channel == _channel)
+        {
+            sum += sample->type1.data;
+            count++;
+        }
+    }
+    if (count == 0)
+    {
+        return;
+    }
+
+    uint32_t millivolts = esp_adc_cal_raw_to_voltage(sum / count, &_calibration);
+    uint16_t milliamps = min(millivolts * 1000 / (uint32_t)_shuntMilliohms, (uint32_t)0xFFFF);
+
+    lock();
+    MotorLoadEvent event = _load.addSample(milliamps, _motor.isTurning(), _motor.getTurningSinceMs(), millis());
+    if (event != MOTOR_LOAD_NONE)
+    {
+        _pendingEvent = max(_pendingEvent, event);
+        _lastEvent = event;
+    }
+    unlock();
+}
+
+/**
+ * Starts a session's baseline, peak, stalls & energy from scratch
+ */
+void CurrentSensor::beginSession()
+{
+    lock();
+    _load.beginSession();
+    _pendingEvent = MOTOR_LOAD_NONE;
+    unlock();
+}
+
+/**
+ * The most severe event since the last call, MOTOR_LOAD_NONE if there wasn't one
+ */
+MotorLoadEvent CurrentSensor::takeEvent()
+{
+    lock();
+    MotorLoadEvent event = _pendingEvent;
+    _pendingEvent = MOTOR_LOAD_NONE;
+    unlock();
+    return event;
+}
+
+MotorLoadEvent CurrentSensor::getLastEvent()
+{
+    return _lastEvent;
+}
+
+bool CurrentSensor::isRunning()
+{
+    return _running;
+}
+
+int CurrentSensor::getMilliamps()
+{
+    lock();
+    int milliamps = _load.getMilliamps();
+    unlock();
+    return milliamps;
+}
+
+int CurrentSensor::getAverageMilliamps()
+{
+    lock();
+    int milliamps = _load.getAverageMilliamps();
+    unlock();
+    return milliamps;
+}
+
+int CurrentSensor::getPeakMilliamps()
+{
+    lock();
+    int milliamps = _load.getPeakMilliamps();
+    unlock();
+    return milliamps;
+}
+
+int CurrentSensor::getBaselineMilliamps()
+{
+    lock();
+    int milliamps = _load.getBaselineMilliamps();
+    unlock();
+    return milliamps;
+}
+
+int CurrentSensor::getStalls()
+{
+    lock();
+    int stalls = _load.getStalls();
+    unlock();
+    return stalls;
+}
+
+uint32_t CurrentSensor::getMilliwattHours(int supplyMillivolts)
+{
+    lock();
+    uint32_t milliwattHours = _load.getMilliwattHours(supplyMillivolts);
+    unlock();
+    return milliwattHours;
+}
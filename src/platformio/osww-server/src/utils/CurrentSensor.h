@@ -0,0 +1,75 @@
+#include <Arduino.h>
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+
+#include "MotorControl.h"
+#include "MotorLoad.h"
+
+#ifndef CurrentSensor_H
+#define CurrentSensor_H
+
+// The ADC runs on its own, DMA fills frames of samples in the background
+#define CURRENT_SENSE_SAMPLE_HZ 20000
+// Samples averaged into one block for MotorLoad, about 13 ms of them
+#define CURRENT_SENSE_FRAME_SAMPLES 256
+#define CURRENT_SENSE_BUFFER_FRAMES 4
+#define CURRENT_SENSE_STACK_SIZE 3072
+// 0 dB reads up to about 950 mV, e.g. 950 mA through a 1 ohm shunt
+#define CURRENT_SENSE_ATTENUATION ADC_ATTEN_DB_0
+
+/**
+ * Motor current through a shunt on an ADC1 pin, sampled in continuous (DMA)
+ * mode so the CPU only sees whole frames. A task averages each frame into a
+ * block, converts it to mA with the chip's calibration & hands it to MotorLoad.
+ *
+ * The loop task picks up what MotorLoad noticed with takeEvent(); the getters
+ * may be called from any task.
+ */
+class CurrentSensor
+{
+private:
+    MotorControl &_motor;
+    MotorLoad _load;
+    int _shuntMilliohms;
+    uint8_t _channel;
+    esp_adc_cal_characteristics_t _calibration;
+    volatile bool _running;
+    MotorLoadEvent _pendingEvent;
+    MotorLoadEvent _lastEvent;
+    SemaphoreHandle_t _mutex;
+
+    void lock();
+
+    void unlock();
+
+    static void samplingTask(void *parameters);
+
+    void readFrame();
+
+public:
+    CurrentSensor(MotorControl &motor, int stallMilliamps);
+
+    bool begin(int pin, int shuntMilliohms);
+
+    void beginSession();
+
+    MotorLoadEvent takeEvent();
+
+    MotorLoadEvent getLastEvent();
+
+    bool isRunning();
+
+    int getMilliamps();
+
+    int getAverageMilliamps();
+
+    int getPeakMilliamps();
+
+    int getBaselineMilliamps();
+
+    int getStalls();
+
+    uint32_t getMilliwattHours(int supplyMillivolts);
+};
+
+#endif
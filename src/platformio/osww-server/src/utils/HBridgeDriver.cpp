@@ -0,0 +1,36 @@
+#include "HBridgeDriver.h"
+
+#if PWM_MOTOR_CONTROL
+	#include <ESP32MX1508.h>
+	#define CH1 1
+	#define CH2 2
+    int motorSpeed = 145;
+#endif
+
+HBridgeDriver::HBridgeDriver(int pinA, int pinB)
+{
+    _pinA = pinA;
+    _pinB = pinB;
+}
+
+void HBridgeDriver::drive(int direction)
+{
+    #if PWM_MOTOR_CONTROL
+        MX1508 pwmControl(_pinA, _pinB, CH1, CH2);
+        if (direction > 0)
+        {
+            pwmControl.motorGo(motorSpeed);
+        }
+        else if (direction < 0)
+        {
+            pwmControl.motorRev(motorSpeed);
+        }
+        else
+        {
+            pwmControl.motorBrake();
+        }
+    #else
+        digitalWrite(_pinA, direction > 0 ? HIGH : LOW);
+        digitalWrite(_pinB, direction < 0 ? HIGH : LOW);
+    #endif
+}
@@ -0,0 +1,24 @@
+#include <Arduino.h>
+
+#include "MotorDriver.h"
+
+#ifndef HBridgeDriver_H
+#define HBridgeDriver_H
+
+/**
+ * A DC motor on an L298N, or an MX1508 with PWM_MOTOR_CONTROL. The two pins
+ * go to IN1 & IN2: one high turns the motor, both low stop it.
+ */
+class HBridgeDriver : public MotorDriver
+{
+private:
+    int _pinA;
+    int _pinB;
+
+public:
+    HBridgeDriver(int pinA, int pinB);
+
+    void drive(int direction) override;
+};
+
+#endif
@@ -0,0 +1,227 @@
+#include "HaDiscovery.h"
+
+#include <Preferences.h>
+
+#include "ApiSchema.h"
+#include "Logger.h"
+
+#define HA_DISCOVERY_NAMESPACE "ha"
+#define HA_DISCOVERY_KEY "discovery"
+// FNV-1a
+#define HA_DISCOVERY_HASH_BASIS 2166136261UL
+#define HA_DISCOVERY_HASH_PRIME 16777619UL
+
+static_assert(sizeof(homeAssistantDiscoveryChoices) / sizeof(homeAssistantDiscoveryChoices[0]) == HA_DISCOVERY_READY + 1, "homeAssistantDiscoveryChoices out of sync");
+
+HaDiscovery::HaDiscovery()
+{
+    _hash = HA_DISCOVERY_HASH_BASIS;
+    _storedHash = 0;
+    _publishing = true;
+    _state = HA_DISCOVERY_DISCONNECTED;
+    _connectingSinceMs = 0;
+    _connectedMs = 0;
+    _reconnectToReadyMs = 0;
+    _connectToReadyMs = 0;
+    _connects = 0;
+    _publishes = 0;
+}
+
+/**
+ * Adds a piece of the discovery configs to the hash. Call while setting the entities up, before begin().
+ */
+void HaDiscovery::add(const char *text)
+{
+    if (text == NULL)
+    {
+        text = "";
+    }
+
+    // The terminator too, so "ab" + "c" doesn't hash like "a" + "bc"
+    do
+    {
+        _hash = (_hash ^ (uint8_t)*text) * HA_DISCOVERY_HASH_PRIME;
+    } while (*text++ != '\0');
+}
+
+void HaDiscovery::add(float value)
+{
+    const uint8_t *bytes = (const uint8_t *)&value;
+    for (size_t i = 0; i < sizeof(value); i++)
+    {
+        _hash = (_hash ^ bytes[i]) * HA_DISCOVERY_HASH_PRIME;
+    }
+}
+
+/**
+ * Compares the finished hash with the one last published. Call once every entity is set up.
+ */
+void HaDiscovery::begin(unsigned long now)
+{
+    Preferences preferences;
+    if (preferences.begin(HA_DISCOVERY_NAMESPACE, true))
+    {
+        _storedHash = preferences.getUInt(HA_DISCOVERY_KEY, 0);
+        preferences.end();
+    }
+
+    _publishing = _storedHash != _hash;
+    _connectingSinceMs = now;
+    if (_publishing)
+    {
+        Log.status(LOG_MAIN, "Home Assistant discovery changed (%08x), publishing it on connect", (unsigned)_hash);
+    }
+}
+
+/**
+ * True while the entities should build & publish their discovery configs
+ */
+bool HaDiscovery::isPublishing()
+{
+    return _publishing;
+}
+
+void HaDiscovery::onConnected(unsigned long now)
+{
+    _connects++;
+    _connectedMs = now;
+    // When publishing, the library sent the configs as it connected; otherwise see if the broker kept them
+    _state = _publishing ? HA_DISCOVERY_PUBLISHED : HA_DISCOVERY_CHECKING;
+}
+
+void HaDiscovery::onDisconnected(unsigned long now)
+{
+    if (_state != HA_DISCOVERY_DISCONNECTED)
+    {
+        _state = HA_DISCOVERY_DISCONNECTED;
+        _connectingSinceMs = now;
+    }
+}
+
+/**
+ * The retained marker the broker sent back, the hash of the configs it holds
+ */
+void HaDiscovery::onMarker(const uint8_t *payload, uint16_t length, unsigned long now)
+{
+    if (_state != HA_DISCOVERY_CHECKING)
+    {
+        return;
+    }
+
+    char hash[9];
+    length = min(length, (uint16_t)(sizeof(hash) - 1));
+    memcpy(hash, payload, length);
+    hash[length] = '\0';
+
+    if (length == 8 && strtoul(hash, NULL, 16) == _hash)
+    {
+        becomeReady(now, "kept by the broker");
+    }
+    else
+    {
+        Log.warn(LOG_MAIN, "Broker has stale Home Assistant discovery (%s), publishing it again", hash);
+        _state = HA_DISCOVERY_LOST;
+    }
+}
+
+/**
+ * Call on the loop after mqtt.loop()
+ *
+ * @return HA_DISCOVERY_ALL to publish every entity's config & then the marker,
+ * HA_DISCOVERY_MARKER for the marker only; call published() after either
+ */
+HaDiscoveryStep HaDiscovery::update(unsigned long now)
+{
+    if (_state == HA_DISCOVERY_CHECKING && now - _connectedMs >= HA_DISCOVERY_CHECK_MS)
+    {
+        Log.warn(LOG_MAIN, "Broker lost Home Assistant discovery, publishing it again");
+        _state = HA_DISCOVERY_LOST;
+    }
+
+    switch (_state)
+    {
+        case HA_DISCOVERY_PUBLISHED:
+            return HA_DISCOVERY_MARKER;
+        case HA_DISCOVERY_LOST:
+            // Once; if the marker doesn't go out, only the marker is retried
+            _publishing = true;
+            _state = HA_DISCOVERY_PUBLISHED;
+            return HA_DISCOVERY_ALL;
+        default:
+            return HA_DISCOVERY_NOTHING;
+    }
+}
+
+/**
+ * The configs & marker are out; remembers their hash so the next boot doesn't send them again
+ */
+void HaDiscovery::published(unsigned long now)
+{
+    _publishes++;
+    _publishing = false;
+
+    if (_storedHash != _hash)
+    {
+        Preferences preferences;
+        if (preferences.begin(HA_DISCOVERY_NAMESPACE, false))
+        {
+            preferences.putUInt(HA_DISCOVERY_KEY, _hash);
+            preferences.end();
+            _storedHash = _hash;
+        }
+        else
+        {
+            Log.error(LOG_MAIN, "Failed to store the Home Assistant discovery hash");
+        }
+    }
+
+    becomeReady(now, "published");
+}
+
+void HaDiscovery::becomeReady(unsigned long now, const char *discovery)
+{
+    _state = HA_DISCOVERY_READY;
+    _reconnectToReadyMs = now - _connectingSinceMs;
+    _connectToReadyMs = now - _connectedMs;
+    Log.status(LOG_MAIN, "Home Assistant ready %lu ms after it began reconnecting (%lu ms after connecting), discovery %s",
+               _reconnectToReadyMs, _connectToReadyMs, discovery);
+}
+
+/**
+ * The hash as the marker holds it, 8 hex digits
+ */
+void HaDiscovery::formatHash(char *buffer, size_t size)
+{
+    snprintf(buffer, size, "%08x", (unsigned)_hash);
+}
+
+HaDiscoveryState HaDiscovery::getState()
+{
+    return _state;
+}
+
+uint32_t HaDiscovery::getConnects()
+{
+    return _connects;
+}
+
+uint32_t HaDiscovery::getPublishes()
+{
+    return _publishes;
+}
+
+/**
+ * From losing the broker (or from begin(), for the first connection) to discovery being settled
+ */
+unsigned long HaDiscovery::getReconnectToReadyMs()
+{
+    return _reconnectToReadyMs;
+}
+
+/**
+ * From the MQTT connection to discovery being settled: the marker's round trip, or the publishing
+ */
+unsigned long HaDiscovery::getConnectToReadyMs()
+{
+    return _connectToReadyMs;
+}
@@ -0,0 +1,89 @@
+#include <Arduino.h>
+
+#ifndef HaDiscovery_H
+#define HaDiscovery_H
+
+// How long the broker gets to send back the retained marker before it's assumed to have lost it
+#define HA_DISCOVERY_CHECK_MS 3000
+
+// What the loop has to publish for discovery, see HaDiscovery::update()
+enum HaDiscoveryStep
+{
+    HA_DISCOVERY_NOTHING,
+    HA_DISCOVERY_MARKER,
+    HA_DISCOVERY_ALL
+};
+
+enum HaDiscoveryState
+{
+    HA_DISCOVERY_DISCONNECTED,
+    HA_DISCOVERY_PUBLISHED,
+    HA_DISCOVERY_CHECKING,
+    HA_DISCOVERY_LOST,
+    HA_DISCOVERY_READY
+};
+
+/**
+ * Decides when Home Assistant's discovery configs need publishing, instead
+ * of sending all of them on every MQTT reconnect.
+ *
+ * The configs are hashed as the entities are set up. The hash of the last
+ * configs published is kept in NVS, and as a retained marker on the broker:
+ * - the hash changed (new firmware, new entities): publish on connect
+ * - the marker comes back unchanged: the broker still has them, skip
+ * - the marker is missing or stale: the broker lost its retained
+ *   messages, publish again
+ *
+ * Knows nothing of MQTT itself; main.cpp does the publishing.
+ */
+class HaDiscovery
+{
+private:
+    uint32_t _hash;
+    uint32_t _storedHash;
+    bool _publishing;
+    HaDiscoveryState _state;
+    unsigned long _connectingSinceMs;
+    unsigned long _connectedMs;
+    unsigned long _reconnectToReadyMs;
+    unsigned long _connectToReadyMs;
+    uint32_t _connects;
+    uint32_t _publishes;
+
+    void becomeReady(unsigned long now, const char *discovery);
+
+public:
+    HaDiscovery();
+
+    void add(const char *text);
+
+    void add(float value);
+
+    void begin(unsigned long now);
+
+    bool isPublishing();
+
+    void onConnected(unsigned long now);
+
+    void onDisconnected(unsigned long now);
+
+    void onMarker(const uint8_t *payload, uint16_t length, unsigned long now);
+
+    HaDiscoveryStep update(unsigned long now);
+
+    void published(unsigned long now);
+
+    void formatHash(char *buffer, size_t size);
+
+    HaDiscoveryState getState();
+
+    uint32_t getConnects();
+
+    uint32_t getPublishes();
+
+    unsigned long getReconnectToReadyMs();
+
+    unsigned long getConnectToReadyMs();
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "HistoryStream.h"
+
+#include "ApiSchema.h"
+
+enum HistoryStreamStage
+{
+    HISTORY_STAGE_HEADER,
+    HISTORY_STAGE_RECORDS,
+    HISTORY_STAGE_TRAILER,
+    HISTORY_STAGE_DONE
+};
+
+static const char *choiceName(const char *const *choices, size_t count, uint8_t index)
+{
+    return index < count ? choices[index] : "unknown";
+}
+
+/**
+ * @param before only sessions older than this id, 0 for the newest
+ * @param limit sessions in the page
+ */
+HistoryStream::HistoryStream(SessionHistory &history, HistoryFormat format, uint32_t before, uint32_t limit) : _history(history)
+{
+    uint32_t newest = history.getNewestSequence();
+
+    _format = format;
+    _nextSequence = before == 0 || before > newest ? newest : before - 1;
+    _oldestSequence = history.getOldestSequence();
+    _remaining = limit;
+    _lastSequence = 0;
+    _stage = HISTORY_STAGE_HEADER;
+    _firstRecord = true;
+    _lineLength = 0;
+    _lineOffset = 0;
+}
+
+void HistoryStream::formatRecord(const SESSION_RECORD &record)
+{
+    const char *direction = choiceName(directionChoices, sizeof(directionChoices) / sizeof(directionChoices[0]), record.direction);
+    const char *stopReason = choiceName(stopReasonChoices, sizeof(stopReasonChoices) / sizeof(stopReasonChoices[0]), record.stopReason);
+
+    if (_format == HISTORY_FORMAT_CSV)
+    {
+        _lineLength = snprintf(_line, sizeof(_line), "%u,%u,%u,%u,%u,%s,%u,%u,%u,%u,%s,",
+                               (unsigned)record.sequence, (unsigned)record.startEpoch, (unsigned)record.endEpoch,
+                               record.plannedTurns, record.deliveredTurns, direction,
+                               record.clockwiseSeconds, record.counterClockwiseSeconds,
+                               record.pauses, record.pausedSeconds, stopReason);
+        // Left empty when it wasn't measured
+        if (record.energyMilliwattHours != HISTORY_ENERGY_UNKNOWN)
+        {
+            _lineLength += snprintf(_line + _lineLength, sizeof(_line) - _lineLength, "%u", record.energyMilliwattHours);
+        }
+        _line[_lineLength++] = '\n';
+        return;
+    }
+
+    JsonMessage json(historySchema);
+    json.set(HISTORY_ID, (unsigned long)record.sequence);
+    json.set(HISTORY_START_EPOCH, (unsigned long)record.startEpoch);
+    json.set(HISTORY_END_EPOCH, (unsigned long)record.endEpoch);
+    json.set(HISTORY_PLANNED_TURNS, (int)record.plannedTurns);
+    json.set(HISTORY_DELIVERED_TURNS, (int)record.deliveredTurns);
+    json.set(HISTORY_DIRECTION, direction);
+    json.set(HISTORY_CLOCKWISE_SECONDS, (int)record.clockwiseSeconds);
+    json.set(HISTORY_COUNTER_CLOCKWISE_SECONDS, (int)record.counterClockwiseSeconds);
+    json.set(HISTORY_PAUSES, (int)record.pauses);
+    json.set(HISTORY_PAUSED_SECONDS, (int)record.pausedSeconds);
+    json.set(HISTORY_STOP_REASON, stopReason);
+    if (record.energyMilliwattHours != HISTORY_ENERGY_UNKNOWN)
+    {
+        json.set(HISTORY_ENERGY, (int)record.energyMilliwattHours);
+    }
+
+    _lineLength = 0;
+    if (!_firstRecord)
+    {
+        _line[_lineLength++] = ',';
+    }
+    _lineLength += json.serialize(_line + _lineLength, sizeof(_line) - _lineLength);
+}
+
+/**
+ * Puts the next piece of the page in _line
+ *
+ * @return false once the page is complete
+ */
+bool HistoryStream::produce()
+{
+    _lineOffset = 0;
+    _lineLength = 0;
+
+    switch (_stage)
+    {
+        case HISTORY_STAGE_HEADER:
+            if (_format == HISTORY_FORMAT_CSV)
+            {
+                // Columns are named & ordered like the JSON fields
+                for (int i = 0; i < HISTORY_FIELD_COUNT; i++)
+                {
+                    _lineLength += snprintf(_line + _lineLength, sizeof(_line) - _lineLength, i ? ",%s" : "%s", historyFields[i].name);
+                }
+                _line[_lineLength++] = '\n';
+            }
+            else
+            {
+                _lineLength = snprintf(_line, sizeof(_line), "{\"records\":[");
+            }
+            _stage = HISTORY_STAGE_RECORDS;
+            return true;
+
+        case HISTORY_STAGE_RECORDS:
+            // Sequences lost to a torn write are skipped
+            while (_remaining > 0 && _nextSequence >= _oldestSequence && _nextSequence > 0)
+            {
+                SESSION_RECORD record;
+                uint32_t sequence = _nextSequence--;
+                if (_history.read(sequence, record))
+                {
+                    formatRecord(record);
+                    _firstRecord = false;
+                    _lastSequence = sequence;
+                    _remaining--;
+                    return true;
+                }
+            }
+            _stage = HISTORY_STAGE_TRAILER;
+            return produce();
+
+        case HISTORY_STAGE_TRAILER:
+            if (_format == HISTORY_FORMAT_JSON)
+            {
+                bool more = _remaining == 0 && _nextSequence >= _oldestSequence && _nextSequence > 0;
+                _lineLength = more ? snprintf(_line, sizeof(_line), "],\"next\":%u}", (unsigned)_lastSequence)
+                                   : snprintf(_line, sizeof(_line), "],\"next\":null}");
+            }
+            _stage = HISTORY_STAGE_DONE;
+            return _lineLength > 0;
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * AwsResponseFiller for beginChunkedResponse()
+ *
+ * @return bytes written, 0 at the end of the page
+ */
+size_t HistoryStream::fill(uint8_t *buffer, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen)
+    {
+        if (_lineOffset == _lineLength && !produce())
+        {
+            break;
+        }
+
+        size_t count = min(_lineLength - _lineOffset, maxLen - written);
+        memcpy(buffer + written, _line + _lineOffset, count);
+        _lineOffset += count;
+        written += count;
+    }
+    return written;
+}
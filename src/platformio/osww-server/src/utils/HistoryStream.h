@@ -0,0 +1,50 @@
+#include <Arduino.h>
+
+#include "SessionHistory.h"
+
+#ifndef HistoryStream_H
+#define HistoryStream_H
+
+#define HISTORY_PAGE_DEFAULT 50
+// Longest piece written at once: one JSON record, the CSV header or the trailer
+#define HISTORY_LINE_SIZE 320
+
+enum HistoryFormat
+{
+    HISTORY_FORMAT_JSON,
+    HISTORY_FORMAT_CSV
+};
+
+/**
+ * One page of /api/history, newest session first, produced a piece at a time
+ * for a chunked response. Only one record is in RAM at any time.
+ *
+ * JSON: {"records":[...],"next":<id>|null}, CSV: a header row, then one row per record.
+ * Pass the last id of a page as `before` to get the next one.
+ */
+class HistoryStream
+{
+private:
+    SessionHistory &_history;
+    HistoryFormat _format;
+    uint32_t _nextSequence;
+    uint32_t _oldestSequence;
+    uint32_t _remaining;
+    uint32_t _lastSequence;
+    int _stage;
+    bool _firstRecord;
+    char _line[HISTORY_LINE_SIZE];
+    size_t _lineLength;
+    size_t _lineOffset;
+
+    bool produce();
+
+    void formatRecord(const SESSION_RECORD &record);
+
+public:
+    HistoryStream(SessionHistory &history, HistoryFormat format, uint32_t before, uint32_t limit);
+
+    size_t fill(uint8_t *buffer, size_t maxLen);
+};
+
+#endif
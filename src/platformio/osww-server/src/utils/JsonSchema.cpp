@@ -0,0 +1,1059 @@
+#include "JsonSchema.h"
+
+// Deepest nesting skipped inside an unknown field
+#define JSON_MAX_SKIP_DEPTH 8
+
+static_assert(JSON_MAX_FIELDS <= 32, "JSON_FORMAT has a bit per field");
+static_assert(sizeof(jsonEncodingContentTypes) / sizeof(jsonEncodingContentTypes[0]) == JSON_ENCODING_CBOR + 1, "jsonEncodingContentTypes out of sync");
+
+enum JsonToken
+{
+    JSON_TOKEN_STRING,
+    JSON_TOKEN_NUMBER,
+    JSON_TOKEN_TRUE,
+    JSON_TOKEN_FALSE,
+    JSON_TOKEN_NULL,
+    JSON_TOKEN_CONTAINER
+};
+
+/**
+ * Cursor over the request body. Bodies aren't NUL terminated, so everything is bounded by `end`.
+ */
+struct JsonCursor
+{
+    const char *position;
+    const char *end;
+
+    bool atEnd()
+    {
+        return position >= end || *position == '\0';
+    }
+
+    void skipWhitespace()
+    {
+        while (position < end && (*position == ' ' || *position == '\t' || *position == '\n' || *position == '\r'))
+        {
+            position++;
+        }
+    }
+
+    bool consume(char expected)
+    {
+        skipWhitespace();
+        if (position < end && *position == expected)
+        {
+            position++;
+            return true;
+        }
+        return false;
+    }
+
+    bool consumeLiteral(const char *literal)
+    {
+        size_t length = strlen(literal);
+        if ((size_t)(end - position) < length || strncmp(position, literal, length) != 0)
+        {
+            return false;
+        }
+        position += length;
+        return true;
+    }
+};
+
+static bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * Reads a string after its opening quote. Decodes into `out` when given
+ * (at most outSize - 1 chars), otherwise just skips it.
+ *
+ * @return decoded length, or -1 when malformed or too long
+ */
+static int readString(JsonCursor &cursor, char *out, size_t outSize)
+{
+    size_t length = 0;
+
+    while (cursor.position < cursor.end)
+    {
+        char c = *cursor.position++;
+        if (c == '"')
+        {
+            if (out)
+            {
+                out[length] = '\0';
+            }
+            return (int)length;
+        }
+
+        if (c == '\\')
+        {
+            if (cursor.position >= cursor.end)
+            {
+                return -1;
+            }
+            char escaped = *cursor.position++;
+            switch (escaped)
+            {
+                case '"': case '\\': case '/': c = escaped; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'u':
+                {
+                    if (cursor.end - cursor.position < 4)
+                    {
+                        return -1;
+                    }
+                    int code = 0;
+                    for (int i = 0; i < 4; i++)
+                    {
+                        int digit = hexValue(*cursor.position++);
+                        if (digit < 0)
+                        {
+                            return -1;
+                        }
+                        code = code * 16 + digit;
+                    }
+                    // None of our fields need more than ASCII
+                    c = code < 0x80 ? (char)code : '?';
+                    break;
+                }
+                default:
+                    return -1;
+            }
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            return -1;
+        }
+
+        if (out)
+        {
+            if (length + 1 >= outSize)
+            {
+                return -1;
+            }
+            out[length] = c;
+        }
+        length++;
+    }
+
+    return -1;
+}
+
+/**
+ * Skips an object or array after its opening bracket
+ */
+static bool skipContainer(JsonCursor &cursor)
+{
+    int depth = 1;
+
+    while (cursor.position < cursor.end && depth > 0)
+    {
+        char c = *cursor.position++;
+        if (c == '"')
+        {
+            if (readString(cursor, nullptr, 0) < 0)
+            {
+                return false;
+            }
+        }
+        else if (c == '{' || c == '[')
+        {
+            if (++depth > JSON_MAX_SKIP_DEPTH)
+            {
+                return false;
+            }
+        }
+        else if (c == '}' || c == ']')
+        {
+            depth--;
+        }
+    }
+
+    return depth == 0;
+}
+
+/**
+ * Appends MessagePack or CBOR to a fixed buffer; once something doesn't fit, nothing more is written
+ */
+struct BinaryWriter
+{
+    uint8_t *buffer;
+    size_t size;
+    size_t length;
+    JsonEncoding encoding;
+    bool ok;
+
+    void put(const void *data, size_t count)
+    {
+        if (!ok || length + count > size)
+        {
+            ok = false;
+            return;
+        }
+        memcpy(buffer + length, data, count);
+        length += count;
+    }
+
+    void put(uint8_t byte)
+    {
+        put(&byte, 1);
+    }
+
+    // Big endian, as both formats want
+    void putNumber(uint64_t value, int bytes)
+    {
+        for (int i = bytes - 1; i >= 0; i--)
+        {
+            put((uint8_t)(value >> (i * 8)));
+        }
+    }
+
+    // CBOR: the major type & its argument, as short as it goes
+    void putHead(uint8_t major, uint64_t argument)
+    {
+        major <<= 5;
+        if (argument < 24)
+        {
+            put((uint8_t)(major | argument));
+        }
+        else if (argument <= 0xff)
+        {
+            put((uint8_t)(major | 24));
+            putNumber(argument, 1);
+        }
+        else if (argument <= 0xffff)
+        {
+            put((uint8_t)(major | 25));
+            putNumber(argument, 2);
+        }
+        else if (argument <= 0xffffffffULL)
+        {
+            put((uint8_t)(major | 26));
+            putNumber(argument, 4);
+        }
+        else
+        {
+            put((uint8_t)(major | 27));
+            putNumber(argument, 8);
+        }
+    }
+
+    void putMap(size_t count)
+    {
+        if (encoding == JSON_ENCODING_CBOR)
+        {
+            putHead(5, count);
+        }
+        else if (count < 16)
+        {
+            put((uint8_t)(0x80 | count));
+        }
+        else
+        {
+            put(0xde);
+            putNumber(count, 2);
+        }
+    }
+
+    void putString(const char *text)
+    {
+        size_t count = strlen(text);
+        if (encoding == JSON_ENCODING_CBOR)
+        {
+            putHead(3, count);
+        }
+        else if (count < 32)
+        {
+            put((uint8_t)(0xa0 | count));
+        }
+        else if (count <= 0xff)
+        {
+            put(0xd9);
+            putNumber(count, 1);
+        }
+        else
+        {
+            put(0xda);
+            putNumber(count, 2);
+        }
+        put(text, count);
+    }
+
+    void putInt(int64_t value)
+    {
+        if (encoding == JSON_ENCODING_CBOR)
+        {
+            // Negatives are stored as -1 - n
+            value >= 0 ? putHead(0, value) : putHead(1, -1 - value);
+        }
+        else if (value >= 0)
+        {
+            if (value < 128)
+            {
+                put((uint8_t)value);
+            }
+            else if (value <= 0xff)
+            {
+                put(0xcc);
+                putNumber(value, 1);
+            }
+            else if (value <= 0xffff)
+            {
+                put(0xcd);
+                putNumber(value, 2);
+            }
+            else if (value <= 0xffffffffLL)
+            {
+                put(0xce);
+                putNumber(value, 4);
+            }
+            else
+            {
+                put(0xcf);
+                putNumber(value, 8);
+            }
+        }
+        else if (value >= -32)
+        {
+            put((uint8_t)value);
+        }
+        else if (value >= INT8_MIN)
+        {
+            put(0xd0);
+            putNumber(value, 1);
+        }
+        else if (value >= INT16_MIN)
+        {
+            put(0xd1);
+            putNumber(value, 2);
+        }
+        else if (value >= INT32_MIN)
+        {
+            put(0xd2);
+            putNumber(value, 4);
+        }
+        else
+        {
+            put(0xd3);
+            putNumber(value, 8);
+        }
+    }
+
+    void putBool(bool value)
+    {
+        if (encoding == JSON_ENCODING_CBOR)
+        {
+            put(value ? 0xf5 : 0xf4);
+        }
+        else
+        {
+            put(value ? 0xc3 : 0xc2);
+        }
+    }
+
+    void putNull()
+    {
+        put(encoding == JSON_ENCODING_CBOR ? 0xf6 : 0xc0);
+    }
+};
+
+/**
+ * Parses a whole decimal integer, no fraction or exponent
+ */
+static bool parseInteger(const char *text, size_t length, int64_t &value)
+{
+    size_t i = 0;
+    bool negative = false;
+    if (i < length && (text[i] == '-' || text[i] == '+'))
+    {
+        negative = text[i] == '-';
+        i++;
+    }
+    if (i == length || length - i > 18)
+    {
+        return false;
+    }
+
+    int64_t result = 0;
+    for (; i < length; i++)
+    {
+        if (!isDigit(text[i]))
+        {
+            return false;
+        }
+        result = result * 10 + (text[i] - '0');
+    }
+
+    value = negative ? -result : result;
+    return true;
+}
+
+JsonMessage::JsonMessage(const JSON_SCHEMA &schema) : _schema(schema)
+{
+    memset(_values, 0, sizeof(_values));
+    _arenaUsed = 0;
+    _error[0] = '\0';
+}
+
+bool JsonMessage::fail(const char *message, const char *field)
+{
+    if (field)
+    {
+        snprintf(_error, sizeof(_error), "%s: '%s'", message, field);
+    }
+    else
+    {
+        snprintf(_error, sizeof(_error), "%s", message);
+    }
+    return false;
+}
+
+int JsonMessage::findField(const char *name, size_t length)
+{
+    for (int i = 0; i < _schema.fieldCount; i++)
+    {
+        if (strncmp(_schema.fields[i].name, name, length) == 0 && _schema.fields[i].name[length] == '\0')
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Copies text into the arena, NUL terminated
+ */
+const char *JsonMessage::store(const char *text, size_t length)
+{
+    if (_arenaUsed + length + 1 > sizeof(_arena))
+    {
+        return nullptr;
+    }
+
+    char *stored = _arena + _arenaUsed;
+    memmove(stored, text, length);
+    stored[length] = '\0';
+    _arenaUsed += length + 1;
+    return stored;
+}
+
+/**
+ * Checks one value against its field & records it
+ *
+ * @param quoted the value was a JSON string
+ * @param literal 1 for true, 0 for false, -1 otherwise
+ */
+bool JsonMessage::validate(int field, const char *text, size_t length, bool quoted, int literal)
+{
+    const JSON_FIELD &definition = _schema.fields[field];
+    JSON_VALUE &value = _values[field];
+    int64_t number = 0;
+
+    switch (definition.type)
+    {
+        case JSON_FIELD_INT:
+            if (literal >= 0)
+            {
+                number = literal;
+                text = literal ? "1" : "0";
+                length = 1;
+            }
+            else if (!parseInteger(text, length, number))
+            {
+                return fail("Invalid value for field", definition.name);
+            }
+
+            if (number < definition.min || number > definition.max ||
+                (definition.step > 1 && (number - definition.min) % definition.step != 0))
+            {
+                return fail("Value out of range for field", definition.name);
+            }
+            break;
+
+        case JSON_FIELD_BOOL:
+            if (literal >= 0)
+            {
+                number = literal;
+            }
+            else if (length == 1 && (text[0] == '0' || text[0] == '1'))
+            {
+                number = text[0] - '0';
+            }
+            else if (quoted && length == 4 && strncmp(text, "true", 4) == 0)
+            {
+                number = 1;
+            }
+            else if (quoted && length == 5 && strncmp(text, "false", 5) == 0)
+            {
+                number = 0;
+            }
+            else
+            {
+                return fail("Invalid value for field", definition.name);
+            }
+            text = number ? "true" : "false";
+            length = strlen(text);
+            break;
+
+        case JSON_FIELD_ENUM:
+            number = -1;
+            for (int i = 0; quoted && i < definition.choiceCount; i++)
+            {
+                if (strlen(definition.choices[i]) == length && strncmp(definition.choices[i], text, length) == 0)
+                {
+                    number = i;
+                }
+            }
+            if (number < 0)
+            {
+                return fail("Invalid value for field", definition.name);
+            }
+            break;
+
+        case JSON_FIELD_STRING:
+        case JSON_FIELD_RAW:
+            if (literal >= 0)
+            {
+                text = literal ? "true" : "false";
+                length = strlen(text);
+            }
+            break;
+    }
+
+    const char *stored = store(text, length);
+    if (!stored)
+    {
+        return fail("Request body too large", nullptr);
+    }
+
+    value.present = true;
+    value.quoted = quoted;
+    value.number = number;
+    value.text = stored;
+    return true;
+}
+
+/**
+ * Parses & validates a flat JSON object against the schema
+ *
+ * @return false with getError() set when the body is malformed, a value is
+ *         invalid or a required field is missing
+ */
+bool JsonMessage::parse(const char *data, size_t length)
+{
+    memset(_values, 0, sizeof(_values));
+    _arenaUsed = 0;
+    _error[0] = '\0';
+
+    JsonCursor cursor = {data, data + length};
+
+    if (!cursor.consume('{'))
+    {
+        return fail("Request body is not a JSON object", nullptr);
+    }
+
+    bool first = true;
+    while (!cursor.consume('}'))
+    {
+        if (!first && !cursor.consume(','))
+        {
+            return fail("Malformed request body", nullptr);
+        }
+        first = false;
+
+        // Key, matched without decoding: none of ours need escapes
+        if (!cursor.consume('"'))
+        {
+            return fail("Malformed request body", nullptr);
+        }
+        const char *key = cursor.position;
+        if (readString(cursor, nullptr, 0) < 0)
+        {
+            return fail("Malformed request body", nullptr);
+        }
+        int field = findField(key, cursor.position - 1 - key);
+        if (!cursor.consume(':'))
+        {
+            return fail("Malformed request body", nullptr);
+        }
+
+        cursor.skipWhitespace();
+        if (cursor.atEnd())
+        {
+            return fail("Malformed request body", nullptr);
+        }
+
+        JsonToken token;
+        const char *text = cursor.position;
+        int textLength = 0;
+        char c = *cursor.position;
+
+        if (c == '"')
+        {
+            cursor.position++;
+            // Decode into the free end of the arena, validate() moves it into place
+            bool keep = field >= 0;
+            char *out = keep ? _arena + _arenaUsed : nullptr;
+            textLength = readString(cursor, out, sizeof(_arena) - _arenaUsed);
+            if (textLength < 0)
+            {
+                return fail(keep ? "Invalid value for field" : "Malformed request body", keep ? _schema.fields[field].name : nullptr);
+            }
+            text = out;
+            token = JSON_TOKEN_STRING;
+        }
+        else if (c == '-' || isDigit(c))
+        {
+            while (cursor.position < cursor.end && (isDigit(*cursor.position) || strchr("+-.eE", *cursor.position)))
+            {
+                cursor.position++;
+            }
+            textLength = cursor.position - text;
+            token = JSON_TOKEN_NUMBER;
+        }
+        else if (cursor.consumeLiteral("true"))
+        {
+            token = JSON_TOKEN_TRUE;
+        }
+        else if (cursor.consumeLiteral("false"))
+        {
+            token = JSON_TOKEN_FALSE;
+        }
+        else if (cursor.consumeLiteral("null"))
+        {
+            token = JSON_TOKEN_NULL;
+        }
+        else if (c == '{' || c == '[')
+        {
+            cursor.position++;
+            if (!skipContainer(cursor))
+            {
+                return fail("Malformed request body", nullptr);
+            }
+            token = JSON_TOKEN_CONTAINER;
+        }
+        else
+        {
+            return fail("Malformed request body", nullptr);
+        }
+
+        if (field < 0 || token == JSON_TOKEN_NULL)
+        {
+            // Unknown fields are ignored, null counts as absent
+            continue;
+        }
+        if (token == JSON_TOKEN_CONTAINER)
+        {
+            return fail("Invalid value for field", _schema.fields[field].name);
+        }
+
+        int literal = token == JSON_TOKEN_TRUE ? 1 : token == JSON_TOKEN_FALSE ? 0 : -1;
+        if (!validate(field, text ? text : "", textLength, token == JSON_TOKEN_STRING, literal))
+        {
+            return false;
+        }
+    }
+
+    cursor.skipWhitespace();
+    if (!cursor.atEnd())
+    {
+        return fail("Malformed request body", nullptr);
+    }
+
+    for (int i = 0; i < _schema.fieldCount; i++)
+    {
+        if (_schema.fields[i].required && !_values[i].present)
+        {
+            return fail("Missing required field", _schema.fields[i].name);
+        }
+    }
+
+    return true;
+}
+
+const char *JsonMessage::getError()
+{
+    return _error;
+}
+
+bool JsonMessage::has(int field)
+{
+    return _values[field].present;
+}
+
+long JsonMessage::getInt(int field)
+{
+    return (long)_values[field].number;
+}
+
+bool JsonMessage::getBool(int field)
+{
+    return _values[field].number != 0;
+}
+
+int JsonMessage::getChoice(int field)
+{
+    return (int)_values[field].number;
+}
+
+/**
+ * The value as it was sent, or "" when absent. Numbers sent as strings keep their
+ * formatting, e.g. hour "08"; booleans read as "true"/"false", or "1"/"0" for int fields.
+ */
+const char *JsonMessage::getText(int field)
+{
+    return _values[field].present ? _values[field].text : "";
+}
+
+void JsonMessage::set(int field, long long value)
+{
+    _values[field].present = true;
+    _values[field].quoted = false;
+    _values[field].number = value;
+    _values[field].text = nullptr;
+}
+
+void JsonMessage::set(int field, int value)
+{
+    set(field, (long long)value);
+}
+
+void JsonMessage::set(int field, long value)
+{
+    set(field, (long long)value);
+}
+
+void JsonMessage::set(int field, unsigned long value)
+{
+    set(field, (long long)value);
+}
+
+void JsonMessage::set(int field, bool value)
+{
+    set(field, (long long)(value ? 1 : 0));
+}
+
+void JsonMessage::set(int field, const char *value)
+{
+    _values[field].present = true;
+    _values[field].quoted = true;
+    _values[field].number = 0;
+    _values[field].text = value ? value : "";
+}
+
+void JsonMessage::setRaw(int field, const char *json)
+{
+    set(field, json);
+    _values[field].quoted = false;
+}
+
+/**
+ * Writes the fields that are set, in schema order, NUL terminated
+ *
+ * @return length written, 0 if it didn't fit
+ */
+size_t JsonMessage::serialize(char *buffer, size_t size)
+{
+    return serializeJson(buffer, size, JSON_ALL_FIELDS);
+}
+
+/**
+ * Writes the fields that are set & wanted, in schema order. JSON is NUL
+ * terminated; MessagePack & CBOR aren't, use the length.
+ *
+ * @return length written, 0 if it didn't fit or a raw field would go out in binary
+ */
+size_t JsonMessage::serialize(char *buffer, size_t size, const JSON_FORMAT &format)
+{
+    if (format.encoding == JSON_ENCODING_JSON)
+    {
+        return serializeJson(buffer, size, format.fields);
+    }
+    return serializeBinary((uint8_t *)buffer, size, format);
+}
+
+JsonArray::JsonArray(char *buffer, size_t size)
+{
+    _buffer = buffer;
+    _size = size;
+    _length = 0;
+    // Room for [ ] & the terminator
+    _failed = size < 3;
+    if (!_failed)
+    {
+        _buffer[_length++] = '[';
+    }
+}
+
+/**
+ * Appends the message, keeping room to close the array
+ *
+ * @return false if it didn't fit, or an earlier one didn't
+ */
+bool JsonArray::add(JsonMessage &message)
+{
+    if (_failed)
+    {
+        return false;
+    }
+
+    size_t start = _length;
+    if (_length > 1)
+    {
+        _buffer[_length++] = ',';
+    }
+    // The message's terminator lands where ] goes, one more byte is left for the array's
+    size_t written = _length + 2 <= _size ? message.serialize(_buffer + _length, _size - _length - 1) : 0;
+    if (written == 0)
+    {
+        _length = start;
+        _failed = true;
+        return false;
+    }
+    _length += written;
+    return true;
+}
+
+/**
+ * Closes the array
+ *
+ * @return its length, 0 if a message didn't fit
+ */
+size_t JsonArray::finish()
+{
+    if (_failed)
+    {
+        return 0;
+    }
+
+    _buffer[_length++] = ']';
+    _buffer[_length] = '\0';
+    return _length;
+}
+
+/**
+ * Parses a ?fields= list, comma separated field names
+ *
+ * @param fields bit i set for field i
+ * @return false if the list is empty or names a field the schema doesn't have
+ */
+bool JsonMessage::selectFields(const JSON_SCHEMA &schema, const char *names, uint32_t &fields)
+{
+    fields = 0;
+    const char *name = names;
+    while (true)
+    {
+        const char *end = strchr(name, ',');
+        size_t length = end ? (size_t)(end - name) : strlen(name);
+
+        int found = -1;
+        for (int i = 0; i < schema.fieldCount && found < 0; i++)
+        {
+            if (strncmp(schema.fields[i].name, name, length) == 0 && schema.fields[i].name[length] == '\0')
+            {
+                found = i;
+            }
+        }
+        if (found < 0)
+        {
+            return false;
+        }
+        fields |= 1UL << found;
+
+        if (!end)
+        {
+            return true;
+        }
+        name = end + 1;
+    }
+}
+
+size_t JsonMessage::serializeBinary(uint8_t *buffer, size_t size, const JSON_FORMAT &format)
+{
+    BinaryWriter writer = {buffer, size, 0, format.encoding, true};
+
+    size_t count = 0;
+    for (int i = 0; i < _schema.fieldCount; i++)
+    {
+        if (_values[i].present && (format.fields & (1UL << i)))
+        {
+            if (_schema.fields[i].type == JSON_FIELD_RAW)
+            {
+                return 0;
+            }
+            count++;
+        }
+    }
+    writer.putMap(count);
+
+    for (int i = 0; writer.ok && i < _schema.fieldCount; i++)
+    {
+        const JSON_FIELD &definition = _schema.fields[i];
+        const JSON_VALUE &value = _values[i];
+        if (!value.present || !(format.fields & (1UL << i)))
+        {
+            continue;
+        }
+
+        writer.putString(definition.name);
+        switch (definition.type)
+        {
+            case JSON_FIELD_INT:
+                writer.putInt(value.number);
+                break;
+
+            case JSON_FIELD_BOOL:
+                writer.putBool(value.number != 0);
+                break;
+
+            case JSON_FIELD_ENUM:
+                if (value.text)
+                {
+                    writer.putString(value.text);
+                }
+                else if (value.number >= 0 && value.number < definition.choiceCount)
+                {
+                    writer.putString(definition.choices[value.number]);
+                }
+                else
+                {
+                    writer.putNull();
+                }
+                break;
+
+            default:
+                // Strings set from a number stay numbers, as in JSON
+                value.text ? writer.putString(value.text) : writer.putInt(value.number);
+                break;
+        }
+    }
+
+    return writer.ok ? writer.length : 0;
+}
+
+size_t JsonMessage::serializeJson(char *buffer, size_t size, uint32_t fields)
+{
+    size_t length = 0;
+
+    // Appends & bails out once the buffer is full, keeping room for the terminator
+    auto append = [&](const char *text, size_t count) {
+        if (length + count + 1 > size)
+        {
+            length = size;
+            return false;
+        }
+        memcpy(buffer + length, text, count);
+        length += count;
+        return true;
+    };
+
+    auto appendString = [&](const char *text) {
+        if (!append("\"", 1))
+        {
+            return false;
+        }
+        for (const char *c = text; *c; c++)
+        {
+            char escaped[7];
+            size_t count;
+            if (*c == '"' || *c == '\\')
+            {
+                escaped[0] = '\\';
+                escaped[1] = *c;
+                count = 2;
+            }
+            else if ((unsigned char)*c < 0x20)
+            {
+                count = snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+            }
+            else
+            {
+                escaped[0] = *c;
+                count = 1;
+            }
+            if (!append(escaped, count))
+            {
+                return false;
+            }
+        }
+        return append("\"", 1);
+    };
+
+    bool ok = append("{", 1);
+    bool first = true;
+
+    for (int i = 0; ok && i < _schema.fieldCount; i++)
+    {
+        const JSON_FIELD &definition = _schema.fields[i];
+        const JSON_VALUE &value = _values[i];
+        if (!value.present || !(fields & (1UL << i)))
+        {
+            continue;
+        }
+
+        ok = (first || append(",", 1)) && appendString(definition.name) && append(":", 1);
+        first = false;
+        if (!ok)
+        {
+            break;
+        }
+
+        char number[24];
+        switch (definition.type)
+        {
+            case JSON_FIELD_INT:
+                ok = append(number, snprintf(number, sizeof(number), "%lld", (long long)value.number));
+                break;
+
+            case JSON_FIELD_BOOL:
+                ok = value.number ? append("true", 4) : append("false", 5);
+                break;
+
+            case JSON_FIELD_ENUM:
+                if (value.text)
+                {
+                    ok = appendString(value.text);
+                }
+                else
+                {
+                    bool known = value.number >= 0 && value.number < definition.choiceCount;
+                    ok = known ? appendString(definition.choices[value.number]) : append("null", 4);
+                }
+                break;
+
+            case JSON_FIELD_STRING:
+                ok = value.text ? appendString(value.text) : append(number, snprintf(number, sizeof(number), "%lld", (long long)value.number));
+                break;
+
+            case JSON_FIELD_RAW:
+                ok = value.text ? append(value.text, strlen(value.text)) : append("null", 4);
+                break;
+        }
+    }
+
+    if (!ok || !append("}", 1))
+    {
+        if (size > 0)
+        {
+            buffer[0] = '\0';
+        }
+        return 0;
+    }
+
+    buffer[length] = '\0';
+    return length;
+}
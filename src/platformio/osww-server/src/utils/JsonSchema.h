@@ -0,0 +1,205 @@
+#include <Arduino.h>
+#include <limits.h>
+
+#ifndef JsonSchema_H
+#define JsonSchema_H
+
+// Fixed storage per message, sized for the largest API body
+#define JSON_MAX_FIELDS 20
+#define JSON_ARENA_SIZE 320
+#define JSON_ERROR_SIZE 64
+// serialize() can leave fields out, one bit per field
+#define JSON_ALL_FIELDS 0xFFFFFFFFUL
+
+enum JsonFieldType
+{
+    JSON_FIELD_INT,    // number, or a numeric string ("330"); true/false count as 1/0
+    JSON_FIELD_BOOL,   // true/false, or 0/1
+    JSON_FIELD_ENUM,   // string, one of `choices`
+    JSON_FIELD_STRING, // any string
+    JSON_FIELD_RAW     // response only: already serialized JSON, written as is
+};
+
+/**
+ * One field of a request or response body. Declare schemas as constexpr tables
+ * of these; the order of the table is the order fields are serialized in.
+ */
+struct JSON_FIELD
+{
+    const char *name;
+    JsonFieldType type;
+    bool required;
+    long min;  // JSON_FIELD_INT, inclusive
+    long max;  // JSON_FIELD_INT, inclusive
+    long step; // JSON_FIELD_INT, value - min must be a multiple of it
+    const char *const *choices;
+    uint8_t choiceCount;
+};
+
+struct JSON_SCHEMA
+{
+    const JSON_FIELD *fields;
+    uint8_t fieldCount;
+};
+
+enum JsonEncoding
+{
+    JSON_ENCODING_JSON,
+    JSON_ENCODING_MSGPACK, // MessagePack
+    JSON_ENCODING_CBOR     // RFC 8949
+};
+
+// In JsonEncoding order
+static constexpr const char *jsonEncodingContentTypes[] = {"application/json", "application/msgpack", "application/cbor"};
+
+/**
+ * How a response is written: the encoding & the fields wanted, bit i for field i
+ */
+struct JSON_FORMAT
+{
+    JsonEncoding encoding;
+    uint32_t fields;
+};
+
+static constexpr JSON_FORMAT jsonFormat = {JSON_ENCODING_JSON, JSON_ALL_FIELDS};
+
+// Builders for constexpr field tables. Fields are required unless wrapped in jsonOptional()
+constexpr JSON_FIELD jsonInt(const char *name, long min = LONG_MIN, long max = LONG_MAX, long step = 1)
+{
+    return {name, JSON_FIELD_INT, true, min, max, step, nullptr, 0};
+}
+
+constexpr JSON_FIELD jsonBool(const char *name)
+{
+    return {name, JSON_FIELD_BOOL, true, 0, 1, 1, nullptr, 0};
+}
+
+template <size_t N>
+constexpr JSON_FIELD jsonEnum(const char *name, const char *const (&choices)[N])
+{
+    return {name, JSON_FIELD_ENUM, true, 0, (long)N - 1, 1, choices, (uint8_t)N};
+}
+
+constexpr JSON_FIELD jsonString(const char *name)
+{
+    return {name, JSON_FIELD_STRING, true, 0, 0, 1, nullptr, 0};
+}
+
+constexpr JSON_FIELD jsonRaw(const char *name)
+{
+    return {name, JSON_FIELD_RAW, false, 0, 0, 1, nullptr, 0};
+}
+
+constexpr JSON_FIELD jsonOptional(JSON_FIELD field)
+{
+    return {field.name, field.type, false, field.min, field.max, field.step, field.choices, field.choiceCount};
+}
+
+template <size_t N>
+constexpr JSON_SCHEMA jsonSchema(const JSON_FIELD (&fields)[N])
+{
+    static_assert(N <= JSON_MAX_FIELDS, "Raise JSON_MAX_FIELDS");
+    return {fields, (uint8_t)N};
+}
+
+struct JSON_VALUE
+{
+    bool present;
+    bool quoted;      // text came from (or goes out as) a JSON string
+    int64_t number;   // JSON_FIELD_INT & JSON_FIELD_BOOL, index into choices for JSON_FIELD_ENUM
+    const char *text; // in the arena when parsed, caller owned when set()
+};
+
+/**
+ * A flat JSON object described by a JSON_SCHEMA, parsed, validated and
+ * serialized without touching the heap. Lives on the stack of a handler.
+ *
+ * parse() copies the text of every known field into the message's arena, so
+ * getText() stays valid as long as the message does. Unknown fields are skipped.
+ *
+ * Strings passed to set() are not copied and must outlive serialize().
+ *
+ * Responses can also be written as MessagePack or CBOR: the same map, field
+ * names & values, in binary. Raw fields are JSON already & can't be.
+ */
+class JsonMessage
+{
+private:
+    const JSON_SCHEMA &_schema;
+    JSON_VALUE _values[JSON_MAX_FIELDS];
+    char _arena[JSON_ARENA_SIZE];
+    size_t _arenaUsed;
+    char _error[JSON_ERROR_SIZE];
+
+    bool fail(const char *message, const char *field);
+
+    int findField(const char *name, size_t length);
+
+    const char *store(const char *text, size_t length);
+
+    bool validate(int field, const char *text, size_t length, bool quoted, int literal);
+
+    size_t serializeJson(char *buffer, size_t size, uint32_t fields);
+
+    size_t serializeBinary(uint8_t *buffer, size_t size, const JSON_FORMAT &format);
+
+public:
+    JsonMessage(const JSON_SCHEMA &schema);
+
+    bool parse(const char *data, size_t length);
+
+    const char *getError();
+
+    bool has(int field);
+
+    long getInt(int field);
+
+    bool getBool(int field);
+
+    int getChoice(int field);
+
+    const char *getText(int field);
+
+    void set(int field, long long value);
+
+    void set(int field, int value);
+
+    void set(int field, long value);
+
+    void set(int field, unsigned long value);
+
+    void set(int field, bool value);
+
+    void set(int field, const char *value);
+
+    void setRaw(int field, const char *json);
+
+    size_t serialize(char *buffer, size_t size);
+
+    size_t serialize(char *buffer, size_t size, const JSON_FORMAT &format);
+
+    static bool selectFields(const JSON_SCHEMA &schema, const char *names, uint32_t &fields);
+};
+
+/**
+ * Gathers serialized messages into a JSON array, for a raw field. The first
+ * message that doesn't fit fails the whole array, rather than leaving it
+ * malformed or silently short.
+ */
+class JsonArray
+{
+private:
+    char *_buffer;
+    size_t _size;
+    size_t _length;
+    bool _failed;
+
+public:
+    JsonArray(char *buffer, size_t size);
+
+    bool add(JsonMessage &message);
+
+    size_t finish();
+};
+
+#endif
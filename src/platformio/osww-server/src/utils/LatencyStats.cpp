@@ -0,0 +1,38 @@
+#include "LatencyStats.h"
+
+LatencyStats::LatencyStats()
+{
+    _count = 0;
+    _lastUs = 0;
+    _maxUs = 0;
+    _totalUs = 0;
+}
+
+void LatencyStats::record(uint32_t us)
+{
+    _lastUs = us;
+    _maxUs = max((uint32_t)_maxUs, us);
+    _totalUs = _totalUs + us;
+    _count = _count + 1;
+}
+
+uint32_t LatencyStats::getCount()
+{
+    return _count;
+}
+
+uint32_t LatencyStats::getLastUs()
+{
+    return _lastUs;
+}
+
+uint32_t LatencyStats::getMaxUs()
+{
+    return _maxUs;
+}
+
+uint32_t LatencyStats::getAverageUs()
+{
+    uint32_t count = _count;
+    return count > 0 ? (uint32_t)(_totalUs / count) : 0;
+}
@@ -0,0 +1,32 @@
+#include <Arduino.h>
+
+#ifndef LatencyStats_H
+#define LatencyStats_H
+
+/**
+ * Count, last, average & worst of a latency, in µs. Recorded from one task,
+ * read from any; a reader may see one sample half applied.
+ */
+class LatencyStats
+{
+private:
+    volatile uint32_t _count;
+    volatile uint32_t _lastUs;
+    volatile uint32_t _maxUs;
+    volatile uint64_t _totalUs;
+
+public:
+    LatencyStats();
+
+    void record(uint32_t us);
+
+    uint32_t getCount();
+
+    uint32_t getLastUs();
+
+    uint32_t getMaxUs();
+
+    uint32_t getAverageUs();
+};
+
+#endif
@@ -1,5 +1,7 @@
 #include "LedControl.h"
 
+#include "Logger.h"
+
 LedControl::LedControl(int ledChannel)
 {
     _ledChannel = ledChannel;
@@ -26,7 +28,7 @@ void LedControl::pwm()
 void LedControl::slowBlink()
 {
     // Slow blink to confirm success & restart
-    Serial.println("[STATUS] - slow blink");
+    Log.status(LOG_LED, "slow blink");
 
     for (int dutyCycle = 0; dutyCycle <= 3; dutyCycle++)
     {
@@ -48,7 +50,7 @@ void LedControl::slowBlink()
 void LedControl::fastBlink()
 {
     // Fast blink to confirm resetting
-    Serial.println("[STATUS] - fast blink");
+    Log.status(LOG_LED, "fast blink");
     for (int i = 0; i < 12; i++)
     {
 
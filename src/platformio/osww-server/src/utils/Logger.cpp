@@ -0,0 +1,403 @@
+#include "Logger.h"
+
+#include "ApiSchema.h"
+
+// In LogLevel order
+static const char *levelPrefixes[] = {"[ERROR]", "[WARN]", "[STATUS]", "[DEBUG]"};
+
+static_assert((LOG_RING_SLOTS & (LOG_RING_SLOTS - 1)) == 0, "LOG_RING_SLOTS must be a power of two");
+static_assert(sizeof(logModuleChoices) / sizeof(logModuleChoices[0]) == LOG_MODULE_COUNT, "logModuleChoices out of sync");
+
+Logger Log;
+
+Logger::Logger()
+{
+    _head = 0;
+    _tail = 0;
+    _dropped = 0;
+    _drainMutex = NULL;
+    _running = false;
+
+    for (int i = 0; i < LOG_RING_SLOTS; i++)
+    {
+        _ring[i].sequence = 0;
+    }
+    for (int i = 0; i < LOG_MODULE_COUNT; i++)
+    {
+        _levels[i] = LOG_LEVEL_STATUS;
+    }
+}
+
+/**
+ * Starts the task that writes records to Serial. Call once, early in setup().
+ */
+void Logger::begin()
+{
+    if (_running)
+    {
+        return;
+    }
+
+    _drainMutex = xSemaphoreCreateMutex();
+    _running = xTaskCreate(drainTask, "logger", LOG_DRAIN_STACK_SIZE, this, 1, NULL) == pdPASS;
+}
+
+void Logger::drainTask(void *parameters)
+{
+    Logger *logger = (Logger *)parameters;
+    for (;;)
+    {
+        vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+        logger->drain();
+    }
+}
+
+void Logger::pack(LOG_ENTRY &entry, LogArgType type, const void *value, size_t size)
+{
+    if (entry.argCount >= LOG_MAX_ARGS || entry.argBytes + size > LOG_ARG_BYTES)
+    {
+        return;
+    }
+
+    entry.types[entry.argCount++] = type;
+    memcpy(entry.args + entry.argBytes, value, size);
+    entry.argBytes += size;
+}
+
+void Logger::packArg(LOG_ENTRY &entry, const char *value)
+{
+    if (value == NULL)
+    {
+        value = "(null)";
+    }
+
+    // Whatever fits, always terminated
+    size_t room = LOG_ARG_BYTES - entry.argBytes;
+    if (entry.argCount >= LOG_MAX_ARGS || room == 0)
+    {
+        return;
+    }
+
+    size_t length = strnlen(value, room - 1);
+    entry.types[entry.argCount++] = LOG_ARG_STRING;
+    memcpy(entry.args + entry.argBytes, value, length);
+    entry.args[entry.argBytes + length] = '\0';
+    entry.argBytes += length + 1;
+}
+
+void Logger::packArg(LOG_ENTRY &entry, char *value)
+{
+    packArg(entry, (const char *)value);
+}
+
+void Logger::packArg(LOG_ENTRY &entry, const String &value)
+{
+    packArg(entry, value.c_str());
+}
+
+void Logger::packArg(LOG_ENTRY &entry, double value)
+{
+    pack(entry, LOG_ARG_DOUBLE, &value, sizeof(value));
+}
+
+/**
+ * Claims the next slot & publishes the entry in it. Safe from any task.
+ */
+void Logger::commit(const LOG_ENTRY &entry)
+{
+    uint32_t index = _head.fetch_add(1);
+    LOG_SLOT &slot = _ring[index & (LOG_RING_SLOTS - 1)];
+
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.entry = entry;
+    slot.sequence.store(index + 1, std::memory_order_release);
+
+    if (!_running)
+    {
+        drain();
+    }
+}
+
+/**
+ * Copies out the record with the given index, if it is still in the ring & complete
+ */
+bool Logger::read(uint32_t index, LOG_ENTRY &entry)
+{
+    LOG_SLOT &slot = _ring[index & (LOG_RING_SLOTS - 1)];
+
+    uint32_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before != index + 1)
+    {
+        return false;
+    }
+    entry = slot.entry;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == before;
+}
+
+/**
+ * Index the next record will get
+ */
+uint32_t Logger::getHead()
+{
+    return _head.load(std::memory_order_acquire);
+}
+
+/**
+ * Writes every published record to Serial. Records overwritten before they
+ * were printed are counted & reported instead.
+ */
+void Logger::drain()
+{
+    if (_drainMutex != NULL)
+    {
+        xSemaphoreTake(_drainMutex, portMAX_DELAY);
+    }
+
+    uint32_t head = getHead();
+    if (head - _tail > LOG_RING_SLOTS)
+    {
+        _dropped += head - _tail - LOG_RING_SLOTS;
+        _tail = head - LOG_RING_SLOTS;
+    }
+
+    while (_tail != head)
+    {
+        LOG_ENTRY entry;
+        if (read(_tail, entry))
+        {
+            if (_dropped > 0)
+            {
+                Serial.printf("[WARN] - Logger fell behind, %u records dropped\n", (unsigned)_dropped);
+                _dropped = 0;
+            }
+            print(entry);
+        }
+        else if (_ring[_tail & (LOG_RING_SLOTS - 1)].sequence.load(std::memory_order_acquire) < _tail + 1 && getHead() - _tail <= LOG_RING_SLOTS)
+        {
+            // Claimed but still being written, next time
+            break;
+        }
+        else
+        {
+            // Overwritten meanwhile
+            _dropped++;
+        }
+        _tail++;
+    }
+
+    if (_drainMutex != NULL)
+    {
+        xSemaphoreGive(_drainMutex);
+    }
+}
+
+/**
+ * Prints everything now, e.g. right before a restart
+ */
+void Logger::flush()
+{
+    drain();
+    Serial.flush();
+}
+
+void Logger::print(const LOG_ENTRY &entry)
+{
+    char line[LOG_LINE_SIZE];
+    format(entry, line, sizeof(line));
+    Serial.printf("%s - %s\n", levelPrefixes[entry.level], line);
+}
+
+/**
+ * Formats the entry's message, printf style
+ *
+ * @return length written, without the terminator
+ */
+size_t Logger::format(const LOG_ENTRY &entry, char *buffer, size_t size)
+{
+    size_t length = 0;
+    uint8_t argIndex = 0;
+    size_t argOffset = 0;
+    const char *c = entry.format;
+
+    while (*c && length + 1 < size)
+    {
+        if (*c != '%')
+        {
+            buffer[length++] = *c++;
+            continue;
+        }
+        if (c[1] == '%')
+        {
+            buffer[length++] = '%';
+            c += 2;
+            continue;
+        }
+
+        // Flags, width & precision are kept; length modifiers are replaced to suit the stored argument
+        char spec[16];
+        size_t specLength = 0;
+        spec[specLength++] = *c++;
+        while (*c && strchr("-+ #0123456789.", *c) && specLength < sizeof(spec) - 4)
+        {
+            spec[specLength++] = *c++;
+        }
+        while (*c && strchr("hlLqjzt", *c))
+        {
+            c++;
+        }
+        char conversion = *c;
+        if (conversion == '\0')
+        {
+            break;
+        }
+        c++;
+
+        if (argIndex >= entry.argCount)
+        {
+            buffer[length++] = '?';
+            continue;
+        }
+
+        uint8_t type = entry.types[argIndex++];
+        const uint8_t *arg = entry.args + argOffset;
+        long long integer = 0;
+        double real = 0;
+        const char *text = "";
+        const void *pointer = NULL;
+
+        switch (type)
+        {
+            case LOG_ARG_INT32: { int32_t v; memcpy(&v, arg, sizeof(v)); integer = v; argOffset += sizeof(v); break; }
+            case LOG_ARG_UINT32: { uint32_t v; memcpy(&v, arg, sizeof(v)); integer = v; argOffset += sizeof(v); break; }
+            case LOG_ARG_INT64: { int64_t v; memcpy(&v, arg, sizeof(v)); integer = v; argOffset += sizeof(v); break; }
+            case LOG_ARG_UINT64: { uint64_t v; memcpy(&v, arg, sizeof(v)); integer = (long long)v; argOffset += sizeof(v); break; }
+            case LOG_ARG_DOUBLE: { memcpy(&real, arg, sizeof(real)); integer = (long long)real; argOffset += sizeof(real); break; }
+            case LOG_ARG_STRING: { text = (const char *)arg; argOffset += strlen(text) + 1; break; }
+            case LOG_ARG_POINTER: { memcpy(&pointer, arg, sizeof(pointer)); argOffset += sizeof(pointer); break; }
+        }
+        if (type != LOG_ARG_DOUBLE)
+        {
+            real = (double)integer;
+        }
+
+        int written = 0;
+        size_t room = size - length;
+        switch (conversion)
+        {
+            case 'd':
+            case 'i':
+                strcpy(spec + specLength, "lld");
+                written = snprintf(buffer + length, room, spec, integer);
+                break;
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                spec[specLength] = 'l';
+                spec[specLength + 1] = 'l';
+                spec[specLength + 2] = conversion;
+                spec[specLength + 3] = '\0';
+                written = snprintf(buffer + length, room, spec, (unsigned long long)integer);
+                break;
+            case 'c':
+                strcpy(spec + specLength, "c");
+                written = snprintf(buffer + length, room, spec, (int)integer);
+                break;
+            case 's':
+                strcpy(spec + specLength, "s");
+                written = snprintf(buffer + length, room, spec, type == LOG_ARG_STRING ? text : "?");
+                break;
+            case 'p':
+                strcpy(spec + specLength, "p");
+                written = snprintf(buffer + length, room, spec, pointer);
+                break;
+            default:
+                spec[specLength] = conversion;
+                spec[specLength + 1] = '\0';
+                written = snprintf(buffer + length, room, spec, real);
+                break;
+        }
+        if (written > 0)
+        {
+            length += min((size_t)written, room - 1);
+        }
+    }
+
+    buffer[length] = '\0';
+    return length;
+}
+
+void Logger::setLevel(LogModule module, LogLevel level)
+{
+    if (module < LOG_MODULE_COUNT)
+    {
+        _levels[module] = level;
+    }
+}
+
+LogLevel Logger::getLevel(LogModule module)
+{
+    return module < LOG_MODULE_COUNT ? (LogLevel)_levels[module] : LOG_LEVEL_STATUS;
+}
+
+/**
+ * @param limit records at most, the newest ones
+ * @param maxLevel leaves out the records below it, e.g. LOG_LEVEL_WARN for warnings & errors only
+ */
+LogTail::LogTail(Logger &logger, uint32_t limit, LogLevel maxLevel) : _logger(logger)
+{
+    _end = logger.getHead();
+    limit = min(limit, (uint32_t)LOG_RING_SLOTS);
+    _next = _end > limit ? _end - limit : 0;
+    _maxLevel = maxLevel;
+    _lineLength = 0;
+    _lineOffset = 0;
+}
+
+/**
+ * Puts the next record in _line as "<ms> <level> <module>: <message>"
+ *
+ * @return false once the tail is complete
+ */
+bool LogTail::produce()
+{
+    while (_next != _end)
+    {
+        LOG_ENTRY entry;
+        if (_logger.read(_next++, entry) && entry.level <= _maxLevel)
+        {
+            _lineOffset = 0;
+            _lineLength = snprintf(_line, sizeof(_line), "%10u %-6s %-7s ", (unsigned)entry.ms, logLevelChoices[entry.level], logModuleChoices[entry.module]);
+            _lineLength = min(_lineLength, sizeof(_line) - 1);
+            _lineLength += Logger::format(entry, _line + _lineLength, sizeof(_line) - _lineLength - 1);
+            _line[_lineLength++] = '\n';
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * AwsResponseFiller for beginChunkedResponse()
+ *
+ * @return bytes written, 0 at the end of the tail
+ */
+size_t LogTail::fill(uint8_t *buffer, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen)
+    {
+        if (_lineOffset == _lineLength && !produce())
+        {
+            break;
+        }
+
+        size_t count = min(_lineLength - _lineOffset, maxLen - written);
+        memcpy(buffer + written, _line + _lineOffset, count);
+        _lineOffset += count;
+        written += count;
+    }
+    return written;
+}
@@ -0,0 +1,252 @@
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+
+#ifndef Logger_H
+#define Logger_H
+
+// Records kept, a power of two. The oldest are overwritten when the UART falls behind.
+#define LOG_RING_SLOTS 128
+#define LOG_MAX_ARGS 6
+#define LOG_ARG_BYTES 40
+#define LOG_LINE_SIZE 192
+#define LOG_TAIL_DEFAULT 50
+#define LOG_DRAIN_INTERVAL_MS 50
+#define LOG_DRAIN_STACK_SIZE 3072
+
+// In logLevelChoices order, see ApiSchema.h
+enum LogLevel
+{
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_STATUS,
+    LOG_LEVEL_DEBUG
+};
+
+// In logModuleChoices order, see ApiSchema.h
+enum LogModule
+{
+    LOG_MAIN,
+    LOG_MOTOR,
+    LOG_WINDER,
+    LOG_LED,
+    LOG_SLEEP,
+    LOG_WIFI,
+    LOG_STARTUP,
+    LOG_STATE,
+    LOG_HISTORY,
+    LOG_OTA,
+    LOG_GROUP,
+    LOG_MODULE_COUNT
+};
+
+enum LogArgType
+{
+    LOG_ARG_INT32,
+    LOG_ARG_UINT32,
+    LOG_ARG_INT64,
+    LOG_ARG_UINT64,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING,
+    LOG_ARG_POINTER
+};
+
+/**
+ * One log call, unformatted: the format string & its arguments in binary.
+ * Strings are copied in (truncated to fit), everything else by value.
+ */
+struct LOG_ENTRY
+{
+    uint32_t ms;
+    const char *format;
+    uint8_t level;
+    uint8_t module;
+    uint8_t argCount;
+    uint8_t argBytes;
+    uint8_t types[LOG_MAX_ARGS];
+    uint8_t args[LOG_ARG_BYTES];
+};
+
+struct LOG_SLOT
+{
+    std::atomic<uint32_t> sequence; // index + 1 once written, 0 while being written
+    LOG_ENTRY entry;
+};
+
+/**
+ * Leveled logger that keeps printing off the caller's path. A log call checks
+ * its module's level, then copies the format pointer & arguments into a ring
+ * slot: no formatting, no locks, no waiting for the UART. A low priority task
+ * formats the records & writes them to Serial; /api/logs reads the ring too.
+ *
+ * The format must be a string literal, it is kept by pointer & formatted later.
+ * printf conversions are supported, without `*` widths.
+ *
+ * Until begin() starts the task, e.g. on the host tools, each call prints
+ * straight away.
+ */
+class Logger
+{
+private:
+    LOG_SLOT _ring[LOG_RING_SLOTS];
+    std::atomic<uint32_t> _head;
+    uint32_t _tail;
+    uint32_t _dropped;
+    uint8_t _levels[LOG_MODULE_COUNT];
+    SemaphoreHandle_t _drainMutex;
+    volatile bool _running;
+
+    static void drainTask(void *parameters);
+
+    void commit(const LOG_ENTRY &entry);
+
+    void print(const LOG_ENTRY &entry);
+
+    static void pack(LOG_ENTRY &entry, LogArgType type, const void *value, size_t size);
+
+    static void packArg(LOG_ENTRY &entry, const char *value);
+
+    static void packArg(LOG_ENTRY &entry, char *value);
+
+    static void packArg(LOG_ENTRY &entry, const String &value);
+
+    static void packArg(LOG_ENTRY &entry, double value);
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type packArg(LOG_ENTRY &entry, T value)
+    {
+        if (std::is_signed<T>::value || std::is_enum<T>::value)
+        {
+            int64_t wide = (int64_t)value;
+            if (sizeof(T) <= 4)
+            {
+                int32_t narrow = (int32_t)wide;
+                pack(entry, LOG_ARG_INT32, &narrow, sizeof(narrow));
+            }
+            else
+            {
+                pack(entry, LOG_ARG_INT64, &wide, sizeof(wide));
+            }
+        }
+        else
+        {
+            uint64_t wide = (uint64_t)value;
+            if (sizeof(T) <= 4)
+            {
+                uint32_t narrow = (uint32_t)wide;
+                pack(entry, LOG_ARG_UINT32, &narrow, sizeof(narrow));
+            }
+            else
+            {
+                pack(entry, LOG_ARG_UINT64, &wide, sizeof(wide));
+            }
+        }
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type packArg(LOG_ENTRY &entry, T value)
+    {
+        packArg(entry, (double)value);
+    }
+
+    template <typename T>
+    static void packArg(LOG_ENTRY &entry, T *value)
+    {
+        const void *pointer = value;
+        pack(entry, LOG_ARG_POINTER, &pointer, sizeof(pointer));
+    }
+
+public:
+    Logger();
+
+    void begin();
+
+    void drain();
+
+    void flush();
+
+    bool isEnabled(LogLevel level, LogModule module)
+    {
+        return module < LOG_MODULE_COUNT && level <= _levels[module];
+    }
+
+    void setLevel(LogModule module, LogLevel level);
+
+    LogLevel getLevel(LogModule module);
+
+    uint32_t getHead();
+
+    bool read(uint32_t index, LOG_ENTRY &entry);
+
+    static size_t format(const LOG_ENTRY &entry, char *buffer, size_t size);
+
+    template <typename... Args>
+    void log(LogLevel level, LogModule module, const char *format, const Args &...args)
+    {
+        if (!isEnabled(level, module))
+        {
+            return;
+        }
+
+        LOG_ENTRY entry;
+        entry.ms = millis();
+        entry.format = format;
+        entry.level = level;
+        entry.module = module;
+        entry.argCount = 0;
+        entry.argBytes = 0;
+        int expand[] = {0, (packArg(entry, args), 0)...};
+        (void)expand;
+        commit(entry);
+    }
+
+    template <typename... Args>
+    void error(LogModule module, const char *format, const Args &...args)
+    {
+        log(LOG_LEVEL_ERROR, module, format, args...);
+    }
+
+    template <typename... Args>
+    void warn(LogModule module, const char *format, const Args &...args)
+    {
+        log(LOG_LEVEL_WARN, module, format, args...);
+    }
+
+    template <typename... Args>
+    void status(LogModule module, const char *format, const Args &...args)
+    {
+        log(LOG_LEVEL_STATUS, module, format, args...);
+    }
+
+    template <typename... Args>
+    void debug(LogModule module, const char *format, const Args &...args)
+    {
+        log(LOG_LEVEL_DEBUG, module, format, args...);
+    }
+};
+
+extern Logger Log;
+
+/**
+ * The last records of the ring as text, a line at a time for a chunked response
+ */
+class LogTail
+{
+private:
+    Logger &_logger;
+    uint32_t _next;
+    uint32_t _end;
+    LogLevel _maxLevel;
+    char _line[LOG_LINE_SIZE];
+    size_t _lineLength;
+    size_t _lineOffset;
+
+    bool produce();
+
+public:
+    LogTail(Logger &logger, uint32_t limit, LogLevel maxLevel);
+
+    size_t fill(uint8_t *buffer, size_t maxLen);
+};
+
+#endif
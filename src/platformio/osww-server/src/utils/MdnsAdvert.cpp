@@ -0,0 +1,91 @@
+#include "MdnsAdvert.h"
+
+#include "ApiSchema.h"
+#include "Logger.h"
+
+static_assert(sizeof(mdnsTxtKeys) / sizeof(mdnsTxtKeys[0]) == MDNS_TXT_COUNT, "mdnsTxtKeys out of sync");
+
+MdnsAdvert::MdnsAdvert()
+{
+    _service = NULL;
+    _proto = NULL;
+    memset(_values, 0, sizeof(_values));
+    _started = false;
+    _changed = false;
+    _announced = false;
+    _announcedMs = 0;
+    _announcements = 0;
+    _changes = 0;
+    set(MDNS_TXT_TXTVERS, "1");
+}
+
+/**
+ * Call once the service is added to the responder; the record goes out with the next update()
+ */
+void MdnsAdvert::begin(const char *service, const char *proto)
+{
+    _service = service;
+    _proto = proto;
+    _started = true;
+}
+
+/**
+ * @param value cut to MDNS_TXT_VALUE_SIZE - 1 characters, empty leaves the key out
+ */
+void MdnsAdvert::set(MdnsTxtKey key, const char *value)
+{
+    char next[MDNS_TXT_VALUE_SIZE];
+    snprintf(next, sizeof(next), "%s", value);
+    if (strcmp(next, _values[key]) == 0)
+    {
+        return;
+    }
+
+    strcpy(_values[key], next);
+    _changed = true;
+    _changes++;
+}
+
+void MdnsAdvert::set(MdnsTxtKey key, unsigned long value)
+{
+    char text[MDNS_TXT_VALUE_SIZE];
+    snprintf(text, sizeof(text), "%lu", value);
+    set(key, text);
+}
+
+/**
+ * Announces the record if it changed & the last announcement is long enough ago
+ */
+void MdnsAdvert::update(unsigned long now)
+{
+    if (!_started || !_changed || (_announced && now - _announcedMs < MDNS_ADVERT_MIN_INTERVAL_MS))
+    {
+        return;
+    }
+
+    mdns_txt_item_t items[MDNS_TXT_COUNT];
+    uint8_t count = 0;
+    for (int key = 0; key < MDNS_TXT_COUNT; key++)
+    {
+        if (_values[key][0] != '\0')
+        {
+            items[count].key = mdnsTxtKeys[key];
+            items[count].value = _values[key];
+            count++;
+        }
+    }
+
+    // A failure is retried once the interval is over again
+    _announced = true;
+    _announcedMs = now;
+    if (mdns_service_txt_set(_service, _proto, items, count) != ESP_OK)
+    {
+        Log.warn(LOG_WIFI, "Failed to update the mDNS TXT record");
+        return;
+    }
+
+    _changed = false;
+    _announcements++;
+    Log.debug(LOG_WIFI, "mDNS TXT record announced, state %s; %lu announcements for %lu changes", _values[MDNS_TXT_STATE_VERSION], _announcements, _changes);
+}
+
@@ -0,0 +1,64 @@
+#include <Arduino.h>
+#include <mdns.h>
+
+#ifndef MdnsAdvert_H
+#define MdnsAdvert_H
+
+// RFC 6762 sends a record at most once a second; changes in between are coalesced
+#define MDNS_ADVERT_MIN_INTERVAL_MS 2000
+// Longest value, with its terminator; keys & values share one 255 byte TXT string each
+#define MDNS_TXT_VALUE_SIZE 32
+
+/**
+ * The entries of the TXT record, named by ApiSchema.h's mdnsTxtKeys
+ */
+enum MdnsTxtKey
+{
+    MDNS_TXT_TXTVERS,       // version of this list, "1"
+    MDNS_TXT_FIRMWARE,      // winderooVersion
+    MDNS_TXT_STATUS,        // as in /api/status
+    MDNS_TXT_TPD,           // turns per day
+    MDNS_TXT_DIRECTION,     // CW, CCW or BOTH
+    MDNS_TXT_TIMER,         // HH:MM, or off
+    MDNS_TXT_ETA,           // epoch the session ends at, 0 when idle
+    MDNS_TXT_STATE_VERSION, // StateStore::getVersion(), to tell a stale record
+    MDNS_TXT_GROUP,         // group name with GROUP_ENABLED, left out otherwise
+    MDNS_TXT_COUNT
+};
+
+/**
+ * Keeps the TXT record of the _winderoo._tcp service in step with the winder,
+ * so one browse shows what the whole fleet is doing without a request to each.
+ *
+ * set() only marks the record changed when a value actually differs. update()
+ * then sends the whole record as one announcement, no more often than
+ * MDNS_ADVERT_MIN_INTERVAL_MS; a burst of changes goes out as the last of them.
+ *
+ * begin() may be called from a startup task, everything else from the loop task.
+ */
+class MdnsAdvert
+{
+private:
+    const char *_service;
+    const char *_proto;
+    char _values[MDNS_TXT_COUNT][MDNS_TXT_VALUE_SIZE];
+    volatile bool _started;
+    bool _changed;
+    bool _announced;
+    unsigned long _announcedMs;
+    unsigned long _announcements; // since boot
+    unsigned long _changes;       // values set since boot, most coalesced away
+
+public:
+    MdnsAdvert();
+
+    void begin(const char *service, const char *proto);
+
+    void set(MdnsTxtKey key, const char *value);
+
+    void set(MdnsTxtKey key, unsigned long value);
+
+    void update(unsigned long now);
+};
+
+#endif
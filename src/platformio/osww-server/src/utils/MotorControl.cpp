@@ -1,54 +1,49 @@
 #include "MotorControl.h"
 
-#if PWM_MOTOR_CONTROL
-	#include <ESP32MX1508.h>
-	#define CH1 1
-	#define CH2 2
-    int motorSpeed = 145;
-#endif
-
-MotorControl::MotorControl(int pinA, int pinB, bool pwmMotorControl)
+#include "Logger.h"
+#include "Tracer.h"
+
+MotorControl::MotorControl(MotorDriver &driver) : _driver(driver)
 {
-    _pinA = pinA;
-    _pinB = pinB;
     _motorDirection = 0;
-    _pwmMotorControl = pwmMotorControl;
+    _driven = 0;
+    _drivenSinceMs = 0;
+    _drivenSinceMicros = 0;
+}
+
+/**
+ * Notes when the motor starts, stops or reverses; repeated writes of the same state aren't a change
+ */
+void MotorControl::setDriven(int driven)
+{
+    if (driven != _driven)
+    {
+        _drivenSinceMs = millis();
+        _drivenSinceMicros = micros();
+        _driven = driven;
+        TRACE_INSTANT(driven > 0 ? "motor clockwise" : driven < 0 ? "motor counter-clockwise" : "motor stop");
+    }
 }
 
 void MotorControl::clockwise()
 {
-    #if PWM_MOTOR_CONTROL
-        MX1508 pwmControl(_pinA, _pinB, CH1, CH2);
-        pwmControl.motorGo(motorSpeed);
-    #else
-        digitalWrite(_pinA, HIGH);
-        digitalWrite(_pinB, LOW);
-    #endif
-    Serial.println("[STATUS] - Motor turning clockwise");
+    _driver.drive(1);
+    setDriven(1);
+    Log.debug(LOG_MOTOR, "Motor turning clockwise");
 }
 
 void MotorControl::countClockwise()
 {
-    #if PWM_MOTOR_CONTROL
-        MX1508 pwmControl(_pinA, _pinB, CH1, CH2);
-        pwmControl.motorRev(motorSpeed);
-    #else
-        digitalWrite(_pinA, LOW);
-        digitalWrite(_pinB, HIGH);
-    #endif
-    Serial.println("[STATUS] - Motor turning counter clockwise");
+    _driver.drive(-1);
+    setDriven(-1);
+    Log.debug(LOG_MOTOR, "Motor turning counter clockwise");
 }
 
 void MotorControl::stop()
 {
-    #if PWM_MOTOR_CONTROL
-        MX1508 pwmControl(_pinA, _pinB, CH1, CH2);
-        pwmControl.motorBrake();
-    #else
-        digitalWrite(_pinA, LOW);
-        digitalWrite(_pinB, LOW);
-    #endif
-    Serial.println("[STATUS] - Motor stopped");
+    _driver.drive(0);
+    setDriven(0);
+    Log.debug(LOG_MOTOR, "Motor stopped");
 }
 
 void MotorControl::determineMotorDirectionAndBegin()
@@ -66,6 +61,41 @@ void MotorControl::determineMotorDirectionAndBegin()
     }
 }
 
+/**
+ * Whether the driver counts turns, so move() can be used
+ */
+bool MotorControl::countsTurns()
+{
+    return _driver.countsTurns();
+}
+
+/**
+ * Turns exactly `turns` in the current direction, then stops on its own. Only when countsTurns().
+ */
+void MotorControl::move(uint32_t turns, float turnsPerMinute)
+{
+    int direction = _motorDirection ? 1 : -1;
+    _driver.move(direction, turns, turnsPerMinute);
+    setDriven(direction);
+    Log.debug(LOG_MOTOR, "Motor moving %u turns %s", (unsigned)turns, direction > 0 ? "clockwise" : "counter clockwise");
+}
+
+/**
+ * Whole turns moved since boot, see MotorDriver::getTurnsMoved()
+ */
+uint32_t MotorControl::getTurnsMoved()
+{
+    return _driver.getTurnsMoved();
+}
+
+/**
+ * See MotorDriver::getRampSeconds()
+ */
+float MotorControl::getRampSeconds(float turnsPerMinute)
+{
+    return _driver.getRampSeconds(turnsPerMinute);
+}
+
 int MotorControl::getMotorDirection()
 {
     return _motorDirection;
@@ -75,3 +105,28 @@ void MotorControl::setMotorDirection(int direction)
 {
     _motorDirection = direction;
 }
+
+/**
+ * Whether the motor is being driven, in either direction. A move that has
+ * finished on its own isn't turning any more.
+ */
+bool MotorControl::isTurning()
+{
+    return _driven != 0 && (!_driver.countsTurns() || _driver.isMoving());
+}
+
+/**
+ * When the motor last started or reversed; meaningless while stopped
+ */
+unsigned long MotorControl::getTurningSinceMs()
+{
+    return _drivenSinceMs;
+}
+
+/**
+ * When the motor was last started, stopped or reversed, for command latencies
+ */
+uint32_t MotorControl::getDrivenSinceMicros()
+{
+    return _drivenSinceMicros;
+}
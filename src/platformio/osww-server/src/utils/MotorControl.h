@@ -1,19 +1,28 @@
 #include <Arduino.h>
 
+#include "MotorDriver.h"
+
 #ifndef MotorControl_H
 #define MotorControl_H
 
+/**
+ * Which way the motor turns & when it last changed, whatever drives it
+ */
 class MotorControl
 {
 private:
-    int _pinA;
-    int _pinB;
+    MotorDriver &_driver;
     // 1 = clockwise, 0 = counter clockwise
     int _motorDirection;
-    bool _pwmMotorControl;
+    // what the driver drives: 1 = clockwise, -1 = counter clockwise, 0 = stopped
+    volatile int _driven;
+    volatile unsigned long _drivenSinceMs;
+    volatile uint32_t _drivenSinceMicros;
+
+    void setDriven(int driven);
 
 public:
-    MotorControl(int _pinA, int _pinB, bool pwmMotorControl = false);
+    MotorControl(MotorDriver &driver);
 
     void clockwise();
 
@@ -23,9 +32,23 @@ public:
 
     void determineMotorDirectionAndBegin();
 
+    bool countsTurns();
+
+    void move(uint32_t turns, float turnsPerMinute);
+
+    uint32_t getTurnsMoved();
+
+    float getRampSeconds(float turnsPerMinute);
+
     int getMotorDirection();
 
     void setMotorDirection(int direction);
+
+    bool isTurning();
+
+    unsigned long getTurningSinceMs();
+
+    uint32_t getDrivenSinceMicros();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include <Arduino.h>
+
+#ifndef MotorDriver_H
+#define MotorDriver_H
+
+/**
+ * The board between the ESP32 & the motor, as MotorControl drives it. A DC
+ * motor on an H-bridge only knows which way it's turning, so its turns are
+ * estimated from time. A stepper counts its steps, so it can also be asked
+ * for an exact number of turns.
+ *
+ * Called from the loop task only.
+ */
+class MotorDriver
+{
+public:
+    virtual ~MotorDriver() {}
+
+    /**
+     * Call once at boot, after the pins are set up
+     *
+     * @return false if the hardware couldn't be set up
+     */
+    virtual bool begin()
+    {
+        return true;
+    }
+
+    /**
+     * Turns until told otherwise
+     *
+     * @param direction 1 clockwise, -1 counter clockwise, 0 to stop
+     */
+    virtual void drive(int direction) = 0;
+
+    /**
+     * Whether move() & getTurnsMoved() are supported
+     */
+    virtual bool countsTurns()
+    {
+        return false;
+    }
+
+    /**
+     * Turns exactly `turns` at `turnsPerMinute`, then stops on its own
+     *
+     * @param direction 1 clockwise, -1 counter clockwise
+     */
+    virtual void move(int direction, uint32_t turns, float turnsPerMinute)
+    {
+    }
+
+    /**
+     * Whether the motor is still moving, a stop included
+     */
+    virtual bool isMoving()
+    {
+        return false;
+    }
+
+    /**
+     * Whole turns since boot, counted from the steps output; exact once the motor has stopped
+     */
+    virtual uint32_t getTurnsMoved()
+    {
+        return 0;
+    }
+
+    /**
+     * How much longer a move takes than cruising all the way, to speed up & slow down
+     */
+    virtual float getRampSeconds(float turnsPerMinute)
+    {
+        return 0;
+    }
+};
+
+#endif
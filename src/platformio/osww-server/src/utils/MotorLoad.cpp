@@ -0,0 +1,193 @@
+#include "MotorLoad.h"
+
+// A gap longer than this between blocks isn't integrated, the sensor wasn't running
+#define MOTOR_LOAD_MAX_GAP_MS 1000
+
+MotorLoad::MotorLoad(int stallMilliamps)
+{
+    _stallMilliamps = stallMilliamps;
+    _lastSampleMs = 0;
+    _windowIndex = 0;
+    _windowCount = 0;
+    _windowSum = 0;
+    for (int i = 0; i < MOTOR_LOAD_WINDOW; i++)
+    {
+        _window[i] = 0;
+    }
+    _milliamps = 0;
+    _averageMilliamps = 0;
+    _turningSinceMs = 0;
+    beginSession();
+}
+
+/**
+ * Forgets the previous session's baseline, peak, stalls & energy
+ */
+void MotorLoad::beginSession()
+{
+    _peakMilliamps = 0;
+    _stalled = false;
+    _stallsInRow = 0;
+    _stalls = 0;
+    _baselineMs = 0;
+    _baselineSum = 0;
+    _baselineCount = 0;
+    _baselineMilliamps = 0;
+    _heavyReported = false;
+    _disconnectedReported = false;
+    _milliampMs = 0;
+    rearm(_lastSampleMs);
+}
+
+/**
+ * Restarts every condition's timer, after a stop or a start
+ */
+void MotorLoad::rearm(unsigned long ms)
+{
+    _stalled = false;
+    _notStalledMs = ms;
+    _notHeavyMs = ms;
+    _loadedMs = ms;
+}
+
+/**
+ * @param milliamps average of one block of samples
+ * @param turning whether the motor is driven
+ * @param turningSinceMs when it was last started or reversed
+ * @param ms when the block ended
+ * @return what this block showed, at most once per condition & start
+ */
+MotorLoadEvent MotorLoad::addSample(uint16_t milliamps, bool turning, unsigned long turningSinceMs, unsigned long ms)
+{
+    unsigned long elapsedMs = ms - _lastSampleMs;
+    if (_lastSampleMs != 0 && elapsedMs <= MOTOR_LOAD_MAX_GAP_MS)
+    {
+        _milliampMs += (uint64_t)milliamps * elapsedMs;
+    }
+    _lastSampleMs = ms;
+
+    _windowSum -= _window[_windowIndex];
+    _window[_windowIndex] = milliamps;
+    _windowSum += milliamps;
+    _windowIndex = (_windowIndex + 1) % MOTOR_LOAD_WINDOW;
+    _windowCount = min(_windowCount + 1, MOTOR_LOAD_WINDOW);
+    _milliamps = milliamps;
+    _averageMilliamps = _windowSum / _windowCount;
+
+    if (!turning || turningSinceMs != _turningSinceMs)
+    {
+        _turningSinceMs = turningSinceMs;
+        rearm(ms);
+        return MOTOR_LOAD_NONE;
+    }
+    if (ms - turningSinceMs < MOTOR_INRUSH_MS)
+    {
+        rearm(ms);
+        return MOTOR_LOAD_NONE;
+    }
+
+    uint16_t average = _averageMilliamps;
+    _peakMilliamps = max(_peakMilliamps, average);
+
+    if (average < _stallMilliamps)
+    {
+        _notStalledMs = ms;
+        if (!_stalled && ms - turningSinceMs >= MOTOR_STALL_CLEAR_MS)
+        {
+            _stallsInRow = 0;
+        }
+    }
+    else if (!_stalled && ms - _notStalledMs >= MOTOR_STALL_MS)
+    {
+        _stalled = true;
+        _stalls++;
+        _stallsInRow++;
+        return _stallsInRow > MOTOR_STALL_RETRIES ? MOTOR_LOAD_JAMMED : MOTOR_LOAD_STALLED;
+    }
+    if (_stalled)
+    {
+        return MOTOR_LOAD_NONE;
+    }
+
+    if (average >= MOTOR_NO_LOAD_MILLIAMPS)
+    {
+        _loadedMs = ms;
+    }
+    else if (!_disconnectedReported && ms - _loadedMs >= MOTOR_NO_LOAD_MS)
+    {
+        _disconnectedReported = true;
+        return MOTOR_LOAD_DISCONNECTED;
+    }
+
+    // Learned while nothing's wrong, then held for the rest of the session
+    if (_baselineMs < MOTOR_BASELINE_MS)
+    {
+        if (average >= MOTOR_NO_LOAD_MILLIAMPS && average < _stallMilliamps)
+        {
+            _baselineMs += min(elapsedMs, (unsigned long)MOTOR_LOAD_MAX_GAP_MS);
+            _baselineSum += average;
+            _baselineCount++;
+            _baselineMilliamps = _baselineSum / _baselineCount;
+        }
+        _notHeavyMs = ms;
+        return MOTOR_LOAD_NONE;
+    }
+
+    if ((uint32_t)average * 100 <= (uint32_t)_baselineMilliamps * MOTOR_HEAVY_PERCENT)
+    {
+        _notHeavyMs = ms;
+    }
+    else if (!_heavyReported && ms - _notHeavyMs >= MOTOR_HEAVY_MS)
+    {
+        _heavyReported = true;
+        return MOTOR_LOAD_HEAVY;
+    }
+
+    return MOTOR_LOAD_NONE;
+}
+
+/**
+ * The last block, unfiltered
+ */
+int MotorLoad::getMilliamps()
+{
+    return _milliamps;
+}
+
+/**
+ * The moving average the checks use
+ */
+int MotorLoad::getAverageMilliamps()
+{
+    return _averageMilliamps;
+}
+
+/**
+ * Highest moving average this session, inrush left out
+ */
+int MotorLoad::getPeakMilliamps()
+{
+    return _peakMilliamps;
+}
+
+/**
+ * Normal running current this session, 0 until some was seen
+ */
+int MotorLoad::getBaselineMilliamps()
+{
+    return _baselineMilliamps;
+}
+
+int MotorLoad::getStalls()
+{
+    return _stalls;
+}
+
+/**
+ * Energy used this session, at the motor supply's voltage
+ */
+uint32_t MotorLoad::getMilliwattHours(int supplyMillivolts)
+{
+    // mA * ms * mV = uW * ms, 3.6e9 of those in a mWh
+    return (uint32_t)(_milliampMs * (uint64_t)supplyMillivolts / 3600000000ULL);
+}
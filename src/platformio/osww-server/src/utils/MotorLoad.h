@@ -0,0 +1,95 @@
+#include <Arduino.h>
+
+#ifndef MotorLoad_H
+#define MotorLoad_H
+
+// Block averages in the moving average, about 100 ms of them at the sensor's block rate
+#define MOTOR_LOAD_WINDOW 8
+// After a start or a reversal; the motor draws several times its running current meanwhile
+#define MOTOR_INRUSH_MS 300
+// Above the stall current for this long is a stall
+#define MOTOR_STALL_MS 400
+// Stalls in a row that are retried before the session is given up
+#define MOTOR_STALL_RETRIES 3
+// Turning this long after a start without stalling clears the stalls in a row
+#define MOTOR_STALL_CLEAR_MS 30000
+// Turning time at the start of a session the normal current is learned over
+#define MOTOR_BASELINE_MS 10000
+// Above this share of the normal current, for this long, the cushion is dragging
+#define MOTOR_HEAVY_PERCENT 160
+#define MOTOR_HEAVY_MS 5000
+// Below this while driven, for this long, the motor isn't connected
+#define MOTOR_NO_LOAD_MILLIAMPS 15
+#define MOTOR_NO_LOAD_MS 2000
+
+// In motorLoadEventChoices order, see ApiSchema.h. Later ones are more severe.
+enum MotorLoadEvent
+{
+    MOTOR_LOAD_NONE,
+    MOTOR_LOAD_HEAVY,        // reported once per session
+    MOTOR_LOAD_DISCONNECTED, // reported once per session
+    MOTOR_LOAD_STALLED,      // worth a retry
+    MOTOR_LOAD_JAMMED        // stalled after every retry
+};
+
+/**
+ * Judges the motor's current, one block average at a time. Knows nothing of
+ * the ADC, so the simulator can feed it synthetic streams.
+ *
+ * Blocks are smoothed by a moving average. Nothing is judged while the motor
+ * is stopped or within its inrush after a start. A stall is reported once per
+ * start; the caller stops & restarts the motor to retry, which rearms it.
+ *
+ * Also integrates the current over time, for the energy a session used.
+ */
+class MotorLoad
+{
+private:
+    int _stallMilliamps;
+    uint16_t _window[MOTOR_LOAD_WINDOW];
+    uint8_t _windowIndex;
+    uint8_t _windowCount;
+    uint32_t _windowSum;
+    uint16_t _milliamps;
+    uint16_t _averageMilliamps;
+    uint16_t _peakMilliamps;
+    unsigned long _lastSampleMs;
+    unsigned long _turningSinceMs;
+    // when each condition last didn't hold; it has held since
+    unsigned long _notStalledMs;
+    unsigned long _notHeavyMs;
+    unsigned long _loadedMs;
+    bool _stalled;
+    uint8_t _stallsInRow;
+    uint16_t _stalls;
+    unsigned long _baselineMs;
+    uint32_t _baselineSum;
+    uint32_t _baselineCount;
+    uint16_t _baselineMilliamps;
+    bool _heavyReported;
+    bool _disconnectedReported;
+    uint64_t _milliampMs;
+
+    void rearm(unsigned long ms);
+
+public:
+    MotorLoad(int stallMilliamps);
+
+    void beginSession();
+
+    MotorLoadEvent addSample(uint16_t milliamps, bool turning, unsigned long turningSinceMs, unsigned long ms);
+
+    int getMilliamps();
+
+    int getAverageMilliamps();
+
+    int getPeakMilliamps();
+
+    int getBaselineMilliamps();
+
+    int getStalls();
+
+    uint32_t getMilliwattHours(int supplyMillivolts);
+};
+
+#endif
@@ -0,0 +1,360 @@
+#include "OtaUpdate.h"
+
+#include <Preferences.h>
+#include <Update.h>
+#include <esp_ota_ops.h>
+
+#include "Logger.h"
+
+#define OTA_NAMESPACE "ota"
+
+OtaUpdate::OtaUpdate()
+{
+    _state = OTA_IDLE;
+    _target = OTA_TARGET_FIRMWARE;
+    _owner = NULL;
+    _totalBytes = 0;
+    _bytesWritten = 0;
+    _startMs = 0;
+    _endMs = 0;
+    _lastWriteMs = 0;
+    _expectedSha256[0] = '\0';
+    _sha256[0] = '\0';
+    _error[0] = '\0';
+    _restartPending = false;
+    _bootPending = false;
+    _mutex = NULL;
+}
+
+void OtaUpdate::lock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+    }
+}
+
+void OtaUpdate::unlock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreGive(_mutex);
+    }
+}
+
+/**
+ * Call early in setup(). Counts the boots of a new firmware & boots the
+ * previous one again once it has used up OTA_MAX_BOOT_ATTEMPTS.
+ */
+void OtaUpdate::checkBoot()
+{
+    if (_mutex == NULL)
+    {
+        _mutex = xSemaphoreCreateMutex();
+    }
+
+    Preferences preferences;
+    if (!preferences.begin(OTA_NAMESPACE, false))
+    {
+        return;
+    }
+
+    if (preferences.getBool("pending"))
+    {
+        const esp_partition_t *running = esp_ota_get_running_partition();
+        String image = preferences.getString("image");
+
+        if (running == NULL || image != running->label)
+        {
+            // The bootloader already fell back
+            Log.warn(LOG_OTA, "New firmware didn't boot, running the previous one");
+            preferences.putBool("pending", false);
+        }
+        else
+        {
+            uint8_t attempts = preferences.getUChar("attempts") + 1;
+            preferences.putUChar("attempts", attempts);
+
+            const esp_partition_t *previous = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, preferences.getString("previous").c_str());
+            if (attempts > OTA_MAX_BOOT_ATTEMPTS && previous != NULL)
+            {
+                Log.error(LOG_OTA, "New firmware restarted %d times, rolling back to %s", attempts - 1, previous->label);
+                preferences.putBool("pending", false);
+                preferences.end();
+                esp_ota_set_boot_partition(previous);
+                Log.flush();
+                ESP.restart();
+                return;
+            }
+
+            Log.status(LOG_OTA, "New firmware, boot %d of %d before rollback", attempts, OTA_MAX_BOOT_ATTEMPTS);
+            _bootPending = true;
+        }
+    }
+    preferences.end();
+}
+
+/**
+ * Call from loop(); keeps the running firmware once it has proven itself
+ */
+void OtaUpdate::confirmBoot()
+{
+    if (!_bootPending || millis() < OTA_CONFIRM_AFTER_MS)
+    {
+        return;
+    }
+
+    _bootPending = false;
+    esp_ota_mark_app_valid_cancel_rollback();
+
+    Preferences preferences;
+    if (preferences.begin(OTA_NAMESPACE, false))
+    {
+        preferences.putBool("pending", false);
+        preferences.end();
+    }
+    Log.status(LOG_OTA, "New firmware confirmed");
+}
+
+/**
+ * @param size of the image, or 0 if unknown
+ * @param expectedSha256 hex digest to verify against, empty to skip the check
+ * @param owner the request the upload belongs to
+ * @return false if another upload is running or the image can't fit
+ */
+bool OtaUpdate::begin(OtaTarget target, size_t size, const char *expectedSha256, const void *owner)
+{
+    lock();
+    if (_state == OTA_RECEIVING)
+    {
+        unlock();
+        return false;
+    }
+
+    _target = target;
+    _owner = owner;
+    _totalBytes = size;
+    _bytesWritten = 0;
+    _startMs = millis();
+    _endMs = 0;
+    _lastWriteMs = _startMs;
+    _sha256[0] = '\0';
+    _error[0] = '\0';
+    strncpy(_expectedSha256, expectedSha256, sizeof(_expectedSha256) - 1);
+    _expectedSha256[sizeof(_expectedSha256) - 1] = '\0';
+    _state = OTA_RECEIVING;
+
+    if (!Update.begin(size > 0 ? size : UPDATE_SIZE_UNKNOWN, target == OTA_TARGET_FIRMWARE ? U_FLASH : U_SPIFFS))
+    {
+        fail(Update.errorString());
+        unlock();
+        return true;
+    }
+
+    mbedtls_sha256_init(&_sha);
+    mbedtls_sha256_starts_ret(&_sha, 0);
+    unlock();
+    Log.status(LOG_OTA, "Receiving %s update, %u bytes", target == OTA_TARGET_FIRMWARE ? "firmware" : "filesystem", (unsigned)size);
+    return true;
+}
+
+bool OtaUpdate::write(uint8_t *data, size_t length)
+{
+    lock();
+    if (_state != OTA_RECEIVING)
+    {
+        unlock();
+        return false;
+    }
+
+    mbedtls_sha256_update_ret(&_sha, data, length);
+    if (Update.write(data, length) != length)
+    {
+        fail(Update.errorString());
+        unlock();
+        return false;
+    }
+
+    _bytesWritten += length;
+    _lastWriteMs = millis();
+    unlock();
+    return true;
+}
+
+/**
+ * Checks the digest, then commits the image. Firmware boots from its new
+ * slot after the next restart.
+ */
+bool OtaUpdate::end()
+{
+    lock();
+    bool committed = commit();
+    unlock();
+    return committed;
+}
+
+bool OtaUpdate::commit()
+{
+    if (_state != OTA_RECEIVING)
+    {
+        return false;
+    }
+
+    unsigned char digest[32];
+    mbedtls_sha256_finish_ret(&_sha, digest);
+    mbedtls_sha256_free(&_sha);
+    for (int i = 0; i < 32; i++)
+    {
+        snprintf(_sha256 + i * 2, 3, "%02x", digest[i]);
+    }
+
+    if (_expectedSha256[0] != '\0' && strcasecmp(_expectedSha256, _sha256) != 0)
+    {
+        fail("SHA-256 mismatch");
+        return false;
+    }
+
+    const esp_partition_t *previous = esp_ota_get_running_partition();
+    if (!Update.end(true))
+    {
+        fail(Update.errorString());
+        return false;
+    }
+
+    if (_target == OTA_TARGET_FIRMWARE)
+    {
+        // Armed for checkBoot()
+        Preferences preferences;
+        if (preferences.begin(OTA_NAMESPACE, false))
+        {
+            preferences.putBool("pending", true);
+            preferences.putUChar("attempts", 0);
+            preferences.putString("image", esp_ota_get_next_update_partition(previous)->label);
+            preferences.putString("previous", previous->label);
+            preferences.end();
+        }
+        _restartPending = true;
+    }
+
+    _endMs = millis();
+    _state = OTA_DONE;
+    Log.status(LOG_OTA, "Update written, %u bytes, sha256 %s", (unsigned)_bytesWritten, _sha256);
+    return true;
+}
+
+void OtaUpdate::fail(const char *error)
+{
+    if (Update.isRunning())
+    {
+        Update.abort();
+    }
+    if (_state == OTA_RECEIVING)
+    {
+        mbedtls_sha256_free(&_sha);
+    }
+
+    strncpy(_error, error, sizeof(_error) - 1);
+    _error[sizeof(_error) - 1] = '\0';
+    _endMs = millis();
+    _state = OTA_FAILED;
+    Log.error(LOG_OTA, "Update failed: %s", _error);
+}
+
+void OtaUpdate::abort(const char *reason)
+{
+    lock();
+    if (_state == OTA_RECEIVING)
+    {
+        fail(reason);
+    }
+    unlock();
+}
+
+/**
+ * Call from loop(); gives up on an upload whose client went quiet. Skipped
+ * while the webserver's task holds the lock, it's writing so it isn't stalled.
+ */
+void OtaUpdate::poll()
+{
+    if (_mutex == NULL || xSemaphoreTake(_mutex, 0) != pdTRUE)
+    {
+        return;
+    }
+
+    if (_state == OTA_RECEIVING && millis() - _lastWriteMs > OTA_STALL_TIMEOUT_MS)
+    {
+        fail("Upload stalled");
+    }
+    unlock();
+}
+
+bool OtaUpdate::isOwner(const void *owner)
+{
+    lock();
+    bool owned = _owner == owner;
+    unlock();
+    return owned;
+}
+
+/**
+ * Forgets the upload's request once it has been answered; its address may be reused
+ */
+void OtaUpdate::release()
+{
+    lock();
+    if (_state != OTA_RECEIVING)
+    {
+        _owner = NULL;
+    }
+    unlock();
+}
+
+OtaState OtaUpdate::getState()
+{
+    return _state;
+}
+
+OtaTarget OtaUpdate::getTarget()
+{
+    return _target;
+}
+
+size_t OtaUpdate::getBytesWritten()
+{
+    return _bytesWritten;
+}
+
+size_t OtaUpdate::getTotalBytes()
+{
+    return _totalBytes;
+}
+
+/**
+ * Average throughput of the current or last upload
+ */
+unsigned long OtaUpdate::getBytesPerSecond()
+{
+    lock();
+    unsigned long elapsedMs = (_endMs ? _endMs : millis()) - _startMs;
+    unsigned long bytesPerSecond = elapsedMs > 0 ? (unsigned long long)_bytesWritten * 1000 / elapsedMs : 0;
+    unlock();
+    return bytesPerSecond;
+}
+
+const char *OtaUpdate::getSha256()
+{
+    return _sha256;
+}
+
+const char *OtaUpdate::getError()
+{
+    return _error;
+}
+
+/**
+ * New firmware is written & waits for a restart
+ */
+bool OtaUpdate::isRestartPending()
+{
+    return _restartPending;
+}
@@ -0,0 +1,107 @@
+#include <Arduino.h>
+#include <mbedtls/sha256.h>
+
+#ifndef OtaUpdate_H
+#define OtaUpdate_H
+
+// A new firmware that reboots this often before confirmBoot() is rolled back
+#define OTA_MAX_BOOT_ATTEMPTS 3
+// Uptime after which a new firmware counts as good
+#define OTA_CONFIRM_AFTER_MS 60000
+// An upload that sends nothing for this long is aborted
+#define OTA_STALL_TIMEOUT_MS 30000
+#define OTA_ERROR_SIZE 64
+
+enum OtaTarget
+{
+    OTA_TARGET_FIRMWARE,
+    OTA_TARGET_FILESYSTEM
+};
+
+// In otaStateChoices order, see ApiSchema.h
+enum OtaState
+{
+    OTA_IDLE,
+    OTA_RECEIVING,
+    OTA_DONE,
+    OTA_FAILED
+};
+
+/**
+ * Streams an uploaded image into flash as it arrives: firmware into the
+ * inactive OTA slot, a filesystem image into the LittleFS partition. The
+ * SHA-256 is computed over the same chunks, so the image is never held in RAM.
+ *
+ * Runs on the webserver's task, one upload at a time; the loop task & the
+ * motor carry on meanwhile. The caller restarts into new firmware when it suits.
+ * A mutex keeps poll() on the loop from aborting mid-write().
+ *
+ * Also guards the first boots of new firmware: if it keeps rebooting before
+ * it has run OTA_CONFIRM_AFTER_MS, the previous firmware is booted again.
+ */
+class OtaUpdate
+{
+private:
+    volatile OtaState _state;
+    OtaTarget _target;
+    const void *_owner;
+    size_t _totalBytes;
+    volatile size_t _bytesWritten;
+    unsigned long _startMs;
+    unsigned long _endMs;
+    volatile unsigned long _lastWriteMs;
+    mbedtls_sha256_context _sha;
+    char _expectedSha256[65];
+    char _sha256[65];
+    char _error[OTA_ERROR_SIZE];
+    bool _restartPending;
+    bool _bootPending;
+    SemaphoreHandle_t _mutex;
+
+    void lock();
+
+    void unlock();
+
+    void fail(const char *error);
+
+    bool commit();
+
+public:
+    OtaUpdate();
+
+    void checkBoot();
+
+    void confirmBoot();
+
+    bool begin(OtaTarget target, size_t size, const char *expectedSha256, const void *owner);
+
+    bool write(uint8_t *data, size_t length);
+
+    bool end();
+
+    void abort(const char *reason);
+
+    void poll();
+
+    bool isOwner(const void *owner);
+
+    void release();
+
+    OtaState getState();
+
+    OtaTarget getTarget();
+
+    size_t getBytesWritten();
+
+    size_t getTotalBytes();
+
+    unsigned long getBytesPerSecond();
+
+    const char *getSha256();
+
+    const char *getError();
+
+    bool isRestartPending();
+};
+
+#endif
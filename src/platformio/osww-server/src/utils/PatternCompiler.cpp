@@ -0,0 +1,478 @@
+#include "PatternCompiler.h"
+
+// Bytes per instruction, in PatternOp order
+static const uint8_t instructionSizes[] = {1, 4, 3, 3, 1};
+
+static_assert(sizeof(instructionSizes) == PATTERN_OP_LOOP + 1, "instructionSizes out of sync");
+static_assert(PATTERN_CODE_SIZE <= 255, "Code offsets are a byte");
+
+/**
+ * Turns & pause seconds in some code, its repeats multiplied out
+ */
+struct PATTERN_TOTALS
+{
+    uint64_t turns;
+    uint64_t pauseSeconds;
+};
+
+static uint16_t getU16(const uint8_t *code)
+{
+    return code[0] | (uint16_t)code[1] << 8;
+}
+
+/**
+ * Reads the source in one pass, writing the code as it goes
+ */
+class PatternParser
+{
+private:
+    const char *_source;
+    const char *_position;
+    WINDING_PATTERN &_pattern;
+    char *_error;
+    size_t _errorSize;
+    uint8_t _speed;
+    bool _reverse; // goes on the next instruction written
+
+    /**
+     * Sets the error, with the line & column of `at`
+     */
+    bool fail(const char *at, const char *message)
+    {
+        int line = 1;
+        int column = 1;
+        for (const char *c = _source; c < at; c++)
+        {
+            column++;
+            if (*c == '\n')
+            {
+                line++;
+                column = 1;
+            }
+        }
+        snprintf(_error, _errorSize, "%d:%d: %s", line, column, message);
+        return false;
+    }
+
+    /**
+     * Skips to the next statement: spaces, new lines, ';' & comments
+     */
+    void skipSeparators()
+    {
+        for (;;)
+        {
+            if (*_position == '#')
+            {
+                while (*_position != '\0' && *_position != '\n')
+                {
+                    _position++;
+                }
+            }
+            else if (isspace((unsigned char)*_position) || *_position == ';')
+            {
+                _position++;
+            }
+            else
+            {
+                return;
+            }
+        }
+    }
+
+    bool emit(const char *at, uint8_t op, const uint8_t *operands, size_t count)
+    {
+        // Room for the END is kept for the end
+        size_t needed = 1 + count + (op == PATTERN_OP_END ? 0 : instructionSizes[PATTERN_OP_END]);
+        if (_pattern.length + needed > PATTERN_CODE_SIZE)
+        {
+            return fail(at, "pattern too long, it must compile to 64 bytes");
+        }
+
+        _pattern.code[_pattern.length++] = op | (_reverse ? PATTERN_REVERSE : 0);
+        memcpy(_pattern.code + _pattern.length, operands, count);
+        _pattern.length += count;
+        _reverse = false;
+        return true;
+    }
+
+    /**
+     * Reads the number after a statement, with a unit if `units` lists any:
+     * s, m & h scale to seconds, % is taken as is
+     */
+    bool readNumber(const char *statement, const char *units, long lowest, long highest, long &value)
+    {
+        while (*_position == ' ' || *_position == '\t')
+        {
+            _position++;
+        }
+
+        const char *at = _position;
+        char message[PATTERN_ERROR_SIZE];
+        value = 0;
+        while (isdigit((unsigned char)*_position))
+        {
+            value = min(value * 10 + (*_position - '0'), (long)INT32_MAX);
+            _position++;
+        }
+        if (_position == at)
+        {
+            snprintf(message, sizeof(message), "expected a number after %s", statement);
+            return fail(at, message);
+        }
+
+        if (*_position != '\0' && strchr(units, *_position) != NULL)
+        {
+            value = min(value * (*_position == 'h' ? 3600 : *_position == 'm' ? 60 : 1), (long)INT32_MAX);
+            _position++;
+        }
+        if (isalnum((unsigned char)*_position) || *_position == '%')
+        {
+            snprintf(message, sizeof(message), "unexpected '%c' after %s", *_position, statement);
+            return fail(_position, message);
+        }
+        if (value < lowest || value > highest)
+        {
+            snprintf(message, sizeof(message), "%s takes %ld to %ld%s", statement, lowest, highest, strchr(units, 's') ? " seconds" : "");
+            return fail(at, message);
+        }
+        return true;
+    }
+
+    /**
+     * Reads statements up to the end of the source, or up to the '}' closing a repeat
+     */
+    bool readBlock(bool nested, int depth, PATTERN_TOTALS &totals)
+    {
+        totals = {0, 0};
+        for (;;)
+        {
+            skipSeparators();
+            const char *at = _position;
+            if (*at == '\0')
+            {
+                return nested ? fail(at, "missing }") : true;
+            }
+            if (*at == '}')
+            {
+                if (!nested)
+                {
+                    return fail(at, "} without a repeat");
+                }
+                _position++;
+                return true;
+            }
+
+            size_t length = 0;
+            while (isalpha((unsigned char)at[length]))
+            {
+                length++;
+            }
+            _position += length;
+
+            long value;
+            if (length == 4 && strncasecmp(at, "turn", 4) == 0)
+            {
+                if (!readNumber("turn", "", 1, PATTERN_MAX_TURNS, value))
+                {
+                    return false;
+                }
+                uint8_t operands[] = {(uint8_t)value, (uint8_t)(value >> 8), _speed};
+                if (!emit(at, PATTERN_OP_TURN, operands, sizeof(operands)))
+                {
+                    return false;
+                }
+                totals.turns += value;
+            }
+            else if (length == 5 && strncasecmp(at, "pause", 5) == 0)
+            {
+                if (!readNumber("pause", "smh", 1, PATTERN_MAX_PAUSE_SECONDS, value))
+                {
+                    return false;
+                }
+                uint8_t operands[] = {(uint8_t)value, (uint8_t)(value >> 8)};
+                if (!emit(at, PATTERN_OP_PAUSE, operands, sizeof(operands)))
+                {
+                    return false;
+                }
+                totals.pauseSeconds += value;
+            }
+            else if (length == 7 && strncasecmp(at, "reverse", 7) == 0)
+            {
+                _reverse = !_reverse;
+            }
+            else if (length == 5 && strncasecmp(at, "speed", 5) == 0)
+            {
+                if (!readNumber("speed", "%", PATTERN_MIN_SPEED_PERCENT, PATTERN_MAX_SPEED_PERCENT, value))
+                {
+                    return false;
+                }
+                _speed = value;
+            }
+            else if (length == 6 && strncasecmp(at, "repeat", 6) == 0)
+            {
+                if (!readNumber("repeat", "", 1, PATTERN_MAX_REPEAT, value))
+                {
+                    return false;
+                }
+                while (isspace((unsigned char)*_position))
+                {
+                    _position++;
+                }
+                if (*_position != '{')
+                {
+                    return fail(_position, "expected { after repeat");
+                }
+                if (depth == PATTERN_MAX_DEPTH)
+                {
+                    return fail(at, "repeats nest at most 4 deep");
+                }
+                _position++;
+
+                uint8_t repeat = _pattern.length;
+                uint8_t operands[] = {(uint8_t)value, 0};
+                PATTERN_TOTALS body;
+                if (!emit(at, PATTERN_OP_REPEAT, operands, sizeof(operands)) || !readBlock(true, depth + 1, body))
+                {
+                    return false;
+                }
+                if (_pattern.length == repeat + instructionSizes[PATTERN_OP_REPEAT])
+                {
+                    return fail(at, "nothing to repeat");
+                }
+                if (!emit(_position - 1, PATTERN_OP_LOOP, NULL, 0))
+                {
+                    return false;
+                }
+                _pattern.code[repeat + 2] = _pattern.length - repeat - instructionSizes[PATTERN_OP_REPEAT];
+                totals.turns += body.turns * value;
+                totals.pauseSeconds += body.pauseSeconds * value;
+            }
+            else
+            {
+                return fail(at, "expected turn, pause, reverse, speed or repeat");
+            }
+        }
+    }
+
+public:
+    PatternParser(const char *source, WINDING_PATTERN &pattern, char *error, size_t errorSize) : _pattern(pattern)
+    {
+        _source = source;
+        _position = source;
+        _error = error;
+        _errorSize = errorSize;
+        _speed = 100;
+        _reverse = false;
+    }
+
+    bool parse()
+    {
+        if (strlen(_source) >= PATTERN_SOURCE_SIZE)
+        {
+            return fail(_source, "pattern longer than 255 characters");
+        }
+
+        PATTERN_TOTALS totals;
+        if (!readBlock(false, 0, totals) || !emit(_position, PATTERN_OP_END, NULL, 0))
+        {
+            return false;
+        }
+        if (totals.turns == 0)
+        {
+            return fail(_position, "a pattern needs at least one turn");
+        }
+        if (totals.pauseSeconds > PATTERN_MAX_PASS_PAUSE_SECONDS)
+        {
+            return fail(_position, "pauses add up to more than 24 h");
+        }
+        return true;
+    }
+};
+
+/**
+ * @param source see the class comment
+ * @param pattern its code is written, its name left as it is
+ * @param error "line:column: what's wrong", if it returns false
+ * @return false if the source isn't a valid pattern
+ */
+bool PatternCompiler::compile(const char *source, WINDING_PATTERN &pattern, char *error, size_t errorSize)
+{
+    pattern.length = 0;
+    memset(pattern.code, 0, sizeof(pattern.code));
+    error[0] = '\0';
+
+    PatternParser parser(source, pattern, error, errorSize);
+    if (!parser.parse())
+    {
+        pattern.length = 0;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Writes the source of a compiled pattern back, on one line. Comments &
+ * redundant statements are gone; compiling it gives the same code.
+ *
+ * @return length written, 0 if it didn't fit
+ */
+size_t PatternCompiler::decompile(const WINDING_PATTERN &pattern, char *buffer, size_t size)
+{
+    enum
+    {
+        START,
+        STATEMENT,
+        OPENED,
+        CLOSED
+    } previous = START;
+
+    size_t length = 0;
+    auto append = [&](const char *separator, const char *text) {
+        int written = snprintf(buffer + length, size - length, "%s%s", separator, text);
+        if (written < 0 || (size_t)written >= size - length)
+        {
+            length = size;
+            return false;
+        }
+        length += written;
+        return true;
+    };
+    auto statement = [&](const char *text) {
+        bool ok = append(previous == STATEMENT && length > 0 ? "; " : length > 0 ? " " : "", text);
+        previous = STATEMENT;
+        return ok;
+    };
+
+    if (size == 0)
+    {
+        return 0;
+    }
+    buffer[0] = '\0';
+
+    uint8_t speed = 100;
+    char text[24];
+    bool ok = true;
+    for (uint8_t pc = 0; ok && pc < pattern.length;)
+    {
+        uint8_t op = pattern.code[pc];
+        if (op & PATTERN_REVERSE)
+        {
+            ok = statement("reverse");
+        }
+
+        switch (op & PATTERN_OP_MASK)
+        {
+            case PATTERN_OP_TURN:
+                if (pattern.code[pc + 3] != speed)
+                {
+                    speed = pattern.code[pc + 3];
+                    snprintf(text, sizeof(text), "speed %u", (unsigned)speed);
+                    ok = ok && statement(text);
+                }
+                snprintf(text, sizeof(text), "turn %u", (unsigned)getU16(pattern.code + pc + 1));
+                ok = ok && statement(text);
+                break;
+            case PATTERN_OP_PAUSE:
+            {
+                unsigned seconds = getU16(pattern.code + pc + 1);
+                if (seconds % 3600 == 0)
+                {
+                    snprintf(text, sizeof(text), "pause %uh", seconds / 3600);
+                }
+                else if (seconds % 60 == 0)
+                {
+                    snprintf(text, sizeof(text), "pause %um", seconds / 60);
+                }
+                else
+                {
+                    snprintf(text, sizeof(text), "pause %us", seconds);
+                }
+                ok = ok && statement(text);
+                break;
+            }
+            case PATTERN_OP_REPEAT:
+                snprintf(text, sizeof(text), "repeat %u {", (unsigned)pattern.code[pc + 1]);
+                ok = ok && statement(text);
+                previous = OPENED;
+                break;
+            case PATTERN_OP_LOOP:
+                ok = ok && append(" ", "}");
+                previous = CLOSED;
+                break;
+        }
+        pc += instructionSizes[min(op & PATTERN_OP_MASK, (int)PATTERN_OP_LOOP)];
+    }
+
+    return ok ? length : 0;
+}
+
+/**
+ * Checks code between `from` & `to` (its LOOP or END), and what it adds up to
+ */
+static bool verifyBlock(const WINDING_PATTERN &pattern, uint8_t from, uint8_t to, int depth, PATTERN_TOTALS &totals)
+{
+    totals = {0, 0};
+    uint8_t pc = from;
+    while (pc < to)
+    {
+        uint8_t op = pattern.code[pc] & PATTERN_OP_MASK;
+        if ((pattern.code[pc] & ~(PATTERN_OP_MASK | PATTERN_REVERSE)) != 0 || op == PATTERN_OP_END || op > PATTERN_OP_REPEAT || pc + instructionSizes[op] > to)
+        {
+            return false;
+        }
+
+        const uint8_t *operands = pattern.code + pc + 1;
+        if (op == PATTERN_OP_TURN)
+        {
+            uint16_t turns = getU16(operands);
+            if (turns < 1 || turns > PATTERN_MAX_TURNS || operands[2] < PATTERN_MIN_SPEED_PERCENT || operands[2] > PATTERN_MAX_SPEED_PERCENT)
+            {
+                return false;
+            }
+            totals.turns += turns;
+        }
+        else if (op == PATTERN_OP_PAUSE)
+        {
+            uint16_t seconds = getU16(operands);
+            if (seconds < 1 || seconds > PATTERN_MAX_PAUSE_SECONDS)
+            {
+                return false;
+            }
+            totals.pauseSeconds += seconds;
+        }
+        else
+        {
+            // A body holds at least one instruction, then its LOOP
+            int bodyEnd = pc + instructionSizes[op] + operands[1];
+            PATTERN_TOTALS body;
+            if (operands[0] < 1 || operands[1] < 2 || bodyEnd > to || depth == PATTERN_MAX_DEPTH ||
+                (pattern.code[bodyEnd - 1] & PATTERN_OP_MASK) != PATTERN_OP_LOOP ||
+                !verifyBlock(pattern, pc + instructionSizes[op], bodyEnd - 1, depth + 1, body))
+            {
+                return false;
+            }
+            totals.turns += body.turns * operands[0];
+            totals.pauseSeconds += body.pauseSeconds * operands[0];
+            pc = bodyEnd;
+            continue;
+        }
+        pc += instructionSizes[op];
+    }
+    return pc == to;
+}
+
+/**
+ * Checks code that didn't come straight from compile(), e.g. read back from NVS,
+ * so the engine can run it without checking as it goes
+ */
+bool PatternCompiler::verify(const WINDING_PATTERN &pattern)
+{
+    if (pattern.length < 1 || pattern.length > PATTERN_CODE_SIZE || memchr(pattern.name, '\0', sizeof(pattern.name)) == NULL ||
+        (pattern.code[pattern.length - 1] & ~PATTERN_REVERSE) != PATTERN_OP_END)
+    {
+        return false;
+    }
+
+    PATTERN_TOTALS totals;
+    return verifyBlock(pattern, 0, pattern.length - 1, 0, totals) && totals.turns > 0 && totals.pauseSeconds <= PATTERN_MAX_PASS_PAUSE_SECONDS;
+}
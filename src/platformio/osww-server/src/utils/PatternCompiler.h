@@ -0,0 +1,76 @@
+#include <Arduino.h>
+
+#ifndef PatternCompiler_H
+#define PatternCompiler_H
+
+// Bytecode of one pattern, its END included
+#define PATTERN_CODE_SIZE 64
+#define PATTERN_NAME_SIZE 24
+// Longest source accepted, with its terminator
+#define PATTERN_SOURCE_SIZE 256
+// Longest source decompile() writes, with its terminator
+#define PATTERN_DECOMPILED_SIZE 384
+#define PATTERN_ERROR_SIZE 64
+#define PATTERN_MAX_DEPTH 4
+#define PATTERN_MAX_TURNS 1000
+#define PATTERN_MAX_PAUSE_SECONDS 43200
+#define PATTERN_MAX_REPEAT 255
+#define PATTERN_MIN_SPEED_PERCENT 25
+#define PATTERN_MAX_SPEED_PERCENT 200
+// Pauses in one pass through a pattern, so a session can't be planned to last for years
+#define PATTERN_MAX_PASS_PAUSE_SECONDS 86400
+
+/**
+ * Instructions, in the low bits of their first byte. Operands follow little endian.
+ */
+enum PatternOp
+{
+    PATTERN_OP_END,    // end of the pattern, which starts over
+    PATTERN_OP_TURN,   // u16 turns, u8 speed in % of one turn per secondsPerRevolution
+    PATTERN_OP_PAUSE,  // u16 seconds
+    PATTERN_OP_REPEAT, // u8 times, u8 bytes of the body that follows, its LOOP included
+    PATTERN_OP_LOOP    // back to the start of the innermost body, until it has run its times
+};
+
+#define PATTERN_OP_MASK 0x0F
+// On any instruction: reverse the motor before it
+#define PATTERN_REVERSE 0x80
+
+/**
+ * A compiled pattern, as stored & as run
+ */
+struct WINDING_PATTERN
+{
+    char name[PATTERN_NAME_SIZE];
+    uint8_t length; // bytes of code used
+    uint8_t code[PATTERN_CODE_SIZE];
+};
+
+/**
+ * Compiles winding patterns from their source to bytecode & back.
+ *
+ * A pattern is a list of statements, separated by spaces, new lines or ';':
+ *
+ *     turn 15        15 turns, at one turn per secondsPerRevolution
+ *     pause 10m      rests 10 minutes; s, m or h, seconds if left out
+ *     reverse        turns the other way from here on
+ *     speed 50       the turns after it at 50 % speed, steppers only
+ *     repeat 4 { }   the statements in between, 4 times
+ *
+ * and # starts a comment. A session runs through the pattern, from the top
+ * again as often as needed, until its turns are delivered.
+ *
+ * speed is resolved as written, into each turn, so the bytecode only has
+ * turns, pauses & loops; each statement runs in constant time.
+ */
+class PatternCompiler
+{
+public:
+    static bool compile(const char *source, WINDING_PATTERN &pattern, char *error, size_t errorSize);
+
+    static size_t decompile(const WINDING_PATTERN &pattern, char *buffer, size_t size);
+
+    static bool verify(const WINDING_PATTERN &pattern);
+};
+
+#endif
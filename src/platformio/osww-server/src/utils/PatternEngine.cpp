@@ -0,0 +1,189 @@
+#include "PatternEngine.h"
+
+static uint16_t getU16(const uint8_t *code)
+{
+    return code[0] | (uint16_t)code[1] << 8;
+}
+
+PatternEngine::PatternEngine()
+{
+    memset(&_pattern, 0, sizeof(_pattern));
+    _timing = {1, false, 0};
+    _passTurns = 0;
+    _passSeconds = 0;
+    _pc = 0;
+    _depth = 0;
+    _turnsLeft = 0;
+}
+
+/**
+ * Takes a copy of the pattern & times one pass through it
+ */
+void PatternEngine::load(const WINDING_PATTERN &pattern, const PATTERN_TIMING &timing)
+{
+    _pattern = pattern;
+    _timing = timing;
+    _timing.secondsPerRevolution = max(_timing.secondsPerRevolution, (uint16_t)1);
+
+    uint64_t turnsLeft = UINT64_MAX;
+    _passSeconds = 0;
+    measureBlock(0, _pattern.length - 1, turnsLeft, _passSeconds);
+    _passTurns = (uint32_t)(UINT64_MAX - turnsLeft);
+
+    begin(0);
+}
+
+/**
+ * Starts from the top of the pattern, to hand out `turns`
+ */
+void PatternEngine::begin(unsigned long turns)
+{
+    _pc = 0;
+    _depth = 0;
+    _turnsLeft = turns;
+}
+
+/**
+ * @return false once all the turns have been handed out
+ */
+bool PatternEngine::next(PATTERN_SEGMENT &segment)
+{
+    if (_turnsLeft == 0 || _passTurns == 0)
+    {
+        return false;
+    }
+
+    bool reverse = false;
+    for (;;)
+    {
+        uint8_t op = _pattern.code[_pc];
+        const uint8_t *operands = _pattern.code + _pc + 1;
+        reverse ^= (op & PATTERN_REVERSE) != 0;
+
+        switch (op & PATTERN_OP_MASK)
+        {
+            case PATTERN_OP_TURN:
+            {
+                uint8_t speedPercent = _timing.variableSpeed ? operands[2] : 100;
+                uint16_t turns = (uint16_t)min((unsigned long)getU16(operands), _turnsLeft);
+                segment = {PATTERN_SEGMENT_TURN, reverse, turns, speedPercent, getTurnSeconds(turns, speedPercent)};
+                _turnsLeft -= turns;
+                _pc += 4;
+                return true;
+            }
+            case PATTERN_OP_PAUSE:
+                segment = {PATTERN_SEGMENT_PAUSE, reverse, 0, 100, getU16(operands)};
+                _pc += 3;
+                return true;
+            case PATTERN_OP_REPEAT:
+                _loops[_depth++] = {(uint8_t)(_pc + 3), operands[0]};
+                _pc += 3;
+                break;
+            case PATTERN_OP_LOOP:
+                if (--_loops[_depth - 1].left > 0)
+                {
+                    _pc = _loops[_depth - 1].body;
+                }
+                else
+                {
+                    _depth--;
+                    _pc++;
+                }
+                break;
+            default:
+                // END: the pattern starts over, until the turns are handed out
+                _pc = 0;
+                break;
+        }
+    }
+}
+
+/**
+ * Adds up the code from `from` to just before `to` (its LOOP or END), until
+ * `turnsLeft` have been handed out
+ */
+void PatternEngine::measureBlock(uint8_t from, uint8_t to, uint64_t &turnsLeft, uint64_t &seconds)
+{
+    uint8_t pc = from;
+    while (pc < to && turnsLeft > 0)
+    {
+        const uint8_t *operands = _pattern.code + pc + 1;
+        switch (_pattern.code[pc] & PATTERN_OP_MASK)
+        {
+            case PATTERN_OP_TURN:
+            {
+                uint8_t speedPercent = _timing.variableSpeed ? operands[2] : 100;
+                uint32_t turns = (uint32_t)min((uint64_t)getU16(operands), turnsLeft);
+                seconds += getTurnSeconds(turns, speedPercent);
+                turnsLeft -= turns;
+                pc += 4;
+                break;
+            }
+            case PATTERN_OP_PAUSE:
+                seconds += getU16(operands);
+                pc += 3;
+                break;
+            default:
+            {
+                // REPEAT: one iteration's worth, times the iterations that don't finish the session
+                uint8_t body = pc + 3;
+                uint8_t loop = body + operands[1] - 1;
+                uint64_t bodyTurnsLeft = UINT64_MAX;
+                uint64_t bodySeconds = 0;
+                measureBlock(body, loop, bodyTurnsLeft, bodySeconds);
+                uint64_t bodyTurns = UINT64_MAX - bodyTurnsLeft;
+
+                uint64_t whole = bodyTurns == 0 ? operands[0] : min((uint64_t)operands[0], (turnsLeft - 1) / bodyTurns);
+                turnsLeft -= whole * bodyTurns;
+                seconds += whole * bodySeconds;
+                if (whole < operands[0])
+                {
+                    measureBlock(body, loop, turnsLeft, seconds);
+                }
+                pc = loop + 1;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Exactly how long a session of `turns` takes, in seconds
+ */
+unsigned long PatternEngine::measure(unsigned long turns)
+{
+    if (turns == 0 || _passTurns == 0)
+    {
+        return 0;
+    }
+
+    uint64_t wholePasses = (turns - 1) / _passTurns;
+    uint64_t turnsLeft = turns - wholePasses * _passTurns;
+    uint64_t seconds = wholePasses * _passSeconds;
+    measureBlock(0, _pattern.length - 1, turnsLeft, seconds);
+
+    return (unsigned long)min(seconds, (uint64_t)UINT32_MAX);
+}
+
+/**
+ * The time one turn segment is planned for. A stepper's move also speeds up
+ * & slows down: at most v/a longer than cruising all the way, rounded up.
+ */
+uint32_t PatternEngine::getTurnSeconds(uint32_t turns, uint8_t speedPercent)
+{
+    if (!_timing.variableSpeed)
+    {
+        return turns * _timing.secondsPerRevolution;
+    }
+    return (uint32_t)ceil(turns * _timing.secondsPerRevolution * 100.0 / speedPercent + _timing.rampSeconds * speedPercent / 100.0);
+}
+
+uint32_t PatternEngine::getTurnsPerPass()
+{
+    return _passTurns;
+}
+
+uint64_t PatternEngine::getSecondsPerPass()
+{
+    return _passSeconds;
+}
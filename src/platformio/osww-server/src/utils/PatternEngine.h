@@ -0,0 +1,87 @@
+#include <Arduino.h>
+
+#include "PatternCompiler.h"
+
+#ifndef PatternEngine_H
+#define PatternEngine_H
+
+/**
+ * How long the motor takes to turn, so segments can be timed ahead
+ */
+struct PATTERN_TIMING
+{
+    uint16_t secondsPerRevolution;
+    bool variableSpeed; // a stepper: speed is honoured & each move ramps up & down
+    float rampSeconds;  // extra time a move at 100 % takes to speed up & slow down
+};
+
+enum PatternSegmentType
+{
+    PATTERN_SEGMENT_TURN,
+    PATTERN_SEGMENT_PAUSE
+};
+
+/**
+ * A stretch of the session: turning or resting, for a planned number of seconds
+ */
+struct PATTERN_SEGMENT
+{
+    PatternSegmentType type;
+    bool reverse; // turn the other way from this segment on
+    uint16_t turns;
+    uint8_t speedPercent; // 100 unless variableSpeed
+    uint32_t seconds;
+};
+
+/**
+ * Runs a compiled pattern as a list of segments, until a number of turns has
+ * been handed out. The last turn segment is cut down to the turns still owed,
+ * and nothing follows it.
+ *
+ * next() reaches the following segment in at most PATTERN_MAX_DEPTH loop
+ * instructions each way, so in constant time. measure() times a whole session
+ * without running it: whole passes through the pattern, & whole iterations of
+ * a repeat, are multiplied rather than walked.
+ *
+ * The pattern must have been compiled or verified.
+ */
+class PatternEngine
+{
+private:
+    struct LOOP_FRAME
+    {
+        uint8_t body; // offset of the body's first instruction
+        uint8_t left; // iterations, this one included
+    };
+
+    WINDING_PATTERN _pattern;
+    PATTERN_TIMING _timing;
+    uint32_t _passTurns;
+    uint64_t _passSeconds;
+
+    uint8_t _pc;
+    LOOP_FRAME _loops[PATTERN_MAX_DEPTH];
+    uint8_t _depth;
+    unsigned long _turnsLeft;
+
+    void measureBlock(uint8_t from, uint8_t to, uint64_t &turnsLeft, uint64_t &seconds);
+
+public:
+    PatternEngine();
+
+    void load(const WINDING_PATTERN &pattern, const PATTERN_TIMING &timing);
+
+    void begin(unsigned long turns);
+
+    bool next(PATTERN_SEGMENT &segment);
+
+    unsigned long measure(unsigned long turns);
+
+    uint32_t getTurnSeconds(uint32_t turns, uint8_t speedPercent);
+
+    uint32_t getTurnsPerPass();
+
+    uint64_t getSecondsPerPass();
+};
+
+#endif
@@ -0,0 +1,283 @@
+#include "PatternStore.h"
+
+#include <Preferences.h>
+#include <rom/crc.h>
+
+#include "ApiSchema.h"
+#include "Logger.h"
+
+#define PATTERN_NAMESPACE "patterns"
+#define PATTERN_ACTIVE_KEY "active"
+
+static_assert(patternSelectFields[PATTERN_SELECT_SLOT].max == PATTERN_SLOTS, "patternSelectFields out of sync");
+
+static uint32_t blobCrc(const PATTERN_BLOB &blob)
+{
+    return crc32_le(0, (const uint8_t *)&blob, offsetof(PATTERN_BLOB, crc));
+}
+
+static void slotKey(int slot, char *key, size_t size)
+{
+    snprintf(key, size, "slot%d", slot);
+}
+
+PatternStore::PatternStore()
+{
+    memset(_patterns, 0, sizeof(_patterns));
+    memset(_used, 0, sizeof(_used));
+    memset(_dirty, 0, sizeof(_dirty));
+    _active = 0;
+    _activeDirty = false;
+    _mutex = NULL;
+}
+
+void PatternStore::lock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+    }
+}
+
+void PatternStore::unlock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreGive(_mutex);
+    }
+}
+
+/**
+ * Fills in a blob ready to store; unused bytes are zeroed so the CRC only depends on the pattern
+ */
+void PatternStore::encode(const WINDING_PATTERN &pattern, PATTERN_BLOB &blob)
+{
+    memset(&blob, 0, sizeof(blob));
+    blob.version = PATTERN_BLOB_VERSION;
+    blob.size = sizeof(blob);
+    snprintf(blob.pattern.name, sizeof(blob.pattern.name), "%.*s", (int)sizeof(pattern.name) - 1, pattern.name);
+    blob.pattern.length = min(pattern.length, (uint8_t)PATTERN_CODE_SIZE);
+    memcpy(blob.pattern.code, pattern.code, blob.pattern.length);
+    blob.crc = blobCrc(blob);
+}
+
+/**
+ * Checks a blob read back from NVS
+ *
+ * @param length bytes that were read
+ * @return false if it's torn, corrupt, from an unknown version or not runnable
+ */
+bool PatternStore::decode(const PATTERN_BLOB &blob, size_t length, WINDING_PATTERN &pattern)
+{
+    // Only one layout so far; an older one would be converted here
+    if (length != sizeof(blob) || blob.size != sizeof(blob) || blob.version != PATTERN_BLOB_VERSION || blob.crc != blobCrc(blob))
+    {
+        return false;
+    }
+    if (!PatternCompiler::verify(blob.pattern))
+    {
+        return false;
+    }
+
+    pattern = blob.pattern;
+    return true;
+}
+
+/**
+ * Reads the patterns & the active slot. Call once at boot.
+ */
+void PatternStore::begin()
+{
+    _mutex = xSemaphoreCreateMutex();
+
+    Preferences preferences;
+    if (!preferences.begin(PATTERN_NAMESPACE, true))
+    {
+        return;
+    }
+
+    int loaded = 0;
+    for (int slot = 1; slot <= PATTERN_SLOTS; slot++)
+    {
+        char key[8];
+        slotKey(slot, key, sizeof(key));
+        PATTERN_BLOB blob;
+        size_t length = preferences.getBytes(key, &blob, sizeof(blob));
+        if (length == 0)
+        {
+            continue;
+        }
+
+        _used[slot - 1] = decode(blob, length, _patterns[slot - 1]);
+        if (!_used[slot - 1])
+        {
+            Log.warn(LOG_STATE, "Winding pattern %d is corrupt, dropped", slot);
+            continue;
+        }
+        loaded++;
+    }
+
+    _active = preferences.getUChar(PATTERN_ACTIVE_KEY, 0);
+    preferences.end();
+
+    if (_active < 0 || _active > PATTERN_SLOTS || (_active > 0 && !_used[_active - 1]))
+    {
+        _active = 0;
+    }
+    if (loaded > 0)
+    {
+        Log.status(LOG_STATE, "%d winding patterns, active: %d", loaded, _active);
+    }
+}
+
+/**
+ * Stores a compiled pattern in a slot, replacing what was there
+ *
+ * @param slot 1 to PATTERN_SLOTS
+ * @return false if the slot doesn't exist or the pattern doesn't verify
+ */
+bool PatternStore::put(int slot, const WINDING_PATTERN &pattern)
+{
+    if (slot < 1 || slot > PATTERN_SLOTS || !PatternCompiler::verify(pattern))
+    {
+        return false;
+    }
+
+    lock();
+    _patterns[slot - 1] = pattern;
+    _used[slot - 1] = true;
+    _dirty[slot - 1] = true;
+    unlock();
+    return true;
+}
+
+/**
+ * Empties a slot; if it was the active one, the sessions go back to the classic motion
+ */
+bool PatternStore::remove(int slot)
+{
+    if (slot < 1 || slot > PATTERN_SLOTS)
+    {
+        return false;
+    }
+
+    lock();
+    _used[slot - 1] = false;
+    _dirty[slot - 1] = true;
+    if (_active == slot)
+    {
+        _active = 0;
+        _activeDirty = true;
+    }
+    unlock();
+    return true;
+}
+
+/**
+ * Picks the pattern the sessions run from the next one on
+ *
+ * @param slot 0 for the classic motion, or a slot holding a pattern
+ */
+bool PatternStore::select(int slot)
+{
+    lock();
+    bool valid = slot == 0 || (slot >= 1 && slot <= PATTERN_SLOTS && _used[slot - 1]);
+    if (valid && slot != _active)
+    {
+        _active = slot;
+        _activeDirty = true;
+    }
+    unlock();
+    return valid;
+}
+
+/**
+ * @return false if the slot is empty
+ */
+bool PatternStore::get(int slot, WINDING_PATTERN &pattern)
+{
+    if (slot < 1 || slot > PATTERN_SLOTS)
+    {
+        return false;
+    }
+
+    lock();
+    bool used = _used[slot - 1];
+    if (used)
+    {
+        pattern = _patterns[slot - 1];
+    }
+    unlock();
+    return used;
+}
+
+/**
+ * @return the selected slot, 0 for the classic motion
+ */
+int PatternStore::getActive()
+{
+    return _active;
+}
+
+/**
+ * @return false for the classic motion
+ */
+bool PatternStore::getActivePattern(WINDING_PATTERN &pattern)
+{
+    lock();
+    int active = _active;
+    unlock();
+    return active > 0 && get(active, pattern);
+}
+
+/**
+ * Writes the slots & selection that changed to NVS
+ */
+void PatternStore::flush()
+{
+    if (!_activeDirty && memchr(_dirty, true, sizeof(_dirty)) == NULL)
+    {
+        return;
+    }
+
+    Preferences preferences;
+    if (!preferences.begin(PATTERN_NAMESPACE, false))
+    {
+        Log.error(LOG_STATE, "Failed to open the winding patterns in NVS");
+        return;
+    }
+
+    lock();
+    for (int slot = 1; slot <= PATTERN_SLOTS; slot++)
+    {
+        if (!_dirty[slot - 1])
+        {
+            continue;
+        }
+
+        char key[8];
+        slotKey(slot, key, sizeof(key));
+        if (!_used[slot - 1])
+        {
+            preferences.remove(key);
+        }
+        else
+        {
+            PATTERN_BLOB blob;
+            encode(_patterns[slot - 1], blob);
+            if (preferences.putBytes(key, &blob, sizeof(blob)) != sizeof(blob))
+            {
+                Log.error(LOG_STATE, "Failed to write winding pattern %d to NVS", slot);
+            }
+        }
+        _dirty[slot - 1] = false;
+    }
+    if (_activeDirty)
+    {
+        preferences.putUChar(PATTERN_ACTIVE_KEY, _active);
+        _activeDirty = false;
+    }
+    unlock();
+
+    preferences.end();
+}
@@ -0,0 +1,71 @@
+#include <Arduino.h>
+
+#include "PatternCompiler.h"
+
+#ifndef PatternStore_H
+#define PatternStore_H
+
+// Slots are numbered from 1; 0 is the classic motion
+#define PATTERN_SLOTS 4
+// Bump when PATTERN_BLOB changes, and convert the older layout in PatternStore::decode()
+#define PATTERN_BLOB_VERSION 1
+
+/**
+ * A pattern as kept in NVS
+ */
+struct PATTERN_BLOB
+{
+    uint16_t version;
+    uint16_t size; // sizeof(PATTERN_BLOB) of the version that wrote it
+    WINDING_PATTERN pattern;
+    uint32_t crc; // of everything above
+};
+
+/**
+ * Keeps the uploaded winding patterns, compiled, one NVS blob per slot, and
+ * which of them the sessions run. Only the bytecode is kept; the source is
+ * given back decompiled. A blob that fails its CRC, or doesn't verify, is
+ * dropped at load().
+ *
+ * put(), remove() & select() only change the copies in RAM; the loop calls
+ * them from queued commands, and flush() writes what changed after.
+ */
+class PatternStore
+{
+private:
+    WINDING_PATTERN _patterns[PATTERN_SLOTS];
+    bool _used[PATTERN_SLOTS];
+    bool _dirty[PATTERN_SLOTS];
+    int _active;
+    bool _activeDirty;
+    SemaphoreHandle_t _mutex;
+
+    void lock();
+
+    void unlock();
+
+public:
+    PatternStore();
+
+    void begin();
+
+    bool put(int slot, const WINDING_PATTERN &pattern);
+
+    bool remove(int slot);
+
+    bool select(int slot);
+
+    bool get(int slot, WINDING_PATTERN &pattern);
+
+    int getActive();
+
+    bool getActivePattern(WINDING_PATTERN &pattern);
+
+    void flush();
+
+    static void encode(const WINDING_PATTERN &pattern, PATTERN_BLOB &blob);
+
+    static bool decode(const PATTERN_BLOB &blob, size_t length, WINDING_PATTERN &pattern);
+};
+
+#endif
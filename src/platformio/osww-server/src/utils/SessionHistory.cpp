@@ -0,0 +1,222 @@
+#include "SessionHistory.h"
+
+#include <rom/crc.h>
+
+#include "Logger.h"
+
+#define HISTORY_ERASED_SEQUENCE 0xFFFFFFFF
+#define HISTORY_SLOTS_PER_SECTOR (HISTORY_SECTOR_SIZE / sizeof(SESSION_RECORD))
+// Records read per flash access while scanning at boot
+#define HISTORY_SCAN_RECORDS 16
+
+static uint32_t recordCrc(const SESSION_RECORD &record)
+{
+    return crc32_le(0, (const uint8_t *)&record, offsetof(SESSION_RECORD, crc));
+}
+
+SessionHistory::SessionHistory()
+{
+    _partition = NULL;
+    _slotCount = 0;
+    _nextSequence = 1;
+    _pendingCount = 0;
+    _mutex = NULL;
+}
+
+/**
+ * Finds the newest record, so appending carries on after it
+ *
+ * @return false if there's no history partition, see partitions.csv
+ */
+bool SessionHistory::begin()
+{
+    _mutex = xSemaphoreCreateMutex();
+    _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, HISTORY_PARTITION_LABEL);
+    if (_partition == NULL)
+    {
+        Log.error(LOG_HISTORY, "No history partition, sessions won't be recorded");
+        return false;
+    }
+    _slotCount = _partition->size / HISTORY_SECTOR_SIZE * HISTORY_SLOTS_PER_SECTOR;
+
+    uint32_t newestSequence = 0;
+    bool sawData = false;
+    SESSION_RECORD chunk[HISTORY_SCAN_RECORDS];
+    for (uint32_t first = 0; first < _slotCount; first += HISTORY_SCAN_RECORDS)
+    {
+        if (esp_partition_read(_partition, first * sizeof(SESSION_RECORD), chunk, sizeof(chunk)) != ESP_OK)
+        {
+            Log.error(LOG_HISTORY, "Failed to read the history partition");
+            _partition = NULL;
+            return false;
+        }
+
+        for (uint32_t i = 0; i < HISTORY_SCAN_RECORDS; i++)
+        {
+            sawData = sawData || chunk[i].sequence != HISTORY_ERASED_SEQUENCE;
+            if (isValid(chunk[i], first + i) && chunk[i].sequence > newestSequence)
+            {
+                newestSequence = chunk[i].sequence;
+            }
+        }
+    }
+
+    // Whatever was in the partition before it held the history
+    if (newestSequence == 0 && sawData)
+    {
+        Log.status(LOG_HISTORY, "Formatting the history partition");
+        esp_partition_erase_range(_partition, 0, _partition->size);
+    }
+
+    _nextSequence = newestSequence + 1;
+    Log.status(LOG_HISTORY, "Session history: newest session %u, room for %u", (unsigned)newestSequence, (unsigned)getCapacity());
+    return true;
+}
+
+bool SessionHistory::readSlot(uint32_t slot, SESSION_RECORD &record)
+{
+    return esp_partition_read(_partition, slot * sizeof(SESSION_RECORD), &record, sizeof(record)) == ESP_OK;
+}
+
+bool SessionHistory::isValid(const SESSION_RECORD &record, uint32_t slot)
+{
+    return record.sequence != HISTORY_ERASED_SEQUENCE &&
+           record.sequence != 0 &&
+           record.sequence % _slotCount == slot &&
+           record.crc == recordCrc(record);
+}
+
+bool SessionHistory::isBlank(uint32_t slot)
+{
+    SESSION_RECORD record;
+    if (!readSlot(slot, record))
+    {
+        return false;
+    }
+
+    const uint8_t *bytes = (const uint8_t *)&record;
+    for (size_t i = 0; i < sizeof(record); i++)
+    {
+        if (bytes[i] != 0xFF)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Writes the record to the slot of the next sequence number. Entering a sector
+ * erases it first; a slot left dirty by a torn write is skipped.
+ */
+void SessionHistory::write(SESSION_RECORD &record)
+{
+    uint32_t sequence = _nextSequence;
+    uint32_t slot = sequence % _slotCount;
+    while (slot % HISTORY_SLOTS_PER_SECTOR != 0 && !isBlank(slot))
+    {
+        sequence++;
+        slot = sequence % _slotCount;
+    }
+
+    if (slot % HISTORY_SLOTS_PER_SECTOR == 0 &&
+        esp_partition_erase_range(_partition, slot * sizeof(SESSION_RECORD), HISTORY_SECTOR_SIZE) != ESP_OK)
+    {
+        Log.error(LOG_HISTORY, "Failed to erase a history sector");
+        return;
+    }
+
+    record.sequence = sequence;
+    record.crc = recordCrc(record);
+    if (esp_partition_write(_partition, slot * sizeof(SESSION_RECORD), &record, sizeof(record)) != ESP_OK)
+    {
+        Log.error(LOG_HISTORY, "Failed to write a history record");
+    }
+    _nextSequence = sequence + 1;
+}
+
+/**
+ * Queues a finished session. Its sequence & CRC are filled in when it's written.
+ */
+void SessionHistory::record(const SESSION_RECORD &record)
+{
+    if (_partition == NULL)
+    {
+        return;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    bool queued = _pendingCount < HISTORY_PENDING_RECORDS;
+    if (queued)
+    {
+        _pending[_pendingCount++] = record;
+    }
+    xSemaphoreGive(_mutex);
+
+    if (!queued)
+    {
+        Log.warn(LOG_HISTORY, "History queue full, session not recorded");
+    }
+}
+
+/**
+ * Writes queued records to flash
+ */
+void SessionHistory::flush()
+{
+    if (_pendingCount == 0)
+    {
+        return;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (int i = 0; i < _pendingCount; i++)
+    {
+        write(_pending[i]);
+    }
+    _pendingCount = 0;
+    xSemaphoreGive(_mutex);
+}
+
+/**
+ * @return false if the record was dropped, torn or never written
+ */
+bool SessionHistory::read(uint32_t sequence, SESSION_RECORD &record)
+{
+    if (_partition == NULL || sequence == 0)
+    {
+        return false;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    uint32_t slot = sequence % _slotCount;
+    bool found = readSlot(slot, record) && isValid(record, slot) && record.sequence == sequence;
+    xSemaphoreGive(_mutex);
+    return found;
+}
+
+/**
+ * @return 0 when there's no history yet
+ */
+uint32_t SessionHistory::getNewestSequence()
+{
+    return _nextSequence - 1;
+}
+
+/**
+ * Oldest sequence number that may still be stored: everything but the
+ * unwritten rest of the sector being filled
+ */
+uint32_t SessionHistory::getOldestSequence()
+{
+    uint32_t stored = _slotCount - HISTORY_SLOTS_PER_SECTOR + _nextSequence % _slotCount % HISTORY_SLOTS_PER_SECTOR;
+    return _nextSequence > stored ? _nextSequence - stored : 1;
+}
+
+/**
+ * Sessions kept before the oldest ones are dropped
+ */
+uint32_t SessionHistory::getCapacity()
+{
+    return _slotCount - HISTORY_SLOTS_PER_SECTOR;
+}
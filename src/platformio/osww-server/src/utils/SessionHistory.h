@@ -0,0 +1,93 @@
+#include <Arduino.h>
+#include <esp_partition.h>
+
+#ifndef SessionHistory_H
+#define SessionHistory_H
+
+#define HISTORY_PARTITION_LABEL "history"
+#define HISTORY_SECTOR_SIZE 4096
+// Finished sessions waiting for the loop task to write them
+#define HISTORY_PENDING_RECORDS 4
+
+// Stored as a byte, append new reasons at the end
+enum HistoryStopReason
+{
+    HISTORY_STOP_COMPLETED,
+    HISTORY_STOP_USER,        // stop from the web UI, Home Assistant or the API
+    HISTORY_STOP_SWITCHED_OFF, // power switch or button
+    HISTORY_STOP_STALLED       // the motor stalled after every retry, see MotorLoad
+};
+
+// energyMilliwattHours of a session without current sensing
+#define HISTORY_ENERGY_UNKNOWN 0xFFFF
+
+/**
+ * One finished winding session, as stored in flash. Fixed size, so a record's
+ * slot follows from its sequence number & no index is needed.
+ */
+struct SESSION_RECORD
+{
+    uint32_t sequence; // 1, 2, 3...; 0xFFFFFFFF is an erased slot
+    uint32_t startEpoch;
+    uint32_t endEpoch;
+    uint16_t plannedTurns;
+    uint16_t deliveredTurns;
+    uint16_t clockwiseSeconds;
+    uint16_t counterClockwiseSeconds;
+    uint16_t pauses;
+    uint16_t pausedSeconds;
+    uint8_t direction;  // index into directionChoices
+    uint8_t stopReason; // HistoryStopReason
+    uint16_t energyMilliwattHours; // HISTORY_ENERGY_UNKNOWN if not measured; older records have it too
+    uint32_t crc; // of everything above
+};
+static_assert(sizeof(SESSION_RECORD) == 32, "SESSION_RECORD must stay 32 bytes, it's the on-flash format");
+
+/**
+ * Append-only log of winding sessions in its own flash partition.
+ *
+ * Records fill the partition's sectors in turn & wrap around, so every sector is
+ * erased equally often. A record is written once & never rewritten; the sector
+ * ahead is erased when writing reaches it, dropping the oldest sessions. A record
+ * torn by a power cut fails its CRC and is skipped.
+ *
+ * record() may be called from any task; flush() does the flash writes & belongs
+ * on the loop task.
+ */
+class SessionHistory
+{
+private:
+    const esp_partition_t *_partition;
+    uint32_t _slotCount;
+    uint32_t _nextSequence;
+    SESSION_RECORD _pending[HISTORY_PENDING_RECORDS];
+    int _pendingCount;
+    SemaphoreHandle_t _mutex;
+
+    bool readSlot(uint32_t slot, SESSION_RECORD &record);
+
+    bool isValid(const SESSION_RECORD &record, uint32_t slot);
+
+    bool isBlank(uint32_t slot);
+
+    void write(SESSION_RECORD &record);
+
+public:
+    SessionHistory();
+
+    bool begin();
+
+    void record(const SESSION_RECORD &record);
+
+    void flush();
+
+    bool read(uint32_t sequence, SESSION_RECORD &record);
+
+    uint32_t getNewestSequence();
+
+    uint32_t getOldestSequence();
+
+    uint32_t getCapacity();
+};
+
+#endif
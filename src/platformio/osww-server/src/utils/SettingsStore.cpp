@@ -0,0 +1,139 @@
+#include "SettingsStore.h"
+
+#include <Preferences.h>
+#include <rom/crc.h>
+
+#include "Logger.h"
+
+#define SETTINGS_NAMESPACE "settings"
+#define SETTINGS_KEY "winder"
+
+static uint32_t blobCrc(const SETTINGS_BLOB &blob)
+{
+    return crc32_le(0, (const uint8_t *)&blob, offsetof(SETTINGS_BLOB, crc));
+}
+
+SettingsStore::SettingsStore()
+{
+    memset(&_saved, 0, sizeof(_saved));
+    _hasSaved = false;
+    _loadMicros = 0;
+}
+
+/**
+ * Fills in a blob ready to store; the padding is zeroed so the CRC only depends on the settings
+ */
+void SettingsStore::encode(const WINDER_SETTINGS &settings, SETTINGS_BLOB &blob)
+{
+    memset(&blob, 0, sizeof(blob));
+    blob.version = SETTINGS_BLOB_VERSION;
+    blob.size = sizeof(blob);
+    blob.settings.rotationsPerDay = settings.rotationsPerDay;
+    blob.settings.direction = settings.direction;
+    blob.settings.hour = settings.hour;
+    blob.settings.minutes = settings.minutes;
+    blob.settings.timerEnabled = settings.timerEnabled;
+    blob.settings.winding = settings.winding;
+    blob.crc = blobCrc(blob);
+}
+
+/**
+ * Checks a blob read back from NVS
+ *
+ * @param length bytes that were read
+ * @return false if it's torn, corrupt, from an unknown version or out of range
+ */
+bool SettingsStore::decode(const SETTINGS_BLOB &blob, size_t length, WINDER_SETTINGS &settings)
+{
+    // Only one layout so far; an older one would be converted here
+    if (length != sizeof(blob) || blob.size != sizeof(blob) || blob.version != SETTINGS_BLOB_VERSION || blob.crc != blobCrc(blob))
+    {
+        return false;
+    }
+
+    const WINDER_SETTINGS &stored = blob.settings;
+    if (stored.rotationsPerDay < 100 || stored.rotationsPerDay > 960 || stored.direction > 2 || stored.hour > 23 || stored.minutes > 59)
+    {
+        return false;
+    }
+
+    settings = stored;
+    return true;
+}
+
+/**
+ * Reads the settings. Call once at boot.
+ *
+ * @return SETTINGS_MISSING if none were ever saved (or NVS was erased), SETTINGS_INVALID if they can't be used
+ */
+SettingsLoad SettingsStore::load(WINDER_SETTINGS &settings)
+{
+    unsigned long started = micros();
+
+    Preferences preferences;
+    if (!preferences.begin(SETTINGS_NAMESPACE, true))
+    {
+        _loadMicros = micros() - started;
+        return SETTINGS_MISSING;
+    }
+
+    SETTINGS_BLOB blob;
+    size_t length = preferences.getBytes(SETTINGS_KEY, &blob, sizeof(blob));
+    preferences.end();
+
+    SettingsLoad result = SETTINGS_MISSING;
+    if (length > 0)
+    {
+        result = decode(blob, length, settings) ? SETTINGS_LOADED : SETTINGS_INVALID;
+    }
+    if (result == SETTINGS_LOADED)
+    {
+        _saved = blob;
+        _hasSaved = true;
+    }
+
+    _loadMicros = micros() - started;
+    return result;
+}
+
+/**
+ * Stores the settings, unless they're already what's stored
+ *
+ * @return false if NVS couldn't be written
+ */
+bool SettingsStore::save(const WINDER_SETTINGS &settings)
+{
+    SETTINGS_BLOB blob;
+    encode(settings, blob);
+    if (_hasSaved && memcmp(&blob, &_saved, sizeof(blob)) == 0)
+    {
+        return true;
+    }
+
+    Preferences preferences;
+    if (!preferences.begin(SETTINGS_NAMESPACE, false))
+    {
+        Log.error(LOG_STATE, "Failed to open the settings in NVS");
+        return false;
+    }
+
+    size_t written = preferences.putBytes(SETTINGS_KEY, &blob, sizeof(blob));
+    preferences.end();
+    if (written != sizeof(blob))
+    {
+        Log.error(LOG_STATE, "Failed to write the settings to NVS");
+        return false;
+    }
+
+    _saved = blob;
+    _hasSaved = true;
+    return true;
+}
+
+/**
+ * How long load() took, NVS read & checks
+ */
+unsigned long SettingsStore::getLoadMicros()
+{
+    return _loadMicros;
+}
@@ -0,0 +1,69 @@
+#include <Arduino.h>
+
+#ifndef SettingsStore_H
+#define SettingsStore_H
+
+// Bump when SETTINGS_BLOB changes, and convert the older layout in SettingsStore::decode()
+#define SETTINGS_BLOB_VERSION 1
+
+/**
+ * The settings that survive a restart
+ */
+struct WINDER_SETTINGS
+{
+    uint16_t rotationsPerDay;
+    uint8_t direction; // index into directionChoices
+    uint8_t hour;
+    uint8_t minutes;
+    bool timerEnabled;
+    bool winding; // a session was running, it's resumed at boot
+};
+
+/**
+ * The settings as kept in NVS
+ */
+struct SETTINGS_BLOB
+{
+    uint16_t version;
+    uint16_t size; // sizeof(SETTINGS_BLOB) of the version that wrote it
+    WINDER_SETTINGS settings;
+    uint32_t crc; // of everything above
+};
+
+enum SettingsLoad
+{
+    SETTINGS_LOADED,
+    SETTINGS_MISSING,
+    SETTINGS_INVALID
+};
+
+/**
+ * Keeps the settings as one small binary blob in NVS, replacing
+ * /settings.json. Loading is a single NVS read & a CRC check, no file
+ * system or parsing. A blob that fails its CRC, or holds values out of
+ * range, isn't used.
+ *
+ * Writes that wouldn't change the blob are skipped, sparing the flash.
+ */
+class SettingsStore
+{
+private:
+    SETTINGS_BLOB _saved; // as last loaded or saved
+    bool _hasSaved;
+    unsigned long _loadMicros;
+
+public:
+    SettingsStore();
+
+    SettingsLoad load(WINDER_SETTINGS &settings);
+
+    bool save(const WINDER_SETTINGS &settings);
+
+    unsigned long getLoadMicros();
+
+    static void encode(const WINDER_SETTINGS &settings, SETTINGS_BLOB &blob);
+
+    static bool decode(const SETTINGS_BLOB &blob, size_t length, WINDER_SETTINGS &settings);
+};
+
+#endif
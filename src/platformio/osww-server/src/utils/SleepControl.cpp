@@ -0,0 +1,198 @@
+#include "SleepControl.h"
+
+#include <esp_sleep.h>
+
+#include "Logger.h"
+
+#define RTC_STATE_MAGIC 0x57444E32 // "WDN2"
+
+// Approximate board draw at the 5V input of an esp32doit-devkit-v1.
+// Deep sleep is dominated by the regulator & USB bridge, not the ESP32 itself.
+#define ACTIVE_POWER_MW 500
+#define DEEP_SLEEP_POWER_MW 40
+
+#define POWER_WINDOW_MS 86400000ULL
+
+// Never trust a calibration more than 5% off, it's more likely a bad NTP response
+#define MAX_DRIFT_PPM 50000
+
+RTC_DATA_ATTR static RTC_SLEEP_STATE rtcState;
+
+static int averagePower(uint64_t awakeMs, uint64_t sleepMs)
+{
+    uint64_t totalMs = awakeMs + sleepMs;
+    if (totalMs == 0)
+    {
+        return ACTIVE_POWER_MW;
+    }
+
+    return (int)((awakeMs * ACTIVE_POWER_MW + sleepMs * DEEP_SLEEP_POWER_MW) / totalMs);
+}
+
+static void copyToBuffer(char *buffer, size_t size, const String &value)
+{
+    strncpy(buffer, value.c_str(), size - 1);
+    buffer[size - 1] = '\0';
+}
+
+SleepControl::SleepControl(int wakeButtonPin)
+{
+    _wakeButtonPin = wakeButtonPin;
+    _resumedFromTimer = false;
+    _resumedFromButton = false;
+    _clockCalibrated = false;
+    _bootToMotorStartMs = -1;
+}
+
+void SleepControl::begin()
+{
+    esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+
+    if (rtcState.magic != RTC_STATE_MAGIC)
+    {
+        // Cold boot - RTC memory holds garbage
+        memset(&rtcState, 0, sizeof(rtcState));
+        rtcState.magic = RTC_STATE_MAGIC;
+        rtcState.lastDayPowerMw = -1;
+        return;
+    }
+
+    _resumedFromTimer = cause == ESP_SLEEP_WAKEUP_TIMER;
+    _resumedFromButton = cause == ESP_SLEEP_WAKEUP_EXT0;
+
+    if (_resumedFromTimer || _resumedFromButton)
+    {
+        Log.status(LOG_SLEEP, "Woke from deep sleep");
+    }
+}
+
+bool SleepControl::resumedFromTimer()
+{
+    return _resumedFromTimer;
+}
+
+bool SleepControl::resumedFromButton()
+{
+    return _resumedFromButton;
+}
+
+const RTC_SLEEP_STATE &SleepControl::getState()
+{
+    return rtcState;
+}
+
+void SleepControl::saveSchedule(const String &rotationsPerDay, const String &direction, const String &hour, const String &minutes, const String &timerEnabled)
+{
+    copyToBuffer(rtcState.rotationsPerDay, sizeof(rtcState.rotationsPerDay), rotationsPerDay);
+    copyToBuffer(rtcState.direction, sizeof(rtcState.direction), direction);
+    copyToBuffer(rtcState.hour, sizeof(rtcState.hour), hour);
+    copyToBuffer(rtcState.minutes, sizeof(rtcState.minutes), minutes);
+    rtcState.timerEnabled = timerEnabled == "1";
+}
+
+void SleepControl::recordSession(unsigned long startEpoch, unsigned long finishEpoch)
+{
+    rtcState.sessionsCompleted++;
+    rtcState.lastSessionStartEpoch = startEpoch;
+    rtcState.lastSessionFinishEpoch = finishEpoch;
+}
+
+void SleepControl::recordMotorStart()
+{
+    if (_bootToMotorStartMs < 0)
+    {
+        _bootToMotorStartMs = millis();
+        Log.status(LOG_SLEEP, "Boot to motor start (ms): %ld", _bootToMotorStartMs);
+    }
+}
+
+long SleepControl::getBootToMotorStartMs()
+{
+    return _bootToMotorStartMs;
+}
+
+/**
+ * Compares the RTC's idea of time after a timed wake against NTP and
+ * folds the difference into a drift estimate used for the next sleep.
+ *
+ * @param rtcEpoch epoch reported by the onboard RTC before the NTP update
+ * @param ntpEpoch epoch reported by the NTP server
+ */
+void SleepControl::calibrateClock(unsigned long rtcEpoch, unsigned long ntpEpoch)
+{
+    if (!_resumedFromTimer || _clockCalibrated || rtcState.plannedSleepSeconds == 0)
+    {
+        return;
+    }
+    _clockCalibrated = true;
+
+    long drift = (long)ntpEpoch - (long)rtcEpoch;
+    long long ppm = (long long)drift * 1000000LL / rtcState.plannedSleepSeconds;
+
+    if (ppm > MAX_DRIFT_PPM || ppm < -MAX_DRIFT_PPM)
+    {
+        Log.warn(LOG_SLEEP, "Ignoring implausible RTC drift");
+        return;
+    }
+
+    // Smooth over several nights; the slow clock wanders with temperature
+    rtcState.driftPpm = (rtcState.driftPpm * 3 + (int32_t)ppm) / 4;
+
+    Log.status(LOG_SLEEP, "RTC drift over sleep (s): %ld", drift);
+}
+
+/**
+ * Seconds from the current wall clock time until the next hh:mm occurrence
+ */
+unsigned long SleepControl::secondsUntil(int hour, int minute, int currentHour, int currentMinute, int currentSecond)
+{
+    long target = (long)hour * 3600 + (long)minute * 60;
+    long now = (long)currentHour * 3600 + (long)currentMinute * 60 + currentSecond;
+    long seconds = (target - now + 86400) % 86400;
+
+    return seconds == 0 ? 86400 : seconds;
+}
+
+/**
+ * Puts the ESP32 into deep sleep. Wakes after `seconds` or when the external button is pressed.
+ * Does not return.
+ */
+void SleepControl::sleepFor(unsigned long seconds, unsigned long currentEpoch)
+{
+    // A slow RTC oversleeps, so ask for correspondingly less
+    uint64_t sleepUs = (uint64_t)seconds * 1000000ULL;
+    sleepUs = sleepUs - (int64_t)sleepUs / 1000000LL * rtcState.driftPpm;
+
+    rtcState.epochAtSleep = currentEpoch;
+    rtcState.plannedSleepSeconds = seconds;
+    rtcState.awakeMs += millis();
+    rtcState.sleepMs += (uint64_t)seconds * 1000ULL;
+    if (rtcState.awakeMs + rtcState.sleepMs >= POWER_WINDOW_MS)
+    {
+        // This sleep closes the day; the next one starts from scratch
+        rtcState.lastDayPowerMw = averagePower(rtcState.awakeMs, rtcState.sleepMs);
+        rtcState.awakeMs = 0;
+        rtcState.sleepMs = 0;
+    }
+
+    Log.status(LOG_SLEEP, "Entering deep sleep for (s): %lu", seconds);
+    Log.flush();
+
+    esp_sleep_enable_timer_wakeup(sleepUs);
+    esp_sleep_enable_ext0_wakeup((gpio_num_t)_wakeButtonPin, HIGH);
+    esp_deep_sleep_start();
+}
+
+/**
+ * Average board power over the last whole day of waking & sleeping. Until the
+ * first day is out, over what has passed of it, the current awake period included.
+ */
+int SleepControl::getAveragePowerMilliwatts()
+{
+    if (rtcState.lastDayPowerMw >= 0)
+    {
+        return rtcState.lastDayPowerMw;
+    }
+
+    return averagePower(rtcState.awakeMs + millis(), rtcState.sleepMs);
+}
@@ -0,0 +1,74 @@
+#include <Arduino.h>
+
+#ifndef SleepControl_H
+#define SleepControl_H
+
+/**
+ * Everything Winderoo needs to resume a timed session after deep sleep.
+ * Lives in RTC slow memory, so it survives deep sleep but not a power cycle.
+ */
+struct RTC_SLEEP_STATE
+{
+    uint32_t magic;
+
+    // schedule
+    char rotationsPerDay[4];
+    char direction[5];
+    char hour[3];
+    char minutes[3];
+    uint8_t timerEnabled;
+
+    // progress
+    uint32_t sessionsCompleted;
+    uint32_t lastSessionStartEpoch;
+    uint32_t lastSessionFinishEpoch;
+
+    // clock calibration
+    uint32_t epochAtSleep;
+    uint32_t plannedSleepSeconds;
+    int32_t driftPpm;
+
+    // power accounting, over the current day
+    uint64_t awakeMs;
+    uint64_t sleepMs;
+    int32_t lastDayPowerMw; // -1 until a whole day has been accounted
+};
+
+class SleepControl
+{
+private:
+    int _wakeButtonPin;
+    bool _resumedFromTimer;
+    bool _resumedFromButton;
+    bool _clockCalibrated;
+    long _bootToMotorStartMs;
+
+public:
+    SleepControl(int wakeButtonPin);
+
+    void begin();
+
+    bool resumedFromTimer();
+
+    bool resumedFromButton();
+
+    const RTC_SLEEP_STATE &getState();
+
+    void saveSchedule(const String &rotationsPerDay, const String &direction, const String &hour, const String &minutes, const String &timerEnabled);
+
+    void recordSession(unsigned long startEpoch, unsigned long finishEpoch);
+
+    void recordMotorStart();
+
+    long getBootToMotorStartMs();
+
+    void calibrateClock(unsigned long rtcEpoch, unsigned long ntpEpoch);
+
+    unsigned long secondsUntil(int hour, int minute, int currentHour, int currentMinute, int currentSecond);
+
+    void sleepFor(unsigned long seconds, unsigned long currentEpoch);
+
+    int getAveragePowerMilliwatts();
+};
+
+#endif
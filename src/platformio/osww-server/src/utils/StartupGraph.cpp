@@ -0,0 +1,156 @@
+#include "StartupGraph.h"
+
+#include "Logger.h"
+
+StartupGraph::StartupGraph(BootProfiler &profiler) : _profiler(profiler)
+{
+    _stageCount = 0;
+}
+
+/**
+ * Registers a stage. Dependencies must already be registered.
+ *
+ * @param name stage name, must be a string literal
+ * @param function does the work
+ * @param dependsOn bit(id) of each stage that must finish first
+ * @param background run in its own task instead of blocking the caller
+ * @return stage id, or -1 if the graph is full
+ */
+int StartupGraph::addStage(const char *name, StartupStageFunction function, uint32_t dependsOn, bool background)
+{
+    if (_stageCount >= STARTUP_MAX_STAGES)
+    {
+        Log.error(LOG_STARTUP, "Too many startup stages");
+        return -1;
+    }
+
+    STARTUP_STAGE &stage = _stages[_stageCount];
+    stage.name = name;
+    stage.function = function;
+    stage.dependsOn = dependsOn;
+    stage.background = background;
+    stage.state = STAGE_PENDING;
+    stage.graph = this;
+
+    return _stageCount++;
+}
+
+bool StartupGraph::dependenciesDone(const STARTUP_STAGE &stage)
+{
+    for (int i = 0; i < _stageCount; i++)
+    {
+        if ((stage.dependsOn & bit(i)) && _stages[i].state != STAGE_DONE)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool StartupGraph::dependencyFailed(const STARTUP_STAGE &stage)
+{
+    for (int i = 0; i < _stageCount; i++)
+    {
+        if ((stage.dependsOn & bit(i)) && (_stages[i].state == STAGE_FAILED || _stages[i].state == STAGE_SKIPPED))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void StartupGraph::execute(STARTUP_STAGE &stage)
+{
+    stage.state = STAGE_RUNNING;
+    unsigned long startMs = millis();
+
+    bool success = stage.function();
+
+    unsigned long durationMs = millis() - startMs;
+    stage.state = success ? STAGE_DONE : STAGE_FAILED;
+    _profiler.recordPhase(stage.name, startMs, durationMs);
+
+    Log.status(LOG_STARTUP, "Startup stage %s %s in %lu ms", stage.name, success ? "done" : "failed", durationMs);
+}
+
+void StartupGraph::backgroundTask(void *parameters)
+{
+    STARTUP_STAGE &stage = *(STARTUP_STAGE *)parameters;
+    StartupGraph &graph = *stage.graph;
+
+    while (stage.state == STAGE_PENDING)
+    {
+        if (graph.dependencyFailed(stage))
+        {
+            stage.state = STAGE_SKIPPED;
+        }
+        else if (graph.dependenciesDone(stage))
+        {
+            graph.execute(stage);
+        }
+        else
+        {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+
+    vTaskDelete(NULL);
+}
+
+/**
+ * Starts the background stages, then runs the foreground stages in registration order
+ * as their dependencies finish. Returns once every foreground stage has run or been skipped;
+ * background stages may still be running.
+ */
+void StartupGraph::run()
+{
+    for (int i = 0; i < _stageCount; i++)
+    {
+        if (_stages[i].background)
+        {
+            xTaskCreate(backgroundTask, _stages[i].name, STARTUP_BACKGROUND_STACK_SIZE, &_stages[i], 1, NULL);
+        }
+    }
+
+    bool foregroundPending = true;
+    while (foregroundPending)
+    {
+        foregroundPending = false;
+        bool progress = false;
+
+        for (int i = 0; i < _stageCount; i++)
+        {
+            STARTUP_STAGE &stage = _stages[i];
+            if (stage.background || stage.state != STAGE_PENDING)
+            {
+                continue;
+            }
+
+            if (dependencyFailed(stage))
+            {
+                stage.state = STAGE_SKIPPED;
+                progress = true;
+            }
+            else if (dependenciesDone(stage))
+            {
+                execute(stage);
+                progress = true;
+            }
+            else
+            {
+                foregroundPending = true;
+            }
+        }
+
+        // Waiting on a background stage
+        if (foregroundPending && !progress)
+        {
+            delay(10);
+        }
+    }
+}
+
+bool StartupGraph::isDone(int stage)
+{
+    return stage >= 0 && stage < _stageCount && _stages[stage].state == STAGE_DONE;
+}
@@ -0,0 +1,67 @@
+#include <Arduino.h>
+
+#include "BootProfiler.h"
+
+#ifndef StartupGraph_H
+#define StartupGraph_H
+
+#define STARTUP_MAX_STAGES 12
+#define STARTUP_BACKGROUND_STACK_SIZE 4096
+
+class StartupGraph;
+
+/**
+ * A stage returns false if it failed; stages depending on it are then skipped.
+ */
+typedef bool (*StartupStageFunction)();
+
+enum StartupStageState : uint8_t
+{
+    STAGE_PENDING,
+    STAGE_RUNNING,
+    STAGE_DONE,
+    STAGE_FAILED,
+    STAGE_SKIPPED
+};
+
+struct STARTUP_STAGE
+{
+    const char *name;
+    StartupStageFunction function;
+    uint32_t dependsOn; // bit mask of stage ids
+    bool background;
+    volatile StartupStageState state;
+    StartupGraph *graph;
+};
+
+/**
+ * Startup expressed as stages with dependencies. Foreground stages run in order on
+ * the caller as soon as their dependencies are done; background stages get a task of
+ * their own and run concurrently. Every stage reports its duration to the BootProfiler.
+ */
+class StartupGraph
+{
+private:
+    STARTUP_STAGE _stages[STARTUP_MAX_STAGES];
+    int _stageCount;
+    BootProfiler &_profiler;
+
+    bool dependenciesDone(const STARTUP_STAGE &stage);
+
+    bool dependencyFailed(const STARTUP_STAGE &stage);
+
+    void execute(STARTUP_STAGE &stage);
+
+    static void backgroundTask(void *parameters);
+
+public:
+    StartupGraph(BootProfiler &profiler);
+
+    int addStage(const char *name, StartupStageFunction function, uint32_t dependsOn = 0, bool background = false);
+
+    void run();
+
+    bool isDone(int stage);
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "StateStore.h"
+
+#include "Logger.h"
+
+StateStore::StateStore()
+{
+    _pending = 0;
+    _version = 0;
+    _subscriberCount = 0;
+    _mutex = NULL;
+}
+
+/**
+ * Call once before any other task touches the store
+ */
+void StateStore::begin()
+{
+    if (_mutex == NULL)
+    {
+        _mutex = xSemaphoreCreateRecursiveMutex();
+    }
+}
+
+void StateStore::lock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreTakeRecursive(_mutex, portMAX_DELAY);
+    }
+}
+
+void StateStore::unlock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreGiveRecursive(_mutex);
+    }
+}
+
+/**
+ * Current state, for reading. Another task may change it meanwhile;
+ * hold lock() while reading several fields that belong together.
+ */
+const WINDER_STATE &StateStore::get()
+{
+    return _state;
+}
+
+void StateStore::setField(String &field, const String &value, uint32_t mask)
+{
+    lock();
+    if (field != value)
+    {
+        field = value;
+        _pending |= mask;
+    }
+    unlock();
+}
+
+void StateStore::setStatus(const String &status)
+{
+    setField(_state.status, status, STATE_STATUS);
+}
+
+void StateStore::setRotationsPerDay(const String &rotationsPerDay)
+{
+    setField(_state.rotationsPerDay, rotationsPerDay, STATE_ROTATIONS_PER_DAY);
+}
+
+void StateStore::setDirection(const String &direction)
+{
+    setField(_state.direction, direction, STATE_DIRECTION);
+}
+
+void StateStore::setHour(const String &hour)
+{
+    setField(_state.hour, hour, STATE_TIMER);
+}
+
+void StateStore::setMinutes(const String &minutes)
+{
+    setField(_state.minutes, minutes, STATE_TIMER);
+}
+
+void StateStore::setTimerEnabled(const String &timerEnabled)
+{
+    setField(_state.timerEnabled, timerEnabled, STATE_TIMER);
+}
+
+void StateStore::setWinderEnabled(const String &winderEnabled)
+{
+    setField(_state.winderEnabled, winderEnabled, STATE_WINDER_ENABLED);
+}
+
+void StateStore::setScreenSleep(bool screenSleep)
+{
+    lock();
+    if (_state.screenSleep != screenSleep)
+    {
+        _state.screenSleep = screenSleep;
+        _pending |= STATE_SCREEN_SLEEP;
+    }
+    unlock();
+}
+
+/**
+ * Queues a message for the user. Only the latest one of a tick is delivered.
+ *
+ * @param notice a string literal, it isn't copied
+ */
+void StateStore::notify(const char *notice)
+{
+    lock();
+    _state.notice = notice;
+    _pending |= STATE_NOTICE;
+    unlock();
+}
+
+/**
+ * Marks fields changed without changing them, e.g. to republish everything after a reconnect
+ */
+void StateStore::touch(uint32_t fields)
+{
+    lock();
+    _pending |= fields;
+    unlock();
+}
+
+/**
+ * Drops changes nobody needs to hear about, e.g. settings just loaded from the file
+ */
+void StateStore::discardChanges()
+{
+    lock();
+    _pending = 0;
+    unlock();
+}
+
+bool StateStore::subscribe(const char *name, uint32_t fields, StateListener listener)
+{
+    lock();
+    bool added = _subscriberCount < STATE_MAX_SUBSCRIBERS;
+    if (added)
+    {
+        _subscribers[_subscriberCount].name = name;
+        _subscribers[_subscriberCount].fields = fields;
+        _subscribers[_subscriberCount].listener = listener;
+        _subscriberCount++;
+    }
+    unlock();
+
+    if (!added)
+    {
+        Log.error(LOG_STATE, "Too many state subscribers, %s not added", name);
+    }
+    return added;
+}
+
+/**
+ * Delivers the changes made since the last call. Call from loop() only; subscribers
+ * run on the loop task, with a snapshot so they don't block the setters.
+ */
+void StateStore::dispatch()
+{
+    if (_pending == 0)
+    {
+        return;
+    }
+
+    lock();
+    uint32_t changed = _pending;
+    _pending = 0;
+    _snapshot = _state;
+    unlock();
+
+    // A notice alone leaves the state as it was
+    if (changed & ~STATE_NOTICE)
+    {
+        _version++;
+    }
+
+    for (int i = 0; i < _subscriberCount; i++)
+    {
+        if (_subscribers[i].fields & changed)
+        {
+            _subscribers[i].listener(changed, _snapshot);
+        }
+    }
+}
+
+/**
+ * Goes up by one with every dispatch() that changed the state, so anyone who
+ * saw an older number knows their copy is stale. Starts over at boot.
+ */
+uint32_t StateStore::getVersion()
+{
+    return _version;
+}
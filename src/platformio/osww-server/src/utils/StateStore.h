@@ -0,0 +1,110 @@
+#include <Arduino.h>
+
+#ifndef StateStore_H
+#define StateStore_H
+
+#define STATE_MAX_SUBSCRIBERS 8
+
+/**
+ * What changed, as bits of a mask. Subscribers pick the ones they care about.
+ */
+enum StateField
+{
+    STATE_STATUS = 1 << 0,
+    STATE_ROTATIONS_PER_DAY = 1 << 1,
+    STATE_DIRECTION = 1 << 2,
+    STATE_TIMER = 1 << 3, // hour, minutes & timerEnabled
+    STATE_WINDER_ENABLED = 1 << 4,
+    STATE_SCREEN_SLEEP = 1 << 5,
+    STATE_NOTICE = 1 << 6, // one-off message for the user, e.g. "Winding Complete"
+    STATE_ALL = (1 << 7) - 1
+};
+
+/**
+ * The user facing state, in the formats the API & settings file have always used
+ */
+struct WINDER_STATE
+{
+    String status = "";
+    String rotationsPerDay = "";
+    String direction = "";
+    String hour = "00";
+    String minutes = "00";
+    String winderEnabled = "1";
+    String timerEnabled = "0";
+    bool screenSleep = false;
+    const char *notice = "";
+};
+
+typedef void (*StateListener)(uint32_t changed, const WINDER_STATE &state);
+
+struct STATE_SUBSCRIBER
+{
+    const char *name;
+    uint32_t fields;
+    StateListener listener;
+};
+
+/**
+ * Single owner of the winder's state. Commands change it through the setters,
+ * which only record what actually changed. dispatch() then tells each subscriber
+ * once about everything that changed since the last call, so a burst of changes
+ * in one loop() tick costs one redraw, one publish & one file write.
+ *
+ * Setters may be called from any task. Wrap a multi-field command in
+ * lock()/unlock() and subscribers will see all of it or none of it.
+ */
+class StateStore
+{
+private:
+    WINDER_STATE _state;
+    WINDER_STATE _snapshot;
+    volatile uint32_t _pending;
+    uint32_t _version;
+    STATE_SUBSCRIBER _subscribers[STATE_MAX_SUBSCRIBERS];
+    int _subscriberCount;
+    SemaphoreHandle_t _mutex;
+
+    void setField(String &field, const String &value, uint32_t mask);
+
+public:
+    StateStore();
+
+    void begin();
+
+    void lock();
+
+    void unlock();
+
+    const WINDER_STATE &get();
+
+    void setStatus(const String &status);
+
+    void setRotationsPerDay(const String &rotationsPerDay);
+
+    void setDirection(const String &direction);
+
+    void setHour(const String &hour);
+
+    void setMinutes(const String &minutes);
+
+    void setTimerEnabled(const String &timerEnabled);
+
+    void setWinderEnabled(const String &winderEnabled);
+
+    void setScreenSleep(bool screenSleep);
+
+    void notify(const char *notice);
+
+    void touch(uint32_t fields);
+
+    void discardChanges();
+
+    bool subscribe(const char *name, uint32_t fields, StateListener listener);
+
+    void dispatch();
+
+    uint32_t getVersion();
+};
+
+#endif
@@ -0,0 +1,182 @@
+#include "StepWaveform.h"
+
+// Corrects the first step of Austin's approximation, see the paper
+#define STEP_FIRST_PERIOD_FACTOR 0.676f
+
+static_assert(sizeof(STEP_ITEM) == sizeof(uint32_t), "STEP_ITEM must be laid out like rmt_item32_t");
+static_assert(STEP_MAX_STEPS_PER_SECOND * 2 * STEP_PULSE_TICKS <= STEP_TICKS_PER_SECOND, "A step needs low time after its pulse");
+
+/**
+ * Takes up to an item half's worth of low time. Never leaves a single tick
+ * behind: it couldn't be split across an item's two halves, and a duration of
+ * 0 would end the transmission.
+ */
+static uint32_t takeTicks(uint32_t &ticks)
+{
+    uint32_t taken = ticks;
+    if (ticks > STEP_MAX_ITEM_TICKS)
+    {
+        taken = ticks - STEP_MAX_ITEM_TICKS >= 2 ? STEP_MAX_ITEM_TICKS : STEP_MAX_ITEM_TICKS - 1;
+    }
+    ticks -= taken;
+    return taken;
+}
+
+StepWaveform::StepWaveform()
+{
+    begin({0, 1, 1});
+}
+
+/**
+ * Starts a move from a standstill
+ */
+void StepWaveform::begin(const STEP_PROFILE &profile)
+{
+    _profile = profile;
+    _profile.stepsPerSecond = profile.stepsPerSecond < 1 ? 1 : min(profile.stepsPerSecond, (uint32_t)STEP_MAX_STEPS_PER_SECOND);
+    _profile.acceleration = profile.acceleration < 1 ? 1 : profile.acceleration;
+
+    // v² / 2a steps to reach the speed
+    float speed = _profile.stepsPerSecond;
+    float ramp = ceilf(speed * speed / (2.0f * _profile.acceleration));
+    _fullRamp = ramp <= _profile.steps / 2;
+    _rampSteps = _fullRamp ? (uint32_t)ramp : _profile.steps / 2;
+    _decelerateFrom = _profile.steps - _rampSteps;
+
+    _firstPeriod = STEP_FIRST_PERIOD_FACTOR * STEP_TICKS_PER_SECOND * sqrtf(2.0f / _profile.acceleration);
+    _cruisePeriod = (float)STEP_TICKS_PER_SECOND / _profile.stepsPerSecond;
+    _period = _firstPeriod;
+    _n = 0;
+    _step = 0;
+    _roundingTicks = 0;
+    _lowTicks = 0;
+}
+
+/**
+ * The period of the next step, in ticks
+ */
+float StepWaveform::nextPeriod()
+{
+    if (_step == 0)
+    {
+        _n = 0;
+        _period = _firstPeriod;
+    }
+    else if (_step < _rampSteps)
+    {
+        _n++;
+        _period -= 2 * _period / (4 * _n + 1);
+    }
+    else if (_step > _decelerateFrom && _n > 0)
+    {
+        // The way up in reverse
+        _period += 2 * _period / (4 * _n - 1);
+        _n--;
+    }
+
+    bool cruising = _fullRamp && _step >= _rampSteps && _step < _decelerateFrom;
+    return cruising ? _cruisePeriod : max(_period, _cruisePeriod);
+}
+
+/**
+ * Writes the next items of the waveform: one per step, plus one for every
+ * further 65 ms of a slow step's low time
+ *
+ * @return items written, 0 once the move is over
+ */
+size_t StepWaveform::fill(STEP_ITEM *items, size_t count)
+{
+    size_t filled = 0;
+    while (filled < count)
+    {
+        STEP_ITEM &item = items[filled];
+        if (_lowTicks > 0)
+        {
+            item.level0 = 0;
+            item.duration0 = takeTicks(_lowTicks);
+            item.level1 = 0;
+            if (_lowTicks == 0)
+            {
+                item.duration1 = item.duration0 / 2;
+                item.duration0 -= item.duration1;
+            }
+            else
+            {
+                item.duration1 = takeTicks(_lowTicks);
+            }
+        }
+        else if (_step < _profile.steps)
+        {
+            float period = nextPeriod() + _roundingTicks;
+            uint32_t ticks = (uint32_t)period;
+            _roundingTicks = period - ticks;
+            _step++;
+
+            _lowTicks = ticks - STEP_PULSE_TICKS;
+            item.level0 = 1;
+            item.duration0 = STEP_PULSE_TICKS;
+            item.level1 = 0;
+            item.duration1 = takeTicks(_lowTicks);
+        }
+        else
+        {
+            break;
+        }
+        filled++;
+    }
+    return filled;
+}
+
+/**
+ * Cuts the move short: slows down to a stop as soon as the acceleration
+ * allows, from the next step generated
+ */
+void StepWaveform::stop()
+{
+    if (_step > _decelerateFrom)
+    {
+        return;
+    }
+
+    // The way up so far, in reverse
+    uint32_t steps = _step == 0 ? 0 : _step + _n + 1;
+    if (steps < _profile.steps)
+    {
+        _profile.steps = steps;
+        _rampSteps = min(_rampSteps, _step);
+        _decelerateFrom = _step;
+    }
+}
+
+bool StepWaveform::isDone()
+{
+    return _step >= _profile.steps && _lowTicks == 0;
+}
+
+/**
+ * Steps generated so far. Every one of them is output: the count is exact once the items are sent.
+ */
+uint32_t StepWaveform::getSteps()
+{
+    return _step;
+}
+
+/**
+ * Steps the move ends on, fewer after a stop()
+ */
+uint32_t StepWaveform::getPlannedSteps()
+{
+    return _profile.steps;
+}
+
+/**
+ * The profile of a move measured in turns
+ */
+STEP_PROFILE StepWaveform::forTurns(uint32_t turns, float turnsPerMinute, uint32_t stepsPerTurn, uint32_t acceleration)
+{
+    STEP_PROFILE profile;
+    profile.steps = (uint32_t)min((uint64_t)turns * stepsPerTurn, (uint64_t)UINT32_MAX);
+    profile.stepsPerSecond = (uint32_t)(turnsPerMinute * stepsPerTurn / 60.0f + 0.5f);
+    profile.acceleration = acceleration;
+    return profile;
+}
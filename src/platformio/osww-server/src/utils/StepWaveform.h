@@ -0,0 +1,85 @@
+#include <Arduino.h>
+
+#ifndef StepWaveform_H
+#define StepWaveform_H
+
+// Pulse timing is in ticks of 1 us, the RMT's 80 MHz clock divided by 80
+#define STEP_TICKS_PER_SECOND 1000000UL
+// STEP is held high this long; the A4988 needs 1 us, the TMC2209 100 ns
+#define STEP_PULSE_TICKS 4
+// The longest either half of an item lasts, RMT durations are 15 bits
+#define STEP_MAX_ITEM_TICKS 32767
+// Speeds above this leave no low time between pulses
+#define STEP_MAX_STEPS_PER_SECOND (STEP_TICKS_PER_SECOND / (2 * STEP_PULSE_TICKS))
+
+/**
+ * One RMT item: a level held for duration0 ticks, then another for
+ * duration1. Laid out like the driver's rmt_item32_t, so a buffer of these is
+ * handed to it as is.
+ */
+struct STEP_ITEM
+{
+    uint32_t duration0 : 15;
+    uint32_t level0 : 1;
+    uint32_t duration1 : 15;
+    uint32_t level1 : 1;
+};
+
+/**
+ * A move: how many steps, the speed to cruise at & how quickly to get there
+ */
+struct STEP_PROFILE
+{
+    uint32_t steps;
+    uint32_t stepsPerSecond;
+    uint32_t acceleration; // steps/s², the same speeding up & slowing down
+};
+
+/**
+ * The STEP waveform of one move with a trapezoidal speed profile: accelerate,
+ * cruise, then decelerate to a stop on the last step. A move too short to
+ * reach its speed turns round halfway.
+ *
+ * Periods follow D. Austin's "Generate stepper-motor speed profiles in real
+ * time", one multiply & divide per step. Every step is exactly one pulse, so
+ * the count is exact whatever the rounding of the timing.
+ *
+ * No hardware involved: StepperDriver feeds the items to the RMT, the
+ * simulator checks them on the host.
+ */
+class StepWaveform
+{
+private:
+    STEP_PROFILE _profile;
+    uint32_t _step;            // steps generated so far
+    uint32_t _rampSteps;       // accelerating for the first this many
+    uint32_t _decelerateFrom;  // the first step slowing down
+    bool _fullRamp;            // the ramp reaches the cruising speed
+    uint32_t _n;               // where the last step is on the ramp
+    float _period;             // ticks, of the last step while on the ramp
+    float _firstPeriod;
+    float _cruisePeriod;
+    float _roundingTicks;      // carried over, so rounding doesn't add up over a move
+    uint32_t _lowTicks;        // of the last step, not yet in an item
+
+    float nextPeriod();
+
+public:
+    StepWaveform();
+
+    void begin(const STEP_PROFILE &profile);
+
+    size_t fill(STEP_ITEM *items, size_t count);
+
+    void stop();
+
+    bool isDone();
+
+    uint32_t getSteps();
+
+    uint32_t getPlannedSteps();
+
+    static STEP_PROFILE forTurns(uint32_t turns, float turnsPerMinute, uint32_t stepsPerTurn, uint32_t acceleration);
+};
+
+#endif
@@ -0,0 +1,191 @@
+#include "StepperDriver.h"
+
+#include "Logger.h"
+
+static_assert(sizeof(STEP_ITEM) == sizeof(rmt_item32_t), "STEP_ITEM must be laid out like rmt_item32_t");
+
+StepperDriver::StepperDriver(int stepPin, int dirPin, uint32_t stepsPerTurn, uint32_t acceleration, float turnsPerMinute)
+{
+    _stepPin = stepPin;
+    _dirPin = dirPin;
+    _stepsPerTurn = max(stepsPerTurn, (uint32_t)1);
+    _acceleration = acceleration;
+    _turnsPerMinute = turnsPerMinute;
+    _direction = 0;
+    _moving = false;
+    _steps = 0;
+    _task = NULL;
+    _mutex = NULL;
+}
+
+void StepperDriver::lock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+    }
+}
+
+void StepperDriver::unlock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreGive(_mutex);
+    }
+}
+
+/**
+ * Hands STEP to the RMT & starts the task that feeds it
+ */
+bool StepperDriver::begin()
+{
+    rmt_config_t config = RMT_DEFAULT_CONFIG_TX((gpio_num_t)_stepPin, STEPPER_RMT_CHANNEL);
+    config.clk_div = STEPPER_RMT_CLOCK_DIVIDER;
+    config.tx_config.idle_output_en = true;
+    config.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+
+    if (rmt_config(&config) != ESP_OK || rmt_driver_install(STEPPER_RMT_CHANNEL, 0, 0) != ESP_OK)
+    {
+        Log.error(LOG_MOTOR, "Couldn't set up the RMT, the stepper won't turn");
+        return false;
+    }
+
+    _mutex = xSemaphoreCreateMutex();
+    if (xTaskCreate(stepTask, "stepper", STEPPER_STACK_SIZE, this, 5, &_task) != pdPASS)
+    {
+        Log.error(LOG_MOTOR, "Couldn't start the stepper task");
+        return false;
+    }
+
+    Log.status(LOG_MOTOR, "Stepper on STEP %d, DIR %d, %u steps per turn", _stepPin, _dirPin, (unsigned)_stepsPerTurn);
+    return true;
+}
+
+void StepperDriver::stepTask(void *parameters)
+{
+    StepperDriver *driver = (StepperDriver *)parameters;
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        driver->output();
+    }
+}
+
+/**
+ * Sends a whole move. Each chunk is generated while the one before it is
+ * still going out; rmt_write_items() waits for that one to finish, by when
+ * its buffer is free again.
+ */
+void StepperDriver::output()
+{
+    int buffer = 0;
+    for (;;)
+    {
+        lock();
+        size_t count = _waveform.fill(_items[buffer], STEPPER_CHUNK_ITEMS);
+        unlock();
+        if (count == 0)
+        {
+            break;
+        }
+
+        rmt_write_items(STEPPER_RMT_CHANNEL, (const rmt_item32_t *)_items[buffer], count, false);
+        buffer = !buffer;
+    }
+    rmt_wait_tx_done(STEPPER_RMT_CHANNEL, portMAX_DELAY);
+
+    lock();
+    _steps += _waveform.getSteps();
+    _direction = 0;
+    _moving = false;
+    unlock();
+}
+
+/**
+ * Slows the move in progress to a stop & waits for it, a fraction of a second
+ */
+void StepperDriver::stopAndWait()
+{
+    lock();
+    if (_moving)
+    {
+        _waveform.stop();
+    }
+    unlock();
+
+    while (_moving)
+    {
+        delay(1);
+    }
+}
+
+void StepperDriver::drive(int direction)
+{
+    if (direction == 0)
+    {
+        lock();
+        if (_moving)
+        {
+            _waveform.stop();
+        }
+        unlock();
+        return;
+    }
+
+    lock();
+    bool running = _moving && _direction == direction && _waveform.getPlannedSteps() == UINT32_MAX;
+    unlock();
+    if (!running)
+    {
+        move(direction, UINT32_MAX / _stepsPerTurn + 1, _turnsPerMinute);
+    }
+}
+
+bool StepperDriver::countsTurns()
+{
+    return true;
+}
+
+/**
+ * Starts a move, after slowing any other one to a stop
+ */
+void StepperDriver::move(int direction, uint32_t turns, float turnsPerMinute)
+{
+    stopAndWait();
+    if (_task == NULL || direction == 0 || turns == 0)
+    {
+        return;
+    }
+
+    // The driver reads DIR well before the first pulse
+    digitalWrite(_dirPin, direction > 0 ? HIGH : LOW);
+
+    lock();
+    _waveform.begin(StepWaveform::forTurns(turns, turnsPerMinute, _stepsPerTurn, _acceleration));
+    _direction = direction;
+    _moving = true;
+    unlock();
+
+    xTaskNotifyGive(_task);
+}
+
+bool StepperDriver::isMoving()
+{
+    return _moving;
+}
+
+uint32_t StepperDriver::getTurnsMoved()
+{
+    lock();
+    uint64_t steps = _steps + (_moving ? _waveform.getSteps() : 0);
+    unlock();
+    return (uint32_t)(steps / _stepsPerTurn);
+}
+
+/**
+ * v/a: half of it speeding up, half slowing down
+ */
+float StepperDriver::getRampSeconds(float turnsPerMinute)
+{
+    return turnsPerMinute * _stepsPerTurn / 60.0f / max(_acceleration, (uint32_t)1);
+}
@@ -0,0 +1,71 @@
+#include <Arduino.h>
+#include <driver/rmt.h>
+
+#include "MotorDriver.h"
+#include "StepWaveform.h"
+
+#ifndef StepperDriver_H
+#define StepperDriver_H
+
+#define STEPPER_RMT_CHANNEL RMT_CHANNEL_0
+// 80 MHz APB clock / 80, the 1 us ticks StepWaveform counts in
+#define STEPPER_RMT_CLOCK_DIVIDER 80
+// Items generated at a time, two such buffers take turns
+#define STEPPER_CHUNK_ITEMS 64
+#define STEPPER_STACK_SIZE 3072
+
+/**
+ * A stepper on a STEP/DIR driver board (A4988, DRV8825, TMC2209 in STEP/DIR
+ * mode). STEP is a pin of the RMT peripheral, which times every pulse on its
+ * own; a task only tops it up with the next chunk of StepWaveform's items, a
+ * few times a second. DIR is a plain GPIO, set before each move.
+ *
+ * Every pulse is a step, so turns are counted rather than estimated. drive()
+ * runs at the speed given to the constructor until stopped; stopping, or a
+ * move in the other direction, slows down first.
+ */
+class StepperDriver : public MotorDriver
+{
+private:
+    int _stepPin;
+    int _dirPin;
+    uint32_t _stepsPerTurn;
+    uint32_t _acceleration;
+    float _turnsPerMinute;
+    int _direction; // of the move in progress, 0 if none
+    StepWaveform _waveform;
+    STEP_ITEM _items[2][STEPPER_CHUNK_ITEMS];
+    volatile bool _moving;
+    uint64_t _steps; // of the moves that are over
+    TaskHandle_t _task;
+    SemaphoreHandle_t _mutex;
+
+    void lock();
+
+    void unlock();
+
+    static void stepTask(void *parameters);
+
+    void output();
+
+    void stopAndWait();
+
+public:
+    StepperDriver(int stepPin, int dirPin, uint32_t stepsPerTurn, uint32_t acceleration, float turnsPerMinute);
+
+    bool begin() override;
+
+    void drive(int direction) override;
+
+    bool countsTurns() override;
+
+    void move(int direction, uint32_t turns, float turnsPerMinute) override;
+
+    bool isMoving() override;
+
+    uint32_t getTurnsMoved() override;
+
+    float getRampSeconds(float turnsPerMinute) override;
+};
+
+#endif
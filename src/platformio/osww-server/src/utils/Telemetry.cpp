@@ -0,0 +1,310 @@
+#include "Telemetry.h"
+
+#include "ApiSchema.h"
+
+static_assert(sizeof(telemetryMetricChoices) / sizeof(telemetryMetricChoices[0]) == TELEMETRY_METRIC_COUNT, "telemetryMetricChoices out of sync");
+static_assert(sizeof(telemetryResolutionChoices) / sizeof(telemetryResolutionChoices[0]) == TELEMETRY_HOUR + 1, "telemetryResolutionChoices out of sync");
+// The sum of an hour of samples must fit the accumulator
+static_assert(3600LL * INT16_MAX <= INT32_MAX, "TELEMETRY_ACCUMULATOR sum would overflow");
+
+// In TelemetryMetric order
+static const char *const telemetryUnits[] = {"dBm", "KiB", "ms", "permille", "mA"};
+static_assert(sizeof(telemetryUnits) / sizeof(telemetryUnits[0]) == TELEMETRY_METRIC_COUNT, "telemetryUnits out of sync");
+
+static void resetAccumulator(TELEMETRY_ACCUMULATOR &accumulator, uint32_t period)
+{
+    for (int i = 0; i < TELEMETRY_METRIC_COUNT; i++)
+    {
+        accumulator.sum[i] = 0;
+        accumulator.min[i] = INT16_MAX;
+        accumulator.max[i] = INT16_MIN;
+    }
+    accumulator.count = 0;
+    accumulator.period = period;
+}
+
+Telemetry::Telemetry()
+{
+    _mutex = NULL;
+    _lastSampleMs = 0;
+
+    for (int i = 0; i <= TELEMETRY_HOUR; i++)
+    {
+        _counts[i] = 0;
+        _newestEpochs[i] = 0;
+    }
+    resetAccumulator(_minute, 0);
+    resetAccumulator(_hour, 0);
+}
+
+/**
+ * Call once before the webserver starts
+ */
+bool Telemetry::begin()
+{
+    if (_mutex == NULL)
+    {
+        _mutex = xSemaphoreCreateMutex();
+    }
+    return _mutex != NULL;
+}
+
+void Telemetry::lock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+    }
+}
+
+void Telemetry::unlock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreGive(_mutex);
+    }
+}
+
+/**
+ * Whether a second has passed since the last sample. Call from the loop, then take one & record() it.
+ */
+bool Telemetry::isSampleDue(unsigned long now)
+{
+    return _counts[TELEMETRY_SECOND] == 0 || now - _lastSampleMs >= 1000;
+}
+
+void Telemetry::accumulate(TELEMETRY_ACCUMULATOR &accumulator, const TELEMETRY_SAMPLE &sample)
+{
+    for (int i = 0; i < TELEMETRY_METRIC_COUNT; i++)
+    {
+        int16_t value = sample.values[i];
+        accumulator.sum[i] += value;
+        accumulator.min[i] = min(accumulator.min[i], value);
+        accumulator.max[i] = max(accumulator.max[i], value);
+    }
+    accumulator.count++;
+}
+
+/**
+ * Moves a finished minute or hour into its ring
+ */
+void Telemetry::close(TELEMETRY_ACCUMULATOR &accumulator, TELEMETRY_AGGREGATE *ring, size_t size, TelemetryResolution resolution, unsigned long epoch)
+{
+    TELEMETRY_AGGREGATE *slot = ring + (_counts[resolution] % size) * TELEMETRY_METRIC_COUNT;
+    for (int i = 0; i < TELEMETRY_METRIC_COUNT; i++)
+    {
+        slot[i].mean = accumulator.sum[i] / accumulator.count;
+        slot[i].min = accumulator.min[i];
+        slot[i].max = accumulator.max[i];
+    }
+    _counts[resolution]++;
+    _newestEpochs[resolution] = epoch;
+}
+
+/**
+ * Adds a sample to the seconds, & to the minute & hour it falls in
+ *
+ * @param now millis() it was taken at
+ * @param epoch RTC time it was taken at, to date the samples
+ */
+void Telemetry::record(const TELEMETRY_SAMPLE &sample, unsigned long now, unsigned long epoch)
+{
+    uint32_t minute = now / 60000UL;
+    uint32_t hour = now / 3600000UL;
+
+    lock();
+
+    memcpy(_seconds[_counts[TELEMETRY_SECOND] % TELEMETRY_SECONDS], sample.values, sizeof(sample.values));
+    _counts[TELEMETRY_SECOND]++;
+    _newestEpochs[TELEMETRY_SECOND] = epoch;
+
+    if (_minute.period != minute)
+    {
+        if (_minute.count > 0)
+        {
+            close(_minute, &_minutes[0][0], TELEMETRY_MINUTES, TELEMETRY_MINUTE, epoch);
+        }
+        resetAccumulator(_minute, minute);
+    }
+    accumulate(_minute, sample);
+
+    if (_hour.period != hour)
+    {
+        if (_hour.count > 0)
+        {
+            close(_hour, &_hours[0][0], TELEMETRY_HOURS, TELEMETRY_HOUR, epoch);
+        }
+        resetAccumulator(_hour, hour);
+    }
+    accumulate(_hour, sample);
+
+    unlock();
+
+    _lastSampleMs = now;
+}
+
+/**
+ * Samples ever recorded at a resolution; the ring holds the last getCapacity() of them
+ */
+uint32_t Telemetry::getCount(TelemetryResolution resolution)
+{
+    lock();
+    uint32_t count = _counts[resolution];
+    unlock();
+    return count;
+}
+
+size_t Telemetry::getCapacity(TelemetryResolution resolution)
+{
+    switch (resolution)
+    {
+        case TELEMETRY_SECOND:
+            return TELEMETRY_SECONDS;
+        case TELEMETRY_MINUTE:
+            return TELEMETRY_MINUTES;
+        default:
+            return TELEMETRY_HOURS;
+    }
+}
+
+/**
+ * RTC time the newest sample at a resolution was taken (or closed) at
+ */
+unsigned long Telemetry::getNewestEpoch(TelemetryResolution resolution)
+{
+    lock();
+    unsigned long epoch = _newestEpochs[resolution];
+    unlock();
+    return epoch;
+}
+
+unsigned long Telemetry::getIntervalSeconds(TelemetryResolution resolution)
+{
+    switch (resolution)
+    {
+        case TELEMETRY_SECOND:
+            return 1;
+        case TELEMETRY_MINUTE:
+            return 60;
+        default:
+            return 3600;
+    }
+}
+
+/**
+ * Copies out one sample. A second's mean, min & max are all its value.
+ *
+ * @param index 0 for the first sample ever recorded at the resolution
+ * @return false if it's not recorded yet, or already overwritten
+ */
+bool Telemetry::read(TelemetryMetric metric, TelemetryResolution resolution, uint32_t index, TELEMETRY_AGGREGATE &aggregate)
+{
+    size_t capacity = getCapacity(resolution);
+
+    lock();
+    uint32_t count = _counts[resolution];
+    bool found = index < count && count - index <= capacity;
+    if (found)
+    {
+        size_t slot = index % capacity;
+        switch (resolution)
+        {
+            case TELEMETRY_SECOND:
+                aggregate.mean = aggregate.min = aggregate.max = _seconds[slot][metric];
+                break;
+            case TELEMETRY_MINUTE:
+                aggregate = _minutes[slot][metric];
+                break;
+            default:
+                aggregate = _hours[slot][metric];
+                break;
+        }
+    }
+    unlock();
+    return found;
+}
+
+/**
+ * Every sample the ring still holds at the time of the request
+ */
+TelemetryStream::TelemetryStream(Telemetry &telemetry, TelemetryMetric metric, TelemetryResolution resolution) : _telemetry(telemetry)
+{
+    size_t capacity = telemetry.getCapacity(resolution);
+
+    _metric = metric;
+    _resolution = resolution;
+    _end = telemetry.getCount(resolution);
+    _next = _end > capacity ? _end - capacity : 0;
+    _started = false;
+    _first = true;
+    _lineLength = 0;
+    _lineOffset = 0;
+}
+
+/**
+ * Puts the next piece of the document in _line
+ *
+ * @return false once it's complete
+ */
+bool TelemetryStream::produce()
+{
+    _lineLength = 0;
+    _lineOffset = 0;
+
+    if (!_started)
+    {
+        _started = true;
+        _lineLength = snprintf(_line, sizeof(_line), "{\"metric\":\"%s\",\"unit\":\"%s\",\"resolution\":\"%s\",\"intervalSeconds\":%lu,\"newestEpoch\":%lu,\"samples\":[",
+                               telemetryMetricChoices[_metric], telemetryUnits[_metric], telemetryResolutionChoices[_resolution],
+                               Telemetry::getIntervalSeconds(_resolution), _telemetry.getNewestEpoch(_resolution));
+        return true;
+    }
+
+    // Samples overwritten since the request came in are skipped
+    while (_next < _end)
+    {
+        TELEMETRY_AGGREGATE aggregate;
+        if (!_telemetry.read(_metric, _resolution, _next++, aggregate))
+        {
+            continue;
+        }
+
+        const char *separator = _first ? "" : ",";
+        _first = false;
+        _lineLength = _resolution == TELEMETRY_SECOND
+            ? snprintf(_line, sizeof(_line), "%s%d", separator, aggregate.mean)
+            : snprintf(_line, sizeof(_line), "%s[%d,%d,%d]", separator, aggregate.mean, aggregate.min, aggregate.max);
+        return true;
+    }
+
+    if (_next == _end)
+    {
+        _next++;
+        _lineLength = snprintf(_line, sizeof(_line), "]}");
+        return true;
+    }
+    return false;
+}
+
+/**
+ * AwsResponseFiller for beginChunkedResponse()
+ *
+ * @return bytes written, 0 at the end of the document
+ */
+size_t TelemetryStream::fill(uint8_t *buffer, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen)
+    {
+        if (_lineOffset == _lineLength && !produce())
+        {
+            break;
+        }
+
+        size_t count = min(_lineLength - _lineOffset, maxLen - written);
+        memcpy(buffer + written, _line + _lineOffset, count);
+        _lineOffset += count;
+        written += count;
+    }
+    return written;
+}
@@ -0,0 +1,141 @@
+#include <Arduino.h>
+
+#ifndef Telemetry_H
+#define Telemetry_H
+
+// Samples kept per metric at each resolution: 2 minutes of seconds, 2 hours of minutes, a week of hours
+#define TELEMETRY_SECONDS 120
+#define TELEMETRY_MINUTES 120
+#define TELEMETRY_HOURS 168
+// Longest piece of /api/telemetry written at once: the header
+#define TELEMETRY_LINE_SIZE 160
+
+enum TelemetryMetric
+{
+    TELEMETRY_RSSI,    // dBm
+    TELEMETRY_HEAP,    // free heap, KiB
+    TELEMETRY_LOOP,    // length of a loop() pass, its 1 s listening included, ms
+    TELEMETRY_MOTOR,   // 1000 while turning, so the mean is the duty in ‰
+    TELEMETRY_CURRENT, // motor current, mA; 0 unless built with CURRENT_SENSE_ENABLED
+    TELEMETRY_METRIC_COUNT
+};
+
+enum TelemetryResolution
+{
+    TELEMETRY_SECOND,
+    TELEMETRY_MINUTE,
+    TELEMETRY_HOUR
+};
+
+/**
+ * One value of each metric, as taken once a second
+ */
+struct TELEMETRY_SAMPLE
+{
+    int16_t values[TELEMETRY_METRIC_COUNT];
+};
+
+/**
+ * A minute or an hour of one metric
+ */
+struct TELEMETRY_AGGREGATE
+{
+    int16_t mean;
+    int16_t min;
+    int16_t max;
+};
+
+/**
+ * Running aggregates of the minute or hour being filled, per metric
+ */
+struct TELEMETRY_ACCUMULATOR
+{
+    int32_t sum[TELEMETRY_METRIC_COUNT];
+    int16_t min[TELEMETRY_METRIC_COUNT];
+    int16_t max[TELEMETRY_METRIC_COUNT];
+    uint16_t count;
+    uint32_t period; // minute or hour of uptime it belongs to
+};
+
+/**
+ * Trends of a few health metrics, in RAM: the last samples at 1 Hz, then
+ * mean, min & max per minute & per hour. Each sample goes into the rings
+ * & the running aggregates as it's taken; a minute or hour is closed when
+ * uptime crosses into the next one, so a late loop doesn't stretch it.
+ *
+ * Recorded from the loop, read from the webserver's task.
+ */
+class Telemetry
+{
+private:
+    SemaphoreHandle_t _mutex;
+    unsigned long _lastSampleMs;
+
+    int16_t _seconds[TELEMETRY_SECONDS][TELEMETRY_METRIC_COUNT];
+    TELEMETRY_AGGREGATE _minutes[TELEMETRY_MINUTES][TELEMETRY_METRIC_COUNT];
+    TELEMETRY_AGGREGATE _hours[TELEMETRY_HOURS][TELEMETRY_METRIC_COUNT];
+    // samples ever written at each resolution; the newest is at (count - 1) % size
+    uint32_t _counts[TELEMETRY_HOUR + 1];
+    unsigned long _newestEpochs[TELEMETRY_HOUR + 1];
+
+    TELEMETRY_ACCUMULATOR _minute;
+    TELEMETRY_ACCUMULATOR _hour;
+
+    void lock();
+
+    void unlock();
+
+    void accumulate(TELEMETRY_ACCUMULATOR &accumulator, const TELEMETRY_SAMPLE &sample);
+
+    void close(TELEMETRY_ACCUMULATOR &accumulator, TELEMETRY_AGGREGATE *ring, size_t size, TelemetryResolution resolution, unsigned long epoch);
+
+public:
+    Telemetry();
+
+    bool begin();
+
+    bool isSampleDue(unsigned long now);
+
+    void record(const TELEMETRY_SAMPLE &sample, unsigned long now, unsigned long epoch);
+
+    uint32_t getCount(TelemetryResolution resolution);
+
+    size_t getCapacity(TelemetryResolution resolution);
+
+    unsigned long getNewestEpoch(TelemetryResolution resolution);
+
+    bool read(TelemetryMetric metric, TelemetryResolution resolution, uint32_t index, TELEMETRY_AGGREGATE &aggregate);
+
+    static unsigned long getIntervalSeconds(TelemetryResolution resolution);
+};
+
+/**
+ * One metric at one resolution for /api/telemetry, oldest sample first, a
+ * sample at a time for a chunked response:
+ * {"metric":"rssi","unit":"dBm","resolution":"minute","intervalSeconds":60,"newestEpoch":...,"samples":[...]}
+ *
+ * Seconds are plain values, minutes & hours are [mean,min,max].
+ */
+class TelemetryStream
+{
+private:
+    Telemetry &_telemetry;
+    TelemetryMetric _metric;
+    TelemetryResolution _resolution;
+    uint32_t _next;
+    uint32_t _end;
+    bool _started;
+    bool _first;
+    char _line[TELEMETRY_LINE_SIZE];
+    size_t _lineLength;
+    size_t _lineOffset;
+
+    bool produce();
+
+public:
+    TelemetryStream(Telemetry &telemetry, TelemetryMetric metric, TelemetryResolution resolution);
+
+    size_t fill(uint8_t *buffer, size_t maxLen);
+};
+
+#endif
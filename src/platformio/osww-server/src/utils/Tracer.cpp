@@ -0,0 +1,228 @@
+#include "Tracer.h"
+
+#include <stdarg.h>
+
+static_assert((TRACE_RING_SLOTS & (TRACE_RING_SLOTS - 1)) == 0, "TRACE_RING_SLOTS must be a power of two");
+
+// Only builds that trace pay for the ring
+#if TRACE_ENABLED
+Tracer Trace;
+#endif
+
+Tracer::Tracer()
+{
+    _head = 0;
+    _taskCount = 0;
+    portMUX_INITIALIZE(&_taskMux);
+
+    for (int i = 0; i < TRACE_RING_SLOTS; i++)
+    {
+        _ring[i].sequence = 0;
+    }
+}
+
+/**
+ * Row in the timeline for the calling task, added the first time it records
+ */
+uint8_t Tracer::taskIndex()
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    uint8_t count = _taskCount.load(std::memory_order_acquire);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (_tasks[i] == task)
+        {
+            return i;
+        }
+    }
+
+    // Another task may have added itself meanwhile, look again inside
+    portENTER_CRITICAL(&_taskMux);
+    count = _taskCount.load(std::memory_order_relaxed);
+    uint8_t index = 0;
+    while (index < count && _tasks[index] != task)
+    {
+        index++;
+    }
+    if (index == count && count < TRACE_MAX_TASKS)
+    {
+        _tasks[index] = task;
+        strncpy(_taskNames[index], pcTaskGetName(task), TRACE_TASK_NAME_SIZE - 1);
+        _taskNames[index][TRACE_TASK_NAME_SIZE - 1] = '\0';
+        _taskCount.store(count + 1, std::memory_order_release);
+    }
+    portEXIT_CRITICAL(&_taskMux);
+
+    return min(index, (uint8_t)(TRACE_MAX_TASKS - 1));
+}
+
+/**
+ * Claims the next slot & publishes the event in it. Safe from any task.
+ */
+void Tracer::record(const char *name, char phase)
+{
+    TRACE_EVENT event;
+    event.name = name;
+    event.phase = phase;
+    event.task = taskIndex();
+
+    uint32_t index = _head.fetch_add(1);
+    TRACE_SLOT &slot = _ring[index & (TRACE_RING_SLOTS - 1)];
+
+    // Timestamped after the claim, so the ring stays (nearly) in time order
+    event.micros = micros();
+
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.event = event;
+    slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+/**
+ * Copies out the event with the given index, if it is still in the ring & complete
+ */
+bool Tracer::read(uint32_t index, TRACE_EVENT &event)
+{
+    TRACE_SLOT &slot = _ring[index & (TRACE_RING_SLOTS - 1)];
+
+    uint32_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before != index + 1)
+    {
+        return false;
+    }
+    event = slot.event;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == before;
+}
+
+/**
+ * Index the next event will get
+ */
+uint32_t Tracer::getHead()
+{
+    return _head.load(std::memory_order_acquire);
+}
+
+uint8_t Tracer::getTaskCount()
+{
+    return _taskCount.load(std::memory_order_acquire);
+}
+
+const char *Tracer::getTaskName(uint8_t task)
+{
+    return task < getTaskCount() ? _taskNames[task] : "";
+}
+
+/**
+ * Exports what the ring holds right now; later events are left for the next export
+ */
+TraceExport::TraceExport(Tracer &tracer) : _tracer(tracer)
+{
+    _end = tracer.getHead();
+    _next = _end > TRACE_RING_SLOTS ? _end - TRACE_RING_SLOTS : 0;
+    _taskCount = tracer.getTaskCount();
+    _nextTask = 0;
+    _started = false;
+    _finished = false;
+    _first = true;
+    _timed = false;
+    _lastMicros = 0;
+    _elapsedMicros = 0;
+    _lineLength = 0;
+    _lineOffset = 0;
+}
+
+void TraceExport::append(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(_line + _lineLength, sizeof(_line) - _lineLength, format, args);
+    va_end(args);
+    if (written > 0)
+    {
+        _lineLength = min(_lineLength + written, sizeof(_line) - 1);
+    }
+}
+
+/**
+ * Puts the next piece of the document in _line: the header, a thread name per
+ * task, the events, then the closing brackets
+ *
+ * @return false once the document is complete
+ */
+bool TraceExport::produce()
+{
+    _lineLength = 0;
+    _lineOffset = 0;
+
+    if (!_started)
+    {
+        _started = true;
+        append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        return true;
+    }
+
+    if (_nextTask < _taskCount)
+    {
+        append("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+               _first ? "" : ",", (unsigned)_nextTask, _tracer.getTaskName(_nextTask));
+        _first = false;
+        _nextTask++;
+        return true;
+    }
+
+    while (_next != _end)
+    {
+        TRACE_EVENT event;
+        if (!_tracer.read(_next++, event))
+        {
+            // Overwritten since the export began
+            continue;
+        }
+
+        // Timestamps from the oldest event on; micros() wraps every 71 minutes
+        if (_timed)
+        {
+            _elapsedMicros += (int32_t)(event.micros - _lastMicros);
+        }
+        _lastMicros = event.micros;
+        _timed = true;
+
+        append("%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld,\"pid\":1,\"tid\":%u%s}",
+               _first ? "" : ",", event.name, event.phase, (long long)_elapsedMicros, (unsigned)event.task,
+               event.phase == TRACE_PHASE_INSTANT ? ",\"s\":\"t\"" : "");
+        _first = false;
+        return true;
+    }
+
+    if (!_finished)
+    {
+        _finished = true;
+        append("]}");
+        return true;
+    }
+    return false;
+}
+
+/**
+ * AwsResponseFiller for beginChunkedResponse()
+ *
+ * @return bytes written, 0 at the end of the document
+ */
+size_t TraceExport::fill(uint8_t *buffer, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen)
+    {
+        if (_lineOffset == _lineLength && !produce())
+        {
+            break;
+        }
+
+        size_t count = min(_lineLength - _lineOffset, maxLen - written);
+        memcpy(buffer + written, _line + _lineOffset, count);
+        _lineOffset += count;
+        written += count;
+    }
+    return written;
+}
@@ -0,0 +1,151 @@
+#include <Arduino.h>
+#include <atomic>
+
+#include "BoardProfile.h"
+
+#ifndef Tracer_H
+#define Tracer_H
+
+// Events kept, a power of two. The oldest are overwritten, the ring always holds the latest.
+#define TRACE_RING_SLOTS 512
+// Tasks told apart in the timeline; events from any more share the last row
+#define TRACE_MAX_TASKS 12
+#define TRACE_TASK_NAME_SIZE 16
+#define TRACE_LINE_SIZE 160
+
+#define TRACE_PHASE_BEGIN 'B'
+#define TRACE_PHASE_END 'E'
+#define TRACE_PHASE_INSTANT 'i'
+
+/**
+ * One begin, end or instant. The name is kept by pointer, it must be a string literal.
+ */
+struct TRACE_EVENT
+{
+    uint32_t micros;
+    const char *name;
+    char phase;
+    uint8_t task;
+};
+
+struct TRACE_SLOT
+{
+    std::atomic<uint32_t> sequence; // index + 1 once written, 0 while being written
+    TRACE_EVENT event;
+};
+
+/**
+ * Timestamps where the time goes on the hot paths: handlers, flash, I2C, NTP,
+ * MQTT, the motor. Recording an event is a micros() read & a few stores into
+ * a ring slot, with the same lock-free claim & publish as the Logger's ring.
+ *
+ * Use TRACE_SCOPE() & TRACE_INSTANT() rather than the methods, they compile
+ * to nothing unless the build has TRACE_ENABLED=true.
+ */
+class Tracer
+{
+private:
+    TRACE_SLOT _ring[TRACE_RING_SLOTS];
+    std::atomic<uint32_t> _head;
+    TaskHandle_t _tasks[TRACE_MAX_TASKS];
+    char _taskNames[TRACE_MAX_TASKS][TRACE_TASK_NAME_SIZE];
+    std::atomic<uint8_t> _taskCount;
+    portMUX_TYPE _taskMux;
+
+    uint8_t taskIndex();
+
+public:
+    Tracer();
+
+    void record(const char *name, char phase);
+
+    void begin(const char *name)
+    {
+        record(name, TRACE_PHASE_BEGIN);
+    }
+
+    void end(const char *name)
+    {
+        record(name, TRACE_PHASE_END);
+    }
+
+    void instant(const char *name)
+    {
+        record(name, TRACE_PHASE_INSTANT);
+    }
+
+    uint32_t getHead();
+
+    bool read(uint32_t index, TRACE_EVENT &event);
+
+    uint8_t getTaskCount();
+
+    const char *getTaskName(uint8_t task);
+};
+
+extern Tracer Trace;
+
+/**
+ * Begins a region when constructed & ends it when it goes out of scope
+ */
+class TraceScope
+{
+private:
+    const char *_name;
+
+public:
+    TraceScope(const char *name) : _name(name)
+    {
+        Trace.begin(_name);
+    }
+
+    ~TraceScope()
+    {
+        Trace.end(_name);
+    }
+};
+
+/**
+ * The ring as Chrome trace-event JSON, an event at a time for a chunked
+ * response. Opens in chrome://tracing & https://ui.perfetto.dev
+ */
+class TraceExport
+{
+private:
+    Tracer &_tracer;
+    uint32_t _next;
+    uint32_t _end;
+    uint8_t _taskCount;
+    uint8_t _nextTask;
+    bool _started;
+    bool _finished;
+    bool _first;
+    bool _timed;
+    uint32_t _lastMicros;
+    int64_t _elapsedMicros;
+    char _line[TRACE_LINE_SIZE];
+    size_t _lineLength;
+    size_t _lineOffset;
+
+    bool produce();
+
+    void append(const char *format, ...);
+
+public:
+    TraceExport(Tracer &tracer);
+
+    size_t fill(uint8_t *buffer, size_t maxLen);
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#if TRACE_ENABLED
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_INSTANT(name) Trace.instant(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,154 @@
+#include "WifiCache.h"
+
+#include <Preferences.h>
+#include <esp_attr.h>
+
+#include "Logger.h"
+
+#define WIFI_CACHE_MAGIC 0x57494632 // "WIF2", access point only
+#define WIFI_CACHE_NAMESPACE "wifi-cache"
+#define WIFI_CACHE_KEY "lease" // kept, so an older cache is overwritten rather than left behind
+
+// Survives deep sleep, so a timed wake doesn't even need to read flash
+RTC_DATA_ATTR static WIFI_CACHE rtcCache;
+
+WifiCache::WifiCache()
+{
+    memset(&_cache, 0, sizeof(_cache));
+    _valid = false;
+    _usedFastReconnect = false;
+}
+
+bool WifiCache::readFromNvs()
+{
+    Preferences preferences;
+    if (!preferences.begin(WIFI_CACHE_NAMESPACE, true))
+    {
+        return false;
+    }
+
+    size_t read = preferences.getBytes(WIFI_CACHE_KEY, &_cache, sizeof(_cache));
+    preferences.end();
+
+    return read == sizeof(_cache) && _cache.magic == WIFI_CACHE_MAGIC;
+}
+
+void WifiCache::writeToNvs()
+{
+    Preferences preferences;
+    if (!preferences.begin(WIFI_CACHE_NAMESPACE, false))
+    {
+        Log.error(LOG_WIFI, "Failed to open WiFi cache");
+        return;
+    }
+
+    preferences.putBytes(WIFI_CACHE_KEY, &_cache, sizeof(_cache));
+    preferences.end();
+}
+
+/**
+ * Loads the last good connection, preferring RTC memory over NVS
+ *
+ * @return true if a usable connection was found
+ */
+bool WifiCache::load()
+{
+    if (rtcCache.magic == WIFI_CACHE_MAGIC)
+    {
+        _cache = rtcCache;
+        _valid = true;
+    }
+    else
+    {
+        _valid = readFromNvs();
+        if (_valid)
+        {
+            rtcCache = _cache;
+        }
+    }
+
+    return _valid && _cache.channel != 0;
+}
+
+/**
+ * Joins the cached BSSID on the cached channel, skipping the scan. The address
+ * still comes from DHCP, so the router's lease is always respected.
+ *
+ * @param ssid saved network name
+ * @param password saved network password
+ * @param timeoutMs how long to wait for association before giving up
+ * @return true if connected
+ */
+bool WifiCache::reconnect(const String &ssid, const String &password, unsigned long timeoutMs)
+{
+    if (!_valid || ssid.length() == 0)
+    {
+        return false;
+    }
+
+    WiFi.begin(ssid.c_str(), password.c_str(), _cache.channel, _cache.bssid);
+
+    unsigned long started = millis();
+    while (WiFi.status() != WL_CONNECTED && millis() - started < timeoutMs)
+    {
+        delay(10);
+    }
+
+    if (WiFi.status() == WL_CONNECTED)
+    {
+        _usedFastReconnect = true;
+        Log.status(LOG_WIFI, "Fast reconnect succeeded (ms): %lu", millis() - started);
+        return true;
+    }
+
+    Log.warn(LOG_WIFI, "Fast reconnect failed, falling back to full connect");
+    WiFi.disconnect();
+    invalidate();
+    return false;
+}
+
+/**
+ * Stores the current connection. NVS is only written when something changed,
+ * so a stable network costs no flash wear across reboots.
+ */
+void WifiCache::save()
+{
+    WIFI_CACHE current;
+    memset(&current, 0, sizeof(current));
+    current.magic = WIFI_CACHE_MAGIC;
+    current.channel = WiFi.channel();
+    memcpy(current.bssid, WiFi.BSSID(), sizeof(current.bssid));
+
+    rtcCache = current;
+
+    if (_valid && memcmp(&current, &_cache, sizeof(current)) == 0)
+    {
+        return;
+    }
+
+    _cache = current;
+    _valid = true;
+    writeToNvs();
+    Log.status(LOG_WIFI, "WiFi cache updated");
+}
+
+/**
+ * Forgets the cached connection, e.g. after a failed attempt or a WiFi reset
+ */
+void WifiCache::invalidate()
+{
+    _valid = false;
+    memset(&rtcCache, 0, sizeof(rtcCache));
+
+    Preferences preferences;
+    if (preferences.begin(WIFI_CACHE_NAMESPACE, false))
+    {
+        preferences.remove(WIFI_CACHE_KEY);
+        preferences.end();
+    }
+}
+
+bool WifiCache::usedFastReconnect()
+{
+    return _usedFastReconnect;
+}
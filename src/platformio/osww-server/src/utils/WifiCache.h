@@ -0,0 +1,42 @@
+#include <Arduino.h>
+#include <WiFi.h>
+
+#ifndef WifiCache_H
+#define WifiCache_H
+
+/**
+ * Everything needed to rejoin the last access point without a scan.
+ * The address always comes from DHCP, so it is never kept past its lease.
+ */
+struct WIFI_CACHE
+{
+    uint32_t magic;
+    uint8_t channel;
+    uint8_t bssid[6];
+};
+
+class WifiCache
+{
+private:
+    WIFI_CACHE _cache;
+    bool _valid;
+    bool _usedFastReconnect;
+
+    bool readFromNvs();
+    void writeToNvs();
+
+public:
+    WifiCache();
+
+    bool load();
+
+    bool reconnect(const String &ssid, const String &password, unsigned long timeoutMs);
+
+    void save();
+
+    void invalidate();
+
+    bool usedFastReconnect();
+};
+
+#endif
@@ -0,0 +1,512 @@
+#include "WinderGroup.h"
+
+#include <rom/crc.h>
+
+#include "Logger.h"
+
+#define GROUP_HEADER_SIZE 14
+#define GROUP_SCHEDULE_ENTRY_SIZE 12
+#define GROUP_PACKET_MAX_SIZE (GROUP_HEADER_SIZE + 2 + GROUP_MAX_MEMBERS * GROUP_SCHEDULE_ENTRY_SIZE)
+
+static const uint8_t groupMagic[4] = {'W', 'D', 'R', 'G'};
+
+// Packets are little endian, whatever the host
+static void putU32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+static uint32_t getU32(const uint8_t *buffer)
+{
+    return buffer[0] | (uint32_t)buffer[1] << 8 | (uint32_t)buffer[2] << 16 | (uint32_t)buffer[3] << 24;
+}
+
+WinderGroup::WinderGroup()
+{
+    _started = false;
+    _groupHash = 0;
+    _maxRunning = 1;
+    _memberCount = 0;
+    _coordinatorId = 0;
+    _lastHeartbeatMs = 0;
+    _lastCommandId = 0;
+    _startRequested = false;
+    _startPending = false;
+    _startAtMs = 0;
+    _mutex = NULL;
+}
+
+void WinderGroup::lock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+    }
+}
+
+void WinderGroup::unlock()
+{
+    if (_mutex != NULL)
+    {
+        xSemaphoreGive(_mutex);
+    }
+}
+
+/**
+ * Joins the group. Call once WiFi is up.
+ *
+ * @param id unique on the LAN, e.g. from the MAC address
+ * @param name winders only group with others of the same name
+ * @param maxRunning sessions allowed to overlap, used while this winder coordinates
+ */
+bool WinderGroup::begin(uint32_t id, const char *name, uint8_t maxRunning)
+{
+    if (_mutex == NULL)
+    {
+        _mutex = xSemaphoreCreateMutex();
+    }
+
+    lock();
+    _groupHash = crc32_le(0, (const uint8_t *)name, strlen(name));
+    _maxRunning = max((uint8_t)1, min(maxRunning, (uint8_t)GROUP_MAX_MEMBERS));
+    _members[0] = {};
+    _members[0].id = id;
+    _memberCount = 1;
+    _coordinatorId = id;
+    unlock();
+
+    if (!_udp.beginMulticast(GROUP_MULTICAST_ADDRESS, GROUP_PORT))
+    {
+        Log.error(LOG_GROUP, "Failed to join the group's multicast address");
+        return false;
+    }
+
+    _started = true;
+    Log.status(LOG_GROUP, "Joined group %s as %08x, at most %u running", name, id, _maxRunning);
+    return true;
+}
+
+/**
+ * Call from loop(). Answers packets, sends the heartbeat when due and, on the
+ * coordinator, plans & sends the offsets.
+ *
+ * @param self this winder's current state
+ */
+void WinderGroup::poll(const GROUP_SELF &self)
+{
+    if (!_started)
+    {
+        return;
+    }
+
+    lock();
+    _members[0].state = self;
+    _members[0].lastSeenMs = millis();
+    unlock();
+
+    receive();
+    expireMembers();
+
+    if (_startRequested)
+    {
+        _startRequested = false;
+        sendStart();
+        deferStart(_members[0].groupStartOffset);
+    }
+
+    if (millis() - _lastHeartbeatMs >= GROUP_HEARTBEAT_INTERVAL_MS)
+    {
+        _lastHeartbeatMs = millis();
+        sendHeartbeat();
+
+        if (_coordinatorId == _members[0].id)
+        {
+            plan();
+            sendSchedule();
+        }
+    }
+}
+
+GROUP_MEMBER *WinderGroup::findMember(uint32_t id)
+{
+    for (int i = 0; i < _memberCount; i++)
+    {
+        if (_members[i].id == id)
+        {
+            return &_members[i];
+        }
+    }
+    return NULL;
+}
+
+void WinderGroup::receive()
+{
+    uint8_t packet[GROUP_PACKET_MAX_SIZE];
+
+    while (_udp.parsePacket() > 0)
+    {
+        int length = _udp.read(packet, sizeof(packet));
+        if (length < GROUP_HEADER_SIZE || memcmp(packet, groupMagic, sizeof(groupMagic)) != 0 ||
+            packet[4] != GROUP_PROTOCOL_VERSION || getU32(packet + 6) != _groupHash)
+        {
+            continue;
+        }
+
+        uint8_t type = packet[5];
+        uint32_t sender = getU32(packet + 10);
+        const uint8_t *payload = packet + GROUP_HEADER_SIZE;
+        int payloadLength = length - GROUP_HEADER_SIZE;
+        if (sender == _members[0].id)
+        {
+            // Our own, looped back
+            continue;
+        }
+
+        lock();
+        if (type == GROUP_PACKET_HEARTBEAT && payloadLength >= 11)
+        {
+            GROUP_MEMBER *member = findMember(sender);
+            if (member == NULL && _memberCount < GROUP_MAX_MEMBERS)
+            {
+                member = &_members[_memberCount++];
+                *member = {};
+                member->id = sender;
+                Log.status(LOG_GROUP, "%08x joined, %d members", sender, _memberCount);
+            }
+            if (member != NULL)
+            {
+                member->ip = (uint32_t)_udp.remoteIP();
+                member->lastSeenMs = millis();
+                member->state.sessionSeconds = getU32(payload);
+                member->state.remainingSeconds = getU32(payload + 4);
+                member->state.running = payload[8] & 1;
+                member->state.timerEnabled = payload[8] & 2;
+                member->state.hour = payload[9];
+                member->state.minute = payload[10];
+            }
+        }
+        else if (type == GROUP_PACKET_SCHEDULE && payloadLength >= 2 && sender <= _coordinatorId)
+        {
+            int count = min((int)payload[1], (payloadLength - 2) / GROUP_SCHEDULE_ENTRY_SIZE);
+            for (int i = 0; i < count; i++)
+            {
+                const uint8_t *entry = payload + 2 + i * GROUP_SCHEDULE_ENTRY_SIZE;
+                GROUP_MEMBER *member = findMember(getU32(entry));
+                if (member != NULL)
+                {
+                    member->groupStartOffset = getU32(entry + 4);
+                    member->timerOffset = getU32(entry + 8);
+                }
+            }
+        }
+        unlock();
+
+        if (type == GROUP_PACKET_START && payloadLength >= 4 && getU32(payload) != _lastCommandId)
+        {
+            _lastCommandId = getU32(payload);
+            Log.status(LOG_GROUP, "Group start from %08x", sender);
+            deferStart(_members[0].groupStartOffset);
+        }
+    }
+}
+
+/**
+ * Forgets silent members & elects the coordinator: the lowest id still heard from
+ */
+void WinderGroup::expireMembers()
+{
+    lock();
+    for (int i = _memberCount - 1; i > 0; i--)
+    {
+        if (millis() - _members[i].lastSeenMs > GROUP_MEMBER_TIMEOUT_MS)
+        {
+            Log.status(LOG_GROUP, "%08x left, %d members", _members[i].id, _memberCount - 1);
+            _members[i] = _members[--_memberCount];
+        }
+    }
+
+    uint32_t coordinatorId = _members[0].id;
+    for (int i = 1; i < _memberCount; i++)
+    {
+        coordinatorId = min(coordinatorId, _members[i].id);
+    }
+    if (coordinatorId != _coordinatorId)
+    {
+        _coordinatorId = coordinatorId;
+        Log.status(LOG_GROUP, "Coordinator is now %08x", coordinatorId);
+
+        // Until the new coordinator's plan arrives
+        for (int i = 0; i < _memberCount; i++)
+        {
+            _members[i].groupStartOffset = 0;
+            _members[i].timerOffset = 0;
+        }
+    }
+    unlock();
+}
+
+/**
+ * Coordinator only. List scheduling over `maxRunning` lanes, members in id
+ * order: each starts when the earliest lane frees up, then holds it for a
+ * session. Running sessions hold their lanes first.
+ */
+void WinderGroup::plan()
+{
+    lock();
+
+    int order[GROUP_MAX_MEMBERS];
+    for (int i = 0; i < _memberCount; i++)
+    {
+        int j = i;
+        while (j > 0 && _members[order[j - 1]].id > _members[i].id)
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    // A group start: everyone, from now
+    uint32_t lanes[GROUP_MAX_MEMBERS] = {};
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 0; i < _memberCount; i++)
+        {
+            GROUP_MEMBER &member = _members[order[i]];
+            if (member.state.running != (pass == 0))
+            {
+                continue;
+            }
+
+            int lane = 0;
+            for (int j = 1; j < _maxRunning; j++)
+            {
+                lane = lanes[j] < lanes[lane] ? j : lane;
+            }
+
+            if (member.state.running)
+            {
+                member.groupStartOffset = 0;
+                lanes[lane] += member.state.remainingSeconds;
+            }
+            else
+            {
+                member.groupStartOffset = lanes[lane];
+                lanes[lane] += member.state.sessionSeconds;
+            }
+        }
+    }
+
+    // Timers: everyone whose timer fires in the same minute, from that minute
+    for (int i = 0; i < _memberCount; i++)
+    {
+        _members[i].timerOffset = 0;
+    }
+    for (int i = 0; i < _memberCount; i++)
+    {
+        GROUP_MEMBER &first = _members[order[i]];
+        bool planned = false;
+        for (int j = 0; j < i && !planned; j++)
+        {
+            GROUP_MEMBER &earlier = _members[order[j]];
+            planned = earlier.state.timerEnabled && earlier.state.hour == first.state.hour && earlier.state.minute == first.state.minute;
+        }
+        if (!first.state.timerEnabled || planned)
+        {
+            continue;
+        }
+
+        uint32_t timerLanes[GROUP_MAX_MEMBERS] = {};
+        for (int j = i; j < _memberCount; j++)
+        {
+            GROUP_MEMBER &member = _members[order[j]];
+            if (!member.state.timerEnabled || member.state.hour != first.state.hour || member.state.minute != first.state.minute)
+            {
+                continue;
+            }
+
+            int lane = 0;
+            for (int k = 1; k < _maxRunning; k++)
+            {
+                lane = timerLanes[k] < timerLanes[lane] ? k : lane;
+            }
+            member.timerOffset = timerLanes[lane];
+            timerLanes[lane] += member.state.sessionSeconds;
+        }
+    }
+
+    unlock();
+}
+
+void WinderGroup::beginPacket(uint8_t type)
+{
+    uint8_t header[GROUP_HEADER_SIZE];
+    memcpy(header, groupMagic, sizeof(groupMagic));
+    header[4] = GROUP_PROTOCOL_VERSION;
+    header[5] = type;
+    putU32(header + 6, _groupHash);
+    putU32(header + 10, _members[0].id);
+
+    _udp.beginMulticastPacket();
+    _udp.write(header, sizeof(header));
+}
+
+void WinderGroup::sendHeartbeat()
+{
+    uint8_t payload[11];
+    lock();
+    const GROUP_SELF &self = _members[0].state;
+    putU32(payload, self.sessionSeconds);
+    putU32(payload + 4, self.remainingSeconds);
+    payload[8] = (self.running ? 1 : 0) | (self.timerEnabled ? 2 : 0);
+    payload[9] = self.hour;
+    payload[10] = self.minute;
+    unlock();
+
+    beginPacket(GROUP_PACKET_HEARTBEAT);
+    _udp.write(payload, sizeof(payload));
+    _udp.endPacket();
+}
+
+void WinderGroup::sendSchedule()
+{
+    uint8_t payload[2 + GROUP_MAX_MEMBERS * GROUP_SCHEDULE_ENTRY_SIZE];
+    lock();
+    payload[0] = _maxRunning;
+    payload[1] = _memberCount;
+    for (int i = 0; i < _memberCount; i++)
+    {
+        uint8_t *entry = payload + 2 + i * GROUP_SCHEDULE_ENTRY_SIZE;
+        putU32(entry, _members[i].id);
+        putU32(entry + 4, _members[i].groupStartOffset);
+        putU32(entry + 8, _members[i].timerOffset);
+    }
+    size_t length = 2 + _memberCount * GROUP_SCHEDULE_ENTRY_SIZE;
+    unlock();
+
+    beginPacket(GROUP_PACKET_SCHEDULE);
+    _udp.write(payload, length);
+    _udp.endPacket();
+}
+
+void WinderGroup::sendStart()
+{
+    uint8_t payload[4];
+    _lastCommandId = (uint32_t)random(1, 0x7FFFFFFF);
+    putU32(payload, _lastCommandId);
+
+    beginPacket(GROUP_PACKET_START);
+    _udp.write(payload, sizeof(payload));
+    _udp.endPacket();
+    Log.status(LOG_GROUP, "Sent group start");
+}
+
+/**
+ * Starts every member, this one included. Sent from loop() on the next poll().
+ */
+void WinderGroup::requestStart()
+{
+    _startRequested = true;
+}
+
+/**
+ * Plans this winder's own start, see takeDueStart()
+ */
+void WinderGroup::deferStart(uint32_t offsetSeconds)
+{
+    lock();
+    _startPending = true;
+    _startAtMs = millis() + offsetSeconds * 1000UL;
+    unlock();
+
+    if (offsetSeconds > 0)
+    {
+        Log.status(LOG_GROUP, "Starting in %u s, after the others", offsetSeconds);
+    }
+}
+
+void WinderGroup::cancelStart()
+{
+    lock();
+    _startPending = false;
+    unlock();
+}
+
+bool WinderGroup::isStartPending()
+{
+    return _startPending;
+}
+
+/**
+ * @return true once, when a deferred start is due
+ */
+bool WinderGroup::takeDueStart()
+{
+    lock();
+    bool due = _startPending && (long)(millis() - _startAtMs) >= 0;
+    if (due)
+    {
+        _startPending = false;
+    }
+    unlock();
+    return due;
+}
+
+/**
+ * @return seconds until the deferred start, -1 if none is pending
+ */
+long WinderGroup::getSecondsUntilStart()
+{
+    lock();
+    long seconds = _startPending ? max(0L, (long)(_startAtMs - millis()) / 1000) : -1;
+    unlock();
+    return seconds;
+}
+
+bool WinderGroup::isEnabled()
+{
+    return _started;
+}
+
+uint32_t WinderGroup::getId()
+{
+    return _members[0].id;
+}
+
+uint32_t WinderGroup::getCoordinatorId()
+{
+    return _coordinatorId;
+}
+
+uint8_t WinderGroup::getMaxRunning()
+{
+    return _maxRunning;
+}
+
+/**
+ * Seconds to wait after this winder's timer fires
+ */
+uint32_t WinderGroup::getTimerOffset()
+{
+    lock();
+    uint32_t offset = _members[0].timerOffset;
+    unlock();
+    return offset;
+}
+
+/**
+ * Snapshot of the members, this winder first
+ *
+ * @return members copied
+ */
+int WinderGroup::copyMembers(GROUP_MEMBER *members, int maxMembers)
+{
+    lock();
+    int count = min(_memberCount, maxMembers);
+    memcpy(members, _members, count * sizeof(GROUP_MEMBER));
+    unlock();
+    return count;
+}
@@ -0,0 +1,130 @@
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+#ifndef WinderGroup_H
+#define WinderGroup_H
+
+#define GROUP_MULTICAST_ADDRESS IPAddress(239, 255, 87, 68)
+#define GROUP_PORT 5356
+#define GROUP_MAX_MEMBERS 16
+#define GROUP_HEARTBEAT_INTERVAL_MS 2000
+// A member missing this many heartbeats has left the group
+#define GROUP_MEMBER_TIMEOUT_MS (3 * GROUP_HEARTBEAT_INTERVAL_MS)
+#define GROUP_PROTOCOL_VERSION 1
+
+enum GroupPacketType
+{
+    GROUP_PACKET_HEARTBEAT = 1,
+    GROUP_PACKET_SCHEDULE = 2,
+    GROUP_PACKET_START = 3
+};
+
+/**
+ * What a member tells the others about itself, every heartbeat
+ */
+struct GROUP_SELF
+{
+    uint32_t sessionSeconds;   // a session at the current settings
+    uint32_t remainingSeconds; // of the running session, 0 when idle
+    bool running;
+    bool timerEnabled;
+    uint8_t hour;
+    uint8_t minute;
+};
+
+struct GROUP_MEMBER
+{
+    uint32_t id;
+    uint32_t ip;
+    unsigned long lastSeenMs;
+    GROUP_SELF state;
+    uint32_t groupStartOffset; // seconds to wait after a group start
+    uint32_t timerOffset;      // seconds to wait after the timer fires
+};
+
+/**
+ * Opt-in coordination between winders on one LAN, so that motors sharing a
+ * supply don't all start together.
+ *
+ * Members multicast a heartbeat every couple of seconds. The member with the
+ * lowest id is the coordinator; it plans start offsets so that at most
+ * `maxRunning` sessions overlap & multicasts the plan. Members whose timers
+ * fire in the same minute are planned together; a group start plans everyone.
+ * A group start is one multicast packet, each member waits for its own offset.
+ *
+ * Offsets are whole sessions apart, based on each member's own estimate of
+ * how long its session takes. Without a coordinator every offset is 0.
+ *
+ * poll() runs on the loop task & owns the socket; the other methods may be
+ * called from any task.
+ */
+class WinderGroup
+{
+private:
+    WiFiUDP _udp;
+    volatile bool _started;
+    uint32_t _groupHash;
+    uint8_t _maxRunning;
+    GROUP_MEMBER _members[GROUP_MAX_MEMBERS]; // this winder first
+    int _memberCount;
+    uint32_t _coordinatorId;
+    unsigned long _lastHeartbeatMs;
+    uint32_t _lastCommandId;
+    volatile bool _startRequested;
+    bool _startPending;
+    unsigned long _startAtMs;
+    SemaphoreHandle_t _mutex;
+
+    void lock();
+
+    void unlock();
+
+    GROUP_MEMBER *findMember(uint32_t id);
+
+    void receive();
+
+    void expireMembers();
+
+    void plan();
+
+    void sendHeartbeat();
+
+    void sendSchedule();
+
+    void sendStart();
+
+    void beginPacket(uint8_t type);
+
+public:
+    WinderGroup();
+
+    bool begin(uint32_t id, const char *name, uint8_t maxRunning);
+
+    void poll(const GROUP_SELF &self);
+
+    void requestStart();
+
+    void deferStart(uint32_t offsetSeconds);
+
+    void cancelStart();
+
+    bool isStartPending();
+
+    bool takeDueStart();
+
+    long getSecondsUntilStart();
+
+    bool isEnabled();
+
+    uint32_t getId();
+
+    uint32_t getCoordinatorId();
+
+    uint8_t getMaxRunning();
+
+    uint32_t getTimerOffset();
+
+    int copyMembers(GROUP_MEMBER *members, int maxMembers);
+};
+
+#endif
@@ -0,0 +1,562 @@
+#include "WindingRoutine.h"
+
+#include "Logger.h"
+
+WindingRoutine::WindingRoutine(MotorControl &motor, int secondsPerRevolution) : _motor(motor)
+{
+    _secondsPerRevolution = secondsPerRevolution;
+    _running = false;
+    _bothDirections = false;
+    _startEpoch = 0;
+    _estimatedFinishEpoch = 0;
+    _previousRestEpoch = 0;
+    _plannedTurns = 0;
+    _lastUpdateEpoch = 0;
+    _clockwiseSeconds = 0;
+    _counterClockwiseSeconds = 0;
+    _pauses = 0;
+    _pausedSeconds = 0;
+    _turnsMovedAtBegin = 0;
+    _turnsBeforeResume = 0;
+    _patterned = false;
+    _segment = {PATTERN_SEGMENT_PAUSE, false, 0, 100, 0};
+    _segmentEndEpoch = 0;
+    _turnsMovedAtSegment = 0;
+    _turnsMovedAtAccount = 0;
+}
+
+/**
+ * The motion of the sessions begun from now on: a compiled pattern, or NULL
+ * for the classic turning & resting. Takes a copy.
+ */
+void WindingRoutine::setPattern(const WINDING_PATTERN *pattern)
+{
+    _patterned = pattern != NULL;
+    if (_patterned)
+    {
+        _engine.load(*pattern, getPatternTiming());
+    }
+}
+
+/**
+ * How this motor times a pattern's segments, see PatternEngine
+ */
+PATTERN_TIMING WindingRoutine::getPatternTiming()
+{
+    return {(uint16_t)_secondsPerRevolution, _motor.countsTurns(), _motor.getRampSeconds(60.0f / _secondsPerRevolution)};
+}
+
+bool WindingRoutine::hasPattern()
+{
+    return _patterned;
+}
+
+/**
+ * Credits the time since the last update to the direction the motor is turning in
+ */
+void WindingRoutine::accountTurning(unsigned long epoch)
+{
+    if (epoch <= _lastUpdateEpoch)
+    {
+        return;
+    }
+
+    if (_motor.getMotorDirection() == 1)
+    {
+        _clockwiseSeconds += epoch - _lastUpdateEpoch;
+    }
+    else
+    {
+        _counterClockwiseSeconds += epoch - _lastUpdateEpoch;
+    }
+    _lastUpdateEpoch = epoch;
+}
+
+/**
+ * Starts the motor, or carries on after it stopped. A motor that counts its
+ * turns is asked for the next stretch: a rest interval's worth of the turns
+ * still owed.
+ */
+void WindingRoutine::turnMotor()
+{
+    if (!_motor.countsTurns())
+    {
+        _motor.determineMotorDirectionAndBegin();
+        return;
+    }
+
+    // Rounded up, so the stretch lasts the whole interval
+    int stretchTurns = (WINDING_REST_INTERVAL_SECONDS + _secondsPerRevolution - 1) / _secondsPerRevolution;
+    int turns = min(_plannedTurns - getDeliveredTurns(), stretchTurns);
+    if (turns > 0)
+    {
+        _motor.move(turns, 60.0f / _secondsPerRevolution);
+    }
+}
+
+/**
+ * Time needed to deliver the turns, including the rests in between
+ *
+ * @param rotationsPerDay turns to deliver
+ * @return duration in seconds
+ */
+unsigned long WindingRoutine::calculateDuration(int rotationsPerDay)
+{
+    if (_patterned)
+    {
+        return _engine.measure(max(rotationsPerDay, 0));
+    }
+
+    long totalSecondsSpentTurning = (long)rotationsPerDay * _secondsPerRevolution;
+
+    long totalNumberOfRestingPeriods = totalSecondsSpentTurning / WINDING_REST_INTERVAL_SECONDS;
+    long totalRestDuration = totalNumberOfRestingPeriods * WINDING_REST_DURATION_MS / 1000;
+
+    return totalSecondsSpentTurning + totalRestDuration;
+}
+
+/**
+ * Starts turning & calculates the estimated finish time
+ *
+ * @param rotationsPerDay turns to deliver
+ * @param direction CW, CCW or BOTH
+ * @param epoch current time
+ */
+void WindingRoutine::begin(int rotationsPerDay, const String &direction, unsigned long epoch)
+{
+    setDirection(direction);
+
+    _startEpoch = epoch;
+    _previousRestEpoch = epoch;
+    _estimatedFinishEpoch = epoch + calculateDuration(rotationsPerDay);
+    _running = true;
+
+    _plannedTurns = rotationsPerDay;
+    _lastUpdateEpoch = epoch;
+    _clockwiseSeconds = 0;
+    _counterClockwiseSeconds = 0;
+    _pauses = 0;
+    _pausedSeconds = 0;
+    _turnsMovedAtBegin = _motor.getTurnsMoved();
+    _turnsBeforeResume = 0;
+
+    Log.status(LOG_WINDER, "Total winding duration: %ld", _estimatedFinishEpoch - epoch);
+
+    if (_patterned)
+    {
+        beginPattern(rotationsPerDay, epoch);
+        return;
+    }
+    turnMotor();
+}
+
+/**
+ * Runs the pattern from the top for `turns`, starting now
+ */
+void WindingRoutine::beginPattern(unsigned long turns, unsigned long epoch)
+{
+    _engine.begin(turns);
+    _segmentEndEpoch = epoch;
+    _turnsMovedAtAccount = _motor.getTurnsMoved();
+    startSegment();
+}
+
+/**
+ * Moves on to the pattern's next segment, from where the last one was planned
+ * to end. Stops the session once there is none.
+ */
+void WindingRoutine::startSegment()
+{
+    if (!_engine.next(_segment))
+    {
+        stop();
+        return;
+    }
+
+    if (_segment.reverse)
+    {
+        _motor.setMotorDirection(!_motor.getMotorDirection());
+        Log.status(LOG_WINDER, "Motor changing direction, pattern");
+    }
+    _segmentEndEpoch += _segment.seconds;
+
+    if (_segment.type == PATTERN_SEGMENT_PAUSE)
+    {
+        _motor.stop();
+        _pauses++;
+        _pausedSeconds += _segment.seconds;
+        Log.status(LOG_WINDER, "Pause for %lu s", (unsigned long)_segment.seconds);
+    }
+    else if (_motor.countsTurns())
+    {
+        _turnsMovedAtSegment = _motor.getTurnsMoved();
+        _motor.move(_segment.turns, 60.0f / _secondsPerRevolution * _segment.speedPercent / 100);
+    }
+    else
+    {
+        _motor.determineMotorDirectionAndBegin();
+    }
+}
+
+/**
+ * Carries on with a session cut short by a restart: only the turns it still
+ * owed are delivered, starting in the direction it was turning in. The
+ * session's totals carry on from the checkpoint too, so the history sees one
+ * session rather than two.
+ *
+ * @param progress as checkpointed by getProgress()
+ * @param direction CW, CCW or BOTH
+ * @param epoch current time
+ * @return turns left to deliver, 0 if there were none & nothing was started
+ */
+int WindingRoutine::resume(const WINDING_PROGRESS &progress, const String &direction, unsigned long epoch)
+{
+    int delivered = (progress.clockwiseSeconds + progress.counterClockwiseSeconds) / _secondsPerRevolution;
+    int remaining = progress.plannedTurns - delivered;
+    if (remaining <= 0)
+    {
+        return 0;
+    }
+
+    // BOTH keeps the current direction, so set it first
+    _motor.setMotorDirection(progress.motorDirection);
+    begin(remaining, direction, epoch);
+
+    _plannedTurns = progress.plannedTurns;
+    _clockwiseSeconds = progress.clockwiseSeconds;
+    _counterClockwiseSeconds = progress.counterClockwiseSeconds;
+    _pauses = progress.pauses;
+    _pausedSeconds = progress.pausedSeconds;
+    _turnsBeforeResume = delivered;
+
+    return remaining;
+}
+
+/**
+ * Keeps the motor turning, rests when one is due & stops at the finish time.
+ * Blocks for the length of a rest.
+ *
+ * @param epoch current time
+ * @return false once the routine has finished (or wasn't running)
+ */
+bool WindingRoutine::update(unsigned long epoch)
+{
+    if (!_running)
+    {
+        return false;
+    }
+    if (_patterned)
+    {
+        return updatePattern(epoch);
+    }
+    if (_motor.countsTurns())
+    {
+        return updateCounting(epoch);
+    }
+
+    accountTurning(epoch < _estimatedFinishEpoch ? epoch : _estimatedFinishEpoch);
+
+    if (epoch >= _estimatedFinishEpoch)
+    {
+        stop();
+        return false;
+    }
+
+    // turn motor in direction
+    _motor.determineMotorDirectionAndBegin();
+
+    if (rand() % 100 > WINDING_REST_CHANCE_PERCENT || epoch - _previousRestEpoch <= WINDING_REST_INTERVAL_SECONDS)
+    {
+        return true;
+    }
+
+    _previousRestEpoch = epoch;
+    _motor.stop();
+    delay(WINDING_REST_DURATION_MS);
+
+    // the rest doesn't count as turning
+    _pauses++;
+    _pausedSeconds += WINDING_REST_DURATION_MS / 1000;
+    _lastUpdateEpoch = epoch + WINDING_REST_DURATION_MS / 1000;
+
+    if (_bothDirections)
+    {
+        _motor.setMotorDirection(!_motor.getMotorDirection());
+        Log.status(LOG_WINDER, "Motor changing direction, mode: BOTH");
+        _motor.determineMotorDirectionAndBegin();
+    }
+    else
+    {
+        Log.status(LOG_WINDER, "Pause");
+    }
+
+    return true;
+}
+
+/**
+ * update() for a motor that counts its turns: nothing to do while a stretch
+ * is moving. Rests once it's over, then starts the next; finishes once every
+ * turn is delivered, whatever the clock says.
+ */
+bool WindingRoutine::updateCounting(unsigned long epoch)
+{
+    accountTurning(epoch);
+    if (_motor.isTurning())
+    {
+        return true;
+    }
+
+    if (getDeliveredTurns() >= _plannedTurns)
+    {
+        stop();
+        return false;
+    }
+
+    _previousRestEpoch = epoch;
+    _motor.stop();
+    delay(WINDING_REST_DURATION_MS);
+
+    _pauses++;
+    _pausedSeconds += WINDING_REST_DURATION_MS / 1000;
+    _lastUpdateEpoch = epoch + WINDING_REST_DURATION_MS / 1000;
+
+    if (_bothDirections)
+    {
+        _motor.setMotorDirection(!_motor.getMotorDirection());
+        Log.status(LOG_WINDER, "Motor changing direction, mode: BOTH");
+    }
+    else
+    {
+        Log.status(LOG_WINDER, "Pause");
+    }
+    turnMotor();
+
+    return true;
+}
+
+/**
+ * Credits the turning since the last update to the direction the motor is
+ * turning in. A motor that counts its turns is credited one revolution's time
+ * per turn moved, whatever its speed & ramps, so resume() still gets the
+ * turns right from the totals.
+ */
+void WindingRoutine::accountPattern(unsigned long epoch)
+{
+    unsigned long seconds = 0;
+    if (_motor.countsTurns())
+    {
+        uint32_t turnsMoved = _motor.getTurnsMoved();
+        seconds = (turnsMoved - _turnsMovedAtAccount) * (unsigned long)_secondsPerRevolution;
+        _turnsMovedAtAccount = turnsMoved;
+    }
+    else if (_segment.type == PATTERN_SEGMENT_TURN && epoch > _lastUpdateEpoch)
+    {
+        seconds = epoch - _lastUpdateEpoch;
+    }
+
+    if (_motor.getMotorDirection() == 1)
+    {
+        _clockwiseSeconds += seconds;
+    }
+    else
+    {
+        _counterClockwiseSeconds += seconds;
+    }
+    _lastUpdateEpoch = max(_lastUpdateEpoch, epoch);
+}
+
+/**
+ * update() with a pattern: starts whichever segments are due. A stepper's
+ * move is let finish even if it runs a little over; the segment after it
+ * makes up for it.
+ */
+bool WindingRoutine::updatePattern(unsigned long epoch)
+{
+    accountPattern(epoch);
+    while (_running && epoch >= _segmentEndEpoch && !(_segment.type == PATTERN_SEGMENT_TURN && _motor.countsTurns() && _motor.isTurning()))
+    {
+        startSegment();
+    }
+    return _running;
+}
+
+void WindingRoutine::stop()
+{
+    _running = false;
+    _motor.stop();
+}
+
+/**
+ * Takes the torque off a stalled cushion, then tries again in the same
+ * direction. Blocks like a rest & counts as one.
+ *
+ * @param epoch current time
+ */
+void WindingRoutine::retryAfterStall(unsigned long epoch)
+{
+    if (!_running)
+    {
+        return;
+    }
+
+    if (_patterned)
+    {
+        accountPattern(epoch);
+    }
+    else
+    {
+        accountTurning(epoch);
+    }
+    _motor.stop();
+    delay(WINDING_STALL_PAUSE_MS);
+
+    if (!_patterned)
+    {
+        turnMotor();
+    }
+    else if (_segment.type == PATTERN_SEGMENT_TURN)
+    {
+        // The segment gets its full turning time back, & the session finishes that much later
+        _segmentEndEpoch += WINDING_STALL_PAUSE_MS / 1000;
+        _estimatedFinishEpoch += WINDING_STALL_PAUSE_MS / 1000;
+        if (_motor.countsTurns())
+        {
+            uint32_t moved = _motor.getTurnsMoved() - _turnsMovedAtSegment;
+            if (moved < _segment.turns)
+            {
+                _motor.move(_segment.turns - moved, 60.0f / _secondsPerRevolution * _segment.speedPercent / 100);
+            }
+        }
+        else
+        {
+            _motor.determineMotorDirectionAndBegin();
+        }
+    }
+
+    _pauses++;
+    _pausedSeconds += WINDING_STALL_PAUSE_MS / 1000;
+    _lastUpdateEpoch = epoch + WINDING_STALL_PAUSE_MS / 1000;
+}
+
+/**
+ * Whether a timed session should start now. True for the whole start minute,
+ * so it relies on the session outlasting that minute.
+ */
+bool WindingRoutine::isTimerDue(int timerHour, int timerMinute, int currentHour, int currentMinute)
+{
+    return !_running && currentHour == timerHour && currentMinute == timerMinute;
+}
+
+/**
+ * @param direction CW, CCW or BOTH. BOTH keeps the current direction until the next rest.
+ */
+void WindingRoutine::setDirection(const String &direction)
+{
+    _bothDirections = direction == "BOTH";
+
+    if (direction == "CW")
+    {
+        _motor.setMotorDirection(1);
+    }
+    else if (direction == "CCW")
+    {
+        _motor.setMotorDirection(0);
+    }
+}
+
+/**
+ * Restarts the estimate from now for a new number of turns. A pattern starts
+ * over from the top for them.
+ */
+void WindingRoutine::setRotationsPerDay(int rotationsPerDay, unsigned long epoch)
+{
+    _estimatedFinishEpoch = epoch + calculateDuration(rotationsPerDay);
+    if (_running)
+    {
+        _plannedTurns = getDeliveredTurns() + rotationsPerDay;
+        if (_patterned)
+        {
+            _motor.stop();
+            beginPattern(max(rotationsPerDay, 0), epoch);
+        }
+    }
+}
+
+/**
+ * Moves the session in time without changing its length, e.g. when the clock is first set
+ */
+void WindingRoutine::shiftEpochs(long seconds)
+{
+    _startEpoch += seconds;
+    _previousRestEpoch += seconds;
+    _estimatedFinishEpoch += seconds;
+    _lastUpdateEpoch += seconds;
+    _segmentEndEpoch += seconds;
+}
+
+bool WindingRoutine::isRunning()
+{
+    return _running;
+}
+
+unsigned long WindingRoutine::getStartEpoch()
+{
+    return _startEpoch;
+}
+
+unsigned long WindingRoutine::getEstimatedFinishEpoch()
+{
+    return _estimatedFinishEpoch;
+}
+
+int WindingRoutine::getPlannedTurns()
+{
+    return _plannedTurns;
+}
+
+/**
+ * Turns delivered so far: counted by the motor if it can, otherwise
+ * estimated from the turning time as of the last update()
+ */
+int WindingRoutine::getDeliveredTurns()
+{
+    if (_motor.countsTurns())
+    {
+        return _turnsBeforeResume + (int)(_motor.getTurnsMoved() - _turnsMovedAtBegin);
+    }
+    return (_clockwiseSeconds + _counterClockwiseSeconds) / _secondsPerRevolution;
+}
+
+unsigned long WindingRoutine::getClockwiseSeconds()
+{
+    return _clockwiseSeconds;
+}
+
+unsigned long WindingRoutine::getCounterClockwiseSeconds()
+{
+    return _counterClockwiseSeconds;
+}
+
+unsigned int WindingRoutine::getPauses()
+{
+    return _pauses;
+}
+
+unsigned long WindingRoutine::getPausedSeconds()
+{
+    return _pausedSeconds;
+}
+
+/**
+ * Where the session has got to, as of the last update()
+ */
+void WindingRoutine::getProgress(WINDING_PROGRESS &progress)
+{
+    memset(&progress, 0, sizeof(progress));
+    progress.plannedTurns = _plannedTurns;
+    progress.motorDirection = _motor.getMotorDirection();
+    progress.clockwiseSeconds = _clockwiseSeconds;
+    progress.counterClockwiseSeconds = _counterClockwiseSeconds;
+    progress.pauses = _pauses;
+    progress.pausedSeconds = _pausedSeconds;
+}
@@ -0,0 +1,140 @@
+#include <Arduino.h>
+
+#include "MotorControl.h"
+#include "PatternEngine.h"
+
+#ifndef WindingRoutine_H
+#define WindingRoutine_H
+
+// Every 3 minutes, rest (or change direction) for 3 seconds
+#define WINDING_REST_INTERVAL_SECONDS 180
+#define WINDING_REST_DURATION_MS 3000
+// Chance per update that a due rest actually happens, so rests don't fall on a fixed beat
+#define WINDING_REST_CHANCE_PERCENT 25
+// After a stall, the motor rests this long before trying again
+#define WINDING_STALL_PAUSE_MS 3000
+
+/**
+ * Where a session has got to, enough to carry on with it after a restart
+ */
+struct WINDING_PROGRESS
+{
+    uint16_t plannedTurns;
+    uint8_t motorDirection; // 1 for CW, as MotorControl has it
+    uint32_t clockwiseSeconds;
+    uint32_t counterClockwiseSeconds;
+    uint16_t pauses;
+    uint32_t pausedSeconds;
+};
+
+/**
+ * The winding session itself: turns the motor in the configured direction(s),
+ * rests periodically and finishes at the estimated finish epoch.
+ *
+ * A motor that counts its turns (a stepper) is asked for them instead: each
+ * stretch between rests is one move of a rest interval's worth of turns at
+ * the speed of one turn per secondsPerRevolution, and the session finishes
+ * when the planned turns are all delivered.
+ *
+ * With a pattern set, the motion is the pattern's instead: its segments run
+ * back to back, each from where the one before was planned to end, so the
+ * finish epoch is known exactly from the start. See PatternEngine.
+ *
+ * Expects update() about once a second. Independent of the RTC, the caller
+ * passes the current epoch in, so the same code runs in the simulator.
+ */
+class WindingRoutine
+{
+private:
+    MotorControl &_motor;
+    int _secondsPerRevolution;
+    bool _running;
+    bool _bothDirections;
+    unsigned long _startEpoch;
+    unsigned long _estimatedFinishEpoch;
+    unsigned long _previousRestEpoch;
+
+    // what the session actually did, for the history
+    int _plannedTurns;
+    unsigned long _lastUpdateEpoch;
+    unsigned long _clockwiseSeconds;
+    unsigned long _counterClockwiseSeconds;
+    unsigned int _pauses;
+    unsigned long _pausedSeconds;
+    // counted turns: the motor's count at begin() & the turns delivered before a resume()
+    uint32_t _turnsMovedAtBegin;
+    int _turnsBeforeResume;
+
+    // the pattern, if one is set
+    bool _patterned;
+    PatternEngine _engine;
+    PATTERN_SEGMENT _segment;
+    unsigned long _segmentEndEpoch;
+    uint32_t _turnsMovedAtSegment;
+    uint32_t _turnsMovedAtAccount;
+
+    void accountTurning(unsigned long epoch);
+
+    void turnMotor();
+
+    bool updateCounting(unsigned long epoch);
+
+    void beginPattern(unsigned long turns, unsigned long epoch);
+
+    void startSegment();
+
+    void accountPattern(unsigned long epoch);
+
+    bool updatePattern(unsigned long epoch);
+
+public:
+    WindingRoutine(MotorControl &motor, int secondsPerRevolution);
+
+    void setPattern(const WINDING_PATTERN *pattern);
+
+    bool hasPattern();
+
+    PATTERN_TIMING getPatternTiming();
+
+    unsigned long calculateDuration(int rotationsPerDay);
+
+    void begin(int rotationsPerDay, const String &direction, unsigned long epoch);
+
+    int resume(const WINDING_PROGRESS &progress, const String &direction, unsigned long epoch);
+
+    bool update(unsigned long epoch);
+
+    void stop();
+
+    void retryAfterStall(unsigned long epoch);
+
+    bool isTimerDue(int timerHour, int timerMinute, int currentHour, int currentMinute);
+
+    void setDirection(const String &direction);
+
+    void setRotationsPerDay(int rotationsPerDay, unsigned long epoch);
+
+    void shiftEpochs(long seconds);
+
+    bool isRunning();
+
+    unsigned long getStartEpoch();
+
+    unsigned long getEstimatedFinishEpoch();
+
+    int getPlannedTurns();
+
+    int getDeliveredTurns();
+
+    unsigned long getClockwiseSeconds();
+
+    unsigned long getCounterClockwiseSeconds();
+
+    unsigned int getPauses();
+
+    unsigned long getPausedSeconds();
+
+    void getProgress(WINDING_PROGRESS &progress);
+};
+
+#endif